@@ -22,6 +22,8 @@
 #include "menudata.c"
 
 #define FILELISTLEN 1024
+//line offsets of the file list, with very short names only every n-th line gets an entry
+#define FILELISTINDEXLEN (FILELISTLEN / 8)
 
 #define FILENAMEMAX 64
 
@@ -48,6 +50,7 @@ void GuiLoadBinary(void);
 typedef struct {
 	eDisplay_t type;
 	char fileList[FILELISTLEN];
+	uint16_t fileListIndex[FILELISTINDEXLEN];
 	char binName[BINTEXT];
 	char binVersion[BINTEXT];
 	char binAuthor[BINTEXT];
@@ -157,6 +160,7 @@ uint8_t menu_action(MENUACTION action) {
 void GuiInit(void) {
 	printf("Starting GUI\r\n");
 	menu_strings[MENU_TEXT_BINLIST] = g_gui.fileList;
+	menu_list_index_set(MENU_LISTINDEX_BININDEX, g_gui.fileListIndex, FILELISTINDEXLEN);
 	menu_strings[MENU_TEXT_BINNAME] = g_gui.binName;
 	menu_strings[MENU_TEXT_BINVERSION] = g_gui.binVersion;
 	menu_strings[MENU_TEXT_BINAUTHOR] = g_gui.binAuthor;
@@ -311,6 +315,7 @@ void GuiUpdateFilelist(void) {
 		}
 		f_closedir(&d);
 	}
+	menu_text_changed(MENU_TEXT_BINLIST);
 	menu_listindexstate[MENU_LISTINDEX_BININDEX] = 0;
 }
 
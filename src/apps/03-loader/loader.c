@@ -178,15 +178,51 @@ typedef struct {
 	//set by the interrupt, cleared by the main thread
 	bool commTransferDone;
 
+	/* Alternate setting 1 streams the tar into a file on the external flash.
+	   g_DfuMem is then a ring buffer, filled by the ISR and emptied by the main
+	   thread. So the tar may be larger than the RAM. */
+	bool streamActive; //set by the ISR with the first block, cleared by the main thread
+	uint32_t streamId; //incremented by the ISR for every new stream
+	uint32_t streamProduced; //written by the ISR
+	uint32_t streamConsumed; //written by the main thread
 } dfuState_t;
 
 dfuState_t g_dfuState = {0, 0, 0, DFU_STATE_DFUIDLE, DFU_STATUS_OK,  0, false};
 
 uint8_t * g_DfuMem;
 size_t g_DfuMemSize;
+//maximum size of a tar streamed to the external flash, the free space on the filesystem
+size_t g_DfuStreamSize;
+
+//as given in the DFU functional descriptors
+#define DFU_TRANSFERSIZE 2048
+
+//the host waits this time before asking again if the ring buffer is full [ms]
+#define DFU_STREAM_POLL 5
+
+//the tar is stored under this name until it has been verified
+#define DFU_STREAM_TMPFILE "/dfu.tmp"
+
+//metadata.json is kept in RAM until the end of the stream
+#define DFU_STREAM_META_MAX 1024
 
 #define TARFILENAME_MAX 64
 
+typedef struct {
+	uint32_t id; //equals g_dfuState.streamId while the stream is processed
+	uint32_t consumed;
+	bool error;
+	bool fileOpen;
+	FIL f;
+	tarStream_t tar;
+	bool appFound;
+	uint32_t timestamp;
+	md5_context md5; //of application.bin
+	bool metaFound;
+	size_t metaLen;
+	char meta[DFU_STREAM_META_MAX];
+} loaderStream_t;
+
 typedef struct {
 	bool usbEnabled;
 	uint32_t downloadedLast;
@@ -202,6 +238,7 @@ typedef struct {
 	bool watchdogEnforced;
 	bool watchdogEnabled;
 	uint16_t watchdogCounter; //counts up every main loop cycle [10ms], resets the watchdog every 10s
+	loaderStream_t stream;
 } loaderState_t;
 
 //Only functions starting with Loader shall use this global variable directly
@@ -300,6 +337,14 @@ void DfuGetStatus(uint8_t * out) {
 		g_dfuState.state = DFU_STATE_MANIFEST;
 		g_dfuState.commStartProgram = true;
 	}
+	if ((g_dfuState.streamActive) && (g_dfuState.state == DFU_STATE_DOWNLOAD_IDLE)) {
+		uint32_t used = g_dfuState.streamProduced - g_dfuState.streamConsumed;
+		if ((g_DfuMemSize - used) < DFU_TRANSFERSIZE) {
+			//the main thread needs to write to the flash first, the host polls until we are idle again
+			out[1] = DFU_STREAM_POLL;
+			out[4] = DFU_STATE_DNBUSY;
+		}
+	}
 }
 
 void DfuGetState(uint8_t * out) {
@@ -330,6 +375,39 @@ void DfuTransferEnd(void) {
 	}
 }
 
+//Data for alternate setting 1, they are copied into the ring buffer
+void DfuStreamBlock(const uint8_t * data, size_t dataLen) {
+	size_t ringSize = g_DfuMemSize;
+	if ((g_dfuState.address == 0) && (g_dfuState.commTransferDone == false) &&
+	    (g_dfuState.commMainProcessing == false)) {
+		//a new transfer, the main thread discards an unfinished one
+		g_dfuState.streamId++;
+		g_dfuState.streamProduced = 0;
+		g_dfuState.streamConsumed = 0;
+		g_dfuState.highestAddress = 0;
+		g_dfuState.streamActive = true;
+	}
+	uint32_t used = g_dfuState.streamProduced - g_dfuState.streamConsumed;
+	if ((g_dfuState.streamActive == false) || (g_dfuState.address != g_dfuState.streamProduced) ||
+	    (g_dfuState.commMainProcessing)) {
+		g_dfuState.state = DFU_STATE_ERROR;
+		g_dfuState.status = DFU_STATUS_ADDRESS;
+	} else if (((used + dataLen) > ringSize) || ((g_dfuState.address + dataLen) > g_DfuStreamSize)) {
+		g_dfuState.state = DFU_STATE_ERROR;
+		g_dfuState.status = DFU_STATUS_WRITE;
+	} else {
+		size_t pos = g_dfuState.streamProduced % ringSize;
+		size_t first = MIN(dataLen, ringSize - pos);
+		memcpy(g_DfuMem + pos, data, first);
+		memcpy(g_DfuMem, data + first, dataLen - first);
+		g_dfuState.address += dataLen;
+		g_dfuState.bytesDownloaded += dataLen;
+		g_dfuState.highestAddress = g_dfuState.address;
+		__sync_synchronize();
+		g_dfuState.streamProduced = g_dfuState.address;
+	}
+}
+
 void DfuDownloadBlock(const uint8_t * data, size_t dataLen, uint32_t wValue) {
 	size_t ramSize = g_DfuMemSize;
 	bool accept = false;
@@ -350,6 +428,8 @@ void DfuDownloadBlock(const uint8_t * data, size_t dataLen, uint32_t wValue) {
 			if (dataLen == 0) {//end of file
 				//printfNowait("Eof\r\n");
 				g_dfuState.state = DFU_STATE_MANIFEST_SYNC;
+			} else if (g_dfuState.target == 1) {
+				DfuStreamBlock(data, dataLen);
 			} else {
 				if ((g_dfuState.address + dataLen) <= ramSize) {
 					//printfNowait("Data\r\n");
@@ -377,7 +457,8 @@ void DfuDownloadBlock(const uint8_t * data, size_t dataLen, uint32_t wValue) {
 			uint32_t address = (data[4] << 24) | (data[3] << 16) | (data[2] << 8) | data[1];
 			address -= DFU_FAKEOFFSET;
 			//printfNowait("Set address %x\r\n", address);
-			if (address < ramSize) {
+			size_t addressMax = (g_dfuState.target == 1) ? g_DfuStreamSize : ramSize;
+			if (address < addressMax) {
 				g_dfuState.address = address;
 				g_dfuState.state = DFU_STATE_DNBUSY;
 			} else {
@@ -465,17 +546,35 @@ void MainMenu(void) {
 	printf("wasd: Control input keys in menu\r\n");
 }
 
+//bufferOut must have >= elements than strlen(text)
+void LoaderTextToDescriptor(const char * text, struct usb_string_descriptor * pDescr) {
+	size_t l = strlen(text);
+	for (uint32_t i = 0; i < l; i++) {
+		pDescr->wString[i] = text[i];
+	}
+	pDescr->bDescriptorType = USB_DTYPE_STRING;
+	pDescr->bLength = 2 + l * 2;
+}
+
 void LoaderUpdateFsGui(void) {
 	DWORD freeclusters;
 	FATFS * pff = NULL;
+	uint32_t freeB = 0;
 	if (f_getfree("0", &freeclusters, &pff) == FR_OK) {
 		uint32_t clustersize = pff->csize;
 		uint32_t freesectors = freeclusters * clustersize;
 		uint32_t totalsectors = (pff->n_fatent - 2) * clustersize;
-		uint32_t freeB = freesectors * FF_MIN_SS;
+		freeB = freesectors * FF_MIN_SS;
 		uint32_t totalB = totalsectors * FF_MIN_SS;
 		GuiShowFsData(totalB, freeB, totalsectors, clustersize * FF_MIN_SS);
 	}
+	//the external flash target streams into a file, so the free space limits its size
+	char buffer[MAX_DESCRIPTOR_CHARS];
+	snprintf(buffer, sizeof(buffer), "@External flash/0x%x/%04u*0001Kg", DFU_FAKEOFFSET, (unsigned int)(freeB / 1024));
+	__disable_irq();
+	g_DfuStreamSize = freeB;
+	LoaderTextToDescriptor(buffer, &g_exttarget_desc);
+	__enable_irq();
 }
 
 //this call assumes an unmounted filesystem
@@ -550,16 +649,6 @@ bool LoaderFormat(void) {
 	return success;
 }
 
-//bufferOut must have >= elements than strlen(text)
-void LoaderTextToDescriptor(const char * text, struct usb_string_descriptor * pDescr) {
-	size_t l = strlen(text);
-	for (uint32_t i = 0; i < l; i++) {
-		pDescr->wString[i] = text[i];
-	}
-	pDescr->bDescriptorType = USB_DTYPE_STRING;
-	pDescr->bLength = 2 + l * 2;
-}
-
 void AppInit(void) {
 	DfuMemInit(&g_DfuMem, &g_DfuMemSize);
 	LedsInit();
@@ -595,8 +684,6 @@ void AppInit(void) {
 	//the g encodes: read + write + eraseable
 	snprintf(buffer, sizeof(buffer), "@Internal RAM/0x%x/%04u*0001Kg", DFU_FAKEOFFSET, (unsigned int)(g_DfuMemSize / 1024));
 	LoaderTextToDescriptor(buffer, &g_target_desc);
-	snprintf(buffer, sizeof(buffer), "@External flash/0x%x/%04u*0001Kg", DFU_FAKEOFFSET, (unsigned int)(g_DfuMemSize / 1024));
-	LoaderTextToDescriptor(buffer, &g_exttarget_desc);
 	int32_t result = UsbStart(&g_usbDev, &usbSetConf, &usbControl, &usbGetDesc);
 	if (result == -1) {
 		printf("Error, failed to start 48MHz clock. Error: %u\r\n", (unsigned int)result);
@@ -781,34 +868,19 @@ void ProgTarStart(void * tarStart, size_t tarLen, bool watchdogEnforced, bool wa
 	printf("Error, program start failed\r\n");
 }
 
-bool ProgTarCheck(void * tarStart, size_t tarLen) {
-	uint8_t * fileStart;
-	size_t fileLen = 0;
-	uint8_t * metaStart;
-	size_t metaLen;
-	uint8_t md5sum1[16];
+//md5sum1 is the checksum of application.bin
+bool ProgMetaCheck(uint8_t * metaStart, size_t metaLen, const uint8_t * md5sum1) {
 	uint8_t md5sum2[16];
-	if (!TarFileStartGet("application.bin", tarStart, tarLen, &fileStart, &fileLen, NULL)) {
-		printf("Error, no application found. Tar len: %u\r\n", (unsigned int)tarLen);
-		md5(tarStart, tarLen, md5sum1);
-		PrintHex(md5sum1, sizeof(md5sum1));
-		return false;
-	}
-	md5(fileStart, fileLen, md5sum1);
-	if (!TarFileStartGet("metadata.json", tarStart, tarLen, &metaStart, &metaLen, NULL)) {
-		printf("Error, no metadata found\r\n");
-		return false;
-	}
 	if (!MetaMd5Get(metaStart, metaLen, md5sum2)) {
 		printf("Error, no checksum in metadata\r\n");
 		return false;
 	}
-	if (memcmp(md5sum1, md5sum2, sizeof(md5sum1))) {
+	if (memcmp(md5sum1, md5sum2, sizeof(md5sum2))) {
 		printf("Error, checksum mismatch\r\n");
 		printf("Should:\r\n");
 		PrintHex(md5sum2, sizeof(md5sum2));
 		printf("Is:\r\n");
-		PrintHex(md5sum1, sizeof(md5sum1));
+		PrintHex(md5sum1, sizeof(md5sum2));
 		return false;
 	}
 	char mcu[16];
@@ -823,6 +895,26 @@ bool ProgTarCheck(void * tarStart, size_t tarLen) {
 	return true;
 }
 
+bool ProgTarCheck(void * tarStart, size_t tarLen) {
+	uint8_t * fileStart;
+	size_t fileLen = 0;
+	uint8_t * metaStart;
+	size_t metaLen;
+	uint8_t md5sum[16];
+	if (!TarFileStartGet("application.bin", tarStart, tarLen, &fileStart, &fileLen, NULL)) {
+		printf("Error, no application found. Tar len: %u\r\n", (unsigned int)tarLen);
+		md5(tarStart, tarLen, md5sum);
+		PrintHex(md5sum, sizeof(md5sum));
+		return false;
+	}
+	md5(fileStart, fileLen, md5sum);
+	if (!TarFileStartGet("metadata.json", tarStart, tarLen, &metaStart, &metaLen, NULL)) {
+		printf("Error, no metadata found\r\n");
+		return false;
+	}
+	return ProgMetaCheck(metaStart, metaLen, md5sum);
+}
+
 void ToggleUsb(void) {
 	if (g_loaderState.usbEnabled == true) {
 		printf("\r\nStopping USB\r\n");
@@ -1005,17 +1097,78 @@ void LoaderUpdateTimestamp(void) {
 	TarFileStartGet("application.bin", g_loaderState.memStart, g_loaderState.tarSize, &startAddr, &fileLen, &(g_loaderState.unixTimestamp));
 }
 
+static bool LoaderTarHeaderRead(FIL * pFile, FSIZE_t position, uint8_t * header) {
+	UINT r = 0;
+	if ((f_lseek(pFile, position) == FR_OK) && (f_read(pFile, header, TAR_BLOCKSIZE, &r) == FR_OK) &&
+	    (r == TAR_BLOCKSIZE) && (header[0] != 0)) {
+		return true;
+	}
+	return false;
+}
+
+static bool LoaderTarEntryRequired(const uint8_t * header) {
+	return ((strncmp((const char *)header, "application.bin", TAR_NAME_MAX) == 0) ||
+	        (strncmp((const char *)header, "metadata.json", TAR_NAME_MAX) == 0));
+}
+
+/* For tars larger than the RAM, as they can be streamed to the flash.
+   Optional files which do not fit any more are left out, the result is a
+   smaller but valid tar. Returns the bytes loaded.
+*/
+static size_t LoaderTarLoadSelective(FIL * pFile) {
+	uint8_t header[TAR_BLOCKSIZE];
+	FSIZE_t position = 0;
+	size_t required = 0;
+	//first pass, space needed for the files to start the program
+	while (LoaderTarHeaderRead(pFile, position, header)) {
+		size_t len = TarParseOctal((const char *)header + 124, 12);
+		size_t allocated = TAR_BLOCKSIZE + ((len + (TAR_BLOCKSIZE - 1)) & (~(TAR_BLOCKSIZE - 1)));
+		if (LoaderTarEntryRequired(header)) {
+			required += allocated;
+		}
+		position += allocated;
+	}
+	size_t used = 0;
+	position = 0;
+	while (LoaderTarHeaderRead(pFile, position, header)) {
+		size_t len = TarParseOctal((const char *)header + 124, 12);
+		size_t allocated = TAR_BLOCKSIZE + ((len + (TAR_BLOCKSIZE - 1)) & (~(TAR_BLOCKSIZE - 1)));
+		bool isRequired = LoaderTarEntryRequired(header);
+		if (isRequired) {
+			required -= allocated;
+		}
+		if ((used + allocated + required) <= g_loaderState.memSize) {
+			UINT r = 0;
+			if ((f_lseek(pFile, position) != FR_OK) ||
+			    (f_read(pFile, g_loaderState.memStart + used, allocated, &r) != FR_OK) || (r != allocated)) {
+				printf("Error, could not read %s\r\n", header);
+				return 0;
+			}
+			used += allocated;
+		} else if (isRequired) {
+			printf("Error, %s does not fit into the RAM\r\n", header);
+			return 0;
+		} else {
+			printf("Leaving out %s, does not fit into the RAM\r\n", header);
+		}
+		position += allocated;
+	}
+	return used;
+}
+
 bool LoaderTarLoad(const char * filename) {
 	bool success = false;
 	FIL f;
 	if (FR_OK == f_open(&f, filename, FA_READ)) {
 		LoaderMemLock();
 		UINT r = 0;
-		FRESULT res = f_read(&f, g_loaderState.memStart, g_loaderState.memSize, &r);
+		FRESULT res = FR_OK;
+		if (f_size(&f) > g_loaderState.memSize) {
+			r = LoaderTarLoadSelective(&f);
+		} else {
+			res = f_read(&f, g_loaderState.memStart, g_loaderState.memSize, &r);
+		}
 		if (res == FR_OK) {
-			if (r == g_loaderState.memSize) {
-				printf("Warning, file most likely too large to load\r\n");
-			}
 			strncpy(g_loaderState.filename, filename, TARFILENAME_MAX - 1);
 			g_loaderState.inFile = true;
 			g_loaderState.watchdogEnforced = false;
@@ -1104,6 +1257,168 @@ bool LoaderTarSaveDelete(void) {
 	return success;
 }
 
+static bool LoaderStreamFile(void * param, const char * name, size_t fileLen, uint32_t timestamp,
+                             size_t offset, const uint8_t * data, size_t dataLen) {
+	loaderStream_t * pStream = (loaderStream_t *)param;
+	if (strcmp(name, "application.bin") == 0) {
+		if (offset == 0) {
+			md5_starts(&(pStream->md5));
+			pStream->appFound = true;
+			pStream->timestamp = timestamp;
+		}
+		md5_update(&(pStream->md5), data, dataLen);
+	} else if (strcmp(name, "metadata.json") == 0) {
+		if (fileLen > DFU_STREAM_META_MAX) {
+			printf("Error, metadata with %ubytes too large\r\n", (unsigned int)fileLen);
+			return false;
+		}
+		memcpy(pStream->meta + offset, data, dataLen);
+		pStream->metaLen = offset + dataLen;
+		pStream->metaFound = true;
+	}
+	return true;
+}
+
+//Lets the host get an error for the next block
+static void LoaderStreamError(void) {
+	loaderStream_t * pStream = &(g_loaderState.stream);
+	pStream->error = true;
+	__disable_irq();
+	if (g_dfuState.streamId == pStream->id) {
+		g_dfuState.state = DFU_STATE_ERROR;
+		g_dfuState.status = DFU_STATUS_WRITE;
+	}
+	__enable_irq();
+}
+
+static void LoaderStreamBegin(uint32_t id) {
+	loaderStream_t * pStream = &(g_loaderState.stream);
+	if (pStream->fileOpen) {
+		printf("Warning, previous transfer not finished\r\n");
+		f_close(&(pStream->f));
+	}
+	pStream->id = id;
+	pStream->consumed = 0;
+	pStream->error = false;
+	pStream->fileOpen = false;
+	pStream->appFound = false;
+	pStream->metaFound = false;
+	pStream->metaLen = 0;
+	TarStreamInit(&(pStream->tar), &LoaderStreamFile, pStream);
+	//the RAM is now used as ring buffer
+	g_loaderState.tarSize = 0;
+	g_loaderState.inFile = false;
+	FRESULT res = f_open(&(pStream->f), DFU_STREAM_TMPFILE, FA_WRITE | FA_CREATE_ALWAYS);
+	if (res == FR_OK) {
+		pStream->fileOpen = true;
+	} else {
+		printf("Error, could not create %s. Error %u\r\n", DFU_STREAM_TMPFILE, (unsigned int)res);
+		LoaderStreamError();
+	}
+}
+
+/* Writes the received data to the file and parses the tar on the fly, so the
+   flash is programmed while the host sends the next blocks.
+*/
+void LoaderStreamProcess(void) {
+	loaderStream_t * pStream = &(g_loaderState.stream);
+	__disable_irq();
+	bool active = g_dfuState.streamActive;
+	uint32_t id = g_dfuState.streamId;
+	uint32_t produced = g_dfuState.streamProduced;
+	__enable_irq();
+	if (!active) {
+		return;
+	}
+	if (id != pStream->id) {
+		LoaderStreamBegin(id);
+	}
+	size_t ringSize = g_loaderState.memSize;
+	while (pStream->consumed != produced) {
+		size_t pos = pStream->consumed % ringSize;
+		size_t len = MIN(produced - pStream->consumed, ringSize - pos);
+		const uint8_t * data = g_loaderState.memStart + pos;
+		if (pStream->error == false) {
+			UINT written = 0;
+			FRESULT res = f_write(&(pStream->f), data, len, &written);
+			if ((res != FR_OK) || (written != len)) {
+				printf("Error, could not write %s. Error %u\r\n", DFU_STREAM_TMPFILE, (unsigned int)res);
+				LoaderStreamError();
+			} else if (!TarStreamFeed(&(pStream->tar), data, len)) {
+				printf("Error, invalid tar\r\n");
+				LoaderStreamError();
+			}
+		}
+		//after an error the data are discarded, so the ring buffer does not block
+		pStream->consumed += len;
+		__disable_irq();
+		if (g_dfuState.streamId == id) {
+			g_dfuState.streamConsumed = pStream->consumed;
+		}
+		__enable_irq();
+	}
+}
+
+/* Verifies the checksum against the metadata at the end of the transfer and
+   renames the file. filenameOut gets the name on success.
+*/
+bool LoaderStreamFinish(char * filenameOut, size_t filenameMax) {
+	loaderStream_t * pStream = &(g_loaderState.stream);
+	LoaderStreamProcess(); //the last blocks
+	__disable_irq();
+	g_dfuState.streamActive = false;
+	__enable_irq();
+	bool success = false;
+	if (pStream->fileOpen) {
+		pStream->fileOpen = false;
+		if (f_close(&(pStream->f)) != FR_OK) {
+			printf("Error, could not close %s\r\n", DFU_STREAM_TMPFILE);
+			pStream->error = true;
+		}
+	}
+	char name[32];
+	if (pStream->error) {
+		printf("Error, transfer failed\r\n");
+	} else if (!pStream->appFound) {
+		printf("Error, no application found\r\n");
+	} else if (!pStream->metaFound) {
+		printf("Error, no metadata found\r\n");
+	} else {
+		uint8_t md5sum[16];
+		md5_finish(&(pStream->md5), md5sum);
+		if (ProgMetaCheck((uint8_t *)pStream->meta, pStream->metaLen, md5sum)) {
+			if (MetaNameGet((uint8_t *)pStream->meta, pStream->metaLen, name, sizeof(name))) {
+				success = true;
+			} else {
+				printf("Error, could not get program name\r\n");
+			}
+		}
+	}
+	if (success) {
+		snprintf(filenameOut, filenameMax, "/bin/%s.tar", name);
+		f_unlink(filenameOut);
+		FRESULT res = f_rename(DFU_STREAM_TMPFILE, filenameOut);
+		if (res == FR_OK) {
+			FILINFO fno = {0};
+			uint32_t date, time;
+			UnixToFatTimeDate(pStream->timestamp, &time, &date);
+			fno.fdate = date;
+			fno.ftime = time;
+			f_utime(filenameOut, &fno);
+			printf("File %s written to disk\r\n", filenameOut);
+		} else {
+			printf("Error, could not rename to %s. Error %u\r\n", filenameOut, (unsigned int)res);
+			success = false;
+		}
+	}
+	if (!success) {
+		f_unlink(DFU_STREAM_TMPFILE);
+	}
+	GuiUpdateFilelist();
+	LoaderUpdateFsGui();
+	return success;
+}
+
 void LoaderFormatAsk(void) {
 	printf("Really format? y/n\r\n");
 	char input;
@@ -1146,6 +1461,7 @@ void AppCycle(void) {
 		case 'f': LoaderFormatAsk(); break;
 		default: break;
 	}
+	LoaderStreamProcess();
 	uint32_t downloaded = g_dfuState.bytesDownloaded;
 	if ((downloaded != g_loaderState.downloadedLast) && (downloaded > 0)) {
 		GuiTransferStart();
@@ -1162,27 +1478,31 @@ void AppCycle(void) {
 	}
 	__enable_irq();
 	if (transferDone) {
-		g_loaderState.tarSize = g_dfuState.commFileSize;
 		g_loaderState.watchdogEnforced = false;
 		bool toFlash = g_dfuState.commToFlash;
-		printf("Program with %ubytes transferred\r\n", (unsigned int)g_loaderState.tarSize);
-		if (ProgTarCheck(g_loaderState.memStart, g_loaderState.tarSize)) {
-			g_loaderState.inFile = false;
-			char name[32];
-			if (TarNameGet(g_loaderState.memStart, g_loaderState.tarSize, name, sizeof(name))) {
-				snprintf(g_loaderState.filename, TARFILENAME_MAX, "/bin/%s.tar", name);
-			} else {
-				g_loaderState.filename[0] = '\0';
-				printf("Error, could not get program name\r\n");
+		printf("Program with %ubytes transferred\r\n", (unsigned int)g_dfuState.commFileSize);
+		if (toFlash) {
+			//the program has been streamed to the flash, load it like a stored one
+			char filename[TARFILENAME_MAX];
+			if ((LoaderStreamFinish(filename, sizeof(filename))) && (LoaderTarLoad(filename))) {
+				GuiJumpBinScreen();
 			}
-			LoaderUpdateTimestamp();
-			if (toFlash) {
-				LoaderTarSave();
-			} else {
+		} else {
+			g_loaderState.tarSize = g_dfuState.commFileSize;
+			if (ProgTarCheck(g_loaderState.memStart, g_loaderState.tarSize)) {
+				g_loaderState.inFile = false;
+				char name[32];
+				if (TarNameGet(g_loaderState.memStart, g_loaderState.tarSize, name, sizeof(name))) {
+					snprintf(g_loaderState.filename, TARFILENAME_MAX, "/bin/%s.tar", name);
+				} else {
+					g_loaderState.filename[0] = '\0';
+					printf("Error, could not get program name\r\n");
+				}
+				LoaderUpdateTimestamp();
 				printf("Valid program in RAM. Awaiting action\r\n");
+				LoaderUpdateGui();
+				GuiJumpBinScreen();
 			}
-			LoaderUpdateGui();
-			GuiJumpBinScreen();
 		}
 		GuiTransferDone();
 		g_dfuState.commTransferDone = false;
@@ -1197,6 +1517,7 @@ void AppCycle(void) {
 	//if (input) {
 	//	printf("Processing took %uticks\r\n", (unsigned int)(timeStop - timeStart));
 	//}
+	FilesystemBackground();
 	g_loaderState.watchdogCounter++;
 	if (g_loaderState.watchdogCounter >= 1000) { //reset every 10s
 		g_loaderState.watchdogCounter = 0;
@@ -113,7 +113,10 @@ bool UsbDfuUploader(const char * filename, uint32_t alternateInterface, bool lea
 				UsbDfuGetStatus();
 				UsbDfuGetStatus();
 				UsbDfuSendData(block, buffer, r);
-				UsbDfuGetStatus();
+				//like dfu-util, wait while the device is busy writing to the flash
+				while (UsbDfuGetStatus() == 4) {
+					usleep(5000);
+				}
 				block++;
 				offset += r;
 				usleep(10000);
@@ -32,6 +32,7 @@ SPDX-License-Identifier: GPL-3.0-or-later
 
 #include "gui.h"
 #include "filesystem.h"
+#include "diskio.h"
 #include "screenshot.h"
 
 uint32_t g_cycleTick;
@@ -214,6 +215,10 @@ void ExecPrintStats(void) {
 	uint16_t noCurrentVin = CoprocReadChargeNoCurrentVolt();
 	printf("No current vin: %umV\r\n", noCurrentVin);
 
+	uint32_t cacheHits, cacheMisses;
+	disk_cache_stats(&cacheHits, &cacheMisses);
+	printf("Disk cache: %u hits, %u misses\r\n", (unsigned int)cacheHits, (unsigned int)cacheMisses);
+
 	uint32_t tStop = HAL_GetTick();
 	printf("Printing took: %ums\r\n", (unsigned int)(tStop - tStart));
 }
@@ -345,6 +350,7 @@ void AppCycle(void) {
 	if (guiUpdate) {
 		GuiCycle(input);
 	}
+	FilesystemBackground();
 	/* Call this function 1000x per second, if one cycle took more than 1ms,
 	   we skip the wait to catch up with calling.
 	   cycleTick last is needed to prevent endless wait in the case of a 32bit
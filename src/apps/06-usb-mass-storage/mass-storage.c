@@ -46,11 +46,27 @@ The assumptions are:
    if this can be read or modified there. Some very aggressive optimizing future
    compilers might make this assumption void and would require the addition of
    __sync_synchronize(); calls as memory barriers.
-10. Beside the timeouts within QueueBufferToHostWithTimeout and
-   QueueCswToHostWithTimeout, this implementation should be free of any side
+10. Beside the timeouts within QueueReadBufferToHostWithTimeout,
+   ReadBufferGetWithTimeout and QueueCswToHostWithTimeout, this implementation should be free of any side
    effects timing and speed of execution has to the state machine.
-11. Command 0x1B (start/stop unit) is issued by the OS on unmount, it is not
-   supported. This is ok.
+11. Command 0x1B (start/stop unit) is issued by the OS on unmount, it only
+   writes the write cache to the flash, like 0x35 (synchronize cache).
+
+Reading uses USB_READ_BUFFERS block buffers as a pipeline. The main loop
+starts the DMA read of the next block with disk_read_start, then queues the
+packets of the previous block while the DMA runs and the USB ISR still sends
+the packets of the blocks before. The packets are queued as
+pointers into the buffers, so there is no copy of the data before the USB
+packet memory. The read and write speed is printed together with the CPU load.
+If a read(10) continues the previous one, the following USB_READAHEAD_BLOCKS
+blocks are read ahead while the USB is idle. Then the next read(10) is
+served from RAM. Writes drop the cache if they hit a cached block.
+
+Writes are collected in a write cache, so the host does not need to wait for
+the flash after every block. The mode sense caching page reports the write
+cache as enabled, so the host sends synchronize cache before it considers
+the data to be written. Should writing the cache fail after the write command
+has already been answered, the next synchronize cache reports the error.
 
 S.M.A.R.T. data can be get by
 smartctl --all -d scsi /dev/sdX
@@ -220,6 +236,37 @@ TODO:
 */
 #define USB_BULK_QUEUE_LEN 24
 
+/* Number of DISK_BLOCKSIZE buffers for reading. While the packets of one
+   buffer are queued, the next block is read into another one by DMA.
+   3 allows this while the USB ISR still sends the packets of a third block.
+*/
+#define USB_READ_BUFFERS 3
+
+#if USB_READ_BUFFERS < 2
+#error "The read pipeline needs at least two buffers"
+#endif
+
+/* Number of blocks read ahead, when the host reads sequentially. They are
+   read while the USB is idle and served from RAM by the next read(10).
+   Each block costs DISK_BLOCKSIZE bytes of RAM. 0 disables the read ahead.
+*/
+#ifndef USB_READAHEAD_BLOCKS
+#define USB_READAHEAD_BLOCKS 16
+#endif
+
+/* Number of consecutive blocks the write cache can hold. They are written to
+   the flash with one disk_write, as soon as the next block does not continue
+   them, a read or synchronize cache command comes in or after
+   USB_WRITECACHE_TIMEOUT [ms]. 0 writes every block at once.
+*/
+#ifndef USB_WRITECACHE_BLOCKS
+#define USB_WRITECACHE_BLOCKS 16
+#endif
+
+#ifndef USB_WRITECACHE_TIMEOUT
+#define USB_WRITECACHE_TIMEOUT 500
+#endif
+
 //from host to device (out)
 #define USB_ENDPOINT_FROMHOST 0x02
 
@@ -354,6 +401,8 @@ usbd_device g_usbDev;
 typedef struct {
 	uint32_t data[USB_BULK_BLOCKSIZE / sizeof(uint32_t)];
 	size_t len;
+	const uint8_t * pData; //if not NULL, the packet is sent from here instead of data
+	bool releasesBuffer; //last packet of a read buffer
 } bulk_t;
 
 typedef struct {
@@ -372,10 +421,18 @@ typedef struct {
 	//sense data
 	uint8_t senseKey; //0 = no error
 	uint8_t additionalSenseCode; //0 = no error
+	//synchronize cache and start/stop unit command
+	bool needSync;
 	//read command
 	bool needRead;
 	uint32_t readBlock;
 	uint32_t readBlockNum;
+	/* Read buffers, used round robin. The ISR sends their packets without a
+	   copy into the queue and increments readBuffersFree after the last one.
+	*/
+	uint32_t readBuffer[USB_READ_BUFFERS][DISK_BLOCKSIZE / sizeof(uint32_t)];
+	uint32_t readBuffersFree;
+	uint32_t readBufferNext; //only accessed from main
 	/* Write command
 	  logic: If needWriteRx is true, put data to writeBuffer
 	  when writeBuffer is full, don't read more data and set needWrite
@@ -404,13 +461,57 @@ typedef struct {
 	uint64_t ticksMainLast; //relative time consumend within the last ~1s in [µs], accessed from main
 	uint64_t ticksUsbIsrLast; //relative time consumend within the last ~1s in [µs], accessed from main
 	uint32_t usbIsrCountLast; //number usb ISRs processed
+	uint64_t readBytesStart; //g_storageState.readBytes when the sample started, accessed from main
+	uint64_t writtenBytesStart; //g_storageState.writtenBytes when the sample started, accessed from main
+	uint32_t readKiBsLast; //read throughput within the last ~1s in [KiB/s], accessed from main
+	uint32_t writtenKiBsLast; //write throughput within the last ~1s in [KiB/s], accessed from main
 	bool printPerformance;
 } performanceState_t;
 
+/* Only accessed from the main loop.
+   The cache holds the blocks first...first + num - 1, block b is in
+   data[b % USB_READAHEAD_BLOCKS]. So dropping blocks from the front does not
+   need to move any data.
+*/
+typedef struct {
+#if USB_READAHEAD_BLOCKS > 0
+	uint32_t data[USB_READAHEAD_BLOCKS][DISK_BLOCKSIZE / sizeof(uint32_t)];
+	bool used[USB_READAHEAD_BLOCKS]; //served at least once since the prefetch
+#endif
+	uint32_t first;
+	uint32_t num;
+	bool active; //the host reads sequentially, so fill the cache
+	uint32_t lastEnd; //block following the previous read(10)
+	uint32_t hits; //blocks served from the cache
+	uint32_t misses; //blocks read from the flash by read(10)
+	uint32_t prefetched; //blocks read ahead
+	uint32_t wasted; //blocks read ahead, but dropped without being served
+} readAhead_t;
+
+/* Only accessed from the main loop.
+   Holds the blocks first...first + num - 1. As DISK_BLOCKSIZE is a multiple of
+   the flash page size, the burst written by WriteCacheFlush is page aligned.
+*/
+typedef struct {
+#if USB_WRITECACHE_BLOCKS > 0
+	uint32_t data[USB_WRITECACHE_BLOCKS][DISK_BLOCKSIZE / sizeof(uint32_t)];
+#endif
+	uint32_t first;
+	uint32_t num;
+	uint32_t dirtySince; //HAL_GetTick() when the first block got added
+	bool error; //writing failed after the write command got its status
+	uint32_t flushes; //number of disk_write calls
+	uint32_t blocksFlushed;
+} writeCache_t;
+
 storageState_t g_storageState;
 
 performanceState_t g_performanceState;
 
+readAhead_t g_readAhead;
+
+writeCache_t g_writeCache;
+
 
 //================== code for USB ==============
 
@@ -475,11 +576,17 @@ static usbd_respond usbGetDesc(usbd_ctlreq *req, void **address, uint16_t *lengt
 void StorageDequeueToHost(usbd_device * dev) {
 	uint32_t thisIndex = g_storageState.toHostR;
 	if ((g_storageState.toHostW != thisIndex) && (g_storageState.toHostFree > 0)) { //elements in queue
-		size_t len = g_storageState.toHost[thisIndex].len;
-		if (usbd_ep_write(dev, USB_ENDPOINT_TOHOST, g_storageState.toHost[thisIndex].data, len) == len) {
+		bulk_t * pBulk = &(g_storageState.toHost[thisIndex]);
+		size_t len = pBulk->len;
+		const void * data = pBulk->pData ? (const void *)pBulk->pData : (const void *)pBulk->data;
+		//copies the data into the USB packet memory, so the source can be reused afterwards
+		if (usbd_ep_write(dev, USB_ENDPOINT_TOHOST, data, len) == len) {
 			uint32_t nextIndex = (thisIndex + 1) % USB_BULK_QUEUE_LEN;
 			g_storageState.toHostFree--;
 			g_storageState.toHostR = nextIndex;
+			if (pBulk->releasesBuffer) {
+				g_storageState.readBuffersFree++;
+			}
 		} else {
 			printfNowait("Err, write\r\n");
 		}
@@ -494,6 +601,28 @@ bool StorageQueueToHost(usbd_device * dev, const void * data, size_t len) {
 	if (g_storageState.toHostR != nextIndex) { //space in queue
 		memcpy(g_storageState.toHost[thisIndex].data, data, len);
 		g_storageState.toHost[thisIndex].len = len;
+		g_storageState.toHost[thisIndex].pData = NULL;
+		g_storageState.toHost[thisIndex].releasesBuffer = false;
+		g_storageState.toHostW = nextIndex;
+		queued = true;
+	}
+	StorageDequeueToHost(dev); //try to send if there is space in the hardware buffer
+	return queued;
+}
+
+/* Must be called from the USB interrupt, or within the UsbLock from other threads
+   Like StorageQueueToHost, but only the pointer is queued. So data must stay
+   valid until the packet has been sent. If releasesBuffer is set, this is
+   signalled by incrementing readBuffersFree.
+*/
+bool StorageQueueRefToHost(usbd_device * dev, const uint8_t * data, size_t len, bool releasesBuffer) {
+	uint32_t thisIndex = g_storageState.toHostW;
+	uint32_t nextIndex = (thisIndex + 1) % USB_BULK_QUEUE_LEN;
+	bool queued = false;
+	if (g_storageState.toHostR != nextIndex) { //space in queue
+		g_storageState.toHost[thisIndex].len = len;
+		g_storageState.toHost[thisIndex].pData = data;
+		g_storageState.toHost[thisIndex].releasesBuffer = releasesBuffer;
 		g_storageState.toHostW = nextIndex;
 		queued = true;
 	}
@@ -555,6 +684,19 @@ static void DataInsert64(uint8_t * out, uint32_t data) {
 	}
 }
 
+#define MODE_CACHING_PAGE_LEN 20
+
+//Fills out with the caching mode page, returns its length
+static size_t ModeSenseCachingPage(uint8_t * out) {
+	memset(out, 0, MODE_CACHING_PAGE_LEN);
+	out[0] = 0x08; //page code
+	out[1] = MODE_CACHING_PAGE_LEN - 2;
+#if USB_WRITECACHE_BLOCKS > 0
+	out[2] = 0x4; //WCE = 1 -> write cache enabled, RCD = 0 -> read cache enabled
+#endif
+	return MODE_CACHING_PAGE_LEN;
+}
+
 void EndpointBulkOut(usbd_device *dev, uint8_t event, uint8_t ep) {
 	//printfNowait("Bulk out %u %u\r\n", event, ep);
 	if (g_storageState.needWriteRx) {
@@ -712,8 +854,12 @@ void EndpointBulkOut(usbd_device *dev, uint8_t event, uint8_t ep) {
 					//add block descriptors if needed
 				}
 				/*0x3F: Request all supported mode pages. Common by 4. request by the host
+				  0x08: Request caching, Linux reports the write cache state from this
 				  0x1C: Request informational exception control, requested by smartctrl
 				*/
+				if ((pageCode == 0x3F) || (pageCode == 0x08)) {
+					idx += ModeSenseCachingPage(data + idx);
+				}
 				if ((pageCode == 0x3F) || (pageCode == 0x1C)) {
 					data[idx] = 0x1C; //support exception control
 					const size_t pageLen = 0xA;
@@ -730,15 +876,20 @@ void EndpointBulkOut(usbd_device *dev, uint8_t event, uint8_t ep) {
 				StorageQueueToHost(dev, data, idx);
 				StorageQueueCsw(dev, cbw->tag, 0);
 			} else if ((command == 0x5A) && (cbw->length >= 6)) { //mode sense(10) (4. looks like a MAC does this instead of mode sense(6))
-				uint8_t data[8] = {0};
+				uint8_t pageCode = cbw->data[2]  & 0x3F;
+				uint8_t data[8 + MODE_CACHING_PAGE_LEN] = {0};
+				size_t idx = 8;
+				if ((pageCode == 0x3F) || (pageCode == 0x08)) {
+					idx += ModeSenseCachingPage(data + idx);
+				}
 				data[0] = 0; //three bytes follow
-				data[1] = 8; //size of this data array
+				data[1] = idx - 2; //the length field itself is excluded
 				if (g_storageState.writeProtected) {
 					data[3] = 0x80;
 				} else {
 					data[3] = 0x0;
 				}
-				StorageQueueToHost(dev, data, sizeof(data));
+				StorageQueueToHost(dev, data, idx);
 				StorageQueueCsw(dev, cbw->tag, 0);
 			} else if ((command == 0x1E) && (cbw->length >= 6)) { //prevent medium removal (5. request by the host)
 				uint32_t status = 0;
@@ -775,6 +926,10 @@ void EndpointBulkOut(usbd_device *dev, uint8_t event, uint8_t ep) {
 				g_storageState.writeBlock = block;
 				g_storageState.writeBlockNum = num;
 				g_storageState.tag = cbw->tag; //no response yet
+			} else if (((command == 0x35) && (cbw->length >= 10)) || //synchronize cache (10)
+			           ((command == 0x1B) && (cbw->length >= 6))) { //start/stop unit, issued on unmount
+				g_storageState.needSync = true;
+				g_storageState.tag = cbw->tag; //no response yet
 			} else if ((command == 0x2F) && (cbw->length >= 10)) { //verify data
 				//nothing to do. We simply tell everything is ok :P
 				StorageQueueCsw(dev, cbw->tag, 0);
@@ -1021,13 +1176,15 @@ void StorageStateReset(void) {
 	g_storageState.toHostFree = 0;
 	g_storageState.toHostR = 0;
 	g_storageState.toHostW = 0;
+	g_storageState.readBuffersFree = USB_READ_BUFFERS;
+	g_storageState.needSync = false;
 	g_storageState.needRead = false;
 	g_storageState.needWrite = false;
 	g_storageState.writeStatus = 0;
 }
 
 
-#ifdef USB_USE_DOUBLEBUFFERING
+#if defined(USB_USE_DOUBLEBUFFERING) && !defined(PC_SIM)
 //function copied from usb stack:
 inline static volatile uint16_t *EPR(uint8_t ep) {
     return (uint16_t*)((ep & 0x07) * 4 + USB_BASE);
@@ -1039,6 +1196,7 @@ void EndpointEventTx(usbd_device *dev, uint8_t event, uint8_t ep) {
 		g_storageState.toHostFree++;
 #ifdef USB_USE_DOUBLEBUFFERING
 		g_storageState.toHostFree = MIN(g_storageState.toHostFree, 2);
+#ifndef PC_SIM
 		/*The problem, when there is a high CPU load, not every sent USB tx packet
 		  gets a proper callback. So there is the need to fix toHostFree back to 2
 		  if this happens. Without the fix, the device continues to work as if only
@@ -1054,6 +1212,7 @@ void EndpointEventTx(usbd_device *dev, uint8_t event, uint8_t ep) {
 				g_storageState.toHostFree = 2;
 			}
 		}
+#endif
 		StorageDequeueToHost(dev); //extra call if a callback was forgotten
 #endif
 		StorageDequeueToHost(dev); //normal call
@@ -1129,6 +1288,63 @@ static usbd_respond usbControl(usbd_device *dev, usbd_ctlreq *req, usbd_rqc_call
 	return usbd_fail;
 }
 
+//================== write cache ==============
+
+//Writes the cached blocks to the flash. Returns false if this failed.
+bool WriteCacheFlush(void) {
+	if (g_writeCache.num == 0) {
+		return true;
+	}
+	bool success = true;
+#if USB_WRITECACHE_BLOCKS > 0
+	//diskio also updates its TRIM bitmap, which FatFs based apps rely on
+	if (disk_write(DEV_EXTFLASH, (const BYTE *)g_writeCache.data, g_writeCache.first, g_writeCache.num) != RES_OK) {
+		g_writeCache.error = true;
+		success = false;
+	}
+	g_writeCache.flushes++;
+	g_writeCache.blocksFlushed += g_writeCache.num;
+	g_writeCache.num = 0;
+#endif
+	return success;
+}
+
+/* Adds the block to the cache, the cache gets written to the flash before if
+   the block does not continue it. Returns false if writing failed.
+*/
+bool WriteCacheAdd(uint32_t block, const uint8_t * data) {
+#if USB_WRITECACHE_BLOCKS > 0
+	bool success = true;
+	if ((block - g_writeCache.first) < g_writeCache.num) { //written again, the FAT for example
+		memcpy(g_writeCache.data[block - g_writeCache.first], data, DISK_BLOCKSIZE);
+		return true;
+	}
+	if ((g_writeCache.num == USB_WRITECACHE_BLOCKS) ||
+	    ((g_writeCache.num) && (block != g_writeCache.first + g_writeCache.num))) {
+		success = WriteCacheFlush();
+	}
+	if (g_writeCache.num == 0) {
+		g_writeCache.first = block;
+		g_writeCache.dirtySince = HAL_GetTick();
+	}
+	memcpy(g_writeCache.data[g_writeCache.num], data, DISK_BLOCKSIZE);
+	g_writeCache.num++;
+	return success;
+#else
+	//diskio also updates its TRIM bitmap, which FatFs based apps rely on
+	return disk_write(DEV_EXTFLASH, data, block, 1) == RES_OK;
+#endif
+}
+
+//Returns true if the cache had to be written
+bool WriteCacheTimeout(void) {
+	if ((g_writeCache.num) && ((HAL_GetTick() - g_writeCache.dirtySince) >= USB_WRITECACHE_TIMEOUT)) {
+		WriteCacheFlush();
+		return true;
+	}
+	return false;
+}
+
 void MainMenu(void) {
 	printf("\r\nSelect operation:\r\n");
 	printf("h: This screen\r\n");
@@ -1136,6 +1352,7 @@ void MainMenu(void) {
 	printf("w: Toggle write protection\r\n");
 	printf("p: Toggle print performance stats\r\n");
 	printf("b: Run read benchmark\r\n");
+	printf("s: Print flash write statistics\r\n");
 	printf("r: Reboot with reset controller\r\n");
 }
 
@@ -1152,6 +1369,9 @@ void AppInit(void) {
 	CoprocInit();
 	PeripheralInit();
 	FlashEnable(8); //6MHz
+	if (disk_initialize(DEV_EXTFLASH) != 0) {
+		printf("Error, flash not ready\r\n");
+	}
 	g_storageState.flashBytes = FlashSizeGet();
 	if (g_storageState.flashBytes >= DISK_RESERVEDOFFSET) {
 		g_storageState.flashBytes -= DISK_RESERVEDOFFSET;
@@ -1171,6 +1391,7 @@ void AppInit(void) {
 }
 
 void StorageStop(void) {
+	WriteCacheFlush();
 	if (g_storageState.usbEnabled == true) {
 		printf("\r\nStopping USB\r\n");
 		UsbStop();
@@ -1204,16 +1425,172 @@ void ToggleWriteprotect(void) {
 	printf("Writeprotect will be %s after next usb disconnect + reconnect\r\n", g_storageState.writeProtected ? "enabled" : "disabled");
 }
 
-bool QueueBufferToHostWithTimeout(usbd_device *dev, const void * buffer, size_t len) {
+/* Queues all packets of a read buffer, the last one releases the buffer.
+   Returns the number of bytes queued. If only a part could be queued before
+   the timeout, the last queued packet releases the buffer instead, so it is
+   not reused while the USB ISR still sends from it. If nothing could be
+   queued, the caller has to call ReadBufferRelease.
+*/
+uint32_t QueueReadBufferToHostWithTimeout(usbd_device *dev, const uint8_t * buffer) {
 	uint32_t start = HAL_GetTick();
 	const uint32_t timeout = 100;
-	bool success;
+	uint32_t offset = 0;
 	do {
 		UsbLock();
-		success = StorageQueueToHost(dev, buffer, len);
+		while (offset < DISK_BLOCKSIZE) {
+			bool last = (offset + USB_BULK_BLOCKSIZE) == DISK_BLOCKSIZE;
+			if (!StorageQueueRefToHost(dev, buffer + offset, USB_BULK_BLOCKSIZE, last)) {
+				break;
+			}
+			offset += USB_BULK_BLOCKSIZE;
+		}
+		UsbUnlock();
+	} while ((offset < DISK_BLOCKSIZE) && ((HAL_GetTick() - start) < timeout));
+	if ((offset > 0) && (offset < DISK_BLOCKSIZE)) {
+		UsbLock();
+		uint32_t lastIndex = (g_storageState.toHostW + USB_BULK_QUEUE_LEN - 1) % USB_BULK_QUEUE_LEN;
+		bulk_t * pBulk = &(g_storageState.toHost[lastIndex]);
+		if ((g_storageState.toHostR != g_storageState.toHostW) &&
+		    (pBulk->pData == buffer + offset - USB_BULK_BLOCKSIZE)) {
+			pBulk->releasesBuffer = true;
+		} else {
+			g_storageState.readBuffersFree++; //the ISR has already sent all packets
+		}
+		UsbUnlock();
+	}
+	return offset;
+}
+
+//Returns the next read buffer, as soon as the USB ISR has sent its old content
+uint8_t * ReadBufferGetWithTimeout(void) {
+	uint32_t start = HAL_GetTick();
+	const uint32_t timeout = 100;
+	bool success = false;
+	do {
+		UsbLock();
+		if (g_storageState.readBuffersFree) {
+			g_storageState.readBuffersFree--;
+			success = true;
+		}
 		UsbUnlock();
 	} while ((!success) && ((HAL_GetTick() - start) < timeout));
-	return success;
+	if (!success) {
+		return NULL;
+	}
+	uint32_t index = g_storageState.readBufferNext;
+	g_storageState.readBufferNext = (index + 1) % USB_READ_BUFFERS;
+	return (uint8_t *)g_storageState.readBuffer[index];
+}
+
+/* Gives back the buffer got last, if none of its packets has been queued.
+   Otherwise no one would increment readBuffersFree for it. If two buffers are
+   given back, the one got last must be released first.
+*/
+void ReadBufferRelease(void) {
+	UsbLock();
+	g_storageState.readBuffersFree++;
+	g_storageState.readBufferNext = (g_storageState.readBufferNext + USB_READ_BUFFERS - 1) % USB_READ_BUFFERS;
+	UsbUnlock();
+}
+
+//================== read ahead ==============
+
+#if USB_READAHEAD_BLOCKS > 0
+
+//Drops the cached blocks in front of block, or all if block is not within the cache
+static void ReadAheadDropUntil(uint32_t block) {
+	while ((g_readAhead.num) && (g_readAhead.first != block)) {
+		if (!g_readAhead.used[g_readAhead.first % USB_READAHEAD_BLOCKS]) {
+			g_readAhead.wasted++;
+		}
+		g_readAhead.first++;
+		g_readAhead.num--;
+	}
+	if (g_readAhead.num == 0) {
+		g_readAhead.first = block;
+	}
+}
+
+static bool ReadAheadContains(uint32_t block) {
+	return (block - g_readAhead.first) < g_readAhead.num;
+}
+
+#endif
+
+/* Copies the block into buffer if it is in the cache. Copying 512 bytes within
+   the RAM is much faster than reading from the flash. And unlike queuing the
+   packets directly from the cache, the next prefetch can not overwrite data
+   the USB ISR still needs to send.
+*/
+bool ReadAheadGet(uint32_t block, uint8_t * buffer) {
+#if USB_READAHEAD_BLOCKS > 0
+	if (ReadAheadContains(block)) {
+		uint32_t slot = block % USB_READAHEAD_BLOCKS;
+		memcpy(buffer, g_readAhead.data[slot], DISK_BLOCKSIZE);
+		g_readAhead.used[slot] = true;
+		g_readAhead.hits++;
+		return true;
+	}
+#else
+	(void)block;
+	(void)buffer;
+#endif
+	g_readAhead.misses++;
+	return false;
+}
+
+//Call before the block gets written, so the cache never serves outdated data
+void ReadAheadInvalidate(uint32_t block) {
+#if USB_READAHEAD_BLOCKS > 0
+	if (ReadAheadContains(block)) {
+		ReadAheadDropUntil(g_readAhead.first + g_readAhead.num);
+		g_readAhead.active = false;
+	}
+#else
+	(void)block;
+#endif
+}
+
+/* Call after a read(10) has been processed. If it continued the previous one,
+   the blocks following it get prefetched.
+*/
+void ReadAheadCommandDone(uint32_t block, uint32_t blocks) {
+	uint32_t end = block + blocks;
+#if USB_READAHEAD_BLOCKS > 0
+	if (block == g_readAhead.lastEnd) {
+		ReadAheadDropUntil(end); //the dropped ones were just served
+		g_readAhead.active = true;
+	} else {
+		//likely a FAT or directory lookup, keep the cache for the sequential read
+		g_readAhead.active = false;
+	}
+#endif
+	g_readAhead.lastEnd = end;
+}
+
+//Reads one more block ahead. Returns true if a block has been read.
+bool ReadAheadPrefetch(void) {
+#if USB_READAHEAD_BLOCKS > 0
+	if ((!g_readAhead.active) || (g_readAhead.num >= USB_READAHEAD_BLOCKS)) {
+		return false;
+	}
+	uint32_t block = g_readAhead.first + g_readAhead.num;
+	if (block >= (g_storageState.flashBytes / DISK_BLOCKSIZE)) {
+		g_readAhead.active = false;
+		return false;
+	}
+	uint32_t slot = block % USB_READAHEAD_BLOCKS;
+	if (disk_read(DEV_EXTFLASH, (BYTE *)g_readAhead.data[slot], block, 1) != RES_OK) {
+		g_readAhead.active = false;
+		return false;
+	}
+	g_readAhead.used[slot] = false;
+	g_readAhead.num++;
+	g_readAhead.prefetched++;
+	return true;
+#else
+	return false;
+#endif
 }
 
 bool QueueCswToHostWithTimeout(usbd_device * dev, uint32_t tag, uint32_t status) {
@@ -1231,6 +1608,24 @@ bool QueueCswToHostWithTimeout(usbd_device * dev, uint32_t tag, uint32_t status)
 
 bool ProcessFlashAccess(void) {
 	bool todo = false;
+	if (g_storageState.needSync) {
+		UsbLock();
+		g_storageState.needSync = false;
+		UsbUnlock();
+		printf("Sync\r\n");
+		uint32_t status = 0; //ok
+		bool success = WriteCacheFlush();
+		if ((!success) || (g_writeCache.error) || (disk_ioctl(DEV_EXTFLASH, CTRL_SYNC, NULL) != RES_OK)) {
+			status = 1; //command failed
+			g_storageState.senseKey = 0x3; //medium error
+			g_storageState.additionalSenseCode = 0x3; //write fault
+		}
+		g_writeCache.error = false;
+		if (!QueueCswToHostWithTimeout(&g_usbDev, g_storageState.tag, status)) {
+			printf("Error, could not queue CSW\r\n");
+		}
+		todo = true;
+	}
 	if (g_storageState.needRead) {
 		UsbLock();
 		g_storageState.needRead = false;
@@ -1238,33 +1633,66 @@ bool ProcessFlashAccess(void) {
 		uint32_t block = g_storageState.readBlock;
 		UsbUnlock();
 		printf("Read %u, len %u\r\n", (unsigned int)block, (unsigned int)blocks);
-		uint32_t address = DISK_RESERVEDOFFSET + block * DISK_BLOCKSIZE;
 		uint32_t status = 0; //ok
-		for (uint32_t i = 0; i < blocks; i++) {
-			/* In order to simulate a RAM disk for speed measurements, set buffer to = {0}
-			   and replace the if (Flash(...)) by if (1).
-			   Don't forget to disable writing too.
-			*/
-			uint8_t buffer[DISK_BLOCKSIZE] = {0};
-			uint32_t address2 = address + i * DISK_BLOCKSIZE;
-			if (FlashRead(address2, buffer, DISK_BLOCKSIZE)) {
-				for (uint32_t j = 0; j < DISK_BLOCKSIZE; j += USB_BULK_BLOCKSIZE) {
-					bool success = QueueBufferToHostWithTimeout(&g_usbDev, buffer + j, USB_BULK_BLOCKSIZE);
-					if (!success) {
-						status = 1;
-						printf("Error, could not queue block\r\n");
-						break;
+		//the blocks to read might be in the write cache, an error is reported by the next sync
+		WriteCacheFlush();
+		/* The DMA fills the buffer of block i, while the packets of block i - 1
+		   are queued and the USB ISR sends the ones before. The packets are
+		   queued directly from the buffers. The last loop only queues.
+		   In order to simulate a RAM disk for speed measurements, replace
+		   the disk_read_start(...) by RES_OK and disk_read_wait() by
+		   a memset of the buffer.
+		   Don't forget to disable writing too.
+		   diskio returns trimmed sectors as zero without reading the flash.
+		*/
+		uint8_t * ready = NULL; //read, but not queued so far
+		for (uint32_t i = 0; i <= blocks; i++) {
+			uint8_t * buffer = NULL;
+			bool cached = true;
+			DRESULT result = RES_OK;
+			if (i < blocks) {
+				buffer = ReadBufferGetWithTimeout();
+				if (!buffer) {
+					status = 1;
+					printf("Error, no read buffer got free\r\n");
+				} else {
+					cached = ReadAheadGet(block + i, buffer);
+					if (!cached) {
+						result = disk_read_start(DEV_EXTFLASH, buffer, block + i);
 					}
 				}
-				g_storageState.readBytes += DISK_BLOCKSIZE;
-			} else {
-				printf("Error, read failed\r\n");
-				status = 1; //command failed
-				g_storageState.senseKey = 0x3; //medium error
-				g_storageState.additionalSenseCode = 0x11; //unrecovered read error
+			}
+			uint32_t queued = 0;
+			if ((ready) && (status == 0)) {
+				queued = QueueReadBufferToHostWithTimeout(&g_usbDev, ready);
+				if (queued == DISK_BLOCKSIZE) {
+					g_storageState.readBytes += DISK_BLOCKSIZE;
+				} else {
+					status = 1;
+					printf("Error, could not queue block\r\n");
+				}
+			}
+			if (!cached) {
+				disk_read_wait();
+				if (result != RES_OK) {
+					printf("Error, read failed\r\n");
+					status = 1; //command failed
+					g_storageState.senseKey = 0x3; //medium error
+					g_storageState.additionalSenseCode = 0x11; //unrecovered read error
+				}
+			}
+			if (status) {
+				if (buffer) {
+					ReadBufferRelease();
+				}
+				if ((ready) && (queued == 0)) {
+					ReadBufferRelease();
+				}
 				break;
 			}
+			ready = buffer;
 		}
+		ReadAheadCommandDone(block, blocks);
 		Led2Off();
 		if (!QueueCswToHostWithTimeout(&g_usbDev, g_storageState.tag, status)) {
 			printf("Error, could not queue CSW\r\n");
@@ -1298,12 +1726,12 @@ bool ProcessFlashAccess(void) {
 			EndpointFillDatabuffer(&g_usbDev, USB_ENDPOINT_FROMHOST);
 		}
 		UsbUnlock();
-		uint32_t address = DISK_RESERVEDOFFSET + writeBlock * DISK_BLOCKSIZE;
 #if 1
 		if (firstBlock) {
 			printf("Write block %u, len %u\r\n", (unsigned int)writeBlock, (unsigned int)blocks);
 		}
-		if (!FlashWrite(address, buffer, DISK_BLOCKSIZE)) {
+		ReadAheadInvalidate(writeBlock);
+		if (!WriteCacheAdd(writeBlock, buffer)) {
 			g_storageState.writeStatus = 1; //command failed
 			g_storageState.senseKey = 0x3; //medium error
 			g_storageState.additionalSenseCode = 0x3; //write fault
@@ -1323,6 +1751,13 @@ bool ProcessFlashAccess(void) {
 		}
 		todo = true;
 	}
+	if ((!todo) && (!g_storageState.needWriteRx)) {
+		todo = WriteCacheTimeout();
+		//the bus is idle, one block at a time to respond quickly to the next command
+		if ((!todo) && (g_writeCache.num == 0)) { //the flash could have outdated data
+			todo = ReadAheadPrefetch();
+		}
+	}
 	return todo;
 }
 
@@ -1330,7 +1765,14 @@ void PrintPerformance(void) {
 	unsigned int mainPerc = g_performanceState.ticksMainLast / 10000; //µs to percent
 	unsigned int isrPerc = g_performanceState.ticksUsbIsrLast / 10000; //µs to percent
 	unsigned int numIsr = g_performanceState.usbIsrCountLast;
-	printf("CPU load of flash rw: %2u%c, Usb ISR: %03u - %2u%c, \r\n", mainPerc, '%', numIsr, isrPerc, '%');
+	unsigned int readKiBs = g_performanceState.readKiBsLast;
+	unsigned int writtenKiBs = g_performanceState.writtenKiBsLast;
+	printf("CPU load of flash rw: %2u%c, Usb ISR: %03u - %2u%c, read: %4uKiB/s, write: %4uKiB/s\r\n",
+	       mainPerc, '%', numIsr, isrPerc, '%', readKiBs, writtenKiBs);
+	uint32_t requested = g_readAhead.hits + g_readAhead.misses;
+	unsigned int hitPerc = requested ? (uint64_t)g_readAhead.hits * 100 / requested : 0;
+	printf("Read ahead hits: %3u%c of %u blocks, prefetched: %u, wasted: %u\r\n", hitPerc, '%',
+	       (unsigned int)requested, (unsigned int)g_readAhead.prefetched, (unsigned int)g_readAhead.wasted);
 }
 
 void TogglePrintPerformance(void) {
@@ -1340,17 +1782,37 @@ void TogglePrintPerformance(void) {
 #define BENCH_BLOCK 512
 #define BENCH_SIZE (1024 * 512)
 
-void BenchmarkRead() {
-	printf("Reading %uKiB\r\n", BENCH_SIZE / 1024);
+//prescaler for the throughput optimized reads, gives 24MHz
+#define BENCH_FAST_PRESCALER 2
+
+void BenchmarkReadPolicy(uint32_t readPrescaler) {
 	uint8_t buffer[BENCH_BLOCK];
+	FlashReadFastSet(readPrescaler);
 	uint64_t tStart = McuTimestampUs();
 	for (uint32_t i = 0; i < BENCH_SIZE; i+= BENCH_BLOCK) {
 		FlashRead(i, buffer, BENCH_BLOCK);
 	}
 	uint64_t tStop = McuTimestampUs();
+	FlashReadFastSet(0);
 	uint32_t deltaMs = (tStop - tStart) / 1000;
 	uint32_t kbs = BENCH_SIZE * 1000 / deltaMs / 1024;
-	printf("Took %ums -> %uKiB/s\r\n", (unsigned int)deltaMs, (unsigned int)kbs);
+	printf("%s: Took %ums -> %uKiB/s\r\n", readPrescaler ? "Fast read" : "Low power read",
+	       (unsigned int)deltaMs, (unsigned int)kbs);
+}
+
+void BenchmarkRead() {
+	printf("Reading %uKiB\r\n", BENCH_SIZE / 1024);
+	BenchmarkReadPolicy(0);
+	BenchmarkReadPolicy(BENCH_FAST_PRESCALER);
+}
+
+void PrintWriteStats(void) {
+	uint32_t pagesWritten, pagesSkipped;
+	FlashWriteStatsGet(&pagesWritten, &pagesSkipped);
+	printf("Flash pages written: %u, skipped as unchanged: %u\r\n", (unsigned int)pagesWritten, (unsigned int)pagesSkipped);
+	uint32_t flushes = g_writeCache.flushes;
+	unsigned int blocksPerFlush = flushes ? g_writeCache.blocksFlushed / flushes : 0;
+	printf("Write cache flushes: %u, blocks per flush: %u\r\n", (unsigned int)flushes, blocksPerFlush);
 }
 
 void AppCycle(void) {
@@ -1363,15 +1825,17 @@ void AppCycle(void) {
 	}
 	switch (input) {
 		case 'h': MainMenu(); break;
-		case 'r': NVIC_SystemReset(); break;
+		case 'r': WriteCacheFlush(); NVIC_SystemReset(); break;
 		case 'u': ToggleUsb(); break;
 		case 'w': ToggleWriteprotect(); break;
 		case 'p': TogglePrintPerformance(); break;
 		case 'b': BenchmarkRead(); break;
+		case 's': PrintWriteStats(); break;
 		default: break;
 	}
 
 	if (KeyLeftPressed()) {
+		WriteCacheFlush();
 		NVIC_SystemReset();
 	}
 	if (KeyUpPressed()) {
@@ -1425,12 +1889,18 @@ void AppCycle(void) {
 		UsbUnlock();
 		uint64_t ticksMain = g_performanceState.ticksMain;
 		g_performanceState.ticksMain = 0;
+		uint64_t readBytes = g_storageState.readBytes - g_performanceState.readBytesStart;
+		g_performanceState.readBytesStart = g_storageState.readBytes;
+		uint64_t writtenBytes = g_storageState.writtenBytes - g_performanceState.writtenBytesStart;
+		g_performanceState.writtenBytesStart = g_storageState.writtenBytes;
 		//if this is run after more than 1000ms, the values needs to be adjusted
 		uint32_t delta = thisStart - lastStart;
 		if ((delta > 0) && (g_performanceState.printPerformance)) {
 			g_performanceState.ticksMainLast = ticksMain * 1000 / delta;
 			g_performanceState.ticksUsbIsrLast = ticksUsb * 1000 / delta;
 			g_performanceState.usbIsrCountLast = isrCount * 1000 / delta;
+			g_performanceState.readKiBsLast = readBytes * 1000 / delta / 1024;
+			g_performanceState.writtenKiBsLast = writtenBytes * 1000 / delta / 1024;
 			PrintPerformance();
 		}
 	}
@@ -0,0 +1,578 @@
+/* Mass storage replay harness
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier: GPL-3.0-or-later
+
+Runs mass-storage.c with the simulated flash and replaces the USB peripheral
+by a simulated endpoint driver. A host thread replays SCSI commands from trace
+files as bulk only transport (BOT): CBW, data packets, then CSW. The USB
+packets are paced like on a full speed bus, and with FLASH_SIMULATE_TIMING
+the flash takes about as long as the real one. So the reported command
+latencies and throughput are close to the hardware.
+
+The data written are generated from the block number and a counter. Blocks
+written within the same run are verified when read again. The program
+returns 1 if a command failed, the data did not match or the device did not
+respond.
+
+Trace file format, one command per line, # starts a comment:
+inquiry
+tur                     test unit ready
+capacity                read capacity (10)
+sense                   request sense
+modesense <page>        mode sense (6)
+sync                    synchronize cache (10)
+eject                   start/stop unit with eject
+read <lba> <blocks>     read (10)
+write <lba> <blocks>    write (10)
+readseq <lba> <blocks> <chunk>   sequential read (10) commands
+writeseq <lba> <blocks> <chunk>  sequential write (10) commands
+idle <ms>               no USB traffic, the device can work in the background
+cdb <in|out|none> <length> <hex bytes>  any recorded command block
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <pthread.h>
+#include <signal.h>
+#include <time.h>
+
+#include "main.h"
+
+#include "mass-storage.h"
+#include "boxlib/boxusb.h"
+#include "boxlib/mcu.h"
+
+#include "usbd_core.h"
+
+#include "utility.h"
+
+//A full speed bus transfers up to 19 bulk packets with 64 bytes within a 1ms frame
+#ifndef USB_SIM_PACKET_NS
+#define USB_SIM_PACKET_NS (1000000 / 19)
+#endif
+
+#define USB_SIM_PACKET 64
+
+//Like the double buffered endpoint of the STM32
+#define USB_SIM_IN_PACKETS 2
+
+#define USB_SIM_TIMEOUT_MS 5000
+
+#define USB_SIM_ENDPOINT_OUT 0x02
+#define USB_SIM_ENDPOINT_IN 0x81
+
+#define USB_SIM_BLOCKSIZE 512
+
+#define NSEC_IN_SEC 1000000000ULL
+
+extern usbd_device * g_pUsbDev;
+extern usbd_cfg_callback g_usbCfgCallback;
+
+//Endpoint buffers, only accessed while __disable_irq() is held
+typedef struct {
+	uint8_t in[USB_SIM_IN_PACKETS][USB_SIM_PACKET];
+	uint16_t inLen[USB_SIM_IN_PACKETS];
+	uint32_t inR;
+	uint32_t inNum;
+	uint8_t out[USB_SIM_PACKET];
+	uint16_t outLen;
+	bool outFull;
+} simEndpoints_t;
+
+typedef struct {
+	uint32_t count;
+	uint32_t failed;
+	uint64_t timeUs;
+	uint64_t maxUs;
+	uint64_t bytes;
+} commandStats_t;
+
+typedef struct {
+	char ** files;
+	int num;
+} replayList_t;
+
+simEndpoints_t g_simEp;
+
+uint64_t g_busNext; //[ns] earliest time for the next packet
+
+commandStats_t g_commandStats[256]; //index is the SCSI operation code
+
+uint32_t g_tag;
+uint32_t g_writeGeneration;
+uint32_t * g_blockGeneration; //0 = not written within this run
+uint32_t g_blockGenerationNum;
+uint32_t g_errors;
+
+volatile bool g_replayDone;
+
+//================== simulated USB driver ==============
+
+static bool SimEpConfig(uint8_t ep, uint8_t eptype, uint16_t epsize) {
+	(void)ep;
+	(void)eptype;
+	(void)epsize;
+	return true;
+}
+
+static void SimEpDeconfig(uint8_t ep) {
+	(void)ep;
+}
+
+static int32_t SimEpRead(uint8_t ep, void * buf, uint16_t blen) {
+	if ((ep != USB_SIM_ENDPOINT_OUT) || (!g_simEp.outFull)) {
+		return -1;
+	}
+	uint16_t len = MIN(blen, g_simEp.outLen);
+	memcpy(buf, g_simEp.out, len);
+	g_simEp.outFull = false;
+	return len;
+}
+
+static int32_t SimEpWrite(uint8_t ep, const void * buf, uint16_t blen) {
+	if ((ep != USB_SIM_ENDPOINT_IN) || (g_simEp.inNum == USB_SIM_IN_PACKETS) || (blen > USB_SIM_PACKET)) {
+		return -1;
+	}
+	uint32_t index = (g_simEp.inR + g_simEp.inNum) % USB_SIM_IN_PACKETS;
+	memcpy(g_simEp.in[index], buf, blen);
+	g_simEp.inLen[index] = blen;
+	g_simEp.inNum++;
+	return blen;
+}
+
+const struct usbd_driver g_simUsbDriver = {
+	.ep_config = SimEpConfig,
+	.ep_deconfig = SimEpDeconfig,
+	.ep_read = SimEpRead,
+	.ep_write = SimEpWrite,
+};
+
+//Same as usbd_process_evt of the usb stack, but within the simulated ISR
+static void SimUsbEvent(uint8_t event, uint8_t ep) {
+	UsbIrqOnEnter();
+	if (g_pUsbDev->endpoint[ep & 0x07]) {
+		g_pUsbDev->endpoint[ep & 0x07](g_pUsbDev, event, ep);
+	}
+	if (g_pUsbDev->events[event]) {
+		g_pUsbDev->events[event](g_pUsbDev, event, ep);
+	}
+	UsbIrqOnLeave();
+}
+
+//================== host side ==============
+
+static uint64_t TimeNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void SleepUntil(uint64_t stamp) {
+	struct timespec ts;
+	ts.tv_sec = stamp / NSEC_IN_SEC;
+	ts.tv_nsec = stamp % NSEC_IN_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+}
+
+static void BusPacketWait(void) {
+	uint64_t now = TimeNs();
+	if (g_busNext > now) {
+		SleepUntil(g_busNext);
+	} else {
+		g_busNext = now;
+	}
+	g_busNext += USB_SIM_PACKET_NS;
+}
+
+//While the device NAKs, the host polls again
+static void BusRetryWait(void) {
+	SleepUntil(TimeNs() + 10000);
+}
+
+static bool HostOut(const uint8_t * data, uint16_t len) {
+	BusPacketWait();
+	uint32_t start = HAL_GetTick();
+	while ((HAL_GetTick() - start) < USB_SIM_TIMEOUT_MS) {
+		bool sent = false;
+		__disable_irq();
+		if (!g_simEp.outFull) {
+			memcpy(g_simEp.out, data, len);
+			g_simEp.outLen = len;
+			g_simEp.outFull = true;
+			SimUsbEvent(usbd_evt_eprx, USB_SIM_ENDPOINT_OUT);
+			sent = true;
+		}
+		__enable_irq();
+		if (sent) {
+			return true;
+		}
+		BusRetryWait();
+	}
+	printf("Error, device does not accept data\n");
+	return false;
+}
+
+static bool HostIn(uint8_t * data, uint16_t * pLen) {
+	BusPacketWait();
+	uint32_t start = HAL_GetTick();
+	while ((HAL_GetTick() - start) < USB_SIM_TIMEOUT_MS) {
+		bool received = false;
+		__disable_irq();
+		if (g_simEp.inNum) {
+			uint32_t index = g_simEp.inR;
+			*pLen = g_simEp.inLen[index];
+			memcpy(data, g_simEp.in[index], *pLen);
+			g_simEp.inR = (index + 1) % USB_SIM_IN_PACKETS;
+			g_simEp.inNum--;
+			SimUsbEvent(usbd_evt_eptx, USB_SIM_ENDPOINT_IN);
+			received = true;
+		}
+		__enable_irq();
+		if (received) {
+			return true;
+		}
+		BusRetryWait();
+	}
+	printf("Error, device does not send data\n");
+	return false;
+}
+
+static uint8_t PatternByte(uint32_t block, uint32_t generation, uint32_t index) {
+	uint32_t x = (block * 2654435761U) ^ (generation * 40503U) ^ (index * 97U);
+	return x ^ (x >> 13);
+}
+
+static void BlockGenerationSet(uint32_t block, uint32_t generation) {
+	if (block >= g_blockGenerationNum) {
+		uint32_t num = block + 1024;
+		uint32_t * p = realloc(g_blockGeneration, num * sizeof(uint32_t));
+		if (!p) {
+			printf("Error, out of memory\n");
+			exit(1);
+		}
+		memset(p + g_blockGenerationNum, 0, (num - g_blockGenerationNum) * sizeof(uint32_t));
+		g_blockGeneration = p;
+		g_blockGenerationNum = num;
+	}
+	g_blockGeneration[block] = generation;
+}
+
+static uint32_t BlockGenerationGet(uint32_t block) {
+	if (block < g_blockGenerationNum) {
+		return g_blockGeneration[block];
+	}
+	return 0;
+}
+
+/* For read (10) and write (10), the data are generated and checked.
+   dataLen is the data the host expects (in) or sends (out).
+*/
+static bool HostCommand(const uint8_t * cdb, uint8_t cdbLen, bool dataIn, uint32_t dataLen) {
+	uint8_t packet[USB_SIM_PACKET];
+	uint8_t opcode = cdb[0];
+	uint32_t block = 0;
+	bool isRead = (opcode == 0x28) && (cdbLen >= 10);
+	bool isWrite = (opcode == 0x2A) && (cdbLen >= 10);
+	if ((isRead) || (isWrite)) {
+		block = (cdb[2] << 24) | (cdb[3] << 16) | (cdb[4] << 8) | cdb[5];
+	}
+	uint32_t generation = 0;
+	if (isWrite) {
+		g_writeGeneration++;
+		generation = g_writeGeneration;
+	}
+	//command block wrapper
+	memset(packet, 0, 31);
+	g_tag++;
+	uint32_t signature = 0x43425355; //ASCII for USBC
+	memcpy(packet, &signature, sizeof(uint32_t));
+	memcpy(packet + 4, &g_tag, sizeof(uint32_t));
+	memcpy(packet + 8, &dataLen, sizeof(uint32_t));
+	packet[12] = dataIn ? 0x80 : 0;
+	packet[14] = cdbLen;
+	memcpy(packet + 15, cdb, cdbLen);
+	uint64_t tStart = McuTimestampUs();
+	if (!HostOut(packet, 31)) {
+		return false;
+	}
+	//data phase
+	bool dataOk = true;
+	uint32_t transferred = 0;
+	bool haveCsw = false;
+	uint16_t len = 0;
+	while (transferred < dataLen) {
+		if (dataIn) {
+			if (!HostIn(packet, &len)) {
+				return false;
+			}
+			uint32_t cswSignature;
+			memcpy(&cswSignature, packet, sizeof(uint32_t));
+			if ((len == 13) && (cswSignature == 0x53425355)) { //the device sent less data than requested
+				haveCsw = true;
+				break;
+			}
+			if (isRead) {
+				for (uint32_t i = 0; i < len; i++) {
+					uint32_t pos = transferred + i;
+					uint32_t b = block + pos / USB_SIM_BLOCKSIZE;
+					uint32_t gen = BlockGenerationGet(b);
+					if ((gen) && (packet[i] != PatternByte(b, gen, pos % USB_SIM_BLOCKSIZE))) {
+						dataOk = false;
+					}
+				}
+			}
+			transferred += len;
+			if (len < USB_SIM_PACKET) {
+				break;
+			}
+		} else {
+			len = MIN(USB_SIM_PACKET, dataLen - transferred);
+			for (uint32_t i = 0; i < len; i++) {
+				uint32_t pos = transferred + i;
+				packet[i] = PatternByte(block + pos / USB_SIM_BLOCKSIZE, generation, pos % USB_SIM_BLOCKSIZE);
+			}
+			if (!HostOut(packet, len)) {
+				return false;
+			}
+			transferred += len;
+		}
+	}
+	//command status wrapper
+	if ((!haveCsw) && (!HostIn(packet, &len))) {
+		return false;
+	}
+	uint64_t timeUs = McuTimestampUs() - tStart;
+	uint32_t cswSignature, cswTag;
+	memcpy(&cswSignature, packet, sizeof(uint32_t));
+	memcpy(&cswTag, packet + 4, sizeof(uint32_t));
+	if ((len != 13) || (cswSignature != 0x53425355) || (cswTag != g_tag)) {
+		printf("Error, invalid CSW for command 0x%x\n", opcode);
+		return false;
+	}
+	uint8_t status = packet[12];
+	if ((status == 0) && (isWrite)) {
+		for (uint32_t i = 0; i < dataLen / USB_SIM_BLOCKSIZE; i++) {
+			BlockGenerationSet(block + i, generation);
+		}
+	}
+	commandStats_t * pStats = &g_commandStats[opcode];
+	pStats->count++;
+	pStats->timeUs += timeUs;
+	pStats->maxUs = MAX(pStats->maxUs, timeUs);
+	pStats->bytes += transferred;
+	if (status != 0) {
+		pStats->failed++;
+		g_errors++;
+		printf("Error, command 0x%x failed with status %u\n", opcode, status);
+	}
+	if (!dataOk) {
+		g_errors++;
+		printf("Error, data read from block %u differ from the written ones\n", (unsigned int)block);
+	}
+	return true;
+}
+
+static void Cdb10Set(uint8_t * cdb, uint8_t opcode, uint32_t block, uint16_t blocks) {
+	memset(cdb, 0, 10);
+	cdb[0] = opcode;
+	cdb[2] = block >> 24;
+	cdb[3] = block >> 16;
+	cdb[4] = block >> 8;
+	cdb[5] = block;
+	cdb[7] = blocks >> 8;
+	cdb[8] = blocks;
+}
+
+static bool HostReadWrite(bool write, uint32_t block, uint32_t blocks, uint32_t chunk) {
+	uint8_t cdb[10];
+	if (chunk == 0) {
+		chunk = blocks;
+	}
+	while (blocks) {
+		uint16_t num = MIN(MIN(blocks, chunk), 0xFFFF);
+		Cdb10Set(cdb, write ? 0x2A : 0x28, block, num);
+		if (!HostCommand(cdb, sizeof(cdb), !write, num * USB_SIM_BLOCKSIZE)) {
+			return false;
+		}
+		block += num;
+		blocks -= num;
+	}
+	return true;
+}
+
+//Returns false if the device does not respond anymore or the line is invalid
+static bool ReplayLine(const char * line) {
+	char command[16];
+	unsigned int a, b, c;
+	uint8_t cdb[16] = {0};
+	if (sscanf(line, "%15s", command) != 1) {
+		return true; //empty line
+	}
+	if (command[0] == '#') {
+		return true;
+	}
+	if (strcmp(command, "inquiry") == 0) {
+		cdb[0] = 0x12;
+		cdb[4] = 36;
+		return HostCommand(cdb, 6, true, 36);
+	}
+	if (strcmp(command, "tur") == 0) {
+		return HostCommand(cdb, 6, false, 0);
+	}
+	if (strcmp(command, "capacity") == 0) {
+		cdb[0] = 0x25;
+		return HostCommand(cdb, 10, true, 8);
+	}
+	if (strcmp(command, "sense") == 0) {
+		cdb[0] = 0x03;
+		cdb[4] = 18;
+		return HostCommand(cdb, 6, true, 18);
+	}
+	if ((strcmp(command, "modesense") == 0) && (sscanf(line, "%*s %x", &a) == 1)) {
+		cdb[0] = 0x1A;
+		cdb[2] = a;
+		cdb[4] = 192;
+		return HostCommand(cdb, 6, true, 192);
+	}
+	if (strcmp(command, "sync") == 0) {
+		cdb[0] = 0x35;
+		return HostCommand(cdb, 10, false, 0);
+	}
+	if (strcmp(command, "eject") == 0) {
+		cdb[0] = 0x1B;
+		cdb[4] = 0x2; //LoEj = 1, Start = 0
+		return HostCommand(cdb, 6, false, 0);
+	}
+	if ((strcmp(command, "read") == 0) && (sscanf(line, "%*s %u %u", &a, &b) == 2)) {
+		return HostReadWrite(false, a, b, 0);
+	}
+	if ((strcmp(command, "write") == 0) && (sscanf(line, "%*s %u %u", &a, &b) == 2)) {
+		return HostReadWrite(true, a, b, 0);
+	}
+	if ((strcmp(command, "readseq") == 0) && (sscanf(line, "%*s %u %u %u", &a, &b, &c) == 3)) {
+		return HostReadWrite(false, a, b, c);
+	}
+	if ((strcmp(command, "writeseq") == 0) && (sscanf(line, "%*s %u %u %u", &a, &b, &c) == 3)) {
+		return HostReadWrite(true, a, b, c);
+	}
+	if ((strcmp(command, "idle") == 0) && (sscanf(line, "%*s %u", &a) == 1)) {
+		HAL_Delay(a);
+		return true;
+	}
+	char direction[8];
+	int used;
+	if ((strcmp(command, "cdb") == 0) && (sscanf(line, "%*s %7s %u%n", direction, &a, &used) == 2)) {
+		const char * pos = line + used;
+		uint8_t cdbLen = 0;
+		int n;
+		while ((cdbLen < sizeof(cdb)) && (sscanf(pos, "%x%n", &b, &n) == 1)) {
+			cdb[cdbLen] = b;
+			cdbLen++;
+			pos += n;
+		}
+		if (cdbLen) {
+			return HostCommand(cdb, cdbLen, strcmp(direction, "in") == 0, a);
+		}
+	}
+	printf("Error, invalid line >%s<\n", line);
+	return false;
+}
+
+static bool ReplayFile(const char * filename) {
+	FILE * f = fopen(filename, "r");
+	if (!f) {
+		printf("Error, could not open %s\n", filename);
+		return false;
+	}
+	printf("Replaying %s\n", filename);
+	char line[256];
+	bool success = true;
+	while ((success) && (fgets(line, sizeof(line), f))) {
+		line[strcspn(line, "\r\n")] = '\0';
+		success = ReplayLine(line);
+	}
+	fclose(f);
+	return success;
+}
+
+static const char * CommandName(uint8_t opcode) {
+	switch (opcode) {
+		case 0x00: return "test unit ready";
+		case 0x03: return "request sense";
+		case 0x12: return "inquiry";
+		case 0x1A: return "mode sense (6)";
+		case 0x1B: return "start/stop unit";
+		case 0x25: return "read capacity";
+		case 0x28: return "read (10)";
+		case 0x2A: return "write (10)";
+		case 0x35: return "sync cache (10)";
+		default: return "other";
+	}
+}
+
+static void PrintReport(void) {
+	printf("\nCommand           count  failed  avg [us]  max [us]       KiB    KiB/s\n");
+	for (uint32_t i = 0; i < 256; i++) {
+		commandStats_t * pStats = &g_commandStats[i];
+		if (pStats->count == 0) {
+			continue;
+		}
+		unsigned int kibs = pStats->timeUs ? pStats->bytes * 1000000 / pStats->timeUs / 1024 : 0;
+		printf("0x%02x %-15s %5u  %6u  %8u  %8u  %8u  %7u\n", (unsigned int)i, CommandName(i),
+		       (unsigned int)pStats->count, (unsigned int)pStats->failed,
+		       (unsigned int)(pStats->timeUs / pStats->count), (unsigned int)pStats->maxUs,
+		       (unsigned int)(pStats->bytes / 1024), kibs);
+	}
+	printf("Errors: %u\n", (unsigned int)g_errors);
+}
+
+void * Replay(void * parameter) {
+	replayList_t * pList = (replayList_t *)parameter;
+	for (int i = 0; i < pList->num; i++) {
+		if (!ReplayFile(pList->files[i])) {
+			g_errors++;
+			break;
+		}
+	}
+	PrintReport();
+	g_replayDone = true;
+	return NULL;
+}
+
+void StopSignal(int sig) {
+	printf("Terminate by signal %u requested\n", sig);
+	SimulatedDeinit();
+	exit(1);
+}
+
+int main(int argc, char ** argv) {
+	if (argc < 2) {
+		printf("Usage: %s <trace files>\n", argv[0]);
+		return 1;
+	}
+	signal(SIGTERM, StopSignal);
+	signal(SIGHUP, StopSignal);
+	signal(SIGINT, StopSignal);
+	SimulatedInit();
+	AppInit();
+	//what the host does after enumeration
+	__disable_irq();
+	g_pUsbDev->driver = &g_simUsbDriver;
+	g_usbCfgCallback(g_pUsbDev, 1);
+	__enable_irq();
+	pthread_t thread;
+	replayList_t list;
+	list.files = argv + 1;
+	list.num = argc - 1;
+	pthread_create(&thread, NULL, &Replay, &list);
+	while (!g_replayDone) {
+		AppCycle();
+	}
+	pthread_join(thread, NULL);
+	SimulatedDeinit();
+	return g_errors ? 1 : 0;
+}
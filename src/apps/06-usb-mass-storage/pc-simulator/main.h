@@ -0,0 +1,8 @@
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+
+#include "simulated.h"
+#include "mainExtra.h"
+
@@ -213,7 +213,7 @@
 /  f_fdisk function. 0x100000000 max. This option has no effect when FF_LBA64 == 0. */
 
 
-#define FF_USE_TRIM		0
+#define FF_USE_TRIM		1
 /* This option switches support for ATA-TRIM. (0:Disable or 1:Enable)
 /  To enable Trim function, also CTRL_TRIM command should be implemented to the
 /  disk_ioctl() function. */
@@ -299,4 +299,14 @@
 
 
 
+/*---------------------------------------------------------------------------/
+/ diskio Configurations
+/---------------------------------------------------------------------------*/
+
+#define DISK_CACHE_SECTORS	4
+#define DISK_CACHE_TIMEOUT	1000
+/* Write-back sector cache of diskio.c, see there. */
+
+
+
 /*--- End of configuration options ---*/
@@ -107,6 +107,7 @@ typedef struct {
 	bool upPressed;
 	bool downPressed;
 	uint32_t timestampUtc;
+	uint32_t digitsShown; //hour, minute and colors of the current digit bitmaps
 	uint32_t editPos;
 	bool needRet;
 } guiState_t;
@@ -168,6 +169,11 @@ static void GuiLargeDigitsUpdate(uint8_t hour, uint8_t minute) {
 	uint8_t minuteL = minute % 10;
 	uint8_t bgColor = g_gui.bgColor;
 	uint8_t fgColor = g_gui.fgColor;
+	uint32_t digitsShown = (hour << 24) | (minute << 16) | (fgColor << 8) | bgColor;
+	if (g_gui.digitsShown == digitsShown) {
+		return;
+	}
+	g_gui.digitsShown = digitsShown;
 	uint8_t offset = 0;
 	if (g_gui.type == ILI9341) {
 		offset = 11; //the xxl digits are later in the array
@@ -178,6 +184,11 @@ static void GuiLargeDigitsUpdate(uint8_t hour, uint8_t minute) {
 	GuiCopyColorizeBitmap(g_gui.minuteLBuffer, DIGITS_LEN_MAX, g_bitmaps[minuteL + offset], g_bitmapsLen[minuteL + offset], bgColor, fgColor);
 	//The colon is the entry after the ten digits in the array
 	GuiCopyColorizeBitmap(g_gui.colonBuffer, DIGITS_LEN_MAX, g_bitmaps[10 + offset], g_bitmapsLen[10 + offset], bgColor, fgColor);
+	for (uint16_t i = MENU_GFX_DIGITHOURH; i <= MENU_GFX_DIGITMINUTEL2; i++) {
+		if (i != MENU_GFX_BACKGROUND2) {
+			menu_gfx_changed(i);
+		}
+	}
 }
 
 
@@ -579,6 +590,7 @@ void GuiInit(void) {
 	menu_radiobuttonstate[MENU_RBUTTON_BACKLIGHT] = blIndex;
 	//prepare first draw
 	g_gui.timestampUtc = 0xFFFFFFFF;
+	g_gui.digitsShown = 0xFFFFFFFF;
 	g_gui.type = FilesystemReadLcd();
 	uint16_t action = 0;
 	if (g_gui.type != NONE) {
@@ -640,7 +652,10 @@ void GuiUpdateClock(void) {
 		TimestampDecode(lastSyncLocal, &year, &month, &day, NULL, &hour, &minute, &second);
 		femtoSnprintf(menu_strings[MENU_TEXT_SYNC], TEXT_LEN_MAX, "%s, %2u.%02u, %2u:%02u:%u", source, day + 1, month + 1, hour, minute, second);
 	}
-	menu_redraw();
+	menu_text_changed(MENU_TEXT_TIME);
+	menu_text_changed(MENU_TEXT_DATE);
+	menu_text_changed(MENU_TEXT_SYNC);
+	menu_redraw_dirty();
 }
 
 
@@ -526,6 +526,7 @@ void MainTask(void * param) {
 		if (dontTryAgain) {
 			dontTryAgain--;
 		}
+		FilesystemBackground();
 		vTaskDelay(10);
 	}
 }
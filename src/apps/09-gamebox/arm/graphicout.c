@@ -32,22 +32,37 @@ void resync_led_display(void) {
 }
 
 
-static void GraphicDrawPixel(uint16_t x, uint16_t y, uint8_t color) {
+static uint8_t GraphicColorConvert(uint8_t color) {
 	uint8_t red = color & 0x03;
 	uint8_t green = (color & 0x30) >> 4;
-	uint8_t colorNew = (red << 2) | green;
-	menu_screen_set(x, y, colorNew);
+	return (red << 2) | green;
 }
 
 bool GraphicUpdate(void) {
 	bool changed = false;
+	uint8_t row[screenx];
 	for (uint16_t py = 0; py < screeny; py++) {
-		for (uint16_t px = 0; px < screenx; px++) {
-			uint8_t color = gdata[py][px];
-			if (color != gdataShadow[py][px]) {
+		uint16_t runStart = 0;
+		uint16_t runLength = 0;
+		//only the changed pixels may be marked as written, so every run of them is drawn at once
+		for (uint16_t px = 0; px <= screenx; px++) {
+			uint8_t color = 0;
+			bool pixelChanged = false;
+			if (px < screenx) {
+				color = gdata[py][px];
+				pixelChanged = (color != gdataShadow[py][px]);
+			}
+			if (pixelChanged) {
 				gdataShadow[py][px] = color;
 				changed = true;
-				GraphicDrawPixel(px, py, color);
+				if (runLength == 0) {
+					runStart = px;
+				}
+				row[runLength] = GraphicColorConvert(color);
+				runLength++;
+			} else if (runLength) {
+				menu_screen_blit(runStart, py, runLength, 1, row);
+				runLength = 0;
 			}
 		}
 	}
@@ -298,4 +298,14 @@
 
 
 
+/*---------------------------------------------------------------------------/
+/ diskio Configurations
+/---------------------------------------------------------------------------*/
+
+#define DISK_CACHE_SECTORS	4
+#define DISK_CACHE_TIMEOUT	1000
+/* Write-back sector cache of diskio.c, see there. */
+
+
+
 /*--- End of configuration options ---*/
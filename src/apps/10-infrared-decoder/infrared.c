@@ -149,6 +149,7 @@ void AppCycle(void) {
 	if (guiUpdate) {
 		GuiCycle(input);
 	}
+	FilesystemBackground();
 	/* Call this function 1000x per second, if one cycle took more than 1ms,
 	   we skip the wait to catch up with calling.
 	   cycleTick last is needed to prevent endless wait in the case of a 32bit
@@ -67,3 +67,9 @@
   This doubles the required stack.
 */
 #define FB_TWOBUFFERS
+
+/*Up to 4 output blocks are merged into one rectangle, so a flush needs fewer
+  window setups and transfers. With FB_TWOBUFFERS this costs 8KiB of static RAM
+  instead of 2KiB of stack.
+*/
+#define FB_COALESCE_BLOCKS 4
@@ -135,6 +135,7 @@ void AppCycle(void) {
 		printf("Gui redraw needs up to %ums\r\n", (unsigned int)delta);
 		guiTickPerformance = delta;
 	}
+	FilesystemBackground();
 	/* Call this function 1000x per second, if one cycle took more than 1ms,
 	   we skip the wait to catch up with calling.
 	   cycleTick last is needed to prevent endless wait in the case of a 32bit
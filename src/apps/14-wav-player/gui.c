@@ -99,6 +99,8 @@ void GuiUpdateFilelist(void) {
 void GuiUpdateText(void) {
 	PlayerFileGetMeta(g_gui.attributes, sizeof(g_gui.attributes));
 	PlayerFileGetState(g_gui.state, sizeof(g_gui.state));
+	menu_text_changed(MENU_TEXT_ATTRIBUTES);
+	menu_text_changed(MENU_TEXT_STATE);
 }
 
 void GuiFileSelect(uint16_t index) {
@@ -252,7 +254,7 @@ void GuiCycle(char key) {
 	g_gui.cycle++;
 	if (g_gui.cycle == 500) { //run every 500ms
 		GuiUpdateText();
-		menu_redraw();
+		menu_redraw_dirty();
 		g_gui.cycle = 0;
 	}
 }
@@ -20,6 +20,7 @@ SPDX-License-Identifier: GPL-3.0-or-later
 #include "boxlib/flash.h"
 #include "boxlib/peripheral.h"
 #include "boxlib/sequenceToPwm.h"
+#include "boxlib/spiExternal.h"
 #include "boxlib/coproc.h"
 #include "boxlib/mcu.h"
 #include "femtoVsnprintf.h"
@@ -27,9 +28,14 @@ SPDX-License-Identifier: GPL-3.0-or-later
 #include "filesystem.h"
 #include "gui.h"
 #include "main.h"
+#include "powerControl.h"
+#include "sdmmcAccess.h"
 #include "utility.h"
 #include "wav.h"
 
+//the SD card is on the external SPI, powered by powerControl.h
+#define SD_CHIPSELECT 1
+
 //should buffer 0.5s at 8bit, 44100Hz, mono
 #define FIFO_SIZE 22050
 
@@ -255,6 +261,29 @@ void PlayerFileGetState(char * text, size_t maxLen) {
 	}
 }
 
+/*Powers the SD card and if it has a filesystem, drive 1 becomes the current
+  drive. So the GUI shows the files of the card instead of the flash.
+*/
+static void SdcardMount(void) {
+	/*The order of the sequence is important, otherwise the input pins of the SD
+	  card might have a higher voltage than Vcc.*/
+	SdCardPowerOn();
+	HAL_Delay(1);
+	SpiExternalInit();
+	SpiExternalPrescaler(256); //the init needs 100...400kHz
+	if (SdmmcInit(SpiExternalTransfer, SD_CHIPSELECT) != 0) {
+		printf("No SD card found\r\n");
+		SpiExternalDeinit();
+		HAL_Delay(1);
+		SdCardPowerOff();
+		return;
+	}
+	SpiExternalPrescaler(4); //20MHz
+	if ((FilesystemMountSdcard()) && (f_chdrive("1:") == FR_OK)) {
+		printf("Using the SD card with %uMiB\r\n", (unsigned int)(SdmmcCapacity() / 2048));
+	}
+}
+
 void AppInit(void) {
 	LedsInit();
 	Led1Yellow();
@@ -274,6 +303,7 @@ void AppInit(void) {
 	PeripheralInit();
 	FlashEnable(4); //4MHz
 	FilesystemMount();
+	SdcardMount();
 	GuiInit();
 	Led1Off();
 	g_cycleTick = HAL_GetTick();
@@ -308,6 +338,7 @@ void AppCycle(void) {
 		}
 	}
 	GuiCycle(input);
+	FilesystemBackground();
 	/* Call this function 1000x per second, if one cycle took more than 1ms,
 	   we skip the wait to catch up with calling.
 	   cycleTick last is needed to prevent endless wait in the case of a 32bit
@@ -22,6 +22,7 @@ SPDX-License-Identifier: GPL-3.0-or-later
 #include "boxlib/peripheral.h"
 #include "boxlib/rs232debug.h"
 #include "boxlib/sequenceToPwm.h"
+#include "boxlib/spiExternal.h"
 #include "boxlib/stackSampler.h"
 #include "boxlib/timer32Bit.h"
 #include "femtoVsnprintf.h"
@@ -30,10 +31,15 @@ SPDX-License-Identifier: GPL-3.0-or-later
 #include "gui.h"
 #include "main.h"
 #include "mad.h"
+#include "powerControl.h"
+#include "sdmmcAccess.h"
 #include "utility.h"
 
 #define SD_BLOCKSIZE 512
 
+//the SD card is on the external SPI, powered by powerControl.h
+#define SD_CHIPSELECT 1
+
 /*The behaviour of libmad is mostly undocumented.
   According to https://lists.mars.org/hyperkitty/list/mad-dev@lists.mars.org/message/23ACZCLN3DMTR62GDAQNBGNUUMXORWYR/
   the maximum mp3 frame size is 2881 bytes, then libmad needs 8 additional guard bytes.
@@ -405,6 +411,29 @@ void PlayerFileGetState(char * text, size_t maxLen) {
 	}
 }
 
+/*Powers the SD card and if it has a filesystem, drive 1 becomes the current
+  drive. So the GUI shows the files of the card instead of the flash.
+*/
+static void SdcardMount(void) {
+	/*The order of the sequence is important, otherwise the input pins of the SD
+	  card might have a higher voltage than Vcc.*/
+	SdCardPowerOn();
+	HAL_Delay(1);
+	SpiExternalInit();
+	SpiExternalPrescaler(256); //the init needs 100...400kHz
+	if (SdmmcInit(SpiExternalTransfer, SD_CHIPSELECT) != 0) {
+		printf("No SD card found\r\n");
+		SpiExternalDeinit();
+		HAL_Delay(1);
+		SdCardPowerOff();
+		return;
+	}
+	SpiExternalPrescaler(4); //20MHz
+	if ((FilesystemMountSdcard()) && (f_chdrive("1:") == FR_OK)) {
+		printf("Using the SD card with %uMiB\r\n", (unsigned int)(SdmmcCapacity() / 2048));
+	}
+}
+
 void AppInit(void) {
 	LedsInit();
 	Led1Yellow();
@@ -424,6 +453,7 @@ void AppInit(void) {
 	PeripheralInit();
 	FlashEnable(16); //5MHz
 	FilesystemMount();
+	SdcardMount();
 	GuiInit();
 	Led1Off();
 	g_cycleTick = HAL_GetTick();
@@ -153,7 +153,7 @@
 /  on character encoding. When LFN is not enabled, these options have no effect. */
 
 
-#define FF_FS_RPATH		0
+#define FF_FS_RPATH		1
 /* This option configures support for relative path.
 /
 /   0: Disable relative path and remove related functions.
@@ -166,7 +166,7 @@
 / Drive/Volume Configurations
 /---------------------------------------------------------------------------*/
 
-#define FF_VOLUMES		1
+#define FF_VOLUMES		2
 /* Number of volumes (logical drives) to be used. (1-10) */
 
 
@@ -298,4 +298,15 @@
 
 
 
+/*---------------------------------------------------------------------------/
+/ diskio Configurations
+/---------------------------------------------------------------------------*/
+
+#define DISK_SDCARD		1
+/* DISK_SDCARD enables the SD card as drive 1 (DEV_SDCARD) in diskio.c. The
+/  card is accessed by sdmmcAccess.c, so the SPI transfers use DMA if the
+/  application links spiExternalDma.c. Needs FF_VOLUMES >= 2. */
+
+
+
 /*--- End of configuration options ---*/
@@ -0,0 +1,9 @@
+#include "powerControl.h"
+
+//The simulated SD card of spiExternal.c is always powered
+
+void SdCardPowerOn(void) {
+}
+
+void SdCardPowerOff(void) {
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+void SdCardPowerOn(void);
+
+void SdCardPowerOff(void);
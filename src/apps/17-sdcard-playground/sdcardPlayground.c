@@ -28,6 +28,9 @@ This program can help identifying if this is the case. (Rescue must be done by a
 -If needed a power cycle can be done after each tried command. This however limits the speed to a few tries per second.
 -Optional reading a block can be done after each power cycle to check if the initialization is really successful.
 -Answer data can be dumped.
+-Measures the read and write speed with single and multiple block commands,
+  and the read speed of the asynchronous DMA reads.
+  The write benchmark writes back the data just read, so the card content is kept.
 
 Limits:
   -Commands needing a stop command, like read multiple or write multiple will not work properly.
@@ -107,6 +110,12 @@ The readme.md provides a sample setup to read all blocks.
 //printing is really slow...
 #define PRINT_LIMIT 6400
 
+//Blocks per SdmmcRead and SdmmcWrite call of the benchmark, must fit into g_dataIn
+#define BENCH_BLOCKS_MAX 64
+
+//Blocks read and written with each benchmark setting, starting with READ_BLOCK_CHECK
+#define BENCH_BLOCKS_TOTAL 1024
+
 static uint32_t g_resetTime; //measured on power up
 static uint32_t g_waitTime; //measured on power up
 static uint32_t g_prescalerInit; //measured on power up, limited by g_minDivder
@@ -177,6 +186,7 @@ void Help(void) {
 	printf("g: Print waiting statistics\r\n");
 	printf("h: This text\r\n");
 	printf("i: Set minimum SPI divider\r\n");
+	printf("j: Benchmark single, multiple block and async transfers\r\n");
 	printf("r: Reboot\r\n");
 }
 
@@ -956,6 +966,104 @@ void PrintWaitingStats(void) {
 	}
 }
 
+static_assert(sizeof(g_dataIn) >= (BENCH_BLOCKS_MAX * SDMMC_BLOCKSIZE), "Increase TRANSFER_LEN_MAX");
+
+/*Reads BENCH_BLOCKS_TOTAL blocks with blocksPerCall blocks per SdmmcRead,
+  and writes the read data back.
+  Returns false if a transfer failed.
+*/
+static bool BenchmarkRun(uint32_t blocksPerCall, uint32_t * pReadMs, uint32_t * pWriteMs) {
+	uint32_t readMs = 0;
+	uint32_t writeMs = 0;
+	for (uint32_t block = 0; block < BENCH_BLOCKS_TOTAL; block += blocksPerCall) {
+		uint32_t blocks = MIN(blocksPerCall, BENCH_BLOCKS_TOTAL - block);
+		uint32_t tStart = HAL_GetTick();
+		if (!SdmmcRead(g_dataIn, READ_BLOCK_CHECK + block, blocks)) {
+			printf("Error, reading block %u failed\r\n", (unsigned int)(READ_BLOCK_CHECK + block));
+			return false;
+		}
+		uint32_t tRead = HAL_GetTick();
+		if (!SdmmcWrite(g_dataIn, READ_BLOCK_CHECK + block, blocks)) {
+			printf("Error, writing block %u failed\r\n", (unsigned int)(READ_BLOCK_CHECK + block));
+			return false;
+		}
+		uint32_t tWrite = HAL_GetTick();
+		readMs += tRead - tStart;
+		writeMs += tWrite - tRead;
+	}
+	*pReadMs = MAX(readMs, 1);
+	*pWriteMs = MAX(writeMs, 1);
+	return true;
+}
+
+/*Reads BENCH_BLOCKS_TOTAL blocks with SdmmcReadStart and SdmmcReadPoll.
+  pPolls gets the number of SdmmcReadPoll calls returning busy, each is a
+  point where the CPU could do something else.
+  Returns false if a transfer failed.
+*/
+static bool BenchmarkAsyncRun(uint32_t blocksPerCall, uint32_t * pReadMs, uint32_t * pPolls) {
+	uint32_t polls = 0;
+	uint32_t tStart = HAL_GetTick();
+	for (uint32_t block = 0; block < BENCH_BLOCKS_TOTAL; block += blocksPerCall) {
+		uint32_t blocks = MIN(blocksPerCall, BENCH_BLOCKS_TOTAL - block);
+		if (!SdmmcReadStart(g_dataIn, READ_BLOCK_CHECK + block, blocks)) {
+			printf("Error, starting to read block %u failed\r\n", (unsigned int)(READ_BLOCK_CHECK + block));
+			return false;
+		}
+		sdmmcAsyncResult_t result;
+		while ((result = SdmmcReadPoll()) == SDMMC_ASYNC_BUSY) {
+			polls++;
+		}
+		if (result != SDMMC_ASYNC_DONE) {
+			printf("Error, reading block %u failed\r\n", (unsigned int)(READ_BLOCK_CHECK + block));
+			return false;
+		}
+	}
+	*pReadMs = MAX(HAL_GetTick() - tStart, 1);
+	*pPolls = polls;
+	return true;
+}
+
+void Benchmark(void) {
+	HardReset(g_resetTime);
+	if (CardInit() != 0) {
+		printf("Error, could not initialize SD card\r\n");
+		return;
+	}
+	SpiExternalPrescaler(g_prescalerInit);
+	uint32_t frequencykHz = F_CPU / g_prescalerInit / 1000;
+	printf("Benchmark with %ukHz SPI clock, %ukiB each\r\n", (unsigned int)frequencykHz,
+	       (unsigned int)(BENCH_BLOCKS_TOTAL * SDMMC_BLOCKSIZE / 1024));
+	const uint32_t blocksPerCall[] = {1, 8, BENCH_BLOCKS_MAX};
+	for (uint32_t multiblock = 0; multiblock < 2; multiblock++) {
+		SdmmcMultiblockSet(multiblock);
+		for (uint32_t i = 0; i < sizeof(blocksPerCall) / sizeof(uint32_t); i++) {
+			if ((multiblock) && (blocksPerCall[i] == 1)) {
+				continue; //single block commands are used anyway
+			}
+			CoprocWatchdogReset();
+			uint32_t readMs, writeMs;
+			if (!BenchmarkRun(blocksPerCall[i], &readMs, &writeMs)) {
+				break;
+			}
+			uint32_t bytes = BENCH_BLOCKS_TOTAL * SDMMC_BLOCKSIZE;
+			printf("%s, %2u blocks: read %4ukB/s, write %4ukB/s\r\n", multiblock ? "CMD18/CMD25" : "CMD17/CMD24",
+			       (unsigned int)blocksPerCall[i], (unsigned int)(bytes / readMs), (unsigned int)(bytes / writeMs));
+		}
+	}
+	SdmmcBackgroundSet(SpiExternalTransferBackground, SpiExternalTransferIsDone);
+	uint32_t readMs, polls;
+	if (BenchmarkAsyncRun(BENCH_BLOCKS_MAX, &readMs, &polls)) {
+		uint32_t bytes = BENCH_BLOCKS_TOTAL * SDMMC_BLOCKSIZE;
+		printf("Async CMD18, %2u blocks: read %4ukB/s, %u polls\r\n", (unsigned int)BENCH_BLOCKS_MAX,
+		       (unsigned int)(bytes / readMs), (unsigned int)polls);
+	}
+	if (!SdmmcMultiblockGet()) {
+		printf("Multiple block transfers got disabled, as they failed\r\n");
+	}
+	SdmmcMultiblockSet(true);
+}
+
 void AppInit(void) {
 	LedsInit();
 	Led1Red();
@@ -1010,6 +1118,7 @@ void AppCycle(void) {
 		case 'g': PrintWaitingStats(); break;
 		case 'h': Help(); break;
 		case 'i': MinDividerSet(); break;
+		case 'j': Benchmark(); break;
 		case 'r': ExecReset(); break;
 
 		default: break;
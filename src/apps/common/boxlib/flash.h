@@ -44,6 +44,26 @@ bool FlashPagesizePowertwoGet(void);
 //Thread safe if peripheralMt.c is used
 bool FlashRead(uint64_t address, uint8_t * buffer, size_t len);
 
+/*Like FlashRead, but the data can arrive in the background by DMA. Then
+  FlashReadBackgroundWait must be called before the buffer is used and before
+  any other flash or peripheral function. Without DMA, the read is done at once.
+  Thread safe if peripheralMt.c is used, the peripheral stays locked until
+  FlashReadBackgroundWait.
+*/
+bool FlashReadBackground(uint64_t address, uint8_t * buffer, size_t len);
+
+//Does nothing if no background read is running
+void FlashReadBackgroundWait(void);
+
+/*Selects the policy of FlashRead. With clockPrescaler = 0 (default), the
+  prescaler from FlashEnable and the low power read command are used.
+  Otherwise reads use clockPrescaler, and if the resulting SPI clock is above
+  15MHz, the high frequency continuous array read commands. This needs more
+  power, but gives a higher throughput for large sequential reads.
+  Not thread safe
+*/
+void FlashReadFastSet(uint32_t clockPrescaler);
+
 //Use for debug only.
 //Writes to the SRAM1 buffer, so no flash is actually written.
 //buffer must have FLASHPAGESIZE number of bytes.
@@ -57,6 +77,21 @@ from which.
 */
 bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len);
 
+/* Like FlashWrite, but each page is compared with the content of the flash first.
+Identical pages are not erased and programmed again, which is faster and reduces
+the wear. Intended for data which are often rewritten unchanged, like the FAT
+and directory sectors of a filesystem.
+If pagesSkipped is not NULL, it gets the number of identical pages.
+Thread safe if peripheralMt.c is used.
+*/
+bool FlashWriteCompare(uint64_t address, const uint8_t * buffer, size_t len, uint32_t * pagesSkipped);
+
+/* Number of pages programmed and skipped by FlashWrite and FlashWriteCompare
+since the start. Both pointers may be NULL.
+Thread safe if peripheralMt.c is used.
+*/
+void FlashWriteStatsGet(uint32_t * pagesWritten, uint32_t * pagesSkipped);
+
 //This should return the last FLASHPAGESIZE byte written by FlashWrite
 //or FlashWriteBuffer1 data
 //Intended for debug purpose
@@ -11,6 +11,8 @@ SPDX-License-Identifier: BSD-3-Clause
 
 #include "usbd_core.h"
 
+#include "simulated.h"
+
 usbd_device * g_pUsbDev;
 usbd_cfg_callback g_usbCfgCallback;
 usbd_ctl_callback g_usbControlCallback;
@@ -29,3 +31,11 @@ int32_t UsbStartAdv(usbd_device * usbDev, usbd_cfg_callback configCallback,
 void UsbStop(void) {
 }
 
+//Like on the device, the simulated USB interrupt can not run while locked
+void UsbLock(void) {
+	__disable_irq();
+}
+
+void UsbUnlock(void) {
+	__enable_irq();
+}
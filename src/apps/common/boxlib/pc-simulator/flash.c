@@ -9,6 +9,7 @@ SPDX-License-Identifier:  BSD-3-Clause
 #include <stdlib.h>
 #include <string.h>
 #include <stdio.h>
+#include <time.h>
 
 #include "boxlib/flash.h"
 
@@ -16,12 +17,81 @@ SPDX-License-Identifier:  BSD-3-Clause
 
 #define FLASHPAGESIZE 256
 
+/*Define FLASH_SIMULATE_TIMING to let the flash functions take about as long as
+  the stm32l452 driver with an AT45DB641E. FLASH_SIMULATE_SINGLE_BUFFER
+  additionally emulates the older driver, which erased each page with a
+  separate command and only used SRAM buffer 1, so both can be compared.
+  The times are the typical values from the datasheet.
+*/
+#ifndef FLASH_SIM_SPI_BASE_HZ
+#define FLASH_SIM_SPI_BASE_HZ 16000000ULL
+#endif
+
+#ifndef FLASH_SIM_ERASE_PROGRAM_US
+#define FLASH_SIM_ERASE_PROGRAM_US 8000
+#endif
+
+#ifndef FLASH_SIM_ERASE_US
+#define FLASH_SIM_ERASE_US 6000
+#endif
+
+#ifndef FLASH_SIM_PROGRAM_US
+#define FLASH_SIM_PROGRAM_US 1500
+#endif
+
+#ifndef FLASH_SIM_COMPARE_US
+#define FLASH_SIM_COMPARE_US 40
+#endif
+
+#define NSEC_IN_SEC 1000000000ULL
+
 uint8_t * g_flashData;
 size_t g_flashDataSize;
 uint32_t g_flashLastTransferred;
 
+uint32_t g_flashPrescaler = 1;
+uint32_t g_flashReadPrescaler;
+uint64_t g_flashBusyUntil; //in ns
+uint8_t g_flashBufferProgramming;
+uint32_t g_flashPagesWritten;
+uint32_t g_flashPagesSkipped;
+uint64_t g_flashWriteTime; //in ns
+
+static uint64_t FlashTimeNs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return ts.tv_sec * NSEC_IN_SEC + ts.tv_nsec;
+}
+
+static void FlashSleepUntil(uint64_t stamp) {
+#ifdef FLASH_SIMULATE_TIMING
+	struct timespec ts;
+	ts.tv_sec = stamp / NSEC_IN_SEC;
+	ts.tv_nsec = stamp % NSEC_IN_SEC;
+	while (clock_nanosleep(CLOCK_MONOTONIC, TIMER_ABSTIME, &ts, NULL) != 0);
+#else
+	(void)stamp;
+#endif
+}
+
+//The CPU is blocked while the data are sent over SPI
+static void FlashTransferTimePrescaler(size_t len, uint32_t prescaler) {
+	uint64_t spiHz = FLASH_SIM_SPI_BASE_HZ / prescaler;
+	FlashSleepUntil(FlashTimeNs() + len * 8 * NSEC_IN_SEC / spiHz);
+}
+
+static void FlashTransferTime(size_t len) {
+	FlashTransferTimePrescaler(len, g_flashPrescaler);
+}
+
+static void FlashBusyStart(uint32_t us) {
+	g_flashBusyUntil = FlashTimeNs() + us * 1000ULL;
+}
+
 void FlashEnable(uint32_t clockPrescaler) {
-	(void)clockPrescaler;
+	if (clockPrescaler) {
+		g_flashPrescaler = clockPrescaler;
+	}
 	//load from file
 	if (!g_flashData) {
 		g_flashDataSize = (1024 * 1024 * 8);
@@ -39,6 +109,15 @@ void FlashEnable(uint32_t clockPrescaler) {
 
 void FlashDisable(void) {
 	if (g_flashData) {
+#ifdef FLASH_SIMULATE_TIMING
+		uint32_t pages = g_flashPagesWritten + g_flashPagesSkipped;
+		if (pages) {
+			uint32_t timeMs = g_flashWriteTime / 1000000;
+			uint32_t speed = timeMs ? ((uint64_t)pages * FLASHPAGESIZE / timeMs) : 0;
+			printf("Written %u pages, skipped %u pages in %ums, %ukB/s\n", (unsigned int)g_flashPagesWritten,
+			       (unsigned int)g_flashPagesSkipped, (unsigned int)timeMs, (unsigned int)speed);
+		}
+#endif
 		printf("Saving simulated flash\n");
 		//save to file
 		FILE * f = fopen(FILENAME, "wb");
@@ -50,6 +129,11 @@ void FlashDisable(void) {
 }
 
 uint16_t FlashGetStatus(void) {
+#ifdef FLASH_SIMULATE_TIMING
+	if (FlashTimeNs() < g_flashBusyUntil) {
+		return 0x3D80; //Busy, 64MBit, 2^n pagesize
+	}
+#endif
 	return 0xBD80; //Ready, 64MBit, 2^n pagesize
 }
 
@@ -63,6 +147,8 @@ void FlashGetId(uint8_t * manufacturer, uint16_t * device) {
 }
 
 void FlashWaitNonBusy(void) {
+	FlashSleepUntil(g_flashBusyUntil);
+	g_flashBufferProgramming = 0;
 }
 
 void FlashPagesizePowertwoSet(void) {
@@ -72,26 +158,121 @@ bool FlashPagesizePowertwoGet(void) {
 	return true;
 }
 
+void FlashReadFastSet(uint32_t clockPrescaler) {
+	g_flashReadPrescaler = clockPrescaler;
+}
+
 bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
 	if ((g_flashData) && ((address + len) <= g_flashDataSize)) {
+		FlashWaitNonBusy();
+		if (g_flashReadPrescaler) {
+			//same command selection as the stm32l452 driver
+			uint64_t spiHz = FLASH_SIM_SPI_BASE_HZ / g_flashReadPrescaler;
+			size_t commandLen = (spiHz > 85000000) ? 6 : ((spiHz > 15000000) ? 5 : 4);
+			FlashTransferTimePrescaler(commandLen + len, g_flashReadPrescaler);
+		} else {
+			FlashTransferTime(4 + len);
+		}
 		memcpy(buffer, g_flashData + address, len);
 		return true;
 	}
 	return false;
 }
 
-bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+//There is no DMA for the flash, so the read is done at once
+bool FlashReadBackground(uint64_t address, uint8_t * buffer, size_t len) {
+	return FlashRead(address, buffer, len);
+}
+
+void FlashReadBackgroundWait(void) {
+}
+
+//Mirrors the sequence of commands and busy waits of the stm32l452 driver
+static void FlashWritePageTime(uint8_t bufferNum, bool compare, bool identical) {
+#ifdef FLASH_SIMULATE_SINGLE_BUFFER
+	(void)bufferNum;
+	(void)compare;
+	(void)identical;
+	FlashWaitNonBusy();
+	FlashTransferTime(4); //page erase
+	FlashBusyStart(FLASH_SIM_ERASE_US);
+	FlashWaitNonBusy();
+	FlashTransferTime(4 + FLASHPAGESIZE); //write to sram buffer 1
+	FlashWaitNonBusy();
+	FlashTransferTime(4); //sram 1 to flash without erase
+	FlashBusyStart(FLASH_SIM_PROGRAM_US);
+	FlashWaitNonBusy();
+#else
+	if ((g_flashBufferProgramming == bufferNum) || (g_flashBufferProgramming == 0)) {
+		FlashWaitNonBusy();
+	}
+	FlashTransferTime(4 + FLASHPAGESIZE); //write to sram buffer 1 or 2
+	FlashWaitNonBusy();
+	if (compare) {
+		FlashTransferTime(4); //compare flash with sram 1 or 2
+		FlashBusyStart(FLASH_SIM_COMPARE_US);
+		FlashWaitNonBusy();
+		if (identical) {
+			return;
+		}
+	}
+	FlashTransferTime(4); //sram 1 or 2 to flash with erase
+	FlashBusyStart(FLASH_SIM_ERASE_PROGRAM_US);
+	g_flashBufferProgramming = bufferNum;
+#endif
+}
+
+static bool FlashWritePages(uint64_t address, const uint8_t * buffer, size_t len, bool compare, uint32_t * pagesSkipped) {
 	if ((address % FLASHPAGESIZE) || (len % FLASHPAGESIZE)) {
 		return false;
 	}
 	if (!g_flashData) {
 		return false;
 	}
-	if ((g_flashData) && ((address + len) <= g_flashDataSize)) {
-		memcpy(g_flashData + address, buffer, len);
-		return true;
+	if ((address + len) > g_flashDataSize) {
+		return false;
+	}
+	uint64_t timeStart = FlashTimeNs();
+	uint32_t skippedNum = 0;
+	uint8_t bufferNum = ((len / FLASHPAGESIZE) % 2) ? 1 : 2;
+	while (len) {
+		bool identical = (memcmp(g_flashData + address, buffer, FLASHPAGESIZE) == 0);
+		FlashWritePageTime(bufferNum, compare, identical);
+		if ((compare) && (identical)) {
+			skippedNum++;
+		} else {
+			memcpy(g_flashData + address, buffer, FLASHPAGESIZE);
+			g_flashPagesWritten++;
+		}
+		bufferNum = 3 - bufferNum;
+		address += FLASHPAGESIZE;
+		buffer += FLASHPAGESIZE;
+		len -= FLASHPAGESIZE;
+	}
+	FlashWaitNonBusy();
+	g_flashPagesSkipped += skippedNum;
+	g_flashWriteTime += FlashTimeNs() - timeStart;
+	if (pagesSkipped) {
+		*pagesSkipped = skippedNum;
+	}
+	return true;
+}
+
+bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+	return FlashWritePages(address, buffer, len, false, NULL);
+}
+
+bool FlashWriteCompare(uint64_t address, const uint8_t * buffer, size_t len, uint32_t * pagesSkipped) {
+	return FlashWritePages(address, buffer, len, true, pagesSkipped);
+}
+
+void FlashWriteStatsGet(uint32_t * pagesWritten, uint32_t * pagesSkipped) {
+	if (pagesWritten) {
+		*pagesWritten = g_flashPagesWritten;
+	}
+	if (pagesSkipped) {
+		*pagesSkipped = g_flashPagesSkipped;
 	}
-	return false;
 }
 
 bool FlashReadBuffer1(uint8_t * buffer, uint32_t offset, size_t len) {
@@ -7,20 +7,26 @@ SPDX-License-Identifier:  BSD-3-Clause
 #include <stdbool.h>
 #include <stdint.h>
 #include <stdio.h>
+#include <stdlib.h>
 #include <string.h>
 #include <math.h>
 #include <pthread.h>
 #include <unistd.h>
 
+#ifndef LCD_HEADLESS
 #ifdef COMPILE_WINDOWS
 #include <windef.h>
 #endif
 #include <GL/gl.h>
 #include <GL/glut.h>
 #include <GL/freeglut.h>
+#endif
 
 #include "boxlib/lcd.h"
 
+#include "lcdPlatform.h"
+#include "utility.h"
+
 #include "boxlib/rs232debug.h"
 
 
@@ -62,6 +68,11 @@ SPDX-License-Identifier:  BSD-3-Clause
 #define LCD_COLOR_OUT_GREEN_MASK  (((1<<LCD_COLOR_OUT_GREEN_BITS) -1) << (LCD_COLOR_OUT_BLUE_BITS))
 #define LCD_COLOR_OUT_BLUE_MASK ((1<<LCD_COLOR_OUT_BLUE_BITS) -1)
 
+//column address, page address and memory write command with their parameters
+#define LCD_WINDOW_SETUP_BYTES 11
+
+#define LCD_SPI_HZ_DEFAULT 8000000
+
 
 bool g_lcdEnabled;
 
@@ -82,12 +93,47 @@ uint32_t g_dispy = 600;
 
 int g_redrawMax = 50; //redraw every x loops
 int g_loopCycle = 0;
-int g_loopMs = 10;
+int g_loopMs = 16;
 bool g_dataChanged;
 
-float g_screen[LCD_SCREEN_MAX_Y][LCD_SCREEN_MAX_X][3];
+//8 bit red, green and blue for every pixel, also the source of the texture
+uint8_t g_screen[LCD_SCREEN_MAX_Y][LCD_SCREEN_MAX_X][3];
 bool g_backlightOn;
 
+//Rectangles written since the last texture update, x2 and y2 are exclusive.
+//If there are too many, they get merged into one bounding box.
+typedef struct {
+	uint16_t x1;
+	uint16_t y1;
+	uint16_t x2;
+	uint16_t y2;
+} LcdDirtyRect_t;
+
+#define LCD_DIRTY_RECTS_MAX 32
+
+LcdDirtyRect_t g_dirtyRects[LCD_DIRTY_RECTS_MAX];
+uint32_t g_dirtyRectsNum;
+
+//conversion of the color components into 8 bit
+uint8_t g_colorRed[1 << LCD_COLOR_OUT_RED_BITS];
+uint8_t g_colorGreen[1 << LCD_COLOR_OUT_GREEN_BITS];
+uint8_t g_colorBlue[1 << LCD_COLOR_OUT_BLUE_BITS];
+
+bool g_lcdHeadless;
+bool g_lcdStatsPrint;
+uint32_t g_lcdSpiHz = LCD_SPI_HZ_DEFAULT;
+const char * g_lcdDumpPrefix;
+bool g_lcdDumpTga;
+//something was written since the last LcdWaitBackgroundDoneRelease
+bool g_lcdFrameChanged;
+//draw every pixel as round dot, set by LCD_DOTS=1
+bool g_lcdDots;
+
+LcdSimStats_t g_lcdStats;
+
+//only present if the menu interpreter is compiled with MENU_BYTE_STATS
+extern uint32_t menu_byte_fetches __attribute__((weak));
+
 bool g_keyLeft;
 bool g_keyRight;
 bool g_keyUp;
@@ -197,6 +243,10 @@ void LcdEnable(uint32_t clockPrescaler) {
 
 void LcdDisable(void) {
 	if (g_lcdEnabled) {
+		//the statistics are protected by g_guiMutex, so print before it gets destroyed
+		if (g_lcdStatsPrint) {
+			LcdSimStatsPrint();
+		}
 		g_lcdEnabled = false;
 		if (g_guiThread) {
 			pthread_join(g_guiThread, NULL);
@@ -213,6 +263,8 @@ void LcdBacklightOff(void) {
 	g_backlightOn = false;
 }
 
+#ifndef LCD_HEADLESS
+
 static void update_window_size(int width, int height) {
 	if ((g_dispx != (uint32_t)width) || (g_dispy != (uint32_t)height)) {
 		glViewport(0, 0, width, height);
@@ -251,46 +303,126 @@ static void drawRoundDot(float x, float y, float r, float g, float b) {
 	glPopMatrix();
 }
 
-static void DrawRectangle(float x, float y, float r, float g, float b) {
+#define LCD_DOT_MASK_SIZE 16
+
+GLuint g_screenTexture;
+GLuint g_dotTexture;
+
+static void TexturesInit(void) {
+	glPixelStorei(GL_UNPACK_ALIGNMENT, 1);
+	glGenTextures(1, &g_screenTexture);
+	glBindTexture(GL_TEXTURE_2D, g_screenTexture);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_NEAREST);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_CLAMP_TO_EDGE);
+	glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_CLAMP_TO_EDGE);
+	pthread_mutex_lock(&g_guiMutex);
+	glTexImage2D(GL_TEXTURE_2D, 0, GL_RGB, LCD_SCREEN_MAX_X, LCD_SCREEN_MAX_Y, 0, GL_RGB, GL_UNSIGNED_BYTE, g_screen);
+	g_dirtyRectsNum = 0;
+	pthread_mutex_unlock(&g_guiMutex);
+	if (g_lcdDots) {
+		//one round dot, repeated for every pixel and multiplied with the screen
+		uint8_t mask[LCD_DOT_MASK_SIZE][LCD_DOT_MASK_SIZE];
+		float center = (LCD_DOT_MASK_SIZE - 1) / 2.0;
+		float radius = LCD_DOT_MASK_SIZE / 2.0;
+		for (uint32_t y = 0; y < LCD_DOT_MASK_SIZE; y++) {
+			for (uint32_t x = 0; x < LCD_DOT_MASK_SIZE; x++) {
+				float distance = sqrtf((x - center) * (x - center) + (y - center) * (y - center));
+				float value = (radius - distance) / 1.5;
+				if (value < 0.0) {
+					value = 0.0;
+				}
+				if (value > 1.0) {
+					value = 1.0;
+				}
+				mask[y][x] = value * 255.0;
+			}
+		}
+		glGenTextures(1, &g_dotTexture);
+		glBindTexture(GL_TEXTURE_2D, g_dotTexture);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MIN_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_MAG_FILTER, GL_LINEAR);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_S, GL_REPEAT);
+		glTexParameteri(GL_TEXTURE_2D, GL_TEXTURE_WRAP_T, GL_REPEAT);
+		glTexImage2D(GL_TEXTURE_2D, 0, GL_LUMINANCE, LCD_DOT_MASK_SIZE, LCD_DOT_MASK_SIZE, 0, GL_LUMINANCE, GL_UNSIGNED_BYTE, mask);
+	}
+}
+
+//Only the rectangles written since the last call are transferred, g_guiMutex must be hold
+static void TextureUpdate(void) {
+	if (g_dirtyRectsNum == 0) {
+		return;
+	}
+	glBindTexture(GL_TEXTURE_2D, g_screenTexture);
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, LCD_SCREEN_MAX_X);
+	for (uint32_t i = 0; i < g_dirtyRectsNum; i++) {
+		const LcdDirtyRect_t * pRect = &g_dirtyRects[i];
+		glTexSubImage2D(GL_TEXTURE_2D, 0, pRect->x1, pRect->y1, pRect->x2 - pRect->x1, pRect->y2 - pRect->y1,
+		                GL_RGB, GL_UNSIGNED_BYTE, &g_screen[pRect->y1][pRect->x1][0]);
+	}
+	glPixelStorei(GL_UNPACK_ROW_LENGTH, 0);
+	g_dirtyRectsNum = 0;
+}
+
+//the texture coordinates u and v are given for the top left corner
+static void DrawScreenQuad(float u, float v) {
 	float xoffset, yoffset, xscale, yscale;
-	glPushMatrix();
-	glColor3f(r,g,b);
-	CalcScaleAndOffset(x, y, &xoffset, &yoffset, &xscale, &yscale);
-	glBegin(GL_TRIANGLE_FAN);
-	glVertex2f(xoffset + xscale, yoffset - yscale);
-	glVertex2f(xoffset - xscale, yoffset - yscale);
-	glVertex2f(xoffset - xscale, yoffset + yscale);
-	glVertex2f(xoffset + xscale, yoffset + yscale);
-	glVertex2f(xoffset - xscale, yoffset + yscale);
+	CalcScaleAndOffset(0, 0, &xoffset, &yoffset, &xscale, &yscale);
+	float left = xoffset - xscale;
+	float top = yoffset + yscale;
+	CalcScaleAndOffset(g_lcdWidth - 1, g_lcdHeight - 1, &xoffset, &yoffset, &xscale, &yscale);
+	float right = xoffset + xscale;
+	float bottom = yoffset - yscale;
+	glBegin(GL_QUADS);
+	glTexCoord2f(0.0, 0.0);
+	glVertex2f(left, top);
+	glTexCoord2f(u, 0.0);
+	glVertex2f(right, top);
+	glTexCoord2f(u, v);
+	glVertex2f(right, bottom);
+	glTexCoord2f(0.0, v);
+	glVertex2f(left, bottom);
 	glEnd();
-	glPopMatrix();
 }
 
+static void DrawScreen(void) {
+	float brightness = g_backlightOn ? 1.0 : 0.5;
+	glEnable(GL_TEXTURE_2D);
+	glBindTexture(GL_TEXTURE_2D, g_screenTexture);
+	glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_MODULATE);
+	glColor3f(brightness, brightness, brightness);
+	DrawScreenQuad((float)g_lcdWidth / LCD_SCREEN_MAX_X, (float)g_lcdHeight / LCD_SCREEN_MAX_Y);
+	if (g_lcdDots) {
+		glBindTexture(GL_TEXTURE_2D, g_dotTexture);
+		glTexEnvi(GL_TEXTURE_ENV, GL_TEXTURE_ENV_MODE, GL_REPLACE);
+		glEnable(GL_BLEND);
+		glBlendFunc(GL_ZERO, GL_SRC_COLOR);
+		DrawScreenQuad(g_lcdWidth, g_lcdHeight);
+		glDisable(GL_BLEND);
+	}
+	glDisable(GL_TEXTURE_2D);
+}
+
+//Runs with its own timer, the application thread only updates g_screen and the dirty rectangles
 static void redraw(int param) {
 	UNREFERENCED_PARAMETER(param);
 	g_loopCycle++;
 	pthread_mutex_lock(&g_guiMutex);
 	bool changed = false;
-	if ((g_dataChanged) || (g_loopCycle >= g_redrawMax))
+	if ((g_dataChanged) || (g_dirtyRectsNum) || (g_loopCycle >= g_redrawMax))
 	{
 		changed = true;
+		TextureUpdate();
+		uint8_t ledState[LEDS_NUM];
+		memcpy(ledState, g_ledState, sizeof(ledState));
+		g_dataChanged = false;
+		g_loopCycle = 0;
+		pthread_mutex_unlock(&g_guiMutex);
 		glClear(GL_COLOR_BUFFER_BIT);
-		for (uint32_t y = 0; y < g_lcdHeight; y++) {
-			for (uint32_t x = 0; x < g_lcdWidth; x++) {
-				float r = g_screen[y][x][0];
-				float g = g_screen[y][x][1];
-				float b = g_screen[y][x][2];
-				if (g_backlightOn == false) {
-					r /= 2.0;
-					g /= 2.0;
-					b /= 2.0;
-				}
-				DrawRectangle(x, y, r, g, b);
-			}
-		}
+		DrawScreen();
 		for (uint32_t i = 0; i < LEDS_NUM; i++) {
 			float r, g, b;
-			switch (g_ledState[i]) {
+			switch (ledState[i]) {
 				case 1:  r = 1.0; g = 0.0; b = 0.0; break;
 				case 2:  r = 0.0; g = 1.0; b = 0.0; break;
 				case 3:  r = 1.0; g = 1.0; b = 0.0; break;
@@ -298,10 +430,9 @@ static void redraw(int param) {
 			}
 			drawRoundDot(g_lcdWidth - LEDS_NUM * 16.0 + i * 16.0, g_lcdHeight + 8.0, r, g, b);
 		}
-		g_dataChanged = false;
-		g_loopCycle = 0;
+	} else {
+		pthread_mutex_unlock(&g_guiMutex);
 	}
-	pthread_mutex_unlock(&g_guiMutex);
 	if (changed) {
 		glutSwapBuffers();
 		glFlush();
@@ -393,11 +524,26 @@ void * GlutGui(void * parameter) {
 	glutCloseFunc(&GlutWindowClosed);
 	glutTimerFunc(g_loopMs, redraw, 0);
 	glClearColor(0.0,0.0,0.0,0.0);
+	TexturesInit();
 	glutMainLoop(); //does not return
 	pthread_exit(0);
 	return NULL;
 }
 
+#endif
+
+static void LcdColorTablesInit(void) {
+	for (uint32_t i = 0; i < (1 << LCD_COLOR_OUT_RED_BITS); i++) {
+		g_colorRed[i] = i * 255 / ((1 << LCD_COLOR_OUT_RED_BITS) - 1);
+	}
+	for (uint32_t i = 0; i < (1 << LCD_COLOR_OUT_GREEN_BITS); i++) {
+		g_colorGreen[i] = i * 255 / ((1 << LCD_COLOR_OUT_GREEN_BITS) - 1);
+	}
+	for (uint32_t i = 0; i < (1 << LCD_COLOR_OUT_BLUE_BITS); i++) {
+		g_colorBlue[i] = i * 255 / ((1 << LCD_COLOR_OUT_BLUE_BITS) - 1);
+	}
+}
+
 void LcdInit(eDisplay_t lcdType) {
 	if (!g_lcdEnabled) {
 		printf("Error, LCD must be enabled before init can be called\n");
@@ -418,9 +564,32 @@ void LcdInit(eDisplay_t lcdType) {
 		g_lcdWidth = 320;
 		g_lcdHeight = 240;
 	}
+#ifdef LCD_HEADLESS
+	g_lcdHeadless = true;
+#else
+	const char * headless = getenv("LCD_HEADLESS");
+	g_lcdHeadless = (headless) && (strcmp(headless, "0"));
+#endif
+	const char * stats = getenv("LCD_STATS");
+	g_lcdStatsPrint = g_lcdHeadless || ((stats) && (strcmp(stats, "0")));
+	const char * spiHz = getenv("LCD_SPI_HZ");
+	if ((spiHz) && (atoi(spiHz) > 0)) {
+		g_lcdSpiHz = atoi(spiHz);
+	}
+	g_lcdDumpPrefix = getenv("LCD_DUMP");
+	const char * dumpTga = getenv("LCD_DUMP_TGA");
+	g_lcdDumpTga = (dumpTga) && (strcmp(dumpTga, "0"));
+	const char * dots = getenv("LCD_DOTS");
+	g_lcdDots = (dots) && (strcmp(dots, "0"));
+	LcdColorTablesInit();
 	if (pthread_mutex_init(&g_guiMutex, NULL) == 0) {
-		pthread_create(&g_guiThread, NULL, &GlutGui, NULL);
+#ifndef LCD_HEADLESS
+		if (!g_lcdHeadless) {
+			pthread_create(&g_guiThread, NULL, &GlutGui, NULL);
+		}
+#endif
 		LcdTestpattern();
+		LcdSimStatsReset();
 	} else {
 		printf("Error, internal\n");
 	}
@@ -431,33 +600,61 @@ static void LcdWritePixelNolock(uint16_t x, uint16_t y, uint16_t color) {
 	//the physical LCD needs the colors in msb first, so we have to convert back here
 	color = (color << 8) | (color >> 8);
 	if ((x < LCD_SCREEN_MAX_X) && (y < LCD_SCREEN_MAX_Y)) {
-		float r = 0.0, g = 0.0, b = 0.0;
-		uint32_t ri = (color & LCD_COLOR_OUT_RED_MASK) >> LCD_COLOR_OUT_RED_LSB_POS;
-		uint32_t gi = (color & LCD_COLOR_OUT_GREEN_MASK) >> LCD_COLOR_OUT_GREEN_LSB_POS;
-		uint32_t bi = (color & LCD_COLOR_OUT_BLUE_MASK) >> LCD_COLOR_OUT_BLUE_LSB_POS;
-		float rmax = (1<<LCD_COLOR_OUT_RED_BITS) -1;
-		float gmax = (1<<LCD_COLOR_OUT_GREEN_BITS) -1;
-		float bmax = (1<<LCD_COLOR_OUT_BLUE_BITS) -1;
-		//printf("%x %i %f %u %x\n", color, ri, rmax, MENU_COLOR_OUT_RED_LSB_POS, MENU_COLOR_OUT_RED_MASK);
-		if (rmax) {
-			r = 1.0/rmax*(float)ri;
+		uint8_t * pPixel = g_screen[y][x];
+		pPixel[0] = g_colorRed[(color & LCD_COLOR_OUT_RED_MASK) >> LCD_COLOR_OUT_RED_LSB_POS];
+		pPixel[1] = g_colorGreen[(color & LCD_COLOR_OUT_GREEN_MASK) >> LCD_COLOR_OUT_GREEN_LSB_POS];
+		pPixel[2] = g_colorBlue[(color & LCD_COLOR_OUT_BLUE_MASK) >> LCD_COLOR_OUT_BLUE_LSB_POS];
+	}
+}
+
+//Remembers the area for the next texture update, g_guiMutex must be hold
+static void LcdDirtyAdd(uint32_t x, uint32_t y, uint32_t width, uint32_t height) {
+	if ((x >= LCD_SCREEN_MAX_X) || (y >= LCD_SCREEN_MAX_Y) || (width == 0) || (height == 0)) {
+		return;
+	}
+	uint16_t x2 = MIN(x + width, LCD_SCREEN_MAX_X);
+	uint16_t y2 = MIN(y + height, LCD_SCREEN_MAX_Y);
+	if (g_dirtyRectsNum) {
+		LcdDirtyRect_t * pLast = &g_dirtyRects[g_dirtyRectsNum - 1];
+		if ((x >= pLast->x1) && (y >= pLast->y1) && (x2 <= pLast->x2) && (y2 <= pLast->y2)) {
+			return; //already covered
 		}
-		if (gmax) {
-			g = 1.0/gmax*(float)gi;
+		//pixels and lines written one after another
+		if ((pLast->y1 == y) && (pLast->y2 == y2) && (pLast->x2 == x)) {
+			pLast->x2 = x2;
+			return;
 		}
-		if (bmax) {
-			b = 1.0/bmax*(float)bi;
+		if ((pLast->x1 == x) && (pLast->x2 == x2) && (pLast->y2 == y)) {
+			pLast->y2 = y2;
+			return;
 		}
-		g_screen[y][x][0] = r;
-		g_screen[y][x][1] = g;
-		g_screen[y][x][2] = b;
-		g_dataChanged = true;
 	}
+	if (g_dirtyRectsNum == LCD_DIRTY_RECTS_MAX) {
+		LcdDirtyRect_t * pBox = &g_dirtyRects[0];
+		for (uint32_t i = 1; i < g_dirtyRectsNum; i++) {
+			pBox->x1 = MIN(pBox->x1, g_dirtyRects[i].x1);
+			pBox->y1 = MIN(pBox->y1, g_dirtyRects[i].y1);
+			pBox->x2 = MAX(pBox->x2, g_dirtyRects[i].x2);
+			pBox->y2 = MAX(pBox->y2, g_dirtyRects[i].y2);
+		}
+		g_dirtyRectsNum = 1;
+	}
+	LcdDirtyRect_t * pRect = &g_dirtyRects[g_dirtyRectsNum];
+	pRect->x1 = x;
+	pRect->y1 = y;
+	pRect->x2 = x2;
+	pRect->y2 = y2;
+	g_dirtyRectsNum++;
 }
 
 void LcdWritePixel(uint16_t x, uint16_t y, uint16_t color) {
 	pthread_mutex_lock(&g_guiMutex);
 	LcdWritePixelNolock(x, y, color);
+	LcdDirtyAdd(x, y, 1, 1);
+	g_lcdStats.pixelCalls++;
+	g_lcdStats.pixels++;
+	g_lcdStats.spiBytes += LCD_WINDOW_SETUP_BYTES + sizeof(uint16_t);
+	g_lcdFrameChanged = true;
 	pthread_mutex_unlock(&g_guiMutex);
 }
 
@@ -466,6 +663,7 @@ void LcdDrawHLine(uint16_t color, uint16_t x, uint16_t y, uint16_t length) {
 	for (uint32_t i = 0; i < length; i++) {
 		LcdWritePixelNolock(x + i, y, color);
 	}
+	LcdDirtyAdd(x, y, length, 1);
 	pthread_mutex_unlock(&g_guiMutex);
 }
 
@@ -474,6 +672,7 @@ void LcdDrawVLine(uint16_t color, uint16_t x, uint16_t y, uint16_t length) {
 	for (uint32_t i = 0; i < length; i++) {
 		LcdWritePixelNolock(x, y + i, color);
 	}
+	LcdDirtyAdd(x, y, 1, length);
 	pthread_mutex_unlock(&g_guiMutex);
 }
 
@@ -489,6 +688,11 @@ void LcdWriteRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const
 			}
 		}
 	}
+	LcdDirtyAdd(x, y, width, height);
+	g_lcdStats.rectCalls++;
+	g_lcdStats.pixels += width * height;
+	g_lcdStats.spiBytes += LCD_WINDOW_SETUP_BYTES + width * height * sizeof(uint16_t);
+	g_lcdFrameChanged = true;
 	pthread_mutex_unlock(&g_guiMutex);
 }
 
@@ -497,6 +701,101 @@ void LcdWaitBackgroundDone(void) {
 
 void LcdWaitBackgroundDoneRelease(void) {
 	LcdWaitBackgroundDone();
+	pthread_mutex_lock(&g_guiMutex);
+	bool changed = g_lcdFrameChanged;
+	uint64_t frame = g_lcdStats.frames;
+	if (changed) {
+		g_lcdStats.frames++;
+		g_lcdFrameChanged = false;
+	}
+	pthread_mutex_unlock(&g_guiMutex);
+	if ((changed) && (g_lcdDumpPrefix)) {
+		char filename[256];
+		snprintf(filename, sizeof(filename), "%s%05u.%s", g_lcdDumpPrefix, (unsigned int)frame, g_lcdDumpTga ? "tga" : "ppm");
+		LcdSimFrameDump(filename);
+	}
+}
+
+void LcdSimStatsGet(LcdSimStats_t * pStats) {
+	pthread_mutex_lock(&g_guiMutex);
+	*pStats = g_lcdStats;
+	pthread_mutex_unlock(&g_guiMutex);
+}
+
+void LcdSimStatsReset(void) {
+	pthread_mutex_lock(&g_guiMutex);
+	memset(&g_lcdStats, 0, sizeof(g_lcdStats));
+	g_lcdFrameChanged = false;
+	pthread_mutex_unlock(&g_guiMutex);
+	if (&menu_byte_fetches) {
+		menu_byte_fetches = 0;
+	}
+}
+
+void LcdSimStatsPrint(void) {
+	LcdSimStats_t stats;
+	LcdSimStatsGet(&stats);
+	uint64_t spiUs = stats.spiBytes * 8 * 1000000 / g_lcdSpiHz;
+	printf("LCD statistics:\n");
+	printf("  Frames: %llu\n", (unsigned long long)stats.frames);
+	printf("  LcdWriteRect calls: %llu\n", (unsigned long long)stats.rectCalls);
+	printf("  LcdWritePixel calls: %llu\n", (unsigned long long)stats.pixelCalls);
+	printf("  Pixels: %llu\n", (unsigned long long)stats.pixels);
+	printf("  SPI bytes: %llu\n", (unsigned long long)stats.spiBytes);
+	printf("  SPI time at %uHz: %llums", (unsigned int)g_lcdSpiHz, (unsigned long long)(spiUs / 1000));
+	if (stats.frames) {
+		printf(", %lluus per frame", (unsigned long long)(spiUs / stats.frames));
+	}
+	printf("\n");
+	if (&menu_byte_fetches) {
+		printf("  Menu data bytes fetched: %u\n", (unsigned int)menu_byte_fetches);
+	}
+}
+
+bool LcdSimFrameDump(const char * filename) {
+	FILE * f = fopen(filename, "wb");
+	if (!f) {
+		printf("Error, could not create %s\n", filename);
+		return false;
+	}
+	size_t nameLen = strlen(filename);
+	bool tga = (nameLen >= 4) && (strcmp(filename + nameLen - 4, ".tga") == 0);
+	pthread_mutex_lock(&g_guiMutex);
+	uint16_t width = g_lcdWidth;
+	uint16_t height = g_lcdHeight;
+	if (tga) {
+		//uncompressed true color, origin top left
+		uint8_t header[18] = {0};
+		header[2] = 2;
+		header[12] = width & 0xFF;
+		header[13] = width >> 8;
+		header[14] = height & 0xFF;
+		header[15] = height >> 8;
+		header[16] = 24;
+		header[17] = 0x20;
+		fwrite(header, sizeof(header), 1, f);
+	} else {
+		fprintf(f, "P6\n%u %u\n255\n", width, height);
+	}
+	for (uint32_t y = 0; y < height; y++) {
+		uint8_t line[LCD_SCREEN_MAX_X][3];
+		for (uint32_t x = 0; x < width; x++) {
+			if (tga) { //blue, green, red
+				line[x][0] = g_screen[y][x][2];
+				line[x][1] = g_screen[y][x][1];
+				line[x][2] = g_screen[y][x][0];
+			} else {
+				line[x][0] = g_screen[y][x][0];
+				line[x][1] = g_screen[y][x][1];
+				line[x][2] = g_screen[y][x][2];
+			}
+		}
+		fwrite(line, width * 3, 1, f);
+	}
+	pthread_mutex_unlock(&g_guiMutex);
+	bool success = (ferror(f) == 0);
+	fclose(f);
+	return success;
 }
 
 
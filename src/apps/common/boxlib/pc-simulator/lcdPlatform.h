@@ -0,0 +1,38 @@
+#pragma once
+
+#include <stdbool.h>
+#include <stdint.h>
+
+/*Simulator only functions of the LCD.
+
+The following environment variables are evaluated by LcdInit:
+LCD_HEADLESS=1      Do not open a window, the LCD content is only kept in memory.
+                    Compiling with LCD_HEADLESS defined has the same effect and
+                    does not need GLUT at all.
+LCD_STATS=1         Print the transfer statistics when the LCD is disabled.
+                    Always enabled in the headless mode. Includes the number
+                    of menu_byte_get calls if the menu interpreter is
+                    compiled with MENU_BYTE_STATS.
+LCD_SPI_HZ=<clock>  SPI clock used to estimate the transfer time. Default is 8MHz.
+LCD_DUMP=<prefix>   Write every frame to <prefix>00000.ppm, <prefix>00001.ppm...
+LCD_DUMP_TGA=1      Use .tga instead of .ppm for LCD_DUMP.
+LCD_DOTS=1          Show every pixel as round dot in the window.
+*/
+
+typedef struct {
+	uint64_t rectCalls;  //calls of LcdWriteRect
+	uint64_t pixelCalls; //calls of LcdWritePixel
+	uint64_t pixels;     //pixels written by both functions
+	uint64_t spiBytes;   //bytes a real LCD would need, including the window setup
+	uint64_t frames;     //calls of LcdWaitBackgroundDoneRelease after something was written
+} LcdSimStats_t;
+
+void LcdSimStatsGet(LcdSimStats_t * pStats);
+
+void LcdSimStatsReset(void);
+
+//Prints the statistics together with the estimated time on the SPI bus
+void LcdSimStatsPrint(void);
+
+//Writes the current LCD content. A filename ending with .tga gives a TGA, otherwise a PPM file
+bool LcdSimFrameDump(const char * filename);
@@ -0,0 +1,371 @@
+/* Boxlib emulation
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Simulates a SDHC card in SPI mode on chip select SPI_SIM_SDCARD_CHIPSELECT,
+so sdmmcAccess.c runs unchanged on the PC. The card content is the file
+emulatedSdcard.bin, read and written block by block, so also images of
+several GiB can be used. Without the file, there is no card inserted.
+The usable size is rounded down to a multiple of 512KiB, as given by the CSD.
+An image can be created for example with:
+truncate -s 64M emulatedSdcard.bin && mkfs.vfat emulatedSdcard.bin
+
+Supported are the commands used by sdmmcAccess.c: CMD0, 8, 9, 12, 16, 17,
+18, 24, 25, 55, 58, 59 and ACMD41.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "boxlib/spiExternal.h"
+#include "boxlib/spiExternalDma.h"
+
+#define FILENAME "emulatedSdcard.bin"
+
+#ifndef SPI_SIM_SDCARD_CHIPSELECT
+#define SPI_SIM_SDCARD_CHIPSELECT 1
+#endif
+
+#define SDCARD_BLOCKSIZE 512
+
+//CSD version 2.0 has a granularity of 512KiB
+#define SDCARD_CSIZE_BLOCKS 1024
+
+//bytes the card signals busy after a write
+#define SDCARD_BUSY_BYTES 16
+
+#define R1_IDLE 0x01
+#define R1_ILLEGALCMD 0x04
+#define R1_CRCERROR 0x08
+#define R1_ADDRESSERROR 0x20
+
+#define DATA_ACCEPTED 0x05
+#define DATA_CRCERROR 0x0B
+
+typedef enum {
+	SD_COMMAND,
+	SD_READMULTIPLE,
+	SD_WRITESINGLE,
+	SD_WRITEMULTIPLE,
+} sdState_t;
+
+typedef struct {
+	FILE * f;
+	uint32_t blocks;
+	bool selected;
+	bool idle;
+	bool appCommand;
+	sdState_t state;
+	uint8_t command[6];
+	uint32_t commandLen;
+	uint32_t block; //next one to read or write
+	int32_t dataLen; //-1 while waiting for the data token
+	uint8_t data[SDCARD_BLOCKSIZE + 2];
+	//bytes the card sends next
+	uint8_t queue[SDCARD_BLOCKSIZE + 32];
+	uint32_t queueRead;
+	uint32_t queueWrite;
+} sdCard_t;
+
+sdCard_t g_sdCard;
+
+static void SdCardOpen(void) {
+	if (g_sdCard.f) {
+		return;
+	}
+	g_sdCard.f = fopen(FILENAME, "r+b");
+	if (g_sdCard.f) {
+		fseek(g_sdCard.f, 0, SEEK_END);
+		long size = ftell(g_sdCard.f);
+		g_sdCard.blocks = (size / (SDCARD_BLOCKSIZE * SDCARD_CSIZE_BLOCKS)) * SDCARD_CSIZE_BLOCKS;
+		printf("Simulated SD card with %uMiB\n", (unsigned int)(g_sdCard.blocks / 2048));
+	}
+}
+
+static void SdCardPush(uint8_t data) {
+	if ((g_sdCard.queueWrite - g_sdCard.queueRead) < sizeof(g_sdCard.queue)) {
+		g_sdCard.queue[g_sdCard.queueWrite % sizeof(g_sdCard.queue)] = data;
+		g_sdCard.queueWrite++;
+	}
+}
+
+static void SdCardQueueClear(void) {
+	g_sdCard.queueRead = 0;
+	g_sdCard.queueWrite = 0;
+}
+
+//CRC16-CCITT, as used for the data blocks
+static uint16_t SdCardCrc(const uint8_t * data, size_t len) {
+	uint16_t crc = 0;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i] << 8;
+		for (uint32_t j = 0; j < 8; j++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+static void SdCardPushData(const uint8_t * data, size_t len) {
+	SdCardPush(0xFE);
+	for (size_t i = 0; i < len; i++) {
+		SdCardPush(data[i]);
+	}
+	uint16_t crc = SdCardCrc(data, len);
+	SdCardPush(crc >> 8);
+	SdCardPush(crc);
+}
+
+static bool SdCardPushBlock(uint32_t block) {
+	uint8_t data[SDCARD_BLOCKSIZE];
+	if ((block >= g_sdCard.blocks) || (fseek(g_sdCard.f, (long)block * SDCARD_BLOCKSIZE, SEEK_SET)) ||
+	    (fread(data, 1, SDCARD_BLOCKSIZE, g_sdCard.f) != SDCARD_BLOCKSIZE)) {
+		SdCardPush(0x08); //data error token: out of range
+		return false;
+	}
+	SdCardPush(0xFF); //one byte access time
+	SdCardPushData(data, sizeof(data));
+	return true;
+}
+
+static void SdCardPushCsd(void) {
+	uint8_t csd[16] = {0x40, 0x0E, 0x00, 0x32, 0x5B, 0x59, 0x00, 0x00, 0x00, 0x00, 0x7F, 0x80, 0x0A, 0x40, 0x00, 0x01};
+	uint32_t csize = g_sdCard.blocks / SDCARD_CSIZE_BLOCKS - 1;
+	csd[7] = (csize >> 16) & 0x3F;
+	csd[8] = csize >> 8;
+	csd[9] = csize;
+	SdCardPush(0xFF);
+	SdCardPushData(csd, sizeof(csd));
+}
+
+static void SdCardBusy(void) {
+	for (uint32_t i = 0; i < SDCARD_BUSY_BYTES; i++) {
+		SdCardPush(0x00);
+	}
+}
+
+static void SdCardCommand(void) {
+	uint8_t index = g_sdCard.command[0] & 0x3F;
+	uint32_t arg = (g_sdCard.command[1] << 24) | (g_sdCard.command[2] << 16) |
+	               (g_sdCard.command[3] << 8) | g_sdCard.command[4];
+	bool appCommand = g_sdCard.appCommand;
+	g_sdCard.appCommand = false;
+	if (g_sdCard.state == SD_READMULTIPLE) {
+		if (index == 12) {
+			//a stuff byte, then the response
+			SdCardQueueClear();
+			SdCardPush(0xFF);
+			SdCardPush(0x00);
+			g_sdCard.state = SD_COMMAND;
+		}
+		return;
+	}
+	uint8_t r1 = g_sdCard.idle ? R1_IDLE : 0;
+	SdCardPush(0xFF); //one byte response time
+	switch (index) {
+		case 0:
+			g_sdCard.idle = true;
+			SdCardPush(R1_IDLE);
+			break;
+		case 8:
+			SdCardPush(r1);
+			SdCardPush(0x00);
+			SdCardPush(0x00);
+			SdCardPush((arg >> 8) & 0xF);
+			SdCardPush(arg);
+			break;
+		case 9:
+			SdCardPush(r1);
+			SdCardPushCsd();
+			break;
+		case 16:
+		case 59:
+			SdCardPush(r1);
+			break;
+		case 17:
+		case 18:
+			if (arg >= g_sdCard.blocks) {
+				SdCardPush(r1 | R1_ADDRESSERROR);
+				break;
+			}
+			SdCardPush(r1);
+			if (index == 17) {
+				SdCardPushBlock(arg);
+			} else {
+				g_sdCard.block = arg;
+				g_sdCard.state = SD_READMULTIPLE;
+			}
+			break;
+		case 24:
+		case 25:
+			if (arg >= g_sdCard.blocks) {
+				SdCardPush(r1 | R1_ADDRESSERROR);
+				break;
+			}
+			SdCardPush(r1);
+			g_sdCard.block = arg;
+			g_sdCard.dataLen = -1;
+			g_sdCard.state = (index == 24) ? SD_WRITESINGLE : SD_WRITEMULTIPLE;
+			break;
+		case 41:
+			if (appCommand) {
+				g_sdCard.idle = false;
+				SdCardPush(0x00);
+			} else {
+				SdCardPush(r1 | R1_ILLEGALCMD);
+			}
+			break;
+		case 55:
+			g_sdCard.appCommand = true;
+			SdCardPush(r1);
+			break;
+		case 58:
+			SdCardPush(r1);
+			//2.7...3.6V, power up and card capacity status bits after the init
+			SdCardPush(g_sdCard.idle ? 0x00 : 0xC0);
+			SdCardPush(0xFF);
+			SdCardPush(0x80);
+			SdCardPush(0x00);
+			break;
+		default:
+			SdCardPush(r1 | R1_ILLEGALCMD);
+	}
+}
+
+static void SdCardDataReceived(void) {
+	uint16_t crc = (g_sdCard.data[SDCARD_BLOCKSIZE] << 8) | g_sdCard.data[SDCARD_BLOCKSIZE + 1];
+	bool success = (crc == SdCardCrc(g_sdCard.data, SDCARD_BLOCKSIZE)) && (g_sdCard.block < g_sdCard.blocks);
+	if (success) {
+		fseek(g_sdCard.f, (long)g_sdCard.block * SDCARD_BLOCKSIZE, SEEK_SET);
+		success = fwrite(g_sdCard.data, 1, SDCARD_BLOCKSIZE, g_sdCard.f) == SDCARD_BLOCKSIZE;
+		fflush(g_sdCard.f);
+		g_sdCard.block++;
+	}
+	SdCardPush(success ? DATA_ACCEPTED : DATA_CRCERROR);
+	SdCardBusy();
+	g_sdCard.dataLen = -1;
+	if (g_sdCard.state == SD_WRITESINGLE) {
+		g_sdCard.state = SD_COMMAND;
+	}
+}
+
+//Returns the byte the card sends while receiving dataOut
+static uint8_t SdCardTransfer(uint8_t dataOut) {
+	uint8_t dataIn = 0xFF;
+	if ((g_sdCard.queueRead == g_sdCard.queueWrite) && (g_sdCard.state == SD_READMULTIPLE)) {
+		if (!SdCardPushBlock(g_sdCard.block)) {
+			g_sdCard.state = SD_COMMAND;
+		}
+		g_sdCard.block++;
+	}
+	if (g_sdCard.queueRead != g_sdCard.queueWrite) {
+		dataIn = g_sdCard.queue[g_sdCard.queueRead % sizeof(g_sdCard.queue)];
+		g_sdCard.queueRead++;
+		if (g_sdCard.queueRead == g_sdCard.queueWrite) {
+			SdCardQueueClear();
+		}
+	}
+	if ((g_sdCard.state == SD_WRITESINGLE) || (g_sdCard.state == SD_WRITEMULTIPLE)) {
+		if (g_sdCard.dataLen >= 0) {
+			g_sdCard.data[g_sdCard.dataLen] = dataOut;
+			g_sdCard.dataLen++;
+			if (g_sdCard.dataLen == sizeof(g_sdCard.data)) {
+				SdCardDataReceived();
+			}
+		} else if ((g_sdCard.state == SD_WRITESINGLE) && (dataOut == 0xFE)) {
+			g_sdCard.dataLen = 0;
+		} else if ((g_sdCard.state == SD_WRITEMULTIPLE) && (dataOut == 0xFC)) {
+			g_sdCard.dataLen = 0;
+		} else if ((g_sdCard.state == SD_WRITEMULTIPLE) && (dataOut == 0xFD)) {
+			//stop tran token, busy starts one byte later
+			SdCardPush(0xFF);
+			SdCardBusy();
+			g_sdCard.state = SD_COMMAND;
+		}
+		return dataIn;
+	}
+	if ((g_sdCard.commandLen == 0) && ((dataOut & 0xC0) != 0x40)) {
+		return dataIn;
+	}
+	g_sdCard.command[g_sdCard.commandLen] = dataOut;
+	g_sdCard.commandLen++;
+	if (g_sdCard.commandLen == sizeof(g_sdCard.command)) {
+		g_sdCard.commandLen = 0;
+		SdCardCommand();
+	}
+	return dataIn;
+}
+
+void SpiExternalBaseInit(void) {
+}
+
+void SpiExternalInit(void) {
+	SdCardOpen();
+}
+
+void SpiExternalDeinit(void) {
+	SpiExternalChipSelect(SPI_SIM_SDCARD_CHIPSELECT, false);
+	g_sdCard.idle = true;
+}
+
+void SpiExternalChipSelect(uint8_t chipSelect, bool selected) {
+	if (chipSelect != SPI_SIM_SDCARD_CHIPSELECT) {
+		return;
+	}
+	if ((g_sdCard.selected) && (!selected)) {
+		//the card stops sending, an unfinished command or data block is lost
+		SdCardQueueClear();
+		g_sdCard.commandLen = 0;
+		g_sdCard.state = SD_COMMAND;
+	}
+	g_sdCard.selected = selected;
+}
+
+void SpiExternalTransferPolling(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
+	if (chipSelect) {
+		SpiExternalChipSelect(chipSelect, true);
+	}
+	for (size_t i = 0; i < len; i++) {
+		uint8_t out = dataOut ? dataOut[i] : 0xFF;
+		uint8_t in = 0xFF;
+		if ((g_sdCard.f) && (g_sdCard.selected)) {
+			in = SdCardTransfer(out);
+		}
+		if (dataIn) {
+			dataIn[i] = in;
+		}
+	}
+	if ((chipSelect) && (resetChipSelect)) {
+		SpiExternalChipSelect(chipSelect, false);
+	}
+}
+
+void SpiExternalTransfer(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
+	SpiExternalTransferPolling(dataOut, dataIn, len, chipSelect, resetChipSelect);
+}
+
+/*There is no DMA on the PC, so the background transfer is done at once,
+  with the chip select state set by the previous transfers.
+*/
+void SpiExternalTransferBackground(const uint8_t * dataOut, uint8_t * dataIn, size_t len) {
+	SpiExternalTransferPolling(dataOut, dataIn, len, 0, false);
+}
+
+void SpiExternalTransferWaitDone(void) {
+}
+
+bool SpiExternalTransferIsDone(void) {
+	return true;
+}
+
+void SpiExternalTransferDma(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
+	SpiExternalTransferPolling(dataOut, dataIn, len, chipSelect, resetChipSelect);
+}
+
+void SpiExternalPrescaler(uint32_t prescaler) {
+	(void)prescaler;
+}
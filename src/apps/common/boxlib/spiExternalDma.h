@@ -1,5 +1,6 @@
 #pragma once
 
+#include <stdbool.h>
 #include <stdint.h>
 #include <stddef.h>
 
@@ -29,3 +30,9 @@ void SpiExternalTransfer(const uint8_t * dataOut, uint8_t * dataIn, size_t len,
   The chip select needs to be manually controlled.
 */
 void SpiExternalTransferBackground(const uint8_t * dataOut, uint8_t * dataIn, size_t len);
+
+/*Returns true if no background transfer is running anymore. Finishes a
+  completed transfer like SpiExternalTransferWaitDone, but never waits for the DMA.
+  This allows polling for the end while doing something else.
+*/
+bool SpiExternalTransferIsDone(void);
@@ -68,10 +68,63 @@ uint64_t FlashSizeGet(void) {
 	return SdmmcCapacity() * SDMMC_BLOCKSIZE;
 }
 
+//The SD card has no separate read commands for higher clocks
+void FlashReadFastSet(uint32_t clockPrescaler) {
+	(void)clockPrescaler;
+}
+
 bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
 	return SdmmcRead(buffer, address / SDMMC_BLOCKSIZE, len / SDMMC_BLOCKSIZE);
 }
 
+//SdmmcRead has no background mode, so the read is done at once
+bool FlashReadBackground(uint64_t address, uint8_t * buffer, size_t len) {
+	return FlashRead(address, buffer, len);
+}
+
+void FlashReadBackgroundWait(void) {
+}
+
+uint32_t g_flashBlocksWritten;
+uint32_t g_flashBlocksSkipped;
+
 bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
-	return SdmmcWrite(buffer, address / SDMMC_BLOCKSIZE, len / SDMMC_BLOCKSIZE);
+	bool success = SdmmcWrite(buffer, address / SDMMC_BLOCKSIZE, len / SDMMC_BLOCKSIZE);
+	if (success) {
+		g_flashBlocksWritten += len / SDMMC_BLOCKSIZE;
+	}
+	return success;
+}
+
+//A SD card has no compare command, so the blocks are read back instead
+bool FlashWriteCompare(uint64_t address, const uint8_t * buffer, size_t len, uint32_t * pagesSkipped) {
+	uint8_t current[SDMMC_BLOCKSIZE];
+	uint32_t block = address / SDMMC_BLOCKSIZE;
+	uint32_t blocks = len / SDMMC_BLOCKSIZE;
+	uint32_t skippedNum = 0;
+	for (uint32_t i = 0; i < blocks; i++) {
+		const uint8_t * data = buffer + i * SDMMC_BLOCKSIZE;
+		if ((SdmmcRead(current, block + i, 1)) && (memcmp(current, data, SDMMC_BLOCKSIZE) == 0)) {
+			skippedNum++;
+			continue;
+		}
+		if (!SdmmcWrite(data, block + i, 1)) {
+			return false;
+		}
+		g_flashBlocksWritten++;
+	}
+	g_flashBlocksSkipped += skippedNum;
+	if (pagesSkipped) {
+		*pagesSkipped = skippedNum;
+	}
+	return true;
+}
+
+void FlashWriteStatsGet(uint32_t * pagesWritten, uint32_t * pagesSkipped) {
+	if (pagesWritten) {
+		*pagesWritten = g_flashBlocksWritten;
+	}
+	if (pagesSkipped) {
+		*pagesSkipped = g_flashBlocksSkipped;
+	}
 }
@@ -58,11 +58,29 @@ void SpiExternalTransferWaitDone(void) {
 	g_spi2Started = 0;
 }
 
-void SpiExternalTransferDma(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
-	SpiExternalChipSelect(chipSelect, true);
+void SpiExternalTransferBackground(const uint8_t * dataOut, uint8_t * dataIn, size_t len) {
+	SpiExternalTransferWaitDone();
 	g_spi2Started = SpiPlatformTransferBackground(SPIPORT, DMASTREAMTX, DMASTREAMRX,
 	                &DMASTREAMTXCLEARREG, DMASTREAMTXCLEARFLAGS,
 	                &DMASTREAMRXCLEARREG, DMASTREAMRXCLEARFLAGS, dataOut, dataIn, len);
+}
+
+bool SpiExternalTransferIsDone(void) {
+	if (g_spi2Started) {
+		if ((DMASTREAMTXCOMPLETEREG & DMASTREAMTXCOMPLETEFLAG) == 0) {
+			return false;
+		}
+		if ((g_spi2Started == 2) && ((DMASTREAMRXCOMPLETEREG & DMASTREAMRXCOMPLETEFLAG) == 0)) {
+			return false;
+		}
+		SpiExternalTransferWaitDone();
+	}
+	return true;
+}
+
+void SpiExternalTransferDma(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
+	SpiExternalChipSelect(chipSelect, true);
+	SpiExternalTransferBackground(dataOut, dataIn, len);
 	SpiExternalTransferWaitDone();
 	if (resetChipSelect) {
 		SpiExternalChipSelect(chipSelect, false);
@@ -20,6 +20,7 @@ SPDX-License-Identifier:  BSD-3-Clause
 
 bool g_flashInit;
 uint32_t g_flashPrescaler;
+uint32_t g_flashReadPrescaler; //0: low power reads with g_flashPrescaler
 
 static void FlashCsOn(void) {
 	if (g_flashInit) {
@@ -89,13 +90,27 @@ void FlashGetId(uint8_t * manufacturer, uint16_t * device) {
 	PeripheralUnlockMt();
 }
 
-static void FlashWaitNonBusy(void) {
+/*Number of the SRAM buffer (1 or 2) which might still be programmed into the
+  flash array. 0 if no page program was started since the last busy wait, but
+  other commands might still keep the flash busy. Only accessed within
+  PeripheralLockMt.
+*/
+static uint8_t g_flashBufferProgramming;
+
+//Statistics for FlashWriteStatsGet. Only accessed within PeripheralLockMt.
+static uint32_t g_flashPagesWritten;
+static uint32_t g_flashPagesSkipped;
+
+//Returns the first byte of the status register
+static uint8_t FlashWaitNonBusy(void) {
 	uint8_t out[2] = {0xD7, 0};
 	uint8_t in[2] = {0};
 	do {
 		FlashTransfer(out, in, sizeof(out));
 		//highest bit shows ready. But if everything is 0, some error occurred
 	} while (((in[1] & 0x80) == 0) && (in[1] != 0));
+	g_flashBufferProgramming = 0;
+	return in[1];
 }
 
 void FlashPagesizePowertwoSet(void) {
@@ -117,22 +132,70 @@ bool FlashPagesizePowertwoGet(void) {
 	return false;
 }
 
-bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
-	uint8_t out[4];
+void FlashReadFastSet(uint32_t clockPrescaler) {
+	g_flashReadPrescaler = clockPrescaler;
+}
+
+/*Fills out with the read command and returns its length. The command depends
+  on the SPI clock resulting from g_flashReadPrescaler. The SPI2 is clocked by
+  PCLK1 and the prescaler is rounded up to the next power of two, like
+  SpiGenericPrescaler does.
+*/
+static size_t FlashReadCommand(uint32_t address, uint8_t * out) {
+	size_t len = 4;
 	out[0] = 0x01; //low power read up to 15MHz
+	if (g_flashReadPrescaler) {
+		uint32_t divider = 2;
+		while ((divider < g_flashReadPrescaler) && (divider < 256)) {
+			divider *= 2;
+		}
+		uint32_t spiHz = HAL_RCC_GetPCLK1Freq() / divider;
+		if (spiHz > 85000000) {
+			out[0] = 0x1B; //read up to 104MHz, two dummy bytes
+			len = 6;
+		} else if (spiHz > 15000000) {
+			out[0] = 0x0B; //read up to 85MHz, one dummy byte
+			len = 5;
+		}
+	}
 	out[1] = (address >> 16) & 0xFF;
 	out[2] = (address >> 8) & 0xFF;
 	out[3] = address & 0xFF;
+	out[4] = 0;
+	out[5] = 0;
+	return len;
+}
+
+static bool g_flashReadBackground;
+
+bool FlashReadBackground(uint64_t address, uint8_t * buffer, size_t len) {
+	uint8_t out[6];
 	if (g_flashInit) {
 		PeripheralLockMt();
-		PeripheralPrescaler(g_flashPrescaler);
+		size_t outLen = FlashReadCommand(address, out);
+		PeripheralPrescaler(g_flashReadPrescaler ? g_flashReadPrescaler : g_flashPrescaler);
 		FlashWaitNonBusy();
 		FlashCsOn();
-		PeripheralTransfer(out, NULL, sizeof(out));
+		PeripheralTransfer(out, NULL, outLen);
 		PeripheralTransferBackground(NULL, buffer, len);
+		g_flashReadBackground = true;
+		return true;
+	}
+	return false;
+}
+
+void FlashReadBackgroundWait(void) {
+	if (g_flashReadBackground) {
 		PeripheralTransferWaitDone();
 		FlashCsOff();
+		g_flashReadBackground = false;
 		PeripheralUnlockMt();
+	}
+}
+
+bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
+	if (FlashReadBackground(address, buffer, len)) {
+		FlashReadBackgroundWait();
 		return true;
 	}
 	return false;
@@ -140,10 +203,16 @@ bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
 
 
 
-static bool FlashWriteBuffer1Int(const uint8_t * buffer) {
+/*Loads a page into SRAM buffer 1 or 2. The AT45 accepts this while the other
+  buffer is programmed into the flash array, so we only wait if the same buffer
+  might still be in use.
+*/
+static bool FlashWriteBufferInt(uint8_t bufferNum, const uint8_t * buffer) {
 	uint8_t out[4];
-	FlashWaitNonBusy();
-	out[0] = 0x84; //write to sram buffer 1
+	if ((g_flashBufferProgramming == bufferNum) || (g_flashBufferProgramming == 0)) {
+		FlashWaitNonBusy();
+	}
+	out[0] = (bufferNum == 1) ? 0x84 : 0x87; //write to sram buffer 1 or 2
 	out[1] = 0x0;
 	out[2] = 0x0;
 	out[3] = 0x0;
@@ -154,61 +223,116 @@ static bool FlashWriteBuffer1Int(const uint8_t * buffer) {
 	return true;
 }
 
-
 bool FlashWriteBuffer1(const uint8_t * buffer) {
 	bool result;
 	PeripheralLockMt();
 	PeripheralPrescaler(g_flashPrescaler);
-	result = FlashWriteBuffer1Int(buffer);
+	result = FlashWriteBufferInt(1, buffer);
 	PeripheralUnlockMt();
 	return result;
 }
 
-//Thread safe if peripheralMt.c is used
-static bool FlashWritePage(uint32_t address, const uint8_t * buffer) {
+/*Thread safe if peripheralMt.c is used
+  Returns while the page is still programmed, so the next page can be loaded
+  into the other buffer in the meantime.
+  If compare is true, the page is only programmed if the flash content differs
+  from the buffer, otherwise skipped is set to true.
+*/
+static bool FlashWritePage(uint32_t address, const uint8_t * buffer, uint8_t bufferNum, bool compare, bool * skipped) {
 	//0. thread safetyness
 	PeripheralLockMt();
 	//1. set prescaler
 	PeripheralPrescaler(g_flashPrescaler);
-	//1. delete page
+	//2. send data to the buffer, while the previous page might still be programmed
+	bool success = FlashWriteBufferInt(bufferNum, buffer);
 	FlashWaitNonBusy();
 	uint8_t out[4];
-	out[0] = 0x81; //page erase
-	out[1] = (address >> 16) & 0xFF;
-	out[2] = (address >> 8) & 0xFF;
-	out[3] = address & 0xFF;
-	FlashTransfer(out, NULL, sizeof(out));
-	//2. send data to 1. buffer
-	bool success = FlashWriteBuffer1Int(buffer);
-	//3. write data to flash
-	FlashWaitNonBusy();
-	out[0] = 0x88; //sram 1 to flash without erase
+	*skipped = false;
+	if (compare) {
+		//3. compare flash page with the buffer
+		out[0] = (bufferNum == 1) ? 0x60 : 0x61; //compare flash with sram 1 or 2
+		out[1] = (address >> 16) & 0xFF;
+		out[2] = (address >> 8) & 0xFF;
+		out[3] = address & 0xFF;
+		FlashTransfer(out, NULL, sizeof(out));
+		uint8_t status = FlashWaitNonBusy();
+		//COMP bit cleared -> identical. All bits 0 would be no answer from the flash
+		if (((status & 0x40) == 0) && (status != 0)) {
+			*skipped = true;
+			g_flashPagesSkipped++;
+			PeripheralUnlockMt();
+			return success;
+		}
+	}
+	//4. erase and write data to flash with one command
+	out[0] = (bufferNum == 1) ? 0x83 : 0x86; //sram 1 or 2 to flash with erase
 	out[1] = (address >> 16) & 0xFF;
 	out[2] = (address >> 8) & 0xFF;
 	out[3] = address & 0xFF;
 	FlashTransfer(out, NULL, sizeof(out));
-	FlashWaitNonBusy();
-	//4. unlock
+	g_flashBufferProgramming = bufferNum;
+	g_flashPagesWritten++;
+	//5. unlock
 	PeripheralUnlockMt();
 	return success;
 }
 
-bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+static bool FlashWritePages(uint64_t address, const uint8_t * buffer, size_t len, bool compare, uint32_t * pagesSkipped) {
+	uint32_t skippedNum = 0;
 	if ((address % FLASHPAGESIZE) || (len % FLASHPAGESIZE)) {
 		return false;
 	}
 	if (!g_flashInit) {
 		return false;
 	}
+	/*Alternate between the two SRAM buffers. Select the first one in a way
+	  that the last page always goes through buffer 1, so FlashReadBuffer1 still
+	  returns the last written page.
+	*/
+	uint8_t bufferNum = ((len / FLASHPAGESIZE) % 2) ? 1 : 2;
+	bool success = true;
 	while (len) {
-		if (!FlashWritePage(address, buffer)) {
-			return false;
+		bool skipped;
+		if (!FlashWritePage(address, buffer, bufferNum, compare, &skipped)) {
+			success = false;
+			break;
 		}
+		if (skipped) {
+			skippedNum++;
+		}
+		bufferNum = 3 - bufferNum;
 		address += FLASHPAGESIZE;
 		buffer += FLASHPAGESIZE;
 		len -= FLASHPAGESIZE;
 	}
-	return true;
+	//the data should be in the flash array when returning
+	PeripheralLockMt();
+	PeripheralPrescaler(g_flashPrescaler);
+	FlashWaitNonBusy();
+	PeripheralUnlockMt();
+	if (pagesSkipped) {
+		*pagesSkipped = skippedNum;
+	}
+	return success;
+}
+
+bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+	return FlashWritePages(address, buffer, len, false, NULL);
+}
+
+bool FlashWriteCompare(uint64_t address, const uint8_t * buffer, size_t len, uint32_t * pagesSkipped) {
+	return FlashWritePages(address, buffer, len, true, pagesSkipped);
+}
+
+void FlashWriteStatsGet(uint32_t * pagesWritten, uint32_t * pagesSkipped) {
+	PeripheralLockMt();
+	if (pagesWritten) {
+		*pagesWritten = g_flashPagesWritten;
+	}
+	if (pagesSkipped) {
+		*pagesSkipped = g_flashPagesSkipped;
+	}
+	PeripheralUnlockMt();
 }
 
 bool FlashReadBuffer1(uint8_t * buffer, uint32_t offset, size_t len) {
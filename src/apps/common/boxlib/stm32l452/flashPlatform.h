@@ -2,3 +2,6 @@
 
 //let the first 4K for testing other non FS data
 #define DISK_RESERVEDOFFSET 4096
+
+//Stores the TRIM bitmap of diskio.c within the reserved area
+#define DISK_TRIMOFFSET 1024
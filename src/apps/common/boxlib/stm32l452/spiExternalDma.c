@@ -65,6 +65,19 @@ void SpiExternalTransferBackground(const uint8_t * dataOut, uint8_t * dataIn, si
 	g_spi1Started = SpiPlatformTransferBackground(SPIPORT, DMACHANNELTX, DMACHANNELRX, clearMask, dataOut, dataIn, len);true;
 }
 
+bool SpiExternalTransferIsDone(void) {
+	if (g_spi1Started) {
+		if (((DMA1->ISR) & DMACHANNELTXCOMPLETEFLAG) == 0) {
+			return false;
+		}
+		if ((g_spi1Started == 2) && (((DMA1->ISR) & DMACHANNELRXCOMPLETEFLAG) == 0)) {
+			return false;
+		}
+		SpiExternalTransferWaitDone();
+	}
+	return true;
+}
+
 void SpiExternalTransferDma(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect) {
 	SpiExternalChipSelect(chipSelect, true);
 	SpiExternalTransferBackground(dataOut, dataIn, len);
@@ -13,6 +13,7 @@ SPDX-License-Identifier: BSD-3-Clause
 #include "filesystem.h"
 
 #include "ff.h"
+#include "diskio.h"
 #include "json.h"
 #include "utility.h"
 
@@ -21,24 +22,55 @@ SPDX-License-Identifier: BSD-3-Clause
 
 FATFS g_fatfs;
 
-bool FilesystemMount(void) {
-	if (FlashReady() != true) {
-		printf("Error, no valid answer from flash\r\n");
-		return false;
-	}
+#if FF_VOLUMES > 1
+FATFS g_fatfsSdcard;
+#endif
+
+static bool FilesystemMountDrive(FATFS * pFatfs, const char * drive) {
 	FRESULT fres;
-	fres = f_mount(&g_fatfs, "0", 1);
+	fres = f_mount(pFatfs, drive, 1);
 	if (fres == FR_OK) {
 		return true;
 	} else if (fres == FR_NO_FILESYSTEM) {
-		printf("Warning, no filesystem\r\n");
+		printf("Warning, no filesystem on drive %s\r\n", drive);
 		return false;
 	} else {
-		printf("Error, mounting returned %u\r\n", (unsigned int)fres);
+		printf("Error, mounting drive %s returned %u\r\n", drive, (unsigned int)fres);
 		return false;
 	}
 }
 
+bool FilesystemMount(void) {
+	if (FlashReady() != true) {
+		printf("Error, no valid answer from flash\r\n");
+		return false;
+	}
+	return FilesystemMountDrive(&g_fatfs, "0");
+}
+
+void FilesystemBackground(void) {
+	if (g_fatfs.fs_type == 0) {
+		return;
+	}
+#if FF_FS_REENTRANT
+	//the volume is locked like the FatFs functions do, as they call diskio too
+	if (ff_req_grant(g_fatfs.sobj)) {
+		disk_background();
+		ff_rel_grant(g_fatfs.sobj);
+	}
+#else
+	disk_background();
+#endif
+}
+
+#if FF_VOLUMES > 1
+
+bool FilesystemMountSdcard(void) {
+	return FilesystemMountDrive(&g_fatfsSdcard, "1");
+}
+
+#endif
+
 bool FilesystemReadFile(const char * filename, void * data, size_t bufferLen, size_t * pReadLen) {
 	bool success = false;
 	FIL f;
@@ -103,7 +135,7 @@ bool FilesystemWriteFile(const char * filename, const void * data, size_t dataLe
 }
 
 bool FilesystemWriteEtcFile(const char * filename, const void * data, size_t dataLen) {
-	f_mkdir("/etc");
+	f_mkdir("0:/etc");
 	return FilesystemWriteFile(filename, data, dataLen);
 }
 
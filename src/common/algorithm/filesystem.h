@@ -6,13 +6,30 @@
 #include "boxlib/lcd.h"
 #include "ff.h"
 
-#define DISPLAYFILENAME "/etc/display.json"
+//The configuration is always on drive 0, even if another is the current drive
+#define DISPLAYFILENAME "0:/etc/display.json"
 
 extern FATFS g_fatfs;
 
 //assumes the filesystem is not mounted. Returns true if successful
 bool FilesystemMount(void);
 
+/*Runs disk_background() for drive 0, call it from the main loop. Writes the
+  delayed sectors of the diskio.c cache. Does nothing if drive 0 is not mounted.
+*/
+void FilesystemBackground(void);
+
+#if FF_VOLUMES > 1
+
+extern FATFS g_fatfsSdcard;
+
+/*Mounts the SD card as drive 1. SdmmcInit must have been successful before
+  and the diskio.c needs DISK_SDCARD set to 1. Returns true if successful.
+*/
+bool FilesystemMountSdcard(void);
+
+#endif
+
 //Requires a mounted filesystem
 eDisplay_t FilesystemReadLcd(void);
 
@@ -20,7 +37,7 @@ bool FilesystemReadFile(const char * filename, void * data, size_t bufferLen, si
 
 bool FilesystemWriteFile(const char * filename, const void * data, size_t dataLen);
 
-//Like FilesystemWriteFile, but creates the folder /etc before
+//Like FilesystemWriteFile, but creates the folder /etc on drive 0 before
 bool FilesystemWriteEtcFile(const char * filename, const void * data, size_t dataLen);
 
 void FilesystemWriteLcd(const char * lcdType);
@@ -0,0 +1,320 @@
+/* Boxlib
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier: BSD-3-Clause
+*/
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <string.h>
+
+#include "flashFtl.h"
+
+#include "boxlib/flash.h"
+
+#define FTL_MAGIC 0x314C5446 //"FTL1"
+
+#define FTL_UNMAPPED 0xFFFF
+
+_Static_assert(FTL_SLOTS_MAX < FTL_UNMAPPED, "The mapping table uses 16 bit");
+
+//Erased by us, can be programmed without erase
+#define SLOT_ERASED 0
+//The header looked erased in FtlInit, but a write could have been aborted
+#define SLOT_UNKNOWN 1
+//Outdated or broken content, needs an erase
+#define SLOT_STALE 2
+//Newest content of a logical sector
+#define SLOT_VALID 3
+
+/*A partially programmed or erased header can not pass the check of the
+  inverted copies, because programming only clears and erasing only sets bits.
+*/
+typedef struct {
+	uint32_t magic;
+	uint32_t sequence;
+	uint32_t sequenceInv;
+	uint32_t sector;
+	uint32_t sectorInv;
+} ftlHeader_t;
+
+uint64_t g_ftlOffset;
+uint32_t g_ftlPageSize;
+uint32_t g_ftlSlotSize;
+uint32_t g_ftlSlots;
+uint32_t g_ftlSectors;
+uint32_t g_ftlSequence; //for the next write
+uint32_t g_ftlWritePos; //slot written last, the next free one after it gets used
+uint32_t g_ftlWearPos;
+uint32_t g_ftlWearCounter;
+
+uint16_t g_ftlMap[FTL_SLOTS_MAX];
+uint8_t g_ftlSlotState[(FTL_SLOTS_MAX + 3) / 4]; //2 bits per slot
+
+ftlStats_t g_ftlStats;
+
+static uint8_t FtlStateGet(uint32_t slot) {
+	return (g_ftlSlotState[slot / 4] >> ((slot % 4) * 2)) & 3;
+}
+
+static void FtlStateSet(uint32_t slot, uint8_t state) {
+	uint8_t shift = (slot % 4) * 2;
+	g_ftlSlotState[slot / 4] = (g_ftlSlotState[slot / 4] & ~(3 << shift)) | (state << shift);
+}
+
+static uint64_t FtlSlotAddress(uint32_t slot) {
+	return g_ftlOffset + (uint64_t)slot * g_ftlSlotSize;
+}
+
+static bool FtlHeaderRead(uint32_t slot, ftlHeader_t * pHeader) {
+	return FlashRead(FtlSlotAddress(slot), (uint8_t *)pHeader, sizeof(ftlHeader_t));
+}
+
+static bool FtlHeaderValid(const ftlHeader_t * pHeader) {
+	return ((pHeader->magic == FTL_MAGIC) && (pHeader->sequence == ~pHeader->sequenceInv) &&
+	        (pHeader->sector == ~pHeader->sectorInv));
+}
+
+static bool FtlErased(const uint8_t * data, size_t len) {
+	for (size_t i = 0; i < len; i++) {
+		if (data[i] != 0xFF) {
+			return false;
+		}
+	}
+	return true;
+}
+
+static bool FtlDataErased(uint32_t slot) {
+	uint8_t data[64];
+	uint64_t address = FtlSlotAddress(slot) + g_ftlPageSize;
+	for (uint32_t i = 0; i < FTL_SECTORSIZE; i += sizeof(data)) {
+		if ((!FlashRead(address + i, data, sizeof(data))) || (!FtlErased(data, sizeof(data)))) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*The data pages are erased before the header. So if the erase gets aborted,
+  the header still marks the slot as outdated or the slot is SLOT_UNKNOWN.
+*/
+static bool FtlSlotErase(uint32_t slot) {
+	uint64_t address = FtlSlotAddress(slot);
+	if ((!FlashErase(address + g_ftlPageSize, FTL_SECTORSIZE)) || (!FlashErase(address, g_ftlPageSize))) {
+		return false;
+	}
+	FtlStateSet(slot, SLOT_ERASED);
+	return true;
+}
+
+bool FtlInit(uint64_t offset, uint64_t size) {
+	uint32_t pageSize = FlashBlocksizeGet();
+	if ((pageSize < sizeof(ftlHeader_t)) || (pageSize > FTL_SECTORSIZE) || (FTL_SECTORSIZE % pageSize)) {
+		return false;
+	}
+	g_ftlOffset = offset;
+	g_ftlPageSize = pageSize;
+	g_ftlSlotSize = pageSize + FTL_SECTORSIZE;
+	uint64_t slots = size / g_ftlSlotSize;
+	if (slots > FTL_SLOTS_MAX) {
+		slots = FTL_SLOTS_MAX;
+	}
+	if (slots <= FTL_SPARE_SLOTS) {
+		return false;
+	}
+	g_ftlSlots = slots;
+	g_ftlSectors = slots - FTL_SPARE_SLOTS;
+	memset(g_ftlMap, 0xFF, sizeof(g_ftlMap));
+	memset(&g_ftlStats, 0, sizeof(g_ftlStats));
+	bool found = false;
+	uint32_t sequenceMax = 0;
+	g_ftlWritePos = g_ftlSlots - 1;
+	for (uint32_t slot = 0; slot < g_ftlSlots; slot++) {
+		ftlHeader_t header;
+		if (!FtlHeaderRead(slot, &header)) {
+			return false;
+		}
+		if (FtlErased((const uint8_t *)&header, sizeof(header))) {
+			FtlStateSet(slot, SLOT_UNKNOWN);
+			continue;
+		}
+		if ((!FtlHeaderValid(&header)) || (header.sector >= g_ftlSectors)) {
+			FtlStateSet(slot, SLOT_STALE);
+			continue;
+		}
+		uint16_t other = g_ftlMap[header.sector];
+		if (other != FTL_UNMAPPED) {
+			//an older copy is only left if the erase has not been done yet
+			ftlHeader_t headerOther;
+			if (!FtlHeaderRead(other, &headerOther)) {
+				return false;
+			}
+			if (headerOther.sequence > header.sequence) {
+				FtlStateSet(slot, SLOT_STALE);
+				continue;
+			}
+			FtlStateSet(other, SLOT_STALE);
+		}
+		g_ftlMap[header.sector] = slot;
+		FtlStateSet(slot, SLOT_VALID);
+		if ((!found) || (header.sequence > sequenceMax)) {
+			found = true;
+			sequenceMax = header.sequence;
+			g_ftlWritePos = slot;
+		}
+	}
+	g_ftlSequence = found ? sequenceMax + 1 : 0;
+	g_ftlWearPos = g_ftlWritePos;
+	g_ftlWearCounter = 0;
+	return true;
+}
+
+uint32_t FtlSectorsGet(void) {
+	return g_ftlSectors;
+}
+
+bool FtlRead(uint32_t sector, uint8_t * buffer) {
+	if (sector >= g_ftlSectors) {
+		return false;
+	}
+	uint16_t slot = g_ftlMap[sector];
+	if (slot == FTL_UNMAPPED) {
+		memset(buffer, 0xFF, FTL_SECTORSIZE);
+		return true;
+	}
+	return FlashRead(FtlSlotAddress(slot) + g_ftlPageSize, buffer, FTL_SECTORSIZE);
+}
+
+static bool FtlWriteSlot(uint32_t sector, const uint8_t * buffer) {
+	uint32_t slot = g_ftlWritePos;
+	for (uint32_t i = 0; i < g_ftlSlots; i++) {
+		slot++;
+		if (slot == g_ftlSlots) {
+			slot = 0;
+		}
+		if (FtlStateGet(slot) != SLOT_VALID) {
+			break;
+		}
+	}
+	uint8_t state = FtlStateGet(slot);
+	if (state == SLOT_VALID) {
+		return false; //can not happen with FTL_SPARE_SLOTS > 0
+	}
+	if ((state == SLOT_UNKNOWN) && (!FtlDataErased(slot))) {
+		state = SLOT_STALE;
+	}
+	ftlHeader_t header;
+	header.magic = FTL_MAGIC;
+	header.sequence = g_ftlSequence;
+	header.sequenceInv = ~g_ftlSequence;
+	header.sector = sector;
+	header.sectorInv = ~sector;
+	uint8_t page[FTL_SECTORSIZE];
+	memset(page, 0xFF, g_ftlPageSize);
+	memcpy(page, &header, sizeof(header));
+	uint64_t address = FtlSlotAddress(slot);
+	bool success;
+	if (state == SLOT_STALE) {
+		//the old header must be gone before new data are in the slot
+		success = FlashErase(address, g_ftlPageSize) &&
+		          FlashWrite(address + g_ftlPageSize, buffer, FTL_SECTORSIZE);
+		g_ftlStats.writesErase++;
+	} else {
+		success = FlashWriteErased(address + g_ftlPageSize, buffer, FTL_SECTORSIZE);
+		g_ftlStats.writesErased++;
+	}
+	//the header makes the new content valid, so it must be written last
+	if ((!success) || (!FlashWriteErased(address, page, g_ftlPageSize))) {
+		FtlStateSet(slot, SLOT_STALE);
+		return false;
+	}
+	uint16_t old = g_ftlMap[sector];
+	if (old != FTL_UNMAPPED) {
+		FtlStateSet(old, SLOT_STALE);
+	}
+	g_ftlMap[sector] = slot;
+	FtlStateSet(slot, SLOT_VALID);
+	g_ftlWritePos = slot;
+	g_ftlSequence++;
+	return true;
+}
+
+//Moves the next valid slot, so its place can be used by frequently written sectors
+static bool FtlWearMove(void) {
+	uint32_t slot = g_ftlWearPos;
+	for (uint32_t i = 0; i < g_ftlSlots; i++) {
+		slot++;
+		if (slot == g_ftlSlots) {
+			slot = 0;
+		}
+		if (FtlStateGet(slot) == SLOT_VALID) {
+			break;
+		}
+	}
+	g_ftlWearPos = slot;
+	if (FtlStateGet(slot) != SLOT_VALID) {
+		return true; //nothing written so far
+	}
+	ftlHeader_t header;
+	uint8_t buffer[FTL_SECTORSIZE];
+	if ((!FtlHeaderRead(slot, &header)) || (!FtlRead(header.sector, buffer))) {
+		return false;
+	}
+	g_ftlStats.moves++;
+	return FtlWriteSlot(header.sector, buffer);
+}
+
+bool FtlWrite(uint32_t sector, const uint8_t * buffer) {
+	if (sector >= g_ftlSectors) {
+		return false;
+	}
+	g_ftlWearCounter++;
+	if (g_ftlWearCounter >= FTL_WEAR_INTERVAL) {
+		g_ftlWearCounter = 0;
+		if (!FtlWearMove()) {
+			return false;
+		}
+	}
+	return FtlWriteSlot(sector, buffer);
+}
+
+uint32_t FtlBackground(uint32_t maxSlots) {
+	uint32_t done = 0;
+	uint32_t slot = g_ftlWritePos;
+	for (uint32_t i = 0; (i < g_ftlSlots) && (done < maxSlots); i++) {
+		slot++;
+		if (slot == g_ftlSlots) {
+			slot = 0;
+		}
+		uint8_t state = FtlStateGet(slot);
+		if (state == SLOT_UNKNOWN) {
+			if (FtlDataErased(slot)) {
+				FtlStateSet(slot, SLOT_ERASED);
+				done++;
+				continue;
+			}
+			state = SLOT_STALE;
+		}
+		if (state == SLOT_STALE) {
+			if (!FtlSlotErase(slot)) {
+				break;
+			}
+			done++;
+		}
+	}
+	return done;
+}
+
+void FtlStatsGet(ftlStats_t * pStats) {
+	memcpy(pStats, &g_ftlStats, sizeof(ftlStats_t));
+	pStats->slotsErased = 0;
+	pStats->slotsStale = 0;
+	for (uint32_t slot = 0; slot < g_ftlSlots; slot++) {
+		uint8_t state = FtlStateGet(slot);
+		if (state == SLOT_ERASED) {
+			pStats->slotsErased++;
+		} else if (state != SLOT_VALID) {
+			pStats->slotsStale++;
+		}
+	}
+}
@@ -0,0 +1,86 @@
+#pragma once
+
+#include <stdint.h>
+#include <stdbool.h>
+#include <stddef.h>
+
+/*Log structured flash translation layer for FatFs on the external flash.
+
+Instead of erasing and programming a logical sector in place, every write goes
+to the next free slot. A slot is one header page followed by the data pages.
+As the AT45 has no spare bytes in the 2^n page mode, the header takes a full
+page. It contains the logical sector and a sequence number, so FtlInit can
+rebuild the mapping table in RAM by reading all headers.
+
+Slots are used round robin, so all free slots get a similar number of erase
+cycles. Additionally every FTL_WEAR_INTERVAL writes a valid slot gets moved, so
+rarely changed data does not keep its slots forever.
+Stale slots are erased by FtlBackground, so the following writes can program
+without erasing. The header is written last, so after a power loss a sector
+has either its old or its new content.
+
+RAM usage is 2.25 bytes per slot.
+
+The FTL is not used by diskio.c. All apps share the FAT volume on the external
+flash, so it can only be enabled for all of them together, with a conversion
+of the existing volume. Besides the functions of boxlib/flash.h, the FTL needs
+the two functions below. The boxlib flash drivers do not provide them.
+*/
+
+#define FTL_SECTORSIZE 512
+
+//Number of slots the tables are sized for, the default fits 8MiB with 256 byte pages
+#ifndef FTL_SLOTS_MAX
+#define FTL_SLOTS_MAX 10922
+#endif
+
+//Slots not available as logical sectors, so there is always a slot to write to
+#ifndef FTL_SPARE_SLOTS
+#define FTL_SPARE_SLOTS 64
+#endif
+
+//Every this number of writes, one valid slot gets moved for wear leveling
+#ifndef FTL_WEAR_INTERVAL
+#define FTL_WEAR_INTERVAL 64
+#endif
+
+/*Programs the pages without erasing them before. The pages must have been
+  erased by FlashErase, otherwise the result is the AND of the old and new content.
+  len must be a multiple of the page size.
+*/
+bool FlashWriteErased(uint64_t address, const uint8_t * buffer, size_t len);
+
+//Erases the pages, they read as 0xFF afterwards
+bool FlashErase(uint64_t address, size_t len);
+
+typedef struct {
+	uint32_t slotsErased; //can be written without erase
+	uint32_t slotsStale; //need to be erased before writing
+	uint32_t writesErased; //writes into erased slots
+	uint32_t writesErase; //writes which had to erase first
+	uint32_t moves; //slots moved for wear leveling
+} ftlStats_t;
+
+/*Uses size bytes of the flash, starting at offset. Reads all slot headers to
+  rebuild the mapping. FlashEnable must be called before.
+  If the flash has more than FTL_SLOTS_MAX slots, the remaining space is unused.
+  Returns false if the flash page size does not fit, the space is too small or
+  could not be read.
+*/
+bool FtlInit(uint64_t offset, uint64_t size);
+
+//Number of logical sectors with FTL_SECTORSIZE bytes
+uint32_t FtlSectorsGet(void);
+
+//Sectors never written read as 0xFF, like an erased flash
+bool FtlRead(uint32_t sector, uint8_t * buffer);
+
+bool FtlWrite(uint32_t sector, const uint8_t * buffer);
+
+/*Erases up to maxSlots stale slots, the ones next to be written first.
+  Call this when there is nothing else to do. Returns the number of slots
+  which got ready for writing without erase.
+*/
+uint32_t FtlBackground(uint32_t maxSlots);
+
+void FtlStatsGet(ftlStats_t * pStats);
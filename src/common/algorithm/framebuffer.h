@@ -8,6 +8,26 @@ void menu_screen_set(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE
 //Optional readback function, interesting to take a screenshot or similar things
 FB_COLOR_IN_TYPE menu_screen_get(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y);
 
+/*Optional readback of length pixels starting at x, y. Gives the same result
+  as calling menu_screen_get for every pixel, but unpacks the framebuffer
+  word by word.
+*/
+void menu_screen_get_row(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE * data);
+
+/*Optional bulk drawing functions. The result is the same as calling
+  menu_screen_set for every pixel, but whole words of the framebuffer are
+  written and each touched block is only marked once. Define MENU_SCREEN_BULK
+  to let the menuInterpreter use them.
+*/
+void menu_screen_fill_rect(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, FB_COLOR_IN_TYPE color);
+
+void menu_screen_hline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color);
+
+void menu_screen_vline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color);
+
+//data must contain sx * sy pixels, row by row
+void menu_screen_blit(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, const FB_COLOR_IN_TYPE * data);
+
 //Callback used by menuInterpreter
 void menu_screen_flush(void);
 
@@ -78,6 +78,133 @@ void menu_screen_set(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE
 	}
 }
 
+//Only the front bit is stored, so a pixel in front reads back as g_fbFrontLevel
+FB_COLOR_IN_TYPE menu_screen_get(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y) {
+	if ((x < g_fbUseX) && (y < g_fbUseY)) {
+		uint32_t index = x / FB_BITMAP_BITS + y * FB_ELEMENTS_X;
+		uint32_t shift = x % FB_BITMAP_BITS;
+		if (g_fbPixel[index] & (1<<shift)) {
+			return g_fbFrontLevel;
+		}
+	}
+	return 0;
+}
+
+void menu_screen_get_row(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE * data) {
+	uint32_t sx = 0;
+	if ((x < g_fbUseX) && (y < g_fbUseY)) {
+		sx = g_fbUseX - x;
+		if (sx > length) {
+			sx = length;
+		}
+	}
+	if (sx) {
+		const FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_BITMAP_BITS + y * FB_ELEMENTS_X];
+		uint32_t shift = x % FB_BITMAP_BITS;
+		FB_BITMAP_TYPE value = *pData >> shift;
+		for (uint32_t i = 0; i < sx; i++) {
+			if (shift == FB_BITMAP_BITS) {
+				pData++;
+				value = *pData;
+				shift = 0;
+			}
+			data[i] = (value & 1) ? g_fbFrontLevel : 0;
+			value >>= 1;
+			shift++;
+		}
+	}
+	//outside of the used screen, like menu_screen_get
+	for (uint32_t i = sx; i < length; i++) {
+		data[i] = 0;
+	}
+}
+
+//Limits the rectangle to the used screen, returns false if nothing is left to draw
+static bool FbClip(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE * pSx, FB_SCREENPOS_TYPE * pSy) {
+	if ((x >= g_fbUseX) || (y >= g_fbUseY) || (*pSx == 0) || (*pSy == 0)) {
+		return false;
+	}
+	if (*pSx > (g_fbUseX - x)) {
+		*pSx = g_fbUseX - x;
+	}
+	if (*pSy > (g_fbUseY - y)) {
+		*pSy = g_fbUseY - y;
+	}
+	return true;
+}
+
+//Mask for the lowest pixels of a datatype
+static FB_BITMAP_TYPE FbPixelMask(uint32_t pixels) {
+	if (pixels >= FB_BITMAP_BITS) {
+		return ~(FB_BITMAP_TYPE)0;
+	}
+	return ((FB_BITMAP_TYPE)1 << pixels) - 1;
+}
+
+void menu_screen_fill_rect(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, FB_COLOR_IN_TYPE color) {
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	FB_BITMAP_TYPE pattern = (color >= g_fbFrontLevel) ? ~(FB_BITMAP_TYPE)0 : 0;
+	uint32_t startShift = x % FB_BITMAP_BITS;
+	for (uint32_t row = y; row < (uint32_t)(y + sy); row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_BITMAP_BITS + row * FB_ELEMENTS_X];
+		uint32_t shift = startShift;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_BITMAP_BITS - shift;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE mask = FbPixelMask(pixels) << shift;
+			*pData = (*pData & ~mask) | (pattern & mask);
+			pData++;
+			remaining -= pixels;
+			shift = 0;
+		}
+	}
+}
+
+void menu_screen_hline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+void menu_screen_blit(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, const FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE stride = sx;
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	uint32_t startShift = x % FB_BITMAP_BITS;
+	for (uint32_t row = 0; row < sy; row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_BITMAP_BITS + (y + row) * FB_ELEMENTS_X];
+		const FB_COLOR_IN_TYPE * pIn = data + row * stride;
+		uint32_t shift = startShift;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_BITMAP_BITS - shift;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE value = 0;
+			for (uint32_t i = 0; i < pixels; i++) {
+				if (pIn[i] >= g_fbFrontLevel) {
+					value |= (FB_BITMAP_TYPE)1 << (shift + i);
+				}
+			}
+			FB_BITMAP_TYPE mask = FbPixelMask(pixels) << shift;
+			*pData = (*pData & ~mask) | value;
+			pData++;
+			pIn += pixels;
+			remaining -= pixels;
+			shift = 0;
+		}
+	}
+}
+
 //block must have FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y elements
 static void FbBlockFlush(const uint16_t startX, const uint16_t startY, FB_COLOR_OUT_TYPE * block) {
 	uint32_t wptr = 0;
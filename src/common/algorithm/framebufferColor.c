@@ -13,6 +13,7 @@ result to boxlib/lcd.h.
 But other graphic libraries than then menu-interpreter can be used.
 */
 
+#include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -48,6 +49,17 @@ FB_RED_OUT_BITS
 FB_GREEN_OUT_BITS
 FB_BLUE_OUT_BITS
 
+Optional, the maximum number of output blocks which are merged into one
+rectangle when flushing. Each rectangle needs only one window setup and one
+transfer to the LCD. The output buffers are then static instead of on the stack
+and need FB_COALESCE_BLOCKS times the memory of one output block.
+FB_COALESCE_BLOCKS
+
+Optional, disables the color conversion lookup table. The table is only used if
+the input color has no more than 8 bits and needs 2^bits * sizeof(FB_COLOR_OUT_TYPE)
+bytes of flash.
+FB_COLOR_NOLUT
+
 */
 
 #include "framebufferConfig.h"
@@ -83,6 +95,57 @@ _Static_assert(FB_BITMAP_BITS == sizeof(FB_BITMAP_TYPE) * 8, "FB_BITMAP_BITS nee
 #define FB_SETGREEN_OUT(color) ((color >> FB_MISSINGGREEN_OUT) << (FB_BLUE_OUT_BITS))
 #define FB_SETBLUE_OUT(color) ((color >> FB_MISSINGBLUE_OUT) << 0)
 
+#if (FB_COLOR_IN_BITS_USED <= 8) && !defined(FB_COLOR_NOLUT)
+#define FB_COLOR_LUT
+#endif
+
+#ifdef FB_COLOR_LUT
+
+//Fills the lower bits if the highest bit is set, so 0xFF on the input is 0xFF on the output too
+#define FB_EXTEND_BITS(value, missing) ((value) | (((value) & 0x80) ? ((1 << (missing)) - 1) : 0))
+
+#define FB_CONVERT_OUT(color) (FB_SETRED_OUT(FB_EXTEND_BITS(FB_GETRED_IN(color), FB_MISSINGRED_IN)) | \
+                               FB_SETGREEN_OUT(FB_EXTEND_BITS(FB_GETGREEN_IN(color), FB_MISSINGGREEN_IN)) | \
+                               FB_SETBLUE_OUT(FB_EXTEND_BITS(FB_GETBLUE_IN(color), FB_MISSINGBLUE_IN)))
+
+//due to little endian, we need to swap the bytes for the transfer later.
+#define FB_SWAP_OUT(color) ((sizeof(FB_COLOR_OUT_TYPE) == 2) ? ((((color) >> 8) & 0xFF) | (((color) & 0xFF) << 8)) : (color))
+
+#define FB_LUT_1(n) FB_SWAP_OUT(FB_CONVERT_OUT((n)))
+#define FB_LUT_2(n) FB_LUT_1(n), FB_LUT_1((n) + 1)
+#define FB_LUT_4(n) FB_LUT_2(n), FB_LUT_2((n) + 2)
+#define FB_LUT_8(n) FB_LUT_4(n), FB_LUT_4((n) + 4)
+#define FB_LUT_16(n) FB_LUT_8(n), FB_LUT_8((n) + 8)
+#define FB_LUT_32(n) FB_LUT_16(n), FB_LUT_16((n) + 16)
+#define FB_LUT_64(n) FB_LUT_32(n), FB_LUT_32((n) + 32)
+#define FB_LUT_128(n) FB_LUT_64(n), FB_LUT_64((n) + 64)
+#define FB_LUT_256(n) FB_LUT_128(n), FB_LUT_128((n) + 128)
+
+/*Output color for every possible input color, already byte swapped for the
+  transfer. Generated by the compiler, so it is placed in the flash.
+*/
+static const FB_COLOR_OUT_TYPE g_fbColorLut[1 << FB_COLOR_IN_BITS_USED] = {
+#if FB_COLOR_IN_BITS_USED == 1
+	FB_LUT_2(0)
+#elif FB_COLOR_IN_BITS_USED == 2
+	FB_LUT_4(0)
+#elif FB_COLOR_IN_BITS_USED == 3
+	FB_LUT_8(0)
+#elif FB_COLOR_IN_BITS_USED == 4
+	FB_LUT_16(0)
+#elif FB_COLOR_IN_BITS_USED == 5
+	FB_LUT_32(0)
+#elif FB_COLOR_IN_BITS_USED == 6
+	FB_LUT_64(0)
+#elif FB_COLOR_IN_BITS_USED == 7
+	FB_LUT_128(0)
+#else
+	FB_LUT_256(0)
+#endif
+};
+
+#endif
+
 FB_BITMAP_TYPE g_fbPixel[FB_ELEMENTS_X * FB_SIZE_Y];
 FB_SCREENPOS_TYPE g_fbUseX = FB_SIZE_X;
 FB_SCREENPOS_TYPE g_fbUseY = FB_SIZE_Y;
@@ -95,11 +158,9 @@ FB_SCREENPOS_TYPE g_fbUseY = FB_SIZE_Y;
   can be skipped. So each pixel write sets the counter to 2. A flush must write
   the block if the counter is non 0 and decreases the counter by 1. But on the very first
   flush, we have to write everything.
-  This works right as long as menu_screen_clear() and menu_screen_flush() are always called in turns.
-  If this is not observed, and menu_screen_flush() is called twice, it is assumed the screen is now clear
-  and therefore a following menu_screen_clear() -> menu_screen_flush() does clear the internal buffer,
-  but the information are not transmitted to the LCD and therefore blocks not written menu_screen_set are
-  not visible as clear on the LCD.
+  A flush without a menu_screen_clear() since the last flush only updates parts
+  of the screen. So it only writes the blocks with a counter of 2 and decreases them to 1,
+  as they still need to be cleared on the LCD by the flush following the next menu_screen_clear().
   Calling menu_screen_clear() more than once is no problem.
   The array must contain two bits for every block.
 */
@@ -111,8 +172,15 @@ FB_SCREENPOS_TYPE g_fbUseY = FB_SIZE_Y;
 
 #define FB_WRITTENBLOCKS_Y FB_OUTPUTBLOCKS_Y
 
+#ifdef FB_COALESCE_BLOCKS
+_Static_assert(FB_COALESCE_BLOCKS > 0, "FB_COALESCE_BLOCKS must be at least 1");
+//Ili9341WriteArray only supports 16 bit for the length
+_Static_assert((FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y * FB_COALESCE_BLOCKS * sizeof(FB_COLOR_OUT_TYPE)) <= 0xFFFF, "FB_COALESCE_BLOCKS too large for one transfer");
+#endif
+
 FB_BITMAP_TYPE g_fbWrittenBlock[FB_WRITTENBLOCKS_X * FB_WRITTENBLOCKS_Y];
 uint8_t g_fbWritten;
+bool g_fbCleared; //menu_screen_clear was called since the last flush
 
 void menu_screen_set(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE color) {
 	if ((x < g_fbUseX) && (y < g_fbUseY)) {
@@ -143,8 +211,229 @@ FB_COLOR_IN_TYPE menu_screen_get(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y) {
 	return 0;
 }
 
-//block must have FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y elements
-static void FbBlockFlush(const uint16_t startX, const uint16_t startY, FB_COLOR_OUT_TYPE * block) {
+//Returns a datatype with the color set for every pixel
+static FB_BITMAP_TYPE FbColorPattern(FB_COLOR_IN_TYPE color) {
+	FB_BITMAP_TYPE pattern = 0;
+	for (uint8_t i = 0; i < FB_PIXELS_IN_DATATYPE; i++) {
+		pattern <<= FB_COLOR_IN_BITS_USED;
+		pattern |= color & FB_MASK_IN_DATATYPE;
+	}
+	return pattern;
+}
+
+//Mask for the lowest pixels of a datatype
+static FB_BITMAP_TYPE FbPixelMask(uint32_t pixels) {
+	if ((pixels * FB_COLOR_IN_BITS_USED) >= FB_BITMAP_BITS) {
+		return ~(FB_BITMAP_TYPE)0;
+	}
+	return ((FB_BITMAP_TYPE)1 << (pixels * FB_COLOR_IN_BITS_USED)) - 1;
+}
+
+//Limits the rectangle to the used screen, returns false if nothing is left to draw
+static bool FbClip(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE * pSx, FB_SCREENPOS_TYPE * pSy) {
+	if ((x >= g_fbUseX) || (y >= g_fbUseY) || (*pSx == 0) || (*pSy == 0)) {
+		return false;
+	}
+	if (*pSx > (g_fbUseX - x)) {
+		*pSx = g_fbUseX - x;
+	}
+	if (*pSy > (g_fbUseY - y)) {
+		*pSy = g_fbUseY - y;
+	}
+	return true;
+}
+
+//Marks every block touched by the rectangle to be written, like menu_screen_set does for one pixel
+static void FbBlocksMark(uint32_t x, uint32_t y, uint32_t sx, uint32_t sy) {
+	uint32_t blockXEnd = (x + sx - 1) / FB_OUTPUTBLOCK_X;
+	uint32_t blockYEnd = (y + sy - 1) / FB_OUTPUTBLOCK_Y;
+	for (uint32_t blockY = y / FB_OUTPUTBLOCK_Y; blockY <= blockYEnd; blockY++) {
+		for (uint32_t blockX = x / FB_OUTPUTBLOCK_X; blockX <= blockXEnd; blockX++) {
+			uint32_t blockWritten = blockX + blockY * FB_WRITTENMANAGED_BLOCKS_X;
+			uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
+			uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
+			g_fbWrittenBlock[indexWritten] |= (FB_BITMAP_TYPE)2 << (offsetWritten * 2);
+		}
+	}
+}
+
+void menu_screen_fill_rect(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, FB_COLOR_IN_TYPE color) {
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	FB_BITMAP_TYPE pattern = FbColorPattern(color);
+	uint32_t startCounter = x % FB_PIXELS_IN_DATATYPE;
+	for (uint32_t row = y; row < (uint32_t)(y + sy); row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + row * FB_ELEMENTS_X];
+		uint32_t counter = startCounter;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			if (pixels == FB_PIXELS_IN_DATATYPE) {
+				*pData = pattern;
+			} else {
+				FB_BITMAP_TYPE mask = FbPixelMask(pixels) << (counter * FB_COLOR_IN_BITS_USED);
+				*pData = (*pData & ~mask) | (pattern & mask);
+			}
+			pData++;
+			remaining -= pixels;
+			counter = 0;
+		}
+	}
+	FbBlocksMark(x, y, sx, sy);
+}
+
+void menu_screen_hline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+void menu_screen_blit(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, const FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE stride = sx;
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	uint32_t startCounter = x % FB_PIXELS_IN_DATATYPE;
+	for (uint32_t row = 0; row < sy; row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + (y + row) * FB_ELEMENTS_X];
+		const FB_COLOR_IN_TYPE * pIn = data + row * stride;
+		uint32_t counter = startCounter;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE value = 0;
+			for (uint32_t i = 0; i < pixels; i++) {
+				value |= (FB_BITMAP_TYPE)(pIn[i] & FB_MASK_IN_DATATYPE) << ((counter + i) * FB_COLOR_IN_BITS_USED);
+			}
+			FB_BITMAP_TYPE mask = FbPixelMask(pixels) << (counter * FB_COLOR_IN_BITS_USED);
+			*pData = (*pData & ~mask) | value;
+			pData++;
+			pIn += pixels;
+			remaining -= pixels;
+			counter = 0;
+		}
+	}
+	FbBlocksMark(x, y, sx, sy);
+}
+
+void menu_screen_get_row(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE sx = length;
+	FB_SCREENPOS_TYPE sy = 1;
+	if (!FbClip(x, y, &sx, &sy)) {
+		sx = 0;
+	}
+	if (sx) {
+		const FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + y * FB_ELEMENTS_X];
+		uint32_t counter = x % FB_PIXELS_IN_DATATYPE;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE value = *pData >> (counter * FB_COLOR_IN_BITS_USED);
+			for (uint32_t i = 0; i < pixels; i++) {
+				*data = value & (FB_BITMAP_TYPE)FB_MASK_IN_DATATYPE;
+				value >>= FB_COLOR_IN_BITS_USED;
+				data++;
+			}
+			pData++;
+			remaining -= pixels;
+			counter = 0;
+		}
+	}
+	//outside of the used screen, like menu_screen_get
+	for (uint32_t i = sx; i < length; i++) {
+		*data = 0;
+		data++;
+	}
+}
+
+//Returns the counter of the block if it needs to be written, otherwise 0. See g_fbWrittenBlock
+static uint8_t FbBlockWrittenGet(uint32_t x, uint32_t y) {
+	uint32_t blockWritten = x + y * FB_WRITTENMANAGED_BLOCKS_X;
+	uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
+	uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
+	uint8_t counter = (g_fbWrittenBlock[indexWritten] >> (offsetWritten * 2)) & 3;
+	if (!g_fbCleared) {
+		counter &= 2;
+	}
+	return counter;
+}
+
+//Must be called after the block has been sent to the LCD, see g_fbWrittenBlock
+static void FbBlockWrittenDone(uint32_t x, uint32_t y) {
+	uint32_t blockWritten = x + y * FB_WRITTENMANAGED_BLOCKS_X;
+	uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
+	uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
+	FB_BITMAP_TYPE maskWrittenHigh = (FB_BITMAP_TYPE)2 << (offsetWritten * 2);
+	FB_BITMAP_TYPE maskWrittenLow = (FB_BITMAP_TYPE)1 << (offsetWritten * 2);
+	FB_BITMAP_TYPE bitsWritten = g_fbWrittenBlock[indexWritten];
+	if (bitsWritten & maskWrittenHigh) { //if 2 -> 1, if 3 -> 1
+		bitsWritten = (bitsWritten & ~maskWrittenHigh) | maskWrittenLow;
+	} else { //if 1 -> 0
+		bitsWritten = bitsWritten & ~maskWrittenLow;
+	}
+	g_fbWrittenBlock[indexWritten] = bitsWritten;
+}
+
+#ifdef FB_COLOR_LUT
+
+//Converts the given number of pixels from colorData, starting with the lowest bits
+static inline FB_COLOR_OUT_TYPE * FbPixelsConvert(FB_BITMAP_TYPE colorData, uint32_t pixels, FB_COLOR_OUT_TYPE * block) {
+	for (uint32_t i = 0; i < pixels; i++) {
+		*block = g_fbColorLut[colorData & FB_MASK_IN_DATATYPE];
+		block++;
+		colorData >>= FB_COLOR_IN_BITS_USED;
+	}
+	return block;
+}
+
+/*block must have width * height elements, width must be a multiple of FB_OUTPUTBLOCK_X
+  Unpacks one FB_BITMAP_TYPE word per iteration, only the first and last word
+  of a row might be used partially.
+*/
+static void FbRectFlush(const uint16_t startX, const uint16_t startY, const uint16_t width, const uint16_t height, FB_COLOR_OUT_TYPE * block) {
+	FB_COLOR_OUT_TYPE * pOut = block;
+	uint32_t startCounter = (startX % FB_PIXELS_IN_DATATYPE);
+	uint32_t startIndex = startX / FB_PIXELS_IN_DATATYPE;
+	for (uint32_t y = startY; y < (uint32_t)(startY + height); y++) {
+		const FB_BITMAP_TYPE * pIn = &g_fbPixel[startIndex + y * FB_ELEMENTS_X];
+		uint32_t remaining = width;
+		if (startCounter != 0) { //first pixel is not at the beginning of the datatype
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - startCounter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			pOut = FbPixelsConvert(*pIn >> (FB_COLOR_IN_BITS_USED * startCounter), pixels, pOut);
+			pIn++;
+			remaining -= pixels;
+		}
+		while (remaining >= FB_PIXELS_IN_DATATYPE) {
+			pOut = FbPixelsConvert(*pIn, FB_PIXELS_IN_DATATYPE, pOut);
+			pIn++;
+			remaining -= FB_PIXELS_IN_DATATYPE;
+		}
+		if (remaining) {
+			pOut = FbPixelsConvert(*pIn, remaining, pOut);
+		}
+	}
+	LcdWriteRect(startX, startY, width, height, (const uint8_t*)block, width * height * sizeof(FB_COLOR_OUT_TYPE));
+}
+
+#else
+
+//block must have width * height elements, width must be a multiple of FB_OUTPUTBLOCK_X
+static void FbRectFlush(const uint16_t startX, const uint16_t startY, const uint16_t width, const uint16_t height, FB_COLOR_OUT_TYPE * block) {
 	uint32_t wptr = 0;
 	FB_BITMAP_TYPE colorData = 0; //contains data of 1..n pixels
 	FB_BITMAP_TYPE colorIn; //contains data of 1 pixel
@@ -153,14 +442,14 @@ static void FbBlockFlush(const uint16_t startX, const uint16_t startY, FB_COLOR_
 
 	uint32_t startCounter = (startX % FB_PIXELS_IN_DATATYPE);
 	uint32_t startIndex = startX / FB_PIXELS_IN_DATATYPE;
-	for (uint32_t y = startY; y < (uint32_t)(startY + FB_OUTPUTBLOCK_Y); y++) {
+	for (uint32_t y = startY; y < (uint32_t)(startY + height); y++) {
 		uint32_t index = startIndex + y * FB_ELEMENTS_X;
 		uint32_t counter = startCounter;
 		if (counter != 0) { //first pixel is not at the beginning of the datatype
 			colorData = g_fbPixel[index];
 			colorData >>= FB_COLOR_IN_BITS_USED * (counter - 1);
 		}
-		for (uint32_t x = startX; x < (uint32_t)(startX + FB_OUTPUTBLOCK_X); x++) {
+		for (uint32_t x = startX; x < (uint32_t)(startX + width); x++) {
 			if (counter == 0) {
 				colorData = g_fbPixel[index];
 			} else {
@@ -201,9 +490,83 @@ static void FbBlockFlush(const uint16_t startX, const uint16_t startY, FB_COLOR_
 			wptr++;
 		}
 	}
-	LcdWriteRect(startX, startY, FB_OUTPUTBLOCK_X, FB_OUTPUTBLOCK_Y, (const uint8_t*)block, FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y * sizeof(FB_COLOR_OUT_TYPE));
+	LcdWriteRect(startX, startY, width, height, (const uint8_t*)block, width * height * sizeof(FB_COLOR_OUT_TYPE));
 }
 
+#endif
+
+#ifdef FB_COALESCE_BLOCKS
+
+#ifdef FB_TWOBUFFERS
+FB_COLOR_OUT_TYPE g_fbOutput[2][FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y * FB_COALESCE_BLOCKS];
+#else
+FB_COLOR_OUT_TYPE g_fbOutput[1][FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y * FB_COALESCE_BLOCKS];
+#endif
+
+//Returns true if all blocks from x to x + width - 1 need to be written
+static bool FbBlockRunWritten(uint32_t x, uint32_t y, uint32_t width) {
+	for (uint32_t i = x; i < x + width; i++) {
+		if (FbBlockWrittenGet(i, y) == 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+/*Merges adjacent blocks which need to be written into rectangles with up to
+  FB_COALESCE_BLOCKS blocks. First the blocks of one row are combined, then
+  the rectangle grows downwards as long as all blocks below need to be written
+  too. So each rectangle needs only one window setup on the LCD and one
+  transfer.
+*/
+void menu_screen_flush(void) {
+	uint16_t xMax = g_fbUseX / FB_OUTPUTBLOCK_X;
+	uint16_t yMax = g_fbUseY / FB_OUTPUTBLOCK_Y;
+	FB_COLOR_OUT_TYPE * block = g_fbOutput[0];
+#ifdef FB_TWOBUFFERS
+	uint8_t toggle = 0;
+#endif
+	//first block row which is not already part of a flushed rectangle
+	uint16_t rowFree[FB_OUTPUTBLOCKS_X] = {0};
+	for (uint32_t y = 0; y < yMax; y++) {
+		uint32_t x = 0;
+		while (x < xMax) {
+			if ((rowFree[x] > y) || (FbBlockWrittenGet(x, y) == 0)) {
+				x++;
+				continue;
+			}
+			uint32_t width = 1;
+			while (((x + width) < xMax) && (width < FB_COALESCE_BLOCKS) &&
+			       (rowFree[x + width] <= y) && (FbBlockWrittenGet(x + width, y))) {
+				width++;
+			}
+			uint32_t height = 1;
+			while (((y + height) < yMax) && ((width * (height + 1)) <= FB_COALESCE_BLOCKS) &&
+			       (FbBlockRunWritten(x, y + height, width))) {
+				height++;
+			}
+			FbRectFlush(x * FB_OUTPUTBLOCK_X, y * FB_OUTPUTBLOCK_Y, width * FB_OUTPUTBLOCK_X, height * FB_OUTPUTBLOCK_Y, block);
+			for (uint32_t i = x; i < x + width; i++) {
+				for (uint32_t j = y; j < y + height; j++) {
+					FbBlockWrittenDone(i, j);
+				}
+				rowFree[i] = y + height;
+			}
+#ifdef FB_TWOBUFFERS
+			toggle = 1 - toggle;
+			block = g_fbOutput[toggle];
+#else
+			LcdWaitBackgroundDone();
+#endif
+			x += width;
+		}
+	}
+	g_fbCleared = false;
+	LcdWaitBackgroundDoneRelease();
+}
+
+#else
+
 void menu_screen_flush(void) {
 	//uint32_t timeStart = HAL_GetTick();
 	uint16_t xMax = g_fbUseX / FB_OUTPUTBLOCK_X;
@@ -217,20 +580,9 @@ void menu_screen_flush(void) {
 #endif
 	for (uint32_t y = 0; y < yMax; y++) {
 		for (uint32_t x = 0; x < xMax; x++) {
-			uint32_t blockWritten = x + y * FB_WRITTENMANAGED_BLOCKS_X;
-			uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
-			uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
-			FB_BITMAP_TYPE maskWrittenHigh = (FB_BITMAP_TYPE)2 << (offsetWritten * 2);
-			FB_BITMAP_TYPE maskWrittenLow = 1 << (offsetWritten * 2);
-			FB_BITMAP_TYPE bitsWritten = g_fbWrittenBlock[indexWritten];
-			if (((maskWrittenHigh | maskWrittenLow) & bitsWritten)) {
-				FbBlockFlush(x * FB_OUTPUTBLOCK_X, y * FB_OUTPUTBLOCK_Y, block);
-				if (bitsWritten & maskWrittenHigh) { //if 2 -> 1, if 3 -> 1
-					bitsWritten = (bitsWritten & ~maskWrittenHigh) | maskWrittenLow;
-				} else { //if 1 -> 0
-					bitsWritten = bitsWritten & ~maskWrittenLow;
-				}
-				g_fbWrittenBlock[indexWritten] = bitsWritten;
+			if (FbBlockWrittenGet(x, y)) {
+				FbRectFlush(x * FB_OUTPUTBLOCK_X, y * FB_OUTPUTBLOCK_Y, FB_OUTPUTBLOCK_X, FB_OUTPUTBLOCK_Y, block);
+				FbBlockWrittenDone(x, y);
 #ifdef FB_TWOBUFFERS
 				toggle = 1 - toggle;
 				block = blocks[toggle];
@@ -240,11 +592,14 @@ void menu_screen_flush(void) {
 			}
 		}
 	}
+	g_fbCleared = false;
 	LcdWaitBackgroundDoneRelease();
 	//uint32_t timeStop = HAL_GetTick();
 	//printf("Redraw took %uticks\r\n", (unsigned int)(timeStop - timeStart));
 }
 
+#endif
+
 void menu_screen_size(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y) {
 	if (x <= FB_SIZE_X) {
 		g_fbUseX = x;
@@ -268,11 +623,7 @@ void menu_screen_frontlevel(uint16_t level) {
 }
 
 void menu_screen_clear(void) {
-	FB_BITMAP_TYPE backgroundColor = 0;
-	for (uint8_t i = 0; i < FB_PIXELS_IN_DATATYPE; i++) {
-		backgroundColor <<= FB_COLOR_IN_BITS_USED;
-		backgroundColor |= FB_COLOR_BACKGROUND;
-	}
+	FB_BITMAP_TYPE backgroundColor = FbColorPattern(FB_COLOR_BACKGROUND);
 	for (uint32_t i = 0; i < (FB_ELEMENTS_X * FB_SIZE_Y); i++) {
 		g_fbPixel[i] = backgroundColor;
 	}
@@ -281,4 +632,5 @@ void menu_screen_clear(void) {
 		memset(g_fbWrittenBlock, 0x55, (FB_WRITTENBLOCKS_X * FB_WRITTENBLOCKS_Y) * sizeof(FB_BITMAP_TYPE));
 		g_fbWritten = 1; //first frame needs to be written completely
 	}
+	g_fbCleared = true;
 }
@@ -13,6 +13,7 @@ result to boxlib/lcd.h.
 But other graphic libraries than then menu-interpreter can be used.
 */
 
+#include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -124,11 +125,9 @@ uint16_t g_fbFrontLevel = FB_FRONT_LEVEL;
   can be skipped. So each pixel write sets the counter to 2. A flush must write
   the block if the counter is non 0 and decreases the counter by 1. But on the very first
   flush, we have to write everything.
-  This works right as long as menu_screen_clear() and menu_screen_flush() are always called in turns.
-  If this is not observed, and menu_screen_flush() is called twice, it is assumed the screen is now clear
-  and therefore a following menu_screen_clear() -> menu_screen_flush() does clear the internal buffer,
-  but the information are not transmitted to the LCD and therefore blocks not written menu_screen_set are
-  not visible as clear on the LCD.
+  A flush without a menu_screen_clear() since the last flush only updates parts
+  of the screen. So it only writes the blocks with a counter of 2 and decreases them to 1,
+  as they still need to be cleared on the LCD by the flush following the next menu_screen_clear().
   Calling menu_screen_clear() more than once is no problem.
   The array must contain two bits for every block.
 */
@@ -142,31 +141,188 @@ _Static_assert((FB_SIZE_Y % FB_OUTPUTBLOCK_Y) == 0, "FB_SIZE_Y must be multiple
 #define FB_WRITTENELEMS ((FB_OUTPUTBLOCKS_X * FB_OUTPUTBLOCKS_Y * 2 + FB_BITMAP_BITS - 1) / FB_BITMAP_BITS)
 FB_BITMAP_TYPE g_fbWrittenBlock[FB_WRITTENELEMS];
 uint8_t g_fbWritten; //to detect the first call
+bool g_fbCleared; //menu_screen_clear was called since the last flush
+
+
+//Sets the pixel without marking the block to be written
+static void FbPixelSet(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE color) {
+	uint8_t r = FB_GETRED_IN(color);
+	uint8_t g = FB_GETGREEN_IN(color);
+	uint8_t b = FB_GETBLUE_IN(color);
+	uint32_t bright = r + g + b;
+	uint32_t index = x / FB_BITMAP_BITS + y * FB_ELEMENTS_X;
+	uint32_t shift = x % FB_BITMAP_BITS;
+	uint32_t indexBlock = (x / FB_COLOR_RES_X) + (y / FB_COLOR_RES_Y * FB_COLORBLOCKS_X);
+	if (bright >= g_fbFrontLevel) {
+		g_fbFrontPixel[index] |= (1<<shift);
+		g_fbColor[indexBlock] = (color << FB_COLOR_IN_BITS_USED) | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_BACK_MASK);
+	} else {
+		g_fbFrontPixel[index] &= ~(1<<shift);
+		g_fbColor[indexBlock] = color | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_FRONT_MASK);
+	}
+}
 
+//Marks every block touched by the rectangle to be written
+static void FbBlocksMark(uint32_t x, uint32_t y, uint32_t sx, uint32_t sy) {
+	uint32_t blockXEnd = (x + sx - 1) / FB_OUTPUTBLOCK_X;
+	uint32_t blockYEnd = (y + sy - 1) / FB_OUTPUTBLOCK_Y;
+	for (uint32_t blockY = y / FB_OUTPUTBLOCK_Y; blockY <= blockYEnd; blockY++) {
+		for (uint32_t blockX = x / FB_OUTPUTBLOCK_X; blockX <= blockXEnd; blockX++) {
+			uint32_t blockWritten = blockX + blockY * FB_OUTPUTBLOCKS_X;
+			uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
+			uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
+			FB_BITMAP_TYPE maskWrittenHigh = 2 << (offsetWritten * 2);
+			g_fbWrittenBlock[indexWritten] |= maskWrittenHigh; //can now be 2 or 3. 3 is handled as it is a 2.
+		}
+	}
+}
 
 void menu_screen_set(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE color) {
 	if ((x < g_fbUseX) && (y < g_fbUseY)) {
-		uint8_t r = FB_GETRED_IN(color);
-		uint8_t g = FB_GETGREEN_IN(color);
-		uint8_t b = FB_GETBLUE_IN(color);
-		uint32_t bright = r + g + b;
+		FbPixelSet(x, y, color);
+		//speed improvement
+		FbBlocksMark(x, y, 1, 1);
+	}
+}
+
+FB_COLOR_IN_TYPE menu_screen_get(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y) {
+	if ((x < g_fbUseX) && (y < g_fbUseY)) {
 		uint32_t index = x / FB_BITMAP_BITS + y * FB_ELEMENTS_X;
 		uint32_t shift = x % FB_BITMAP_BITS;
 		uint32_t indexBlock = (x / FB_COLOR_RES_X) + (y / FB_COLOR_RES_Y * FB_COLORBLOCKS_X);
-		if (bright >= g_fbFrontLevel) {
-			g_fbFrontPixel[index] |= (1<<shift);
-			g_fbColor[indexBlock] = (color << FB_COLOR_IN_BITS_USED) | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_BACK_MASK);
-		} else {
-			g_fbFrontPixel[index] &= ~(1<<shift);
-			g_fbColor[indexBlock] = color | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_FRONT_MASK);
+		if (g_fbFrontPixel[index] & (1<<shift)) {
+			return g_fbColor[indexBlock] >> FB_COLOR_IN_BITS_USED;
 		}
-		//speed improvement
-		uint32_t blockWritten = (x / FB_OUTPUTBLOCK_X) + (y / FB_OUTPUTBLOCK_Y) * FB_OUTPUTBLOCKS_X;
-		uint32_t indexWritten = blockWritten / (FB_BITMAP_BITS / 2);
-		uint32_t offsetWritten = blockWritten % (FB_BITMAP_BITS / 2);
-		FB_BITMAP_TYPE maskWrittenHigh = 2 << (offsetWritten * 2);
-		g_fbWrittenBlock[indexWritten] |= maskWrittenHigh; //can now be 2 or 3. 3 is handled as it is a 2.
+		return g_fbColor[indexBlock] & FB_DOUBLECOLOR_BACK_MASK;
 	}
+	return 0;
+}
+
+void menu_screen_get_row(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE * data) {
+	uint32_t sx = 0;
+	if ((x < g_fbUseX) && (y < g_fbUseY)) {
+		sx = g_fbUseX - x;
+		if (sx > length) {
+			sx = length;
+		}
+	}
+	if (sx) {
+		const FB_BITMAP_TYPE * pData = &g_fbFrontPixel[x / FB_BITMAP_BITS + y * FB_ELEMENTS_X];
+		const fb_DoubleColor_t * pColor = &g_fbColor[(x / FB_COLOR_RES_X) + (y / FB_COLOR_RES_Y * FB_COLORBLOCKS_X)];
+		uint32_t shift = x % FB_BITMAP_BITS;
+		uint32_t colorCnt = x % FB_COLOR_RES_X;
+		FB_BITMAP_TYPE value = *pData >> shift;
+		for (uint32_t i = 0; i < sx; i++) {
+			if (shift == FB_BITMAP_BITS) {
+				pData++;
+				value = *pData;
+				shift = 0;
+			}
+			if (colorCnt == FB_COLOR_RES_X) {
+				pColor++;
+				colorCnt = 0;
+			}
+			if (value & 1) {
+				data[i] = *pColor >> FB_COLOR_IN_BITS_USED;
+			} else {
+				data[i] = *pColor & FB_DOUBLECOLOR_BACK_MASK;
+			}
+			value >>= 1;
+			shift++;
+			colorCnt++;
+		}
+	}
+	//outside of the used screen, like menu_screen_get
+	for (uint32_t i = sx; i < length; i++) {
+		data[i] = 0;
+	}
+}
+
+//Limits the rectangle to the used screen, returns false if nothing is left to draw
+static bool FbClip(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE * pSx, FB_SCREENPOS_TYPE * pSy) {
+	if ((x >= g_fbUseX) || (y >= g_fbUseY) || (*pSx == 0) || (*pSy == 0)) {
+		return false;
+	}
+	if (*pSx > (g_fbUseX - x)) {
+		*pSx = g_fbUseX - x;
+	}
+	if (*pSy > (g_fbUseY - y)) {
+		*pSy = g_fbUseY - y;
+	}
+	return true;
+}
+
+void menu_screen_fill_rect(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, FB_COLOR_IN_TYPE color) {
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	uint8_t r = FB_GETRED_IN(color);
+	uint8_t g = FB_GETGREEN_IN(color);
+	uint8_t b = FB_GETBLUE_IN(color);
+	uint32_t bright = r + g + b;
+	bool front = (bright >= g_fbFrontLevel);
+	//1. the front bit of every pixel
+	FB_BITMAP_TYPE pattern = front ? ~(FB_BITMAP_TYPE)0 : 0;
+	uint32_t startShift = x % FB_BITMAP_BITS;
+	for (uint32_t row = y; row < (uint32_t)(y + sy); row++) {
+		FB_BITMAP_TYPE * pData = &g_fbFrontPixel[x / FB_BITMAP_BITS + row * FB_ELEMENTS_X];
+		uint32_t shift = startShift;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_BITMAP_BITS - shift;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			if (pixels == FB_BITMAP_BITS) {
+				*pData = pattern;
+			} else {
+				FB_BITMAP_TYPE mask = (((FB_BITMAP_TYPE)1 << pixels) - 1) << shift;
+				*pData = (*pData & ~mask) | (pattern & mask);
+			}
+			pData++;
+			remaining -= pixels;
+			shift = 0;
+		}
+	}
+	//2. the front or back color of the color blocks
+	uint32_t colorXEnd = (x + sx - 1) / FB_COLOR_RES_X;
+	uint32_t colorYEnd = (y + sy - 1) / FB_COLOR_RES_Y;
+	for (uint32_t colorY = y / FB_COLOR_RES_Y; colorY <= colorYEnd; colorY++) {
+		for (uint32_t colorX = x / FB_COLOR_RES_X; colorX <= colorXEnd; colorX++) {
+			uint32_t indexBlock = colorX + colorY * FB_COLORBLOCKS_X;
+			if (front) {
+				g_fbColor[indexBlock] = (color << FB_COLOR_IN_BITS_USED) | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_BACK_MASK);
+			} else {
+				g_fbColor[indexBlock] = color | (g_fbColor[indexBlock] & FB_DOUBLECOLOR_FRONT_MASK);
+			}
+		}
+	}
+	FbBlocksMark(x, y, sx, sy);
+}
+
+void menu_screen_hline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+/*As the colors are only stored per color block, there is no benefit in
+  writing whole words, but the blocks are only marked once.
+*/
+void menu_screen_blit(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, const FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE stride = sx;
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	for (FB_SCREENPOS_TYPE row = 0; row < sy; row++) {
+		const FB_COLOR_IN_TYPE * pIn = data + row * stride;
+		for (FB_SCREENPOS_TYPE column = 0; column < sx; column++) {
+			FbPixelSet(x + column, y + row, pIn[column]);
+		}
+	}
+	FbBlocksMark(x, y, sx, sy);
 }
 
 //block must have FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y elements
@@ -275,6 +431,10 @@ void menu_screen_flush(void) {
 			FB_BITMAP_TYPE maskWrittenHigh = 2 << (offsetWritten * 2);
 			FB_BITMAP_TYPE maskWrittenLow = 1 << (offsetWritten * 2);
 			FB_BITMAP_TYPE bitsWritten = g_fbWrittenBlock[indexWritten];
+			if (!g_fbCleared) {
+				//only update what has been written since the last flush, keep the counter at 1
+				maskWrittenLow = 0;
+			}
 			if (((maskWrittenHigh | maskWrittenLow) & bitsWritten)) {
 				FbBlockFlush(x * FB_OUTPUTBLOCK_X, y * FB_OUTPUTBLOCK_Y, block);
 				if (bitsWritten & maskWrittenHigh) { //if 2 -> 1, if 3 -> 1
@@ -292,6 +452,7 @@ void menu_screen_flush(void) {
 			}
 		}
 	}
+	g_fbCleared = false;
 	LcdWaitBackgroundDoneRelease();
 	//uint32_t timeStop = HAL_GetTick();
 	//printf("Redraw took %uticks\r\n", (unsigned int)(timeStop - timeStart));
@@ -327,4 +488,5 @@ void menu_screen_clear(void) {
 		memset(g_fbWrittenBlock, 0x55, FB_WRITTENELEMS * sizeof(FB_BITMAP_TYPE));
 		g_fbWritten = 1; //first frame needs to be written completely
 	}
+	g_fbCleared = true;
 }
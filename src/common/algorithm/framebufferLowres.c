@@ -16,6 +16,7 @@ This variant does upscaling (without interpolating) and uses a palette.
 
 */
 
+#include <stdbool.h>
 #include <string.h>
 #include <stdint.h>
 #include <stdio.h>
@@ -107,7 +108,9 @@ FB_SCREENPOS_TYPE g_fbOffsetY = 0;
   When no menu_screen_set is done between two menu_screen_clear, a write to the LCD
   can be skipped. Since we need to write on the So each pixel write sets the counter to 2. A flush must write
   the block if the counter is non 0 and dercreases the counter by 1. But on the very first
-  flush, we have to write everything
+  flush, we have to write everything.
+  A flush without a menu_screen_clear() since the last flush only writes the pixels with
+  a counter of 2, see framebufferColor.c.
 */
 #define FB_WRITTENPIXELS_PER_DATATYPE (FB_BITMAP_BITS / 2)
 
@@ -119,6 +122,7 @@ FB_SCREENPOS_TYPE g_fbOffsetY = 0;
 
 FB_BITMAP_TYPE g_fbWrittenPixel[FB_WRITTENPIXELS_X * FB_WRITTENPIXELS_Y];
 uint8_t g_fbWritten;
+bool g_fbCleared; //menu_screen_clear was called since the last flush
 
 void menu_screen_set(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_COLOR_IN_TYPE color) {
 	if ((x < g_fbUseX) && (y < g_fbUseY)) {
@@ -150,6 +154,160 @@ FB_COLOR_IN_TYPE menu_screen_get(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y) {
 }
 
 
+//Returns a datatype with the color set for every pixel
+static FB_BITMAP_TYPE FbColorPattern(FB_COLOR_IN_TYPE color) {
+	FB_BITMAP_TYPE pattern = 0;
+	for (uint8_t i = 0; i < FB_PIXELS_IN_DATATYPE; i++) {
+		pattern <<= FB_COLOR_IN_BITS_USED;
+		pattern |= color & FB_MASK_IN_DATATYPE;
+	}
+	return pattern;
+}
+
+//Mask for the lowest pixels of a datatype
+static FB_BITMAP_TYPE FbPixelMask(uint32_t pixels) {
+	if ((pixels * FB_COLOR_IN_BITS_USED) >= FB_BITMAP_BITS) {
+		return ~(FB_BITMAP_TYPE)0;
+	}
+	return ((FB_BITMAP_TYPE)1 << (pixels * FB_COLOR_IN_BITS_USED)) - 1;
+}
+
+//Limits the rectangle to the used screen, returns false if nothing is left to draw
+static bool FbClip(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE * pSx, FB_SCREENPOS_TYPE * pSy) {
+	if ((x >= g_fbUseX) || (y >= g_fbUseY) || (*pSx == 0) || (*pSy == 0)) {
+		return false;
+	}
+	if (*pSx > (g_fbUseX - x)) {
+		*pSx = g_fbUseX - x;
+	}
+	if (*pSy > (g_fbUseY - y)) {
+		*pSy = g_fbUseY - y;
+	}
+	return true;
+}
+
+//Sets the counter of sx pixels in row y to 2, see g_fbWrittenPixel
+static void FbPixelsMark(uint32_t x, uint32_t y, uint32_t sx) {
+	uint32_t pixelWritten = x + y * FB_WRITTENMANAGED_PIXELS_X;
+	FB_BITMAP_TYPE * pData = &g_fbWrittenPixel[pixelWritten / FB_WRITTENPIXELS_PER_DATATYPE];
+	uint32_t counter = pixelWritten % FB_WRITTENPIXELS_PER_DATATYPE;
+	FB_BITMAP_TYPE pattern = 0;
+	for (uint8_t i = 0; i < FB_WRITTENPIXELS_PER_DATATYPE; i++) {
+		pattern = (pattern << 2) | 2;
+	}
+	while (sx) {
+		uint32_t pixels = FB_WRITTENPIXELS_PER_DATATYPE - counter;
+		if (pixels > sx) {
+			pixels = sx;
+		}
+		FB_BITMAP_TYPE mask = ~(FB_BITMAP_TYPE)0;
+		if (pixels < FB_WRITTENPIXELS_PER_DATATYPE) {
+			mask = (((FB_BITMAP_TYPE)1 << (pixels * 2)) - 1) << (counter * 2);
+		}
+		*pData |= pattern & mask; //can now be 2 or 3. 3 is handled as it is a 2.
+		pData++;
+		sx -= pixels;
+		counter = 0;
+	}
+}
+
+void menu_screen_fill_rect(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, FB_COLOR_IN_TYPE color) {
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	FB_BITMAP_TYPE pattern = FbColorPattern(color);
+	uint32_t startCounter = x % FB_PIXELS_IN_DATATYPE;
+	for (uint32_t row = y; row < (uint32_t)(y + sy); row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + row * FB_ELEMENTS_X];
+		uint32_t counter = startCounter;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE mask = FbPixelMask(pixels) << (counter * FB_COLOR_IN_BITS_USED);
+			*pData = (*pData & ~mask) | (pattern & mask);
+			pData++;
+			remaining -= pixels;
+			counter = 0;
+		}
+		FbPixelsMark(x, row, sx);
+	}
+}
+
+void menu_screen_hline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+void menu_screen_blit(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE sx, FB_SCREENPOS_TYPE sy, const FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE stride = sx;
+	if (!FbClip(x, y, &sx, &sy)) {
+		return;
+	}
+	uint32_t startCounter = x % FB_PIXELS_IN_DATATYPE;
+	for (uint32_t row = 0; row < sy; row++) {
+		FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + (y + row) * FB_ELEMENTS_X];
+		const FB_COLOR_IN_TYPE * pIn = data + row * stride;
+		uint32_t counter = startCounter;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE value = 0;
+			for (uint32_t i = 0; i < pixels; i++) {
+				value |= (FB_BITMAP_TYPE)(pIn[i] & FB_MASK_IN_DATATYPE) << ((counter + i) * FB_COLOR_IN_BITS_USED);
+			}
+			FB_BITMAP_TYPE mask = FbPixelMask(pixels) << (counter * FB_COLOR_IN_BITS_USED);
+			*pData = (*pData & ~mask) | value;
+			pData++;
+			pIn += pixels;
+			remaining -= pixels;
+			counter = 0;
+		}
+		FbPixelsMark(x, y + row, sx);
+	}
+}
+
+void menu_screen_get_row(FB_SCREENPOS_TYPE x, FB_SCREENPOS_TYPE y, FB_SCREENPOS_TYPE length, FB_COLOR_IN_TYPE * data) {
+	FB_SCREENPOS_TYPE sx = length;
+	FB_SCREENPOS_TYPE sy = 1;
+	if (!FbClip(x, y, &sx, &sy)) {
+		sx = 0;
+	}
+	if (sx) {
+		const FB_BITMAP_TYPE * pData = &g_fbPixel[x / FB_PIXELS_IN_DATATYPE + y * FB_ELEMENTS_X];
+		uint32_t counter = x % FB_PIXELS_IN_DATATYPE;
+		uint32_t remaining = sx;
+		while (remaining) {
+			uint32_t pixels = FB_PIXELS_IN_DATATYPE - counter;
+			if (pixels > remaining) {
+				pixels = remaining;
+			}
+			FB_BITMAP_TYPE value = *pData >> (counter * FB_COLOR_IN_BITS_USED);
+			for (uint32_t i = 0; i < pixels; i++) {
+				*data = value & (FB_BITMAP_TYPE)FB_MASK_IN_DATATYPE;
+				value >>= FB_COLOR_IN_BITS_USED;
+				data++;
+			}
+			pData++;
+			remaining -= pixels;
+			counter = 0;
+		}
+	}
+	//outside of the used screen, like menu_screen_get
+	for (uint32_t i = sx; i < length; i++) {
+		*data = 0;
+		data++;
+	}
+}
+
 static void FbBlockFlush(const uint16_t x, const uint16_t y,  FB_COLOR_OUT_TYPE * block) {
 	//1. get the color
 	uint32_t index = x / FB_PIXELS_IN_DATATYPE + y * FB_ELEMENTS_X;
@@ -184,6 +342,10 @@ void menu_screen_flush(void) {
 			FB_BITMAP_TYPE maskWrittenHigh = (FB_BITMAP_TYPE)2 << (offsetWritten * 2);
 			FB_BITMAP_TYPE maskWrittenLow = 1 << (offsetWritten * 2);
 			FB_BITMAP_TYPE bitsWritten = g_fbWrittenPixel[indexWritten];
+			if (!g_fbCleared) {
+				//only update what has been written since the last flush, keep the counter at 1
+				maskWrittenLow = 0;
+			}
 			if (((maskWrittenHigh | maskWrittenLow) & bitsWritten)) {
 				FbBlockFlush(x, y, block);
 				if (bitsWritten & maskWrittenHigh) { //if 2 -> 1, if 3 -> 1
@@ -201,6 +363,7 @@ void menu_screen_flush(void) {
 			}
 		}
 	}
+	g_fbCleared = false;
 	LcdWaitBackgroundDone(); //is an empty function if DMA is not used
 	//uint32_t timeStop = HAL_GetTick();
 	//printf("Redraw took %uticks\r\n", (unsigned int)(timeStop - timeStart));
@@ -235,6 +398,7 @@ void menu_screen_clear(void) {
 		memset(g_fbWrittenPixel, 0x55, (FB_WRITTENPIXELS_X * FB_WRITTENPIXELS_Y) * sizeof(FB_BITMAP_TYPE));
 		g_fbWritten = 1; //first frame needs to be written completely
 	}
+	g_fbCleared = true;
 }
 
 void menu_screen_scale(FB_SCREENPOS_TYPE offsetX, FB_SCREENPOS_TYPE offsetY,
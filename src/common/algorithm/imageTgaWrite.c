@@ -205,9 +205,8 @@ bool ImgTgaAppendCompress1Byte(const uint8_t * data, size_t bytes, outputWriteFu
 		}
 		if (equals > 1) {
 			//ok, add start a compression packet
-			uint8_t rlp = 0x80 | (equals - 1); //run length packet
-			success &= pWriter(&rlp, 1, param);
-			success &= pWriter(data + i, 1, param);
+			uint8_t rlp[2] = {0x80 | (equals - 1), data[i]}; //run length packet
+			success &= pWriter(rlp, sizeof(rlp), param);
 			i += equals;
 		} else {
 			//add a raw packet
@@ -37,12 +37,11 @@ bool Screenshot(void) {
 	uint32_t colors = 1 << (FB_RED_IN_BITS + FB_GREEN_IN_BITS + FB_BLUE_IN_BITS);
 	success &= ImgTgaStart(pixelX, pixelY, colors, 24, true, &FilesystemBufferwriterAppend, &fb);
 	success &= ImgTgaColormap24(FB_RED_IN_BITS, FB_GREEN_IN_BITS, FB_BLUE_IN_BITS, &FilesystemBufferwriterAppend, &fb);
-	//write image data
-	for (uint32_t y = 0; y < pixelY; y++) {
-		uint8_t data[pixelX];
-		for (uint32_t x = 0; x < pixelX; x++) {
-			data[x] = menu_screen_get(x, y);
-		}
+	//write image data, row by row from the framebuffer into the file buffer
+	_Static_assert(sizeof(FB_COLOR_IN_TYPE) == 1, "Compression expects one byte per pixel");
+	FB_COLOR_IN_TYPE data[FB_SIZE_X];
+	for (uint32_t y = 0; (y < pixelY) && (success); y++) {
+		menu_screen_get_row(0, y, pixelX, data);
 		success &= ImgTgaAppendCompress1Byte(data, pixelX, &FilesystemBufferwriterAppend, &fb);
 		//success &= ImgTgaAppendDirect(data, pixelX, &FilesystemBufferwriterAppend, &fb);
 	}
@@ -71,12 +70,15 @@ bool ScreenshotPalette24(uint8_t scale, const uint32_t * colormap, const uint8_t
 	success &= ImgTgaStart(pixelX * scale, pixelY * scale, colors, 24, true, &FilesystemBufferwriterAppend, &fb);
 	success &= ImgTgaAppend32To24(colormap, colors, &FilesystemBufferwriterAppend, &fb);
 	//write image data
-	for (uint32_t y = 0; y < pixelY; y++) {
-		uint8_t data[pixelX * scale];
-		for (uint32_t x = 0; x < pixelX; x++) {
-			data[x * scale] = menu_screen_get(x, y);
-			for (uint32_t s = 1; s < scale; s++) {
-				data[x * scale + s] = data[x * scale];
+	_Static_assert(sizeof(FB_COLOR_IN_TYPE) == 1, "Compression expects one byte per pixel");
+	FB_COLOR_IN_TYPE data[pixelX * scale];
+	for (uint32_t y = 0; (y < pixelY) && (success); y++) {
+		menu_screen_get_row(0, y, pixelX, data);
+		//scale up in place, starting at the end of the row
+		for (uint32_t x = pixelX; x > 0; x--) {
+			FB_COLOR_IN_TYPE color = data[x - 1];
+			for (uint32_t s = 0; s < scale; s++) {
+				data[(x - 1) * scale + s] = color;
 			}
 		}
 		for (uint32_t s = 0; s < scale; s++) {
@@ -26,15 +26,23 @@ Successfully tested cards:
 
 (No tested cards failed to work.)
 
-By default only single block read and write is enabled.
-Multiblock read can be enabled. But it does not increase the speed a lot and
-just needs more program memory.
+Reading and writing more than one block uses the multiple block commands
+CMD18 and CMD25. This saves the command and the wait for the data for every
+block. If a multiple block transfer fails, it is retried with single blocks.
+When this happens repeatedly, multiple block transfers are disabled. They can
+also be disabled by SdmmcMultiblockSet.
 
-Multiblock write has not been added.
+SdmmcReadStart and SdmmcReadPoll read blocks without blocking the caller.
+The payload of each block is transferred by DMA directly into the buffer of
+the caller, only the command, the wait for the data start and the CRC use
+the blocking SPI function. So for example audio decoding can run while the
+card delivers the next blocks.
 
 Changelog:
 2024-07-13: Version 1.0
 2025-08-05: Version 1.1
+2026-10-17: Version 1.2 - multiple block read and write, polling without delays
+2026-10-17: Version 1.3 - asynchronous reads with DMA, CRC with tables or hardware
 */
 
 #include <stdbool.h>
@@ -44,7 +52,7 @@ Changelog:
 
 #include "sdmmcAccess.h"
 
-//should provide HAL_Delay()
+//should provide HAL_Delay() and HAL_GetTick()
 #include "main.h"
 #include "utility.h"
 
@@ -55,10 +63,44 @@ typedef struct {
 	bool isSd; //if true, its a SD or SDHC card, not MMC card
 	bool isSdhc; //if true, its a SDHC or SDXC card, not SD and not MMC
 	uint32_t capacity; //in units of SDMMC_BLOCKSIZE
+	uint32_t multiblockFails; //multiple block transfers which only worked with the single block retry
 } sdmmcState_t;
 
 static sdmmcState_t g_sdmmcState;
 
+typedef struct {
+	SpiBackgroundFunc_t * pBackground;
+	SpiBackgroundDoneFunc_t * pBackgroundDone;
+	uint8_t * buffer; //receives the current block
+	uint32_t block; //number of the current block
+	uint32_t blocksLeft; //including the current block, 0 if no read is running
+	bool multiple; //CMD18 is used, otherwise CMD17 for each block
+	bool receiving; //the DMA is running, otherwise the data start is awaited
+	uint32_t tStart; //begin of the wait for the data start
+} sdmmcAsyncState_t;
+
+static sdmmcAsyncState_t g_sdmmcAsync;
+
+//set by SdmmcMultiblockSet, kept by SdmmcInit
+static bool g_sdmmcMultiblock = true;
+
+#define SDMMC_CRC_BITWISE 0
+#define SDMMC_CRC_TABLE 1
+#define SDMMC_CRC_SLICE4 2
+#define SDMMC_CRC_HW 3
+
+/*Implementation of the CRC16 checking every data block, can be set by the Makefile:
+  SDMMC_CRC_BITWISE: No tables, slowest.
+  SDMMC_CRC_TABLE: One lookup per byte, 512 bytes of flash.
+  SDMMC_CRC_SLICE4: Four bytes per step, 2KiB of RAM, filled on the first use.
+  SDMMC_CRC_HW: The CRC unit of the STM32L4. The STM32F4 can not be used, as its
+                polynomial is fixed.
+  All but SDMMC_CRC_BITWISE use a 256 byte flash table for the CRC7 of the commands.
+*/
+#ifndef SDMMC_CRC
+#define SDMMC_CRC SDMMC_CRC_TABLE
+#endif
+
 //enable to get debug messages
 //#define SDMMC_DEBUG printf
 #define SDMMC_DEBUGERROR printf
@@ -87,6 +129,12 @@ static sdmmcState_t g_sdmmcState;
 //time in [ms] to wait for data
 #define SDMMC_TIMEOUT 1000
 
+//bytes checked for the data start by each SdmmcReadPoll call
+#define SDMMC_ASYNC_POLLS 8
+
+//multiple block transfers get disabled after this number of fails
+#define SDMMC_MULTIBLOCK_FAILS 3
+
 //1 command byte, 4 parameter bytes, 1 CRC byte
 #define SDMMC_COMMAND_LEN 6
 /*Up to 8 dummy bytes can be sent, then there should be at least the R1 response in the 9th byte
@@ -95,6 +143,57 @@ static sdmmcState_t g_sdmmcState;
 #define SDMMC_R1_RESPONSE_RANGE 9
 
 
+#if SDMMC_CRC == SDMMC_CRC_BITWISE
+
+//CRC7 of the command index and the parameter
+static uint8_t SdmmcCommandCrc(const uint8_t * command) {
+	uint8_t crc = 0;
+	for (uint8_t i = 0; i < 5; i++) {
+		uint8_t d = command[i];
+		for (uint8_t j = 0; j < 8; j++) {
+			crc <<= 1;
+			if ((d ^ crc) & 0x80) {
+				crc ^= 0x09;
+			}
+			d <<= 1;
+		}
+	}
+	return crc & 0x7F;
+}
+
+#else
+
+//CRC7 of every byte value, used by all variants with a table
+static const uint8_t g_sdmmcCrc7Table[256] = {
+	0x00, 0x09, 0x12, 0x1B, 0x24, 0x2D, 0x36, 0x3F, 0x48, 0x41, 0x5A, 0x53, 0x6C, 0x65, 0x7E, 0x77,
+	0x19, 0x10, 0x0B, 0x02, 0x3D, 0x34, 0x2F, 0x26, 0x51, 0x58, 0x43, 0x4A, 0x75, 0x7C, 0x67, 0x6E,
+	0x32, 0x3B, 0x20, 0x29, 0x16, 0x1F, 0x04, 0x0D, 0x7A, 0x73, 0x68, 0x61, 0x5E, 0x57, 0x4C, 0x45,
+	0x2B, 0x22, 0x39, 0x30, 0x0F, 0x06, 0x1D, 0x14, 0x63, 0x6A, 0x71, 0x78, 0x47, 0x4E, 0x55, 0x5C,
+	0x64, 0x6D, 0x76, 0x7F, 0x40, 0x49, 0x52, 0x5B, 0x2C, 0x25, 0x3E, 0x37, 0x08, 0x01, 0x1A, 0x13,
+	0x7D, 0x74, 0x6F, 0x66, 0x59, 0x50, 0x4B, 0x42, 0x35, 0x3C, 0x27, 0x2E, 0x11, 0x18, 0x03, 0x0A,
+	0x56, 0x5F, 0x44, 0x4D, 0x72, 0x7B, 0x60, 0x69, 0x1E, 0x17, 0x0C, 0x05, 0x3A, 0x33, 0x28, 0x21,
+	0x4F, 0x46, 0x5D, 0x54, 0x6B, 0x62, 0x79, 0x70, 0x07, 0x0E, 0x15, 0x1C, 0x23, 0x2A, 0x31, 0x38,
+	0x41, 0x48, 0x53, 0x5A, 0x65, 0x6C, 0x77, 0x7E, 0x09, 0x00, 0x1B, 0x12, 0x2D, 0x24, 0x3F, 0x36,
+	0x58, 0x51, 0x4A, 0x43, 0x7C, 0x75, 0x6E, 0x67, 0x10, 0x19, 0x02, 0x0B, 0x34, 0x3D, 0x26, 0x2F,
+	0x73, 0x7A, 0x61, 0x68, 0x57, 0x5E, 0x45, 0x4C, 0x3B, 0x32, 0x29, 0x20, 0x1F, 0x16, 0x0D, 0x04,
+	0x6A, 0x63, 0x78, 0x71, 0x4E, 0x47, 0x5C, 0x55, 0x22, 0x2B, 0x30, 0x39, 0x06, 0x0F, 0x14, 0x1D,
+	0x25, 0x2C, 0x37, 0x3E, 0x01, 0x08, 0x13, 0x1A, 0x6D, 0x64, 0x7F, 0x76, 0x49, 0x40, 0x5B, 0x52,
+	0x3C, 0x35, 0x2E, 0x27, 0x18, 0x11, 0x0A, 0x03, 0x74, 0x7D, 0x66, 0x6F, 0x50, 0x59, 0x42, 0x4B,
+	0x17, 0x1E, 0x05, 0x0C, 0x33, 0x3A, 0x21, 0x28, 0x5F, 0x56, 0x4D, 0x44, 0x7B, 0x72, 0x69, 0x60,
+	0x0E, 0x07, 0x1C, 0x15, 0x2A, 0x23, 0x38, 0x31, 0x46, 0x4F, 0x54, 0x5D, 0x62, 0x6B, 0x70, 0x79
+};
+
+//CRC7 of the command index and the parameter
+static uint8_t SdmmcCommandCrc(const uint8_t * command) {
+	uint8_t crc = 0;
+	for (uint8_t i = 0; i < 5; i++) {
+		crc = g_sdmmcCrc7Table[(crc << 1) ^ command[i]];
+	}
+	return crc;
+}
+
+#endif
+
 /*Fills in the command in outBuff, also calculating the CRC. Everything after
   the crc is padded with 0xFF.
   inBuff and outBuff must be buffLen in size.
@@ -112,27 +211,19 @@ void SdmmcFillCommand(uint8_t * outBuff, uint8_t * inBuff, size_t buffLen, uint8
 	outBuff[2] = param >> 16;
 	outBuff[3] = param >> 8;
 	outBuff[4] = param;
-	uint8_t crc = 0;
-	for (uint8_t i = 0; i < 5; i++) {
-		uint8_t d = outBuff[i];
-		for (uint8_t j = 0; j < 8; j++) {
-			crc <<= 1;
-			if ((d ^ crc) & 0x80) {
-				crc ^= 0x09;
-			}
-			d <<= 1;
-		}
-	}
-	outBuff[5] = (crc << 1) | 1;
+	outBuff[5] = (SdmmcCommandCrc(outBuff) << 1) | 1;
 }
 
 /*See https://www.nongnu.org/avr-libc/user-manual/group__util__crc.html
   _crc_xmodem_update()
+  All other variants must give the same result, this is checked by
+  unittests/testSdmmcCrc.c.
 */
-uint16_t SdmmcDataCrc(const uint8_t * datablock) {
+#if (SDMMC_CRC == SDMMC_CRC_BITWISE) || (SDMMC_CRC == SDMMC_CRC_SLICE4)
+static uint16_t SdmmcDataCrcBitwise(const uint8_t * data, size_t len) {
 	uint16_t crc = 0;
-	for (uint32_t i = 0; i < SDMMC_BLOCKSIZE; i++) {
-		uint8_t d = datablock[i];
+	for (size_t i = 0; i < len; i++) {
+		uint8_t d = data[i];
 		crc = crc ^ ((uint16_t)d << 8);
 		for (uint32_t j = 0; j < 8; j++) {
 			if (crc & 0x8000) {
@@ -144,6 +235,125 @@ uint16_t SdmmcDataCrc(const uint8_t * datablock) {
 	}
 	return crc;
 }
+#endif
+
+#if SDMMC_CRC == SDMMC_CRC_BITWISE
+
+uint16_t SdmmcDataCrc(const uint8_t * datablock) {
+	return SdmmcDataCrcBitwise(datablock, SDMMC_BLOCKSIZE);
+}
+
+#elif SDMMC_CRC == SDMMC_CRC_TABLE
+
+//CRC of every byte value, so one lookup replaces the 8 steps of SdmmcDataCrcBitwise
+static const uint16_t g_sdmmcCrc16Table[256] = {
+	0x0000, 0x1021, 0x2042, 0x3063, 0x4084, 0x50A5, 0x60C6, 0x70E7,
+	0x8108, 0x9129, 0xA14A, 0xB16B, 0xC18C, 0xD1AD, 0xE1CE, 0xF1EF,
+	0x1231, 0x0210, 0x3273, 0x2252, 0x52B5, 0x4294, 0x72F7, 0x62D6,
+	0x9339, 0x8318, 0xB37B, 0xA35A, 0xD3BD, 0xC39C, 0xF3FF, 0xE3DE,
+	0x2462, 0x3443, 0x0420, 0x1401, 0x64E6, 0x74C7, 0x44A4, 0x5485,
+	0xA56A, 0xB54B, 0x8528, 0x9509, 0xE5EE, 0xF5CF, 0xC5AC, 0xD58D,
+	0x3653, 0x2672, 0x1611, 0x0630, 0x76D7, 0x66F6, 0x5695, 0x46B4,
+	0xB75B, 0xA77A, 0x9719, 0x8738, 0xF7DF, 0xE7FE, 0xD79D, 0xC7BC,
+	0x48C4, 0x58E5, 0x6886, 0x78A7, 0x0840, 0x1861, 0x2802, 0x3823,
+	0xC9CC, 0xD9ED, 0xE98E, 0xF9AF, 0x8948, 0x9969, 0xA90A, 0xB92B,
+	0x5AF5, 0x4AD4, 0x7AB7, 0x6A96, 0x1A71, 0x0A50, 0x3A33, 0x2A12,
+	0xDBFD, 0xCBDC, 0xFBBF, 0xEB9E, 0x9B79, 0x8B58, 0xBB3B, 0xAB1A,
+	0x6CA6, 0x7C87, 0x4CE4, 0x5CC5, 0x2C22, 0x3C03, 0x0C60, 0x1C41,
+	0xEDAE, 0xFD8F, 0xCDEC, 0xDDCD, 0xAD2A, 0xBD0B, 0x8D68, 0x9D49,
+	0x7E97, 0x6EB6, 0x5ED5, 0x4EF4, 0x3E13, 0x2E32, 0x1E51, 0x0E70,
+	0xFF9F, 0xEFBE, 0xDFDD, 0xCFFC, 0xBF1B, 0xAF3A, 0x9F59, 0x8F78,
+	0x9188, 0x81A9, 0xB1CA, 0xA1EB, 0xD10C, 0xC12D, 0xF14E, 0xE16F,
+	0x1080, 0x00A1, 0x30C2, 0x20E3, 0x5004, 0x4025, 0x7046, 0x6067,
+	0x83B9, 0x9398, 0xA3FB, 0xB3DA, 0xC33D, 0xD31C, 0xE37F, 0xF35E,
+	0x02B1, 0x1290, 0x22F3, 0x32D2, 0x4235, 0x5214, 0x6277, 0x7256,
+	0xB5EA, 0xA5CB, 0x95A8, 0x8589, 0xF56E, 0xE54F, 0xD52C, 0xC50D,
+	0x34E2, 0x24C3, 0x14A0, 0x0481, 0x7466, 0x6447, 0x5424, 0x4405,
+	0xA7DB, 0xB7FA, 0x8799, 0x97B8, 0xE75F, 0xF77E, 0xC71D, 0xD73C,
+	0x26D3, 0x36F2, 0x0691, 0x16B0, 0x6657, 0x7676, 0x4615, 0x5634,
+	0xD94C, 0xC96D, 0xF90E, 0xE92F, 0x99C8, 0x89E9, 0xB98A, 0xA9AB,
+	0x5844, 0x4865, 0x7806, 0x6827, 0x18C0, 0x08E1, 0x3882, 0x28A3,
+	0xCB7D, 0xDB5C, 0xEB3F, 0xFB1E, 0x8BF9, 0x9BD8, 0xABBB, 0xBB9A,
+	0x4A75, 0x5A54, 0x6A37, 0x7A16, 0x0AF1, 0x1AD0, 0x2AB3, 0x3A92,
+	0xFD2E, 0xED0F, 0xDD6C, 0xCD4D, 0xBDAA, 0xAD8B, 0x9DE8, 0x8DC9,
+	0x7C26, 0x6C07, 0x5C64, 0x4C45, 0x3CA2, 0x2C83, 0x1CE0, 0x0CC1,
+	0xEF1F, 0xFF3E, 0xCF5D, 0xDF7C, 0xAF9B, 0xBFBA, 0x8FD9, 0x9FF8,
+	0x6E17, 0x7E36, 0x4E55, 0x5E74, 0x2E93, 0x3EB2, 0x0ED1, 0x1EF0
+};
+
+uint16_t SdmmcDataCrc(const uint8_t * datablock) {
+	uint16_t crc = 0;
+	for (uint32_t i = 0; i < SDMMC_BLOCKSIZE; i++) {
+		crc = (crc << 8) ^ g_sdmmcCrc16Table[(crc >> 8) ^ datablock[i]];
+	}
+	return crc;
+}
+
+#elif SDMMC_CRC == SDMMC_CRC_SLICE4
+
+/*g_sdmmcCrc16Slice[0] is the same as the byte table, g_sdmmcCrc16Slice[k]
+  is the CRC of a byte followed by k zero bytes. So four bytes need four
+  independent lookups.
+*/
+static uint16_t g_sdmmcCrc16Slice[4][256];
+static bool g_sdmmcCrc16SliceReady;
+
+static void SdmmcDataCrcSliceInit(void) {
+	for (uint32_t n = 0; n < 256; n++) {
+		uint8_t d = n;
+		g_sdmmcCrc16Slice[0][n] = SdmmcDataCrcBitwise(&d, sizeof(d));
+	}
+	for (uint32_t k = 1; k < 4; k++) {
+		for (uint32_t n = 0; n < 256; n++) {
+			uint16_t prev = g_sdmmcCrc16Slice[k - 1][n];
+			g_sdmmcCrc16Slice[k][n] = (prev << 8) ^ g_sdmmcCrc16Slice[0][prev >> 8];
+		}
+	}
+	g_sdmmcCrc16SliceReady = true;
+}
+
+uint16_t SdmmcDataCrc(const uint8_t * datablock) {
+	if (!g_sdmmcCrc16SliceReady) {
+		SdmmcDataCrcSliceInit();
+	}
+	uint16_t crc = 0;
+	for (uint32_t i = 0; i < SDMMC_BLOCKSIZE; i += 4) {
+		uint16_t high = crc ^ ((datablock[i] << 8) | datablock[i + 1]);
+		crc = g_sdmmcCrc16Slice[3][high >> 8] ^ g_sdmmcCrc16Slice[2][high & 0xFF] ^
+		      g_sdmmcCrc16Slice[1][datablock[i + 2]] ^ g_sdmmcCrc16Slice[0][datablock[i + 3]];
+	}
+	return crc;
+}
+
+#elif SDMMC_CRC == SDMMC_CRC_HW
+
+#ifndef CRC_CR_POLYSIZE
+#error "SDMMC_CRC_HW needs a CRC unit with a programmable polynomial, like the one of the STM32L4"
+#endif
+
+static bool g_sdmmcCrcHwReady;
+
+uint16_t SdmmcDataCrc(const uint8_t * datablock) {
+	if (!g_sdmmcCrcHwReady) {
+		__HAL_RCC_CRC_CLK_ENABLE();
+		g_sdmmcCrcHwReady = true;
+	}
+	//set every time, so the unit can be shared with other code
+	CRC->POL = 0x1021;
+	CRC->INIT = 0;
+	CRC->CR = CRC_CR_POLYSIZE_0 | CRC_CR_RESET; //16 bit, no bit reversal
+	for (uint32_t i = 0; i < SDMMC_BLOCKSIZE; i += sizeof(uint32_t)) {
+		uint32_t data;
+		memcpy(&data, datablock + i, sizeof(data));
+		//the unit processes the most significant byte first
+		CRC->DR = __REV(data);
+	}
+	return CRC->DR;
+}
+
+#else
+#error "Unsupported SDMMC_CRC"
+#endif
 
 /* Returns len in the case of an error. Otherwise the index in data with the response.
 */
@@ -606,98 +816,202 @@ static void SdmmcDisableCs(void) {
 	g_sdmmcState.pSpi(NULL, NULL, 0,  g_sdmmcState.chipSelect, true);
 }
 
-bool SdmmcReadSingleBlock(uint8_t * buffer, uint32_t block) {
-	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (block > g_sdmmcState.capacity)) {
-		SDMMC_DEBUGERROR("Error, invalid read request 0x%x, max 0x%x\r\n", (unsigned int)block, (unsigned int)g_sdmmcState.capacity);
-		return false;
+/*Reads one byte while waiting for the data start token.
+  returns 1: data start found, 0: not yet, -1: the card sent a data error token
+*/
+static int SdmmcPollDataStart(void) {
+	uint8_t dataOut = 0xFF;
+	uint8_t dataIn = 0;
+	g_sdmmcState.pSpi(&dataOut, &dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
+	SDMMC_DEBUGHEX(&dataIn, sizeof(dataIn));
+	if (SdmmcSeekDataStart(&dataIn, sizeof(dataIn)) == 0) {
+		return 1;
 	}
-	uint8_t * bufferStart = buffer;
-	if (g_sdmmcState.isSdhc == false) {
-		block *= SDMMC_BLOCKSIZE;
+	if ((dataIn) && ((dataIn & 0xF0) == 0)) {
+		SDMMC_DEBUGERROR("Error, data error token 0x%x\r\n", (unsigned int)dataIn);
+		return -1;
 	}
-	SDMMC_DEBUG("Read 0x%x\r\n", (unsigned int)block);
-	uint8_t dataOutCmd17[16]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait byte, 1 response bytes, 1 extra byte for have a good buffer size
-	uint8_t dataInCmd17[16];
-	SdmmcFillCommand(dataOutCmd17, dataInCmd17, sizeof(dataOutCmd17), 17, block);
-	size_t thisRound = sizeof(dataOutCmd17);
-	g_sdmmcState.pSpi(dataOutCmd17, dataInCmd17, thisRound, g_sdmmcState.chipSelect, false);
-	SDMMC_DEBUG("Response from CMD17 (read single block):\r\n");
-	SDMMC_DEBUGHEX(dataInCmd17, sizeof(dataInCmd17));
-	size_t idxR1 = SdmmcSDR1ResponseIndex(dataInCmd17, sizeof(dataInCmd17));
-	if (idxR1 == 0) {
-		SDMMC_DEBUGERROR("Error, no R1 response\r\n");
-		SdmmcDisableCs();
+	return 0;
+}
+
+/*Polls until the card sends the data start token. There is no delay between
+  the polls, as the transfer of each byte already takes some µs and most cards
+  answer within a few bytes.
+  Returns false on a timeout or if the card sends a data error token.
+*/
+static bool SdmmcWaitDataStart(void) {
+	uint32_t tStart = HAL_GetTick();
+	uint32_t polls = 0;
+	do {
+		int result = SdmmcPollDataStart();
+		polls++;
+		if (result > 0) {
+			SDMMC_DEBUG("Data start found after %u reads\r\n", (unsigned int)polls);
+			return true;
+		}
+		if (result < 0) {
+			return false;
+		}
+	} while ((HAL_GetTick() - tStart) < SDMMC_TIMEOUT);
+	SDMMC_DEBUGERROR("Error, no data start found\r\n");
+	return false;
+}
+
+//Polls until the card does not signal busy anymore, again without delays
+static bool SdmmcWaitNotBusy(void) {
+	uint32_t tStart = HAL_GetTick();
+	uint32_t polls = 0;
+	do {
+		uint8_t dataOut[8];
+		uint8_t dataIn[8] = {0};
+		memset(dataOut, 0xFF, sizeof(dataOut));
+		g_sdmmcState.pSpi(dataOut, dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
+		polls++;
+		//the busy signal ends with the last byte, so it can not be followed by data
+		if (dataIn[sizeof(dataIn) - 1] == 0xFF) {
+			SDMMC_DEBUG("Busy for %u polls\r\n", (unsigned int)polls);
+			return true;
+		}
+	} while ((HAL_GetTick() - tStart) < SDMMC_TIMEOUT);
+	SDMMC_DEBUGERROR("Error, card stays busy\r\n");
+	return false;
+}
+
+//Reads the CRC following a data block and compares it with the received block
+static bool SdmmcReadBlockCrc(const uint8_t * block) {
+	uint8_t dataOut[2] = {0xFF, 0xFF};
+	uint8_t crc[2];
+	g_sdmmcState.pSpi(dataOut, crc, sizeof(crc), g_sdmmcState.chipSelect, false);
+	SDMMC_DEBUG("CRC:\r\n");
+	SDMMC_DEBUGHEX(crc, sizeof(crc));
+	uint16_t crcIs = SdmmcDataCrc(block);
+	uint16_t crcShould = (crc[0] << 8) | crc[1];
+	if (crcIs != crcShould) {
+		SDMMC_DEBUGERROR("Error, CRC mismatch, should %x, is %x\r\n", (unsigned int)crcShould, (unsigned int)crcIs);
+		SDMMC_DEBUGHEX(block, SDMMC_BLOCKSIZE);
 		return false;
 	}
-	if (dataInCmd17[idxR1] != 0) {
-		SdmmcDisableCs();
-		return false;
+	return true;
+}
+
+/*Searches the bytes already received after the R1 response for the data
+  start token and copies data following it into outBlock.
+  Returns the number of copied bytes.
+*/
+static size_t SdmmcCopyPreserved(const uint8_t * startBytes, size_t startLen, uint8_t * outBlock, bool * pGotDataStart) {
+	size_t dStart = SdmmcSeekDataStart(startBytes, startLen);
+	*pGotDataStart = false;
+	if (dStart >= startLen) {
+		return 0;
 	}
-	size_t idx = idxR1 + 1;
-	size_t bytesLeft = SDMMC_BLOCKSIZE;
-	//1. do we already have some data we can search and copy?
-	bool gotDataStart = false;
-	size_t dataSearchRange = sizeof(dataInCmd17) - idx;
-	size_t dStart = SdmmcSeekDataStart(dataInCmd17 + idx, dataSearchRange) + idx;
-	if (dStart < sizeof(dataInCmd17)) {
-		gotDataStart = true;
-		size_t dData = dStart + 1;
-		SDMMC_DEBUG("Start already present\r\n");
-		if (dData < sizeof(dataInCmd17)) { //there are already data we need to copy
-			size_t dLen = sizeof(dataInCmd17) - dData;
-			SDMMC_DEBUG("Preserved bytes: %u\r\n", (unsigned int)dLen);
-			memcpy(buffer, dataInCmd17 + dData, dLen);
-			bytesLeft -= dLen;
-			buffer += dLen;
-		}
+	*pGotDataStart = true;
+	SDMMC_DEBUG("Start already present\r\n");
+	size_t dData = dStart + 1;
+	size_t dLen = startLen - dData;
+	if (dLen) { //there are already data we need to copy
+		SDMMC_DEBUG("Preserved bytes: %u\r\n", (unsigned int)dLen);
+		memcpy(outBlock, startBytes + dData, dLen);
 	}
+	return dLen;
+}
+
+/*Reads one data block, including the start token and the CRC.
+  startBytes are the bytes already received after the R1 response. They
+  may contain the data start token and the first data bytes.
+  Chip select is kept active.
+*/
+static bool SdmmcReadBlockComplete(const uint8_t * startBytes, size_t startLen, uint8_t * outBlock) {
+	uint8_t * bufferStart = outBlock;
+	//1. do we already have some data we can search and copy?
+	bool gotDataStart;
+	size_t preserved = SdmmcCopyPreserved(startBytes, startLen, outBlock, &gotDataStart);
+	size_t bytesLeft = SDMMC_BLOCKSIZE - preserved;
+	outBlock += preserved;
 	//2. no start? lets wait for the start
-	if (gotDataStart == false) {
-		for (uint32_t i = 0; i < SDMMC_TIMEOUT; i++) {
-			uint8_t dataOut = 0xFF;
-			uint8_t dataIn = 0;
-			g_sdmmcState.pSpi(&dataOut, &dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
-			SDMMC_DEBUGHEX(&dataIn, sizeof(dataIn));
-			if (SdmmcSeekDataStart(&dataIn, sizeof(dataIn)) == 0) {
-				SDMMC_DEBUG("Data start found after %u reads\r\n", (unsigned int)(i + 1));
-				gotDataStart = true;
-				break;
-			}
-			HAL_Delay(1);
-		}
-	}
-	if (!gotDataStart) {
-		SDMMC_DEBUGERROR("Error, no data start found\r\n");
-		SdmmcDisableCs();
+	if ((gotDataStart == false) && (SdmmcWaitDataStart() == false)) {
 		return false;
 	}
 	//Copy rest of the data
 	uint8_t outBuffer[64]; //we could use one huge transfer, but this would need 512 byte on the stack
 	memset(outBuffer, 0xFF, sizeof(outBuffer));
 	while (bytesLeft) {
-		thisRound = MIN(bytesLeft, sizeof(outBuffer));
-		g_sdmmcState.pSpi(outBuffer, buffer, thisRound, g_sdmmcState.chipSelect, false);
-		SDMMC_DEBUGHEX(buffer, thisRound);
+		size_t thisRound = MIN(bytesLeft, sizeof(outBuffer));
+		g_sdmmcState.pSpi(outBuffer, outBlock, thisRound, g_sdmmcState.chipSelect, false);
+		SDMMC_DEBUGHEX(outBlock, thisRound);
 		bytesLeft -= thisRound;
-		buffer += thisRound;
+		outBlock += thisRound;
 	}
-	//Read CRC and disable chip select
-	uint8_t crc[2];
-	g_sdmmcState.pSpi(outBuffer, crc, sizeof(crc), g_sdmmcState.chipSelect, true);
-	SDMMC_DEBUG("CRC:\r\n");
-	SDMMC_DEBUGHEX(crc, sizeof(crc));
-	uint16_t crcIs = SdmmcDataCrc(bufferStart);
-	uint16_t crcShould = (crc[0] << 8) | crc[1];
-	if (crcIs != crcShould) {
-		SDMMC_DEBUGERROR("Error, CRC mismatch, should %x, is %x at block %x\r\n", (unsigned int)crcShould, (unsigned int)crcIs, (unsigned int)block);
-		SDMMC_DEBUGHEX(bufferStart, SDMMC_BLOCKSIZE);
+	return SdmmcReadBlockCrc(bufferStart);
+}
+
+/*Sends the data token, the block and its CRC. Then waits until the card has
+  written the block. Chip select is kept active.
+*/
+static bool SdmmcWriteBlockComplete(const uint8_t * buffer, uint8_t token) {
+	uint16_t crc = SdmmcDataCrc(buffer);
+	uint8_t dataStart[2] = {0xFF, token};
+	g_sdmmcState.pSpi(dataStart, NULL, sizeof(dataStart), g_sdmmcState.chipSelect, false);
+	g_sdmmcState.pSpi(buffer, NULL, SDMMC_BLOCKSIZE,  g_sdmmcState.chipSelect, false);
+	uint8_t terminate[3];
+	terminate[0] = crc >> 8;
+	terminate[1] = crc;
+	terminate[2] = 0xFF;
+	uint8_t response[3];
+	g_sdmmcState.pSpi(terminate, response, sizeof(terminate),  g_sdmmcState.chipSelect, false);
+	SDMMC_DEBUG("Data response: 0x%x\r\n", response[2]);
+	if ((response[2] & 0x1F ) != 0x5) {
+		SDMMC_DEBUGERROR("Error, data rejected\r\n");
 		return false;
 	}
+	//ok, now wait until the card indicates its not busy writing anymore
+	return SdmmcWaitNotBusy();
+}
+
+/*Sends a read or write command with a block address and checks the R1 response.
+  If successful, chip select is kept active and the bytes after the R1
+  response are in dataIn.
+*/
+static bool SdmmcBlockCommand(uint8_t cmd, uint32_t block, uint8_t * dataIn, size_t len, size_t * pIdxData) {
+	if (g_sdmmcState.isSdhc == false) {
+		block *= SDMMC_BLOCKSIZE;
+	}
+	SDMMC_DEBUG("CMD%u 0x%x\r\n", (unsigned int)cmd, (unsigned int)block);
+	uint8_t dataOut[16];
+	SdmmcFillCommand(dataOut, dataIn, len, cmd, block);
+	g_sdmmcState.pSpi(dataOut, dataIn, len, g_sdmmcState.chipSelect, false);
+	SDMMC_DEBUGHEX(dataIn, len);
+	size_t idxR1 = SdmmcSDR1ResponseIndex(dataIn, len);
+	if (idxR1 == 0) {
+		SDMMC_DEBUGERROR("Error, no R1 response\r\n");
+		SdmmcDisableCs();
+		return false;
+	}
+	if (dataIn[idxR1] != 0) {
+		SDMMC_DEBUGERROR("Error, CMD%u rejected with 0x%x\r\n", (unsigned int)cmd, (unsigned int)dataIn[idxR1]);
+		SdmmcDisableCs();
+		return false;
+	}
+	*pIdxData = idxR1 + 1;
 	return true;
 }
 
-//Enable to use multi block read command
-#if 0
+bool SdmmcReadSingleBlock(uint8_t * buffer, uint32_t block) {
+	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (block > g_sdmmcState.capacity)) {
+		SDMMC_DEBUGERROR("Error, invalid read request 0x%x, max 0x%x\r\n", (unsigned int)block, (unsigned int)g_sdmmcState.capacity);
+		return false;
+	}
+	uint8_t dataInCmd17[16]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait byte, 1 response bytes, 1 extra byte for have a good buffer size
+	size_t idx;
+	if (!SdmmcBlockCommand(17, block, dataInCmd17, sizeof(dataInCmd17), &idx)) {
+		return false;
+	}
+	bool success = SdmmcReadBlockComplete(dataInCmd17 + idx, sizeof(dataInCmd17) - idx, buffer);
+	SdmmcDisableCs();
+	if (!success) {
+		SDMMC_DEBUGERROR("Error, reading block 0x%x failed\r\n", (unsigned int)block);
+	}
+	return success;
+}
 
 static bool SdmmcContainsTerminate(const uint8_t * buffer, size_t len) {
 	for (size_t i = 0; i < len; i++) {
@@ -708,111 +1022,95 @@ static bool SdmmcContainsTerminate(const uint8_t * buffer, size_t len) {
 	return false;
 }
 
+//Sends CMD12 to stop a multiple block read and disables chip select
 static bool SdmmcTerminateTransfer(void) {
 	SDMMC_DEBUG("Terminating...\r\n");
 	bool success = false;
-	uint8_t dataOutCmd12[15]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, 1-8 wait bytes, 1 response bytes
+	uint8_t dataOutCmd12[15]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, 1 stuff byte, 1-8 wait bytes, 1 response bytes
 	uint8_t dataInCmd12[15];
 	SdmmcFillCommand(dataOutCmd12, dataInCmd12, sizeof(dataOutCmd12), 12, 0x0);
 	g_sdmmcState.pSpi(dataOutCmd12, dataInCmd12, sizeof(dataOutCmd12), g_sdmmcState.chipSelect, false);
 	SDMMC_DEBUGHEX(dataInCmd12, sizeof(dataInCmd12));
-
+	//the byte following the command is a stuff byte, it could still be data of the next block
 	size_t index = SdmmcSeekSDR1Response(dataInCmd12 + SDMMC_COMMAND_LEN + 1, SDMMC_R1_RESPONSE_RANGE - 1);
-
-	if (index < SDMMC_R1_RESPONSE_RANGE) {
-		size_t searchStart = SDMMC_COMMAND_LEN + index + 1;
-		if ((searchStart == sizeof(dataInCmd12)) || (SdmmcContainsTerminate(dataInCmd12 + searchStart, sizeof(dataInCmd12) - searchStart) == false)) {
-			for (uint32_t i = 0; i < 500; i++) {
-				uint8_t dataOut[8];
-				memset(dataOut, 0xFF, sizeof(dataOut));
-				uint8_t dataIn[8] = {0};
-				g_sdmmcState.pSpi(dataOut, dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
-				SDMMC_DEBUGHEX(dataIn, sizeof(dataIn));
-				if (SdmmcContainsTerminate(dataIn, sizeof(dataIn))) {
-					success = true;
-					break;
-				}
-				HAL_Delay(1);
-			}
-		} else {
+	if (index < (SDMMC_R1_RESPONSE_RANGE - 1)) {
+		size_t searchStart = SDMMC_COMMAND_LEN + index + 2;
+		if ((searchStart < sizeof(dataInCmd12)) &&
+		    (SdmmcContainsTerminate(dataInCmd12 + searchStart, sizeof(dataInCmd12) - searchStart))) {
 			success = true;
-		}
-		if (!success) {
-			SDMMC_DEBUGERROR("Error, card stays busy\r\n");
+		} else {
+			success = SdmmcWaitNotBusy();
 		}
 	} else {
 		SDMMC_DEBUGERROR("Error, no response found\r\n");
-	}
-	if (!success) {
 		SDMMC_DEBUGHEX(dataInCmd12, sizeof(dataInCmd12));
 	}
-	g_sdmmcState.pSpi(NULL, NULL, 0, g_sdmmcState.chipSelect, true);
+	SdmmcDisableCs();
 	return success;
 }
 
-static bool SdmmcReadBlockComplete(const uint8_t * startBytes, size_t startLen, uint8_t * outBlock) {
-	size_t bytesLeft = SDMMC_BLOCKSIZE;
-	uint8_t * bufferStart = outBlock;
-	//1. do we already have some data we can search and copy?
-	bool gotDataStart = false;
-	printf("Seek in\r\n");
-	SDMMC_DEBUGHEX(startBytes, startLen);
-	size_t dStart = SdmmcSeekDataStart(startBytes, startLen);
-	if (dStart < startLen) {
-		gotDataStart = true;
-		size_t dData = dStart + 1;
-		SDMMC_DEBUG("Start already present\r\n");
-		if (dData < startLen) { //there are already data we need to copy
-			size_t dLen = startLen - dData;
-			SDMMC_DEBUG("Preserved bytes: %u\r\n", (unsigned int)dLen);
-			memcpy(outBlock, startBytes + dData, dLen);
-			bytesLeft -= dLen;
-			outBlock += dLen;
-		}
+static bool SdmmcReadMultiple(uint8_t * buffer, uint32_t block, uint32_t blockNum) {
+	uint8_t dataInCmd18[16]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait bytes, 1 response bytes, 1 extra byte for have a good buffer size
+	size_t idx;
+	if (!SdmmcBlockCommand(18, block, dataInCmd18, sizeof(dataInCmd18), &idx)) {
+		return false;
 	}
-	//2. no start? lets wait for the start
-	if (gotDataStart == false) {
-		for (uint32_t i = 0; i < SDMMC_TIMEOUT; i++) {
-			uint8_t dataOut = 0xFF;
-			uint8_t dataIn = 0;
-			g_sdmmcState.pSpi(&dataOut, &dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
-			SDMMC_DEBUGHEX(&dataIn, sizeof(dataIn));
-			if (SdmmcSeekDataStart(&dataIn, sizeof(dataIn)) == 0) {
-				SDMMC_DEBUG("Data start found after %u reads\r\n", (unsigned int)(i + 1));
-				gotDataStart = true;
-				break;
-			}
-			HAL_Delay(1);
+	bool success = true;
+	size_t preservedBytes = sizeof(dataInCmd18) - idx;
+	for (uint32_t i = 0; i < blockNum; i++) {
+		if (!SdmmcReadBlockComplete(dataInCmd18 + idx, preservedBytes, buffer + i * SDMMC_BLOCKSIZE)) {
+			SDMMC_DEBUGERROR("Error, reading block 0x%x failed\r\n", (unsigned int)(block + i));
+			success = false;
+			break;
 		}
+		preservedBytes = 0;
 	}
-	if (!gotDataStart) {
-		SDMMC_DEBUGERROR("Error, no data start found\r\n");
+	//the card continues sending blocks until it gets the stop command
+	if (!SdmmcTerminateTransfer()) {
+		success = false;
+	}
+	return success;
+}
+
+static bool SdmmcWriteMultiple(const uint8_t * buffer, uint32_t block, uint32_t blockNum) {
+	uint8_t dataInCmd25[15]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait byte, 1 response bytes,
+	size_t idx;
+	if (!SdmmcBlockCommand(25, block, dataInCmd25, sizeof(dataInCmd25), &idx)) {
 		return false;
 	}
-	//Copy rest of the data
-	uint8_t outBuffer[64]; //we could use one huge transfer, but this would need 512 byte on the stack
-	memset(outBuffer, 0xFF, sizeof(outBuffer));
-	while (bytesLeft) {
-		size_t thisRound = MIN(bytesLeft, sizeof(outBuffer));
-		g_sdmmcState.pSpi(outBuffer, outBlock, thisRound, g_sdmmcState.chipSelect, false);
-		SDMMC_DEBUGHEX(outBlock, thisRound);
-		bytesLeft -= thisRound;
-		outBlock += thisRound;
+	bool success = true;
+	for (uint32_t i = 0; i < blockNum; i++) {
+		if (!SdmmcWriteBlockComplete(buffer + i * SDMMC_BLOCKSIZE, 0xFC)) {
+			SDMMC_DEBUGERROR("Error, writing block 0x%x failed\r\n", (unsigned int)(block + i));
+			success = false;
+			break;
+		}
 	}
-	//Read CRC and compare
-	uint8_t crc[2];
-	g_sdmmcState.pSpi(outBuffer, crc, sizeof(crc), g_sdmmcState.chipSelect, false);
-	SDMMC_DEBUG("CRC:\r\n");
-	SDMMC_DEBUGHEX(crc, sizeof(crc));
-	uint16_t crcIs = SdmmcDataCrc(bufferStart);
-	uint16_t crcShould = (crc[0] << 8) | crc[1];
-	if (crcIs != crcShould) {
-		SDMMC_DEBUGERROR("Error, CRC mismatch, should %x, is %x\r\n", (unsigned int)crcShould, (unsigned int)crcIs);
-		return false;
+	/*The stop tran token ends the transfer, also after a rejected block.
+	  The card signals busy one byte later.
+	*/
+	uint8_t stopTran[2] = {0xFD, 0xFF};
+	g_sdmmcState.pSpi(stopTran, NULL, sizeof(stopTran), g_sdmmcState.chipSelect, false);
+	if (!SdmmcWaitNotBusy()) {
+		success = false;
 	}
-	return true;
+	SdmmcDisableCs();
+	return success;
 }
 
+static bool SdmmcMultipleUse(uint32_t blockNum) {
+	return (blockNum > 1) && (SdmmcMultiblockGet());
+}
+
+/*Called after a multiple block transfer failed, but the single block retry
+  worked. If this happens repeatedly, the card likely does not support it properly.
+*/
+static void SdmmcMultipleFailed(void) {
+	g_sdmmcState.multiblockFails++;
+	if (g_sdmmcState.multiblockFails == SDMMC_MULTIBLOCK_FAILS) {
+		SDMMC_DEBUGERROR("Disabling multiple block transfers\r\n");
+	}
+}
 
 bool SdmmcRead(uint8_t * buffer, uint32_t block, uint32_t blockNum) {
 	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (blockNum == 0) ||
@@ -820,133 +1118,193 @@ bool SdmmcRead(uint8_t * buffer, uint32_t block, uint32_t blockNum) {
 		SDMMC_DEBUGERROR("Error, invalid read request 0x%x, blocks %u, max 0x%x\r\n", (unsigned int)block, (unsigned int)blockNum, (unsigned int)g_sdmmcState.capacity);
 		return false;
 	}
-	if (g_sdmmcState.isSdhc == false) {
-		block *= SDMMC_BLOCKSIZE;
+	bool multiple = SdmmcMultipleUse(blockNum);
+	if (multiple) {
+		if (SdmmcReadMultiple(buffer, block, blockNum)) {
+			g_sdmmcState.multiblockFails = 0;
+			return true;
+		}
+		SDMMC_DEBUGERROR("Retry with single block reads\r\n");
 	}
-	SDMMC_DEBUG("Read 0x%x, blocks %u\r\n", (unsigned int)block, (unsigned int)blockNum);
-	bool success = false;
-	uint8_t dataOutCmd18[16]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait bytes, 1 response bytes, 1 extra byte for have a good buffer size
-	uint8_t dataInCmd18[16];
-	SdmmcFillCommand(dataOutCmd18, dataInCmd18, sizeof(dataOutCmd18), 18, block);
-	g_sdmmcState.pSpi(dataOutCmd18, dataInCmd18, sizeof(dataOutCmd18), g_sdmmcState.chipSelect, false);
-	SDMMC_DEBUG("Response from CMD18 (read multiple blocks):\r\n");
-	SDMMC_DEBUGHEX(dataInCmd18, sizeof(dataInCmd18));
-	size_t idxR1 = SdmmcSDR1ResponseIndex(dataInCmd18, sizeof(dataInCmd18));
-	if (idxR1 > 0) {
-		size_t idx = idxR1 + 1;
-		size_t preservedBytes = sizeof(dataInCmd18) - idx;
-		SDMMC_DEBUG("Preserved bytes: %u\r\n", preservedBytes);
-		for (uint32_t i = 0; i < blockNum; i++) {
-			if (!SdmmcReadBlockComplete(dataInCmd18 + idx, preservedBytes, buffer + i * SDMMC_BLOCKSIZE)) {
-				break;
-			}
-			SDMMC_DEBUG("Block %u\r\n", (unsigned int)i);
-			//SDMMC_DEBUGHEX(buffer + i * SDMMC_BLOCKSIZE, SDMMC_BLOCKSIZE);
-			if (i == blockNum - 1) {
-				success = true;
-			}
-			preservedBytes = 0;
+	for (uint32_t i = 0; i < blockNum; i++) {
+		if (!SdmmcReadSingleBlock(buffer + i * SDMMC_BLOCKSIZE, block + i)) {
+			return false;
 		}
 	}
-	//terminate the transfer
-	success &= SdmmcTerminateTransfer();
-	return success;
+	if (multiple) {
+		SdmmcMultipleFailed();
+	}
+	return true;
 }
 
+void SdmmcBackgroundSet(SpiBackgroundFunc_t * pBackground, SpiBackgroundDoneFunc_t * pBackgroundDone) {
+	g_sdmmcAsync.pBackground = pBackground;
+	g_sdmmcAsync.pBackgroundDone = pBackgroundDone;
+}
 
-#else
+//Starts the DMA for the rest of the current block, offset bytes are already in the buffer
+static void SdmmcAsyncReceive(size_t offset) {
+	g_sdmmcAsync.receiving = true;
+	g_sdmmcAsync.pBackground(NULL, g_sdmmcAsync.buffer + offset, SDMMC_BLOCKSIZE - offset);
+}
 
-//Simply use single block read instead
+/*Prepares for receiving the current block. startBytes are the bytes already
+  received after the R1 response, if they contain the data start, the DMA is
+  started directly.
+*/
+static void SdmmcAsyncBlockBegin(const uint8_t * startBytes, size_t startLen) {
+	bool gotDataStart;
+	size_t preserved = SdmmcCopyPreserved(startBytes, startLen, g_sdmmcAsync.buffer, &gotDataStart);
+	g_sdmmcAsync.receiving = false;
+	g_sdmmcAsync.tStart = HAL_GetTick();
+	if (gotDataStart) {
+		SdmmcAsyncReceive(preserved);
+	}
+}
 
-bool SdmmcRead(uint8_t * buffer, uint32_t block, uint32_t blockNum) {
-	if (blockNum == 0) {
-		SDMMC_DEBUGERROR("Error, invalid read request 0x%x, blocks %u, max 0x%x\r\n", (unsigned int)block, (unsigned int)blockNum, (unsigned int)g_sdmmcState.capacity);
+//Sends CMD18 or CMD17 for the current block
+static bool SdmmcAsyncCommand(void) {
+	uint8_t dataIn[16]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait bytes, 1 response bytes, 1 extra byte for have a good buffer size
+	size_t idx;
+	uint8_t cmd = g_sdmmcAsync.multiple ? 18 : 17;
+	if (!SdmmcBlockCommand(cmd, g_sdmmcAsync.block, dataIn, sizeof(dataIn), &idx)) {
 		return false;
 	}
-	bool success = true;
-	for (uint32_t i = 0; i < blockNum; i++) {
-		success &= SdmmcReadSingleBlock(buffer + i * SDMMC_BLOCKSIZE, block + i);
-		if (!success) {
-			break;
+	SdmmcAsyncBlockBegin(dataIn + idx, sizeof(dataIn) - idx);
+	return true;
+}
+
+//Ends the read and disables chip select
+static sdmmcAsyncResult_t SdmmcAsyncFinish(bool success) {
+	if (g_sdmmcAsync.multiple) {
+		if (!SdmmcTerminateTransfer()) {
+			success = false;
+		}
+		if (success) {
+			g_sdmmcState.multiblockFails = 0;
 		}
+	} else {
+		SdmmcDisableCs();
 	}
-	return success;
+	if (!success) {
+		SDMMC_DEBUGERROR("Error, reading block 0x%x failed\r\n", (unsigned int)g_sdmmcAsync.block);
+	}
+	g_sdmmcAsync.blocksLeft = 0;
+	return success ? SDMMC_ASYNC_DONE : SDMMC_ASYNC_ERROR;
 }
 
-#endif
-
-bool SdmmcWriteSingleBlock(const uint8_t * buffer, uint32_t block) {
-	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (block > g_sdmmcState.capacity)) {
-		SDMMC_DEBUGERROR("Error, invalid write request 0x%x, max 0x%x\r\n", (unsigned int)block, (unsigned int)g_sdmmcState.capacity);
+bool SdmmcReadStart(uint8_t * buffer, uint32_t block, uint32_t blockNum) {
+	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (blockNum == 0) ||
+	    (block > g_sdmmcState.capacity) || ((block + blockNum) > g_sdmmcState.capacity) ||
+	    (g_sdmmcAsync.pBackground == NULL) || (g_sdmmcAsync.blocksLeft)) {
+		SDMMC_DEBUGERROR("Error, invalid async read request 0x%x, blocks %u, max 0x%x\r\n", (unsigned int)block, (unsigned int)blockNum, (unsigned int)g_sdmmcState.capacity);
 		return false;
 	}
-	if (g_sdmmcState.isSdhc == false) {
-		block *= SDMMC_BLOCKSIZE;
+	g_sdmmcAsync.buffer = buffer;
+	g_sdmmcAsync.block = block;
+	g_sdmmcAsync.blocksLeft = blockNum;
+	g_sdmmcAsync.multiple = SdmmcMultipleUse(blockNum);
+	if (!SdmmcAsyncCommand()) {
+		g_sdmmcAsync.blocksLeft = 0;
+		return false;
 	}
-	SDMMC_DEBUG("Write 0x%x\r\n", (unsigned int)block);
-	uint8_t dataOutCmd24[15]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait byte, 1 response bytes,
-	uint8_t dataInCmd24[15];
-	SdmmcFillCommand(dataOutCmd24, dataInCmd24, sizeof(dataOutCmd24), 24, block);
-	size_t thisRound = sizeof(dataOutCmd24);
-	g_sdmmcState.pSpi(dataOutCmd24, dataInCmd24, thisRound, g_sdmmcState.chipSelect, false);
+	return true;
+}
 
-	SDMMC_DEBUGHEX(dataInCmd24, sizeof(dataInCmd24));
-	size_t idxR1 = SdmmcSDR1ResponseIndex(dataInCmd24, sizeof(dataInCmd24));
-	if (idxR1 == 0) {
-		SDMMC_DEBUGERROR("Error, no R1 response\r\n");
-		SdmmcDisableCs();
-		return false;
+sdmmcAsyncResult_t SdmmcReadPoll(void) {
+	if (g_sdmmcAsync.blocksLeft == 0) {
+		return SDMMC_ASYNC_DONE;
+	}
+	if (g_sdmmcAsync.receiving == false) {
+		for (uint32_t i = 0; i < SDMMC_ASYNC_POLLS; i++) {
+			int result = SdmmcPollDataStart();
+			if (result > 0) {
+				SdmmcAsyncReceive(0);
+				return SDMMC_ASYNC_BUSY;
+			}
+			if (result < 0) {
+				return SdmmcAsyncFinish(false);
+			}
+		}
+		if ((HAL_GetTick() - g_sdmmcAsync.tStart) >= SDMMC_TIMEOUT) {
+			SDMMC_DEBUGERROR("Error, no data start found\r\n");
+			return SdmmcAsyncFinish(false);
+		}
+		return SDMMC_ASYNC_BUSY;
 	}
-	if (dataInCmd24[idxR1] != 0x0) {
-		SdmmcDisableCs();
-		return false;
+	if (!g_sdmmcAsync.pBackgroundDone()) {
+		return SDMMC_ASYNC_BUSY;
 	}
-	uint16_t crc = SdmmcDataCrc(buffer);
-	uint8_t dataStart[2] = {0xFF, 0xFE};
-	g_sdmmcState.pSpi(dataStart, NULL, sizeof(dataStart), g_sdmmcState.chipSelect, false);
-	g_sdmmcState.pSpi(buffer, NULL, SDMMC_BLOCKSIZE,  g_sdmmcState.chipSelect, false);
-	uint8_t terminate[3];
-	terminate[0] = crc >> 8;
-	terminate[1] = crc;
-	terminate[2] = 0xFF;
-	uint8_t response[3];
-	g_sdmmcState.pSpi(terminate, response, sizeof(terminate),  g_sdmmcState.chipSelect, false);
-	SDMMC_DEBUG("Data response: 0x%x\r\n", response[2]);
-	if ((response[2] & 0x1F ) != 0x5) {
-		SDMMC_DEBUGERROR("Error, data rejected\r\n");
+	SDMMC_DEBUGHEX(g_sdmmcAsync.buffer, SDMMC_BLOCKSIZE);
+	if (!SdmmcReadBlockCrc(g_sdmmcAsync.buffer)) {
+		return SdmmcAsyncFinish(false);
+	}
+	if (g_sdmmcAsync.blocksLeft == 1) {
+		return SdmmcAsyncFinish(true);
+	}
+	g_sdmmcAsync.blocksLeft--;
+	g_sdmmcAsync.buffer += SDMMC_BLOCKSIZE;
+	g_sdmmcAsync.block++;
+	if (g_sdmmcAsync.multiple) {
+		//the card sends the next block without a new command
+		SdmmcAsyncBlockBegin(NULL, 0);
+	} else {
 		SdmmcDisableCs();
+		if (!SdmmcAsyncCommand()) {
+			g_sdmmcAsync.blocksLeft = 0;
+			return SDMMC_ASYNC_ERROR;
+		}
+	}
+	return SDMMC_ASYNC_BUSY;
+}
+
+bool SdmmcWriteSingleBlock(const uint8_t * buffer, uint32_t block) {
+	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (block > g_sdmmcState.capacity)) {
+		SDMMC_DEBUGERROR("Error, invalid write request 0x%x, max 0x%x\r\n", (unsigned int)block, (unsigned int)g_sdmmcState.capacity);
 		return false;
 	}
-	//ok, now wait until the card indicates its not busy writing anymore
-	bool success = false;
-	for (uint32_t i = 0; i < SDMMC_TIMEOUT; i++) {
-		uint8_t dataOut = 0xFF;
-		uint8_t dataIn = 0;
-		g_sdmmcState.pSpi(&dataOut, &dataIn, sizeof(dataIn), g_sdmmcState.chipSelect, false);
-		if (dataIn == 0xFF) {
-			SDMMC_DEBUG("Writing took %u cycles\r\n", (unsigned int)i);
-			success = true;
-			break;
-		}
-		HAL_Delay(1);
+	uint8_t dataInCmd24[15]; //1 byte CMD index, 4 bytes CMD parameter, 1 byte CRC, up to 8 wait byte, 1 response bytes,
+	size_t idx;
+	if (!SdmmcBlockCommand(24, block, dataInCmd24, sizeof(dataInCmd24), &idx)) {
+		return false;
 	}
+	bool success = SdmmcWriteBlockComplete(buffer, 0xFE);
 	SdmmcDisableCs();
 	return success;
 }
 
 bool SdmmcWrite(const uint8_t * buffer, uint32_t block, uint32_t blockNum) {
-	if (blockNum == 0) {
+	if ((g_sdmmcState.isInitialized == false) || (buffer == NULL) || (blockNum == 0) ||
+	    (block > g_sdmmcState.capacity) || ((block + blockNum) > g_sdmmcState.capacity)) {
 		SDMMC_DEBUGERROR("Error, invalid write request 0x%x, blocks %u, max 0x%x\r\n", (unsigned int)block, (unsigned int)blockNum, (unsigned int)g_sdmmcState.capacity);
 		return false;
 	}
-	bool success = true;
+	bool multiple = SdmmcMultipleUse(blockNum);
+	if (multiple) {
+		if (SdmmcWriteMultiple(buffer, block, blockNum)) {
+			g_sdmmcState.multiblockFails = 0;
+			return true;
+		}
+		SDMMC_DEBUGERROR("Retry with single block writes\r\n");
+	}
 	for (uint32_t i = 0; i < blockNum; i++) {
-		success &= SdmmcWriteSingleBlock(buffer + i * SDMMC_BLOCKSIZE, block + i);
-		if (!success) {
-			break;
+		if (!SdmmcWriteSingleBlock(buffer + i * SDMMC_BLOCKSIZE, block + i)) {
+			return false;
 		}
 	}
-	return success;
+	if (multiple) {
+		SdmmcMultipleFailed();
+	}
+	return true;
+}
+
+void SdmmcMultiblockSet(bool enabled) {
+	g_sdmmcMultiblock = enabled;
+	g_sdmmcState.multiblockFails = 0;
+}
+
+bool SdmmcMultiblockGet(void) {
+	return (g_sdmmcMultiblock) && (g_sdmmcState.multiblockFails < SDMMC_MULTIBLOCK_FAILS);
 }
 
 uint32_t SdmmcCapacity(void) {
@@ -18,6 +18,22 @@ len may be zero, to just reset the chip select without any transfer.
 
 typedef void (SpiTransferFunc_t)(const uint8_t * dataOut, uint8_t * dataIn, size_t len, uint8_t chipSelect, bool resetChipSelect);
 
+/*Starts a SPI transfer in the background, like SpiExternalTransferBackground.
+  The chip select is already active and must be kept. If dataOut is NULL, 0xFF must be sent.
+*/
+typedef void (SpiBackgroundFunc_t)(const uint8_t * dataOut, uint8_t * dataIn, size_t len);
+
+/*Returns true if the background transfer has completed and the SPI can be
+  used by the SpiTransferFunc_t again, like SpiExternalTransferIsDone.
+*/
+typedef bool (SpiBackgroundDoneFunc_t)(void);
+
+typedef enum {
+	SDMMC_ASYNC_BUSY = 0,
+	SDMMC_ASYNC_DONE = 1,
+	SDMMC_ASYNC_ERROR = 2
+} sdmmcAsyncResult_t;
+
 /*Initializes the SD or MMC card. Has an internal state for the later SdmmcRead and SdmmcWrite functions.
   The pSpiTransfer function must do the I/O transfer, and the SPI peripheral should be initialized
   before calling this function to a frequency between 100kHz and 400kHz.
@@ -41,10 +57,35 @@ bool SdmmcReadSingleBlock(uint8_t * buffer, uint32_t block);
 /*Reads the blocks into the buffer.
   Each block is 512 bytes in size.
   blockNum number of blocks to read.
+  For more than one block, CMD18 is used, with a single block retry on a failure.
   Returns true if reading was successful.
 */
 bool SdmmcRead(uint8_t * buffer, uint32_t block, uint32_t blockNum);
 
+/*Sets the functions used by SdmmcReadStart and SdmmcReadPoll. They must use
+  the same SPI peripheral as the function given to SdmmcInit.
+*/
+void SdmmcBackgroundSet(SpiBackgroundFunc_t * pBackground, SpiBackgroundDoneFunc_t * pBackgroundDone);
+
+/*Starts reading blocks into the buffer without waiting for the data.
+  Each block is 512 bytes in size and is transferred by DMA, so the buffer
+  must be DMA accessible and stay valid until the read is done.
+  For more than one block, CMD18 is used, but there is no single block retry.
+  SdmmcBackgroundSet must be called before.
+  Returns true if the read has been started. Then SdmmcReadPoll must be called
+  until it does not return SDMMC_ASYNC_BUSY. Until then, no other function of
+  this module may be used and the SPI may not be used for anything else.
+*/
+bool SdmmcReadStart(uint8_t * buffer, uint32_t block, uint32_t blockNum);
+
+/*Continues the read started by SdmmcReadStart. Each call only takes a few
+  byte transfers on the SPI.
+  Returns SDMMC_ASYNC_BUSY as long as the read is running, SDMMC_ASYNC_DONE if
+  all blocks have been read with a correct CRC (also if no read is running)
+  and SDMMC_ASYNC_ERROR if the read failed. SdmmcRead can be used for a retry.
+*/
+sdmmcAsyncResult_t SdmmcReadPoll(void);
+
 /*Writes one block onto the SD/MMC card.
   A block is 512 bytes in size.
   Returns true if writing was successful.
@@ -54,6 +95,7 @@ bool SdmmcWriteSingleBlock(const uint8_t * buffer, uint32_t block);
 /*Writes the blocks onto the SD/MMC card
   Each block is 512 bytes in size.
   blockNum number of blocks to write.
+  For more than one block, CMD25 is used, with a single block retry on a failure.
   Returns true if writing was successful.
 */
 bool SdmmcWrite(const uint8_t * buffer, uint32_t block, uint32_t blockNum);
@@ -62,6 +104,17 @@ bool SdmmcWrite(const uint8_t * buffer, uint32_t block, uint32_t blockNum);
 */
 uint32_t SdmmcCapacity(void);
 
+/*Enables or disables the use of the multiple block commands by SdmmcRead and
+  SdmmcWrite. Enabled by default.
+  Also enables them again, after they were disabled because of repeated fails.
+*/
+void SdmmcMultiblockSet(bool enabled);
+
+/*Returns true if SdmmcRead and SdmmcWrite use multiple block commands for
+  more than one block.
+*/
+bool SdmmcMultiblockGet(void);
+
 //============ Commands intended for debugging ===================
 
 
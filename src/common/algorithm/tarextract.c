@@ -3,7 +3,7 @@
 #include <string.h>
 #include <stdio.h>
 
-#define BLOCKSIZE 512
+#include "tarextract.h"
 
 uint32_t TarParseOctal(const char * input, size_t len) {
 	uint32_t res = 0;
@@ -19,13 +19,13 @@ uint32_t TarParseOctal(const char * input, size_t len) {
 }
 
 bool TarFileStartGet(const char * filename, uint8_t * tarData, size_t tarLen,  uint8_t ** startAddress, size_t * fileLen, uint32_t * timestamp) {
-	while (tarLen >= BLOCKSIZE) {
+	while (tarLen >= TAR_BLOCKSIZE) {
 		size_t len = TarParseOctal((const char *)tarData + 124, 12);
 		const char * name = (const char *)tarData;
 		const char * date = (const char *)tarData + 136;
 		//printf("%s - %s - %u\n", name, (char *)tarData + 124, len);
-		tarData += BLOCKSIZE;
-		tarLen -= BLOCKSIZE;
+		tarData += TAR_BLOCKSIZE;
+		tarLen -= TAR_BLOCKSIZE;
 		if (tarLen < len) { //wrong format, the resulting file would be out of bounds
 			return false;
 		}
@@ -39,7 +39,7 @@ bool TarFileStartGet(const char * filename, uint8_t * tarData, size_t tarLen,  u
 		} else {
 			//printf("no match with >%s<\n", filename);
 		}
-		uint32_t allocated = (len + (BLOCKSIZE - 1)) & (~(BLOCKSIZE -1)); //round up to blocksize
+		uint32_t allocated = (len + (TAR_BLOCKSIZE - 1)) & (~(TAR_BLOCKSIZE -1)); //round up to blocksize
 		if (tarLen >= allocated) {
 			tarData += allocated;
 			tarLen -= allocated;
@@ -49,3 +49,81 @@ bool TarFileStartGet(const char * filename, uint8_t * tarData, size_t tarLen,  u
 	}
 	return false;
 }
+
+void TarStreamInit(tarStream_t * pStream, tarStreamCallback_t * callback, void * param) {
+	memset(pStream, 0, sizeof(tarStream_t));
+	pStream->callback = callback;
+	pStream->param = param;
+}
+
+static bool TarStreamHeader(tarStream_t * pStream) {
+	const uint8_t * header = pStream->header;
+	if (header[0] == 0) {
+		pStream->ended = true;
+		return true;
+	}
+	//the checksum is calculated with spaces in place of the checksum field
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < TAR_BLOCKSIZE; i++) {
+		if ((i >= 148) && (i < 156)) {
+			sum += ' ';
+		} else {
+			sum += header[i];
+		}
+	}
+	//the digits may have leading spaces and end with a NUL and a space, or only one of them
+	uint32_t checksum = 0;
+	uint32_t i = 148;
+	while ((i < 156) && (header[i] == ' ')) {
+		i++;
+	}
+	for (; (i < 156) && (header[i] >= '0') && (header[i] <= '7'); i++) {
+		checksum = (checksum << 3) + (header[i] - '0');
+	}
+	if (sum != checksum) {
+		return false;
+	}
+	memcpy(pStream->name, header, TAR_NAME_MAX);
+	pStream->name[TAR_NAME_MAX] = '\0';
+	pStream->fileLen = TarParseOctal((const char *)header + 124, 12);
+	pStream->timestamp = TarParseOctal((const char *)header + 136, 12);
+	pStream->fileDone = 0;
+	uint32_t allocated = (pStream->fileLen + (TAR_BLOCKSIZE - 1)) & (~(TAR_BLOCKSIZE -1));
+	pStream->padding = allocated - pStream->fileLen;
+	if (pStream->fileLen == 0) {
+		return pStream->callback(pStream->param, pStream->name, 0, pStream->timestamp, 0, NULL, 0);
+	}
+	return true;
+}
+
+bool TarStreamFeed(tarStream_t * pStream, const uint8_t * data, size_t len) {
+	while ((len) && (pStream->ended == false)) {
+		size_t chunk;
+		if (pStream->fileDone < pStream->fileLen) {
+			chunk = pStream->fileLen - pStream->fileDone;
+			chunk = (chunk < len) ? chunk : len;
+			if (!pStream->callback(pStream->param, pStream->name, pStream->fileLen,
+			                       pStream->timestamp, pStream->fileDone, data, chunk)) {
+				return false;
+			}
+			pStream->fileDone += chunk;
+		} else if (pStream->padding) {
+			chunk = (pStream->padding < len) ? pStream->padding : len;
+			pStream->padding -= chunk;
+		} else {
+			chunk = TAR_BLOCKSIZE - pStream->headerFill;
+			chunk = (chunk < len) ? chunk : len;
+			memcpy(pStream->header + pStream->headerFill, data, chunk);
+			pStream->headerFill += chunk;
+			if (pStream->headerFill == TAR_BLOCKSIZE) {
+				pStream->headerFill = 0;
+				if (!TarStreamHeader(pStream)) {
+					return false;
+				}
+			}
+		}
+		data += chunk;
+		len -= chunk;
+	}
+	return true;
+}
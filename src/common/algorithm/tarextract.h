@@ -2,5 +2,39 @@
 
 #include <stdint.h>
 #include <stdbool.h>
+#include <stddef.h>
+
+#define TAR_BLOCKSIZE 512
+#define TAR_NAME_MAX 100
 
 bool TarFileStartGet(const char * filename, uint8_t * tarData, size_t tarLen,  uint8_t ** startAddress, size_t * fileLen, uint32_t * timestamp);
+
+uint32_t TarParseOctal(const char * input, size_t len);
+
+/*Called with the content of the files in a tar stream, in the order of the
+  stream. The first call for a file has offset 0. Empty files get one call
+  with dataLen 0. Returning false stops the stream.
+*/
+typedef bool (tarStreamCallback_t)(void * param, const char * name, size_t fileLen,
+              uint32_t timestamp, size_t offset, const uint8_t * data, size_t dataLen);
+
+typedef struct {
+	tarStreamCallback_t * callback;
+	void * param;
+	uint8_t header[TAR_BLOCKSIZE];
+	size_t headerFill;
+	char name[TAR_NAME_MAX + 1];
+	size_t fileLen;
+	size_t fileDone;
+	uint32_t timestamp;
+	size_t padding; //bytes until the next header
+	bool ended; //the end of archive block has been seen
+} tarStream_t;
+
+void TarStreamInit(tarStream_t * pStream, tarStreamCallback_t * callback, void * param);
+
+/*Parses a tar, which may be passed in pieces of any size. Returns false for an
+  invalid header or if the callback returned false. Data after the end of
+  archive block are ignored.
+*/
+bool TarStreamFeed(tarStream_t * pStream, const uint8_t * data, size_t len);
@@ -0,0 +1,110 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Measures the time menu_screen_flush of framebufferColor.c needs to convert
+the whole screen. Compile once with and once without FB_COLOR_NOLUT to compare
+the lookup table with the conversion per pixel. The printed checksum of the
+LCD data must be the same for both variants.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "framebufferColor.h"
+
+#include "boxlib/lcd.h"
+
+#define FB_COLORS (1 << (FB_RED_IN_BITS + FB_GREEN_IN_BITS + FB_BLUE_IN_BITS))
+
+#define ROUNDS 200
+
+uint32_t g_lcdChecksum;
+bool g_lcdChecksumEnabled;
+
+void LcdWriteRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t * data, size_t len) {
+	(void)x;
+	(void)y;
+	(void)width;
+	(void)height;
+	if (!g_lcdChecksumEnabled) {
+		return;
+	}
+	uint32_t checksum = g_lcdChecksum;
+	for (size_t i = 0; i < len; i++) {
+		checksum = (checksum << 1) + (checksum >> 31) + data[i];
+	}
+	g_lcdChecksum = checksum;
+}
+
+void LcdWaitBackgroundDone(void) {
+}
+
+void LcdWaitBackgroundDoneRelease(void) {
+}
+
+static uint64_t TimeUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+//writes one pixel of every block with its own color, so every block gets flushed
+static void MarkAllBlocks(void) {
+	for (uint16_t y = 0; y < FB_SIZE_Y; y += FB_OUTPUTBLOCK_Y) {
+		for (uint16_t x = 0; x < FB_SIZE_X; x += FB_OUTPUTBLOCK_X) {
+			menu_screen_set(x, y, menu_screen_get(x, y));
+		}
+	}
+}
+
+static void Benchmark(const char * name) {
+	uint64_t timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		MarkAllBlocks();
+		menu_screen_flush();
+	}
+	uint64_t timeStop = TimeUs();
+	//the checksum is not part of the measured time
+	g_lcdChecksum = 0;
+	g_lcdChecksumEnabled = true;
+	MarkAllBlocks();
+	menu_screen_flush();
+	g_lcdChecksumEnabled = false;
+	printf("%-16s %6uus per full screen flush, checksum 0x%08x\n", name,
+	       (unsigned int)((timeStop - timeStart) / ROUNDS), (unsigned int)g_lcdChecksum);
+}
+
+int main(void) {
+#ifdef FB_COLOR_NOLUT
+	printf("Conversion per pixel, %u colors\n", FB_COLORS);
+#else
+	printf("Lookup table, %u colors\n", FB_COLORS);
+#endif
+	menu_screen_clear();
+	menu_screen_flush();
+	Benchmark("Background");
+
+	//typical menu: background with some text lines and boxes in a few colors
+	for (uint16_t y = 0; y < FB_SIZE_Y; y++) {
+		for (uint16_t x = 0; x < FB_SIZE_X; x++) {
+			if (((y % 20) < 8) && (((x + y) % 3) == 0)) {
+				menu_screen_set(x, y, (y / 20) % FB_COLORS);
+			}
+		}
+	}
+	Benchmark("Text");
+
+	srand(1);
+	for (uint16_t y = 0; y < FB_SIZE_Y; y++) {
+		for (uint16_t x = 0; x < FB_SIZE_X; x++) {
+			menu_screen_set(x, y, rand() % FB_COLORS);
+		}
+	}
+	Benchmark("Random pixels");
+	return 0;
+}
@@ -0,0 +1,155 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Measures drawing and scrolling a list with 10000 lines in the menu interpreter,
+using the menu of the loader. Compile once with and once without
+MENU_LIST_INDEX to compare the line offset index with searching the text.
+The printed checksums of the screen must be the same for both variants.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "menu-interpreter.h"
+
+#define LIST_LINES 10000
+
+#define ROUNDS 200
+
+//key codes used by the loader
+#define KEY_UP 3
+#define KEY_DOWN 4
+//switches to the 320x240 window with the program list
+#define KEY_LARGE_SCREEN 102
+
+extern const uint8_t menudata[];
+
+SCREENCOLOR g_screen[MENU_SCREEN_Y][MENU_SCREEN_X];
+
+char g_list[LIST_LINES * 6];
+
+#ifdef MENU_LIST_INDEX
+uint16_t g_listIndex[LIST_LINES];
+#endif
+
+uint8_t menu_byte_get(MENUADDR addr) {
+	if (addr < MENU_DATASIZE) {
+		return menudata[addr];
+	}
+	return 0;
+}
+
+void menu_screen_set(SCREENPOS x, SCREENPOS y, SCREENCOLOR color) {
+	if ((x < MENU_SCREEN_X) && (y < MENU_SCREEN_Y)) {
+		g_screen[y][x] = color;
+	}
+}
+
+void menu_screen_fill_rect(SCREENPOS x, SCREENPOS y, SCREENPOS sx, SCREENPOS sy, SCREENCOLOR color) {
+	for (SCREENPOS j = y; j < y + sy; j++) {
+		for (SCREENPOS i = x; i < x + sx; i++) {
+			menu_screen_set(i, j, color);
+		}
+	}
+}
+
+void menu_screen_hline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+void menu_screen_flush(void) {
+}
+
+void menu_screen_clear(void) {
+	for (uint16_t y = 0; y < MENU_SCREEN_Y; y++) {
+		for (uint16_t x = 0; x < MENU_SCREEN_X; x++) {
+			g_screen[y][x] = MENU_COLOR_BACKGROUND;
+		}
+	}
+}
+
+uint8_t menu_action(MENUACTION action) {
+	(void)action;
+	return 0;
+}
+
+static uint64_t TimeUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t ScreenChecksum(void) {
+	uint32_t checksum = 0;
+	const uint8_t * data = (const uint8_t *)g_screen;
+	for (size_t i = 0; i < sizeof(g_screen); i++) {
+		checksum = (checksum << 1) + (checksum >> 31) + data[i];
+	}
+	return checksum;
+}
+
+static void ListFill(uint32_t first) {
+	size_t offset = 0;
+	for (uint32_t i = 0; i < LIST_LINES; i++) {
+		offset += sprintf(g_list + offset, "%s%u", i ? "\n" : "", (unsigned int)((first + i) % 100000));
+	}
+}
+
+static void Print(const char * name, uint64_t timeStart, uint64_t timeStop) {
+	printf("%-20s %6uus per operation, checksum 0x%08x\n", name,
+	       (unsigned int)((timeStop - timeStart) / ROUNDS), (unsigned int)ScreenChecksum());
+}
+
+int main(void) {
+#ifdef MENU_LIST_INDEX
+	printf("Line offset index, %u lines\n", LIST_LINES);
+	menu_list_index_set(MENU_LISTINDEX_BININDEX, g_listIndex, LIST_LINES);
+#else
+	printf("Searching the text, %u lines\n", LIST_LINES);
+#endif
+	ListFill(0);
+	menu_strings[MENU_TEXT_BINLIST] = g_list;
+	menu_redraw();
+	menu_keypress(KEY_LARGE_SCREEN);
+
+	uint64_t timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		menu_keypress(KEY_DOWN);
+	}
+	uint64_t timeStop = TimeUs();
+	Print("Key down at start", timeStart, timeStop);
+
+	menu_listindexstate[MENU_LISTINDEX_BININDEX] = LIST_LINES - ROUNDS - 10;
+	menu_redraw();
+	timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		menu_keypress(KEY_DOWN);
+	}
+	timeStop = TimeUs();
+	Print("Key down at end", timeStart, timeStop);
+
+	timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		menu_keypress(KEY_UP);
+	}
+	timeStop = TimeUs();
+	Print("Key up at end", timeStart, timeStop);
+
+	timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		ListFill(i);
+		menu_text_changed(MENU_TEXT_BINLIST);
+		menu_redraw();
+	}
+	timeStop = TimeUs();
+	Print("Text change", timeStart, timeStop);
+	return 0;
+}
@@ -0,0 +1,132 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Measures redrawing a screen full of text in the menu interpreter, using the
+menu of the loader. Compile without MENU_SCREEN_BULK to draw every pixel by
+menu_screen_set, with it to draw the characters as horizontal spans and
+additionally with MENU_TEXT_GLYPH_CACHE to keep the prepared characters.
+The printed checksums of the screen must be the same for all variants.
+*/
+
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+
+#include "menu-interpreter.h"
+
+#define LIST_LINES 100
+
+#define ROUNDS 500
+
+//switches to the 320x240 window with the program list
+#define KEY_LARGE_SCREEN 102
+
+extern const uint8_t menudata[];
+
+SCREENCOLOR g_screen[MENU_SCREEN_Y][MENU_SCREEN_X];
+
+char g_list[LIST_LINES * 32];
+
+uint32_t g_screenCalls;
+
+uint8_t menu_byte_get(MENUADDR addr) {
+	if (addr < MENU_DATASIZE) {
+		return menudata[addr];
+	}
+	return 0;
+}
+
+void menu_screen_set(SCREENPOS x, SCREENPOS y, SCREENCOLOR color) {
+	g_screenCalls++;
+	if ((x < MENU_SCREEN_X) && (y < MENU_SCREEN_Y)) {
+		g_screen[y][x] = color;
+	}
+}
+
+//like a framebuffer would do it: clip once, then fill the whole span
+void menu_screen_fill_rect(SCREENPOS x, SCREENPOS y, SCREENPOS sx, SCREENPOS sy, SCREENCOLOR color) {
+	g_screenCalls++;
+	uint32_t x2 = (uint32_t)x + sx;
+	uint32_t y2 = (uint32_t)y + sy;
+	if (x2 > MENU_SCREEN_X) {
+		x2 = MENU_SCREEN_X;
+	}
+	if (y2 > MENU_SCREEN_Y) {
+		y2 = MENU_SCREEN_Y;
+	}
+	for (uint32_t j = y; j < y2; j++) {
+		for (uint32_t i = x; i < x2; i++) {
+			g_screen[j][i] = color;
+		}
+	}
+}
+
+void menu_screen_hline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color) {
+	menu_screen_fill_rect(x, y, length, 1, color);
+}
+
+void menu_screen_vline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color) {
+	menu_screen_fill_rect(x, y, 1, length, color);
+}
+
+void menu_screen_flush(void) {
+}
+
+void menu_screen_clear(void) {
+	for (uint16_t y = 0; y < MENU_SCREEN_Y; y++) {
+		for (uint16_t x = 0; x < MENU_SCREEN_X; x++) {
+			g_screen[y][x] = MENU_COLOR_BACKGROUND;
+		}
+	}
+}
+
+uint8_t menu_action(MENUACTION action) {
+	(void)action;
+	return 0;
+}
+
+static uint64_t TimeUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+static uint32_t ScreenChecksum(void) {
+	uint32_t checksum = 0;
+	const uint8_t * data = (const uint8_t *)g_screen;
+	for (size_t i = 0; i < sizeof(g_screen); i++) {
+		checksum = (checksum << 1) + (checksum >> 31) + data[i];
+	}
+	return checksum;
+}
+
+int main(void) {
+#if defined(MENU_TEXT_GLYPH_CACHE)
+	printf("Spans with %u cached characters\n", MENU_TEXT_GLYPH_CACHE);
+#elif defined(MENU_SCREEN_BULK)
+	printf("Spans\n");
+#else
+	printf("Single pixels\n");
+#endif
+	size_t offset = 0;
+	for (uint32_t i = 0; i < LIST_LINES; i++) {
+		offset += sprintf(g_list + offset, "%s%02u-Program_%u.bin", i ? "\n" : "", (unsigned int)i, (unsigned int)(i * 7919));
+	}
+	menu_strings[MENU_TEXT_BINLIST] = g_list;
+	menu_redraw();
+	menu_keypress(KEY_LARGE_SCREEN);
+
+	g_screenCalls = 0;
+	uint64_t timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		menu_redraw();
+	}
+	uint64_t timeStop = TimeUs();
+	printf("%-20s %6uus per redraw, %u screen calls, checksum 0x%08x\n", "List window",
+	       (unsigned int)((timeStop - timeStart) / ROUNDS), (unsigned int)(g_screenCalls / ROUNDS),
+	       (unsigned int)ScreenChecksum());
+	return 0;
+}
@@ -0,0 +1,62 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Measures the time SdmmcDataCrc of sdmmcAccess.c needs for one block. The
+Makefile builds it for every SDMMC_CRC variant which runs on the PC. The
+printed checksum of all CRCs must be the same for all variants.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+
+#include "sdmmcAccess.h"
+
+#define BLOCKS 64
+
+#define ROUNDS 2000
+
+#define STRINGIFY(x) #x
+#define VARIANT(x) STRINGIFY(x)
+
+uint8_t g_blocks[BLOCKS][SDMMC_BLOCKSIZE];
+
+uint32_t HAL_GetTick(void) {
+	return 0;
+}
+
+void HAL_Delay(uint32_t delay) {
+	(void)delay;
+}
+
+static uint64_t TimeUs(void) {
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000 + ts.tv_nsec / 1000;
+}
+
+int main(void) {
+	uint32_t x = 1;
+	for (uint32_t i = 0; i < BLOCKS; i++) {
+		for (uint32_t j = 0; j < SDMMC_BLOCKSIZE; j++) {
+			x = x * 1103515245 + 12345;
+			g_blocks[i][j] = x >> 16;
+		}
+	}
+	//the first call may fill the tables
+	uint32_t checksum = SdmmcDataCrc(g_blocks[0]);
+	uint64_t timeStart = TimeUs();
+	for (uint32_t i = 0; i < ROUNDS; i++) {
+		for (uint32_t j = 0; j < BLOCKS; j++) {
+			checksum += SdmmcDataCrc(g_blocks[j]);
+		}
+	}
+	uint64_t timeStop = TimeUs();
+	uint64_t ns = (timeStop - timeStart) * 1000 / (ROUNDS * BLOCKS);
+	printf("%-18s %6uns per block, checksum 0x%08x\n", VARIANT(SDMMC_CRC), (unsigned int)ns, (unsigned int)checksum);
+	return 0;
+}
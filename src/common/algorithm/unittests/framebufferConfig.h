@@ -0,0 +1,37 @@
+#pragma once
+
+#include <stdint.h>
+
+//Configuration for testFramebufferColor.c, similar to the 11-adc-scope
+
+#define FB_SIZE_X 320
+#define FB_SIZE_Y 240
+
+#define FB_COLOR_IN_TYPE uint8_t
+
+#define FB_COLOR_OUT_TYPE uint16_t
+
+#define FB_COLOR_BACKGROUND 0
+
+#define FB_SCREENPOS_TYPE uint16_t
+
+//benchFramebufferColor.c overrides the input colors by the Makefile
+#ifndef FB_RED_IN_BITS
+#define FB_RED_IN_BITS 1
+#define FB_GREEN_IN_BITS 1
+#define FB_BLUE_IN_BITS 1
+#endif
+
+#define FB_RED_OUT_BITS 5
+#define FB_GREEN_OUT_BITS 6
+#define FB_BLUE_OUT_BITS 5
+
+#define FB_BITMAP_TYPE uint32_t
+#define FB_BITMAP_BITS 32
+
+#define FB_OUTPUTBLOCK_X 32
+#define FB_OUTPUTBLOCK_Y 16
+
+#define FB_TWOBUFFERS
+
+//FB_COALESCE_BLOCKS is set by the Makefile
@@ -0,0 +1,9 @@
+#pragma once
+
+#include <stdint.h>
+
+//Replaces the main.h of an app for sdmmcAccess.c, the tests implement the functions
+
+uint32_t HAL_GetTick(void);
+
+void HAL_Delay(uint32_t delay);
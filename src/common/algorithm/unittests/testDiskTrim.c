@@ -0,0 +1,169 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Tests the TRIM bitmap of diskio.c with FatFs on a simulated flash. Writing
+files into trimmed clusters must not store the bitmap for every sector. When
+the stored bitmap is older than the FAT, like after a power loss or after a
+build without the bitmap wrote the volume, the files must still read back.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "ff.h"
+#include "diskio.h"
+
+#include "boxlib/flash.h"
+
+#define FLASHSIZE (DISK_RESERVEDOFFSET + 1024 * 1024)
+#define PAGESIZE 256
+
+#define FILESIZE (40 * 1024)
+
+extern uint8_t g_diskState[];
+
+uint8_t g_flash[FLASHSIZE];
+uint32_t g_trimPageWrites;
+uint32_t g_tick;
+
+uint32_t g_randomState = 1;
+
+//own generator, so the results are the same on every system
+static uint32_t Random(void) {
+	g_randomState = g_randomState * 1103515245 + 12345;
+	return g_randomState >> 8;
+}
+
+#define TASS(is, should) if ((is) != (should)) {printf("Error in line %u, should %u, is %u\n", (unsigned int)__LINE__, (unsigned int)should, (unsigned int)is); exit(1);}
+
+uint32_t HAL_GetTick(void) {
+	return g_tick++;
+}
+
+bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
+	if ((address + len) > FLASHSIZE) {
+		return false;
+	}
+	memcpy(buffer, g_flash + address, len);
+	return true;
+}
+
+bool FlashReadBackground(uint64_t address, uint8_t * buffer, size_t len) {
+	return FlashRead(address, buffer, len);
+}
+
+void FlashReadBackgroundWait(void) {
+}
+
+bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+	if ((address + len) > FLASHSIZE) {
+		return false;
+	}
+	if ((address >= DISK_TRIMOFFSET) && (address < DISK_RESERVEDOFFSET)) {
+		g_trimPageWrites += (len + PAGESIZE - 1) / PAGESIZE;
+	}
+	memcpy(g_flash + address, buffer, len);
+	return true;
+}
+
+bool FlashWriteCompare(uint64_t address, const uint8_t * buffer, size_t len, uint32_t * pagesSkipped) {
+	if (pagesSkipped) {
+		*pagesSkipped = 0;
+	}
+	return FlashWrite(address, buffer, len);
+}
+
+bool FlashReady(void) {
+	return true;
+}
+
+bool FlashPagesizePowertwoGet(void) {
+	return true;
+}
+
+uint64_t FlashSizeGet(void) {
+	return FLASHSIZE;
+}
+
+uint32_t FlashBlocksizeGet(void) {
+	return PAGESIZE;
+}
+
+FATFS g_fs;
+uint8_t g_content[FILESIZE];
+
+static void FileWrite(const char * name, uint32_t seed) {
+	FIL f;
+	UINT written;
+	g_randomState = seed;
+	for (uint32_t i = 0; i < FILESIZE; i++) {
+		g_content[i] = Random();
+	}
+	TASS(f_open(&f, name, FA_WRITE | FA_CREATE_ALWAYS), FR_OK);
+	//small pieces, so FatFs writes single sectors like most apps do
+	for (uint32_t i = 0; i < FILESIZE; i += 100) {
+		uint32_t len = ((FILESIZE - i) < 100) ? (FILESIZE - i) : 100;
+		TASS(f_write(&f, g_content + i, len, &written), FR_OK);
+	}
+	TASS(f_close(&f), FR_OK);
+}
+
+static void FileCheck(const char * name, uint32_t seed) {
+	FIL f;
+	UINT read;
+	uint8_t data[FILESIZE];
+	g_randomState = seed;
+	for (uint32_t i = 0; i < FILESIZE; i++) {
+		g_content[i] = Random();
+	}
+	TASS(f_open(&f, name, FA_READ), FR_OK);
+	TASS(f_read(&f, data, FILESIZE, &read), FR_OK);
+	TASS(read, FILESIZE);
+	TASS(memcmp(data, g_content, FILESIZE), 0);
+	TASS(f_close(&f), FR_OK);
+}
+
+//like a reset, the bitmap is loaded from the flash again
+static void Remount(void) {
+	g_diskState[DEV_EXTFLASH] = STA_NOINIT;
+	TASS(f_mount(&g_fs, "", 1), FR_OK);
+}
+
+int main(void) {
+	uint8_t work[FF_MAX_SS];
+	memset(g_flash, 0xFF, sizeof(g_flash));
+	TASS(f_mkfs("", NULL, work, sizeof(work)), FR_OK);
+	Remount();
+	FileWrite("a.bin", 1);
+	TASS(f_unlink("a.bin"), FR_OK);
+	//the clusters of a.bin are trimmed now, writing them only stores the bitmap at f_close
+	g_trimPageWrites = 0;
+	FileWrite("b.bin", 2);
+	TASS(g_trimPageWrites <= 2, true);
+	Remount();
+	FileCheck("b.bin", 2);
+
+	//the stored bitmap still has b.bin trimmed, as if written before b.bin
+	uint8_t bitmap[DISK_RESERVEDOFFSET - DISK_TRIMOFFSET];
+	TASS(f_unlink("b.bin"), FR_OK);
+	memcpy(bitmap, g_flash + DISK_TRIMOFFSET, sizeof(bitmap));
+	FileWrite("c.bin", 3);
+	memcpy(g_flash + DISK_TRIMOFFSET, bitmap, sizeof(bitmap));
+	Remount();
+	FileCheck("c.bin", 3);
+
+	//free clusters stay trimmed
+	TASS(f_unlink("c.bin"), FR_OK);
+	Remount();
+	g_trimPageWrites = 0;
+	FileWrite("d.bin", 4);
+	TASS(g_trimPageWrites > 0, true);
+	FileCheck("d.bin", 4);
+	printf("Disk trim ok\n");
+	return 0;
+}
@@ -0,0 +1,269 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Tests flashFtl.c against a simulated AT45 flash. The power cut test aborts
+the flash operations at random points, leaving a partially programmed or
+erased page like a real flash would. After each cut the FTL is initialized
+again and every sector must have either the last successfully written content
+or, for the sector in progress, the new one.
+*/
+
+#include <setjmp.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "flashFtl.h"
+
+#include "boxlib/flash.h"
+
+#define PAGESIZE 256
+#define OFFSET 4096
+#define SLOTS 200
+#define FLASHSIZE (OFFSET + SLOTS * (PAGESIZE + FTL_SECTORSIZE))
+#define PAGES (FLASHSIZE / PAGESIZE)
+
+uint8_t g_flash[FLASHSIZE];
+uint32_t g_eraseCount[PAGES];
+
+//number of page operations until the power is cut, 0 for never
+uint32_t g_cutCountdown;
+jmp_buf g_cutJump;
+
+uint32_t g_randomState = 1;
+
+//own generator, so the results are the same on every system
+static uint32_t Random(void) {
+	g_randomState = g_randomState * 1103515245 + 12345;
+	return g_randomState >> 8;
+}
+
+static void PowerCutCheck(uint32_t page, const uint8_t * data) {
+	if (g_cutCountdown) {
+		g_cutCountdown--;
+		if (g_cutCountdown == 0) {
+			//only some of the bits reached their new state, or the operation just completed
+			bool completed = (Random() % 4) == 0;
+			uint8_t * pPage = g_flash + page * PAGESIZE;
+			for (uint32_t i = 0; i < PAGESIZE; i++) {
+				uint8_t mask = completed ? 0 : Random();
+				if (data) {
+					pPage[i] &= data[i] | mask;
+				} else {
+					pPage[i] |= ~mask;
+				}
+			}
+			longjmp(g_cutJump, 1);
+		}
+	}
+}
+
+static bool PagesCheck(uint64_t address, size_t len) {
+	return ((address % PAGESIZE) == 0) && ((len % PAGESIZE) == 0) && ((address + len) <= FLASHSIZE);
+}
+
+bool FlashRead(uint64_t address, uint8_t * buffer, size_t len) {
+	if ((address + len) > FLASHSIZE) {
+		return false;
+	}
+	memcpy(buffer, g_flash + address, len);
+	return true;
+}
+
+bool FlashErase(uint64_t address, size_t len) {
+	if (!PagesCheck(address, len)) {
+		return false;
+	}
+	for (size_t i = 0; i < len; i += PAGESIZE) {
+		uint32_t page = (address + i) / PAGESIZE;
+		PowerCutCheck(page, NULL);
+		memset(g_flash + page * PAGESIZE, 0xFF, PAGESIZE);
+		g_eraseCount[page]++;
+	}
+	return true;
+}
+
+bool FlashWriteErased(uint64_t address, const uint8_t * buffer, size_t len) {
+	if (!PagesCheck(address, len)) {
+		return false;
+	}
+	for (size_t i = 0; i < len; i += PAGESIZE) {
+		uint32_t page = (address + i) / PAGESIZE;
+		PowerCutCheck(page, buffer + i);
+		for (uint32_t j = 0; j < PAGESIZE; j++) {
+			g_flash[page * PAGESIZE + j] &= buffer[i + j];
+		}
+	}
+	return true;
+}
+
+bool FlashWrite(uint64_t address, const uint8_t * buffer, size_t len) {
+	if (!PagesCheck(address, len)) {
+		return false;
+	}
+	for (size_t i = 0; i < len; i += PAGESIZE) {
+		uint32_t page = (address + i) / PAGESIZE;
+		PowerCutCheck(page, NULL);
+		memset(g_flash + page * PAGESIZE, 0xFF, PAGESIZE);
+		g_eraseCount[page]++;
+		PowerCutCheck(page, buffer + i);
+		memcpy(g_flash + page * PAGESIZE, buffer + i, PAGESIZE);
+	}
+	return true;
+}
+
+uint32_t FlashBlocksizeGet(void) {
+	return PAGESIZE;
+}
+
+#define TASS(is, should) if ((is) != (should)) {printf("Error in line %u, should %u, is %u\n", (unsigned int)__LINE__, (unsigned int)should, (unsigned int)is); exit(1);}
+
+//version 0 is a never written sector
+static void SectorContent(uint32_t sector, uint32_t version, uint8_t * data) {
+	if (version == 0) {
+		memset(data, 0xFF, FTL_SECTORSIZE);
+		return;
+	}
+	uint32_t x = sector * 7919 + version * 104729;
+	for (uint32_t i = 0; i < FTL_SECTORSIZE; i++) {
+		x = x * 1103515245 + 12345;
+		data[i] = x >> 16;
+	}
+}
+
+static bool SectorIs(uint32_t sector, uint32_t version) {
+	uint8_t should[FTL_SECTORSIZE];
+	uint8_t is[FTL_SECTORSIZE];
+	SectorContent(sector, version, should);
+	TASS(FtlRead(sector, is), true);
+	return memcmp(should, is, FTL_SECTORSIZE) == 0;
+}
+
+static void TestBasic(void) {
+	memset(g_flash, 0xFF, sizeof(g_flash));
+	TASS(FtlInit(OFFSET, FLASHSIZE - OFFSET), true);
+	uint32_t sectors = FtlSectorsGet();
+	TASS(sectors, SLOTS - FTL_SPARE_SLOTS);
+	TASS(SectorIs(0, 0), true);
+	uint8_t data[FTL_SECTORSIZE];
+	for (uint32_t version = 1; version <= 3; version++) {
+		for (uint32_t i = 0; i < sectors; i++) {
+			SectorContent(i, version, data);
+			TASS(FtlWrite(i, data), true);
+		}
+	}
+	TASS(FtlWrite(sectors, data), false);
+	TASS(FtlInit(OFFSET, FLASHSIZE - OFFSET), true);
+	for (uint32_t i = 0; i < sectors; i++) {
+		TASS(SectorIs(i, 3), true);
+	}
+	//old copies get erased, so the next writes do not need to
+	TASS(FtlBackground(SLOTS) > 0, true);
+	ftlStats_t stats;
+	FtlStatsGet(&stats);
+	TASS(stats.slotsStale, 0);
+	TASS(stats.slotsErased, FTL_SPARE_SLOTS);
+	SectorContent(5, 4, data);
+	TASS(FtlWrite(5, data), true);
+	FtlStatsGet(&stats);
+	TASS(stats.writesErased, 1);
+	TASS(stats.writesErase, 0);
+	printf("Basic ok\n");
+}
+
+static void TestPowerCut(void) {
+	uint32_t versions[SLOTS] = {0};
+	memset(g_flash, 0xFF, sizeof(g_flash));
+	TASS(FtlInit(OFFSET, FLASHSIZE - OFFSET), true);
+	uint32_t sectors = FtlSectorsGet();
+	uint32_t cuts = 0;
+	uint32_t newAccepted = 0;
+	volatile uint32_t pendingSector = 0;
+	volatile uint32_t pendingVersion = 0;
+	for (uint32_t round = 0; round < 3000; round++) {
+		g_cutCountdown = 1 + Random() % 50;
+		if (setjmp(g_cutJump) == 0) {
+			while (true) {
+				if ((Random() % 8) == 0) {
+					FtlBackground(1 + Random() % 4);
+					continue;
+				}
+				//most writes go to a few sectors, like the FAT
+				uint32_t sector = (Random() % 4) ? (Random() % 4) : (Random() % sectors);
+				uint8_t data[FTL_SECTORSIZE];
+				pendingSector = sector;
+				pendingVersion = versions[sector] + 1;
+				SectorContent(sector, pendingVersion, data);
+				TASS(FtlWrite(sector, data), true);
+				versions[sector] = pendingVersion;
+				pendingVersion = 0;
+			}
+		}
+		//power is back
+		cuts++;
+		TASS(FtlInit(OFFSET, FLASHSIZE - OFFSET), true);
+		for (uint32_t i = 0; i < sectors; i++) {
+			if (SectorIs(i, versions[i])) {
+				continue;
+			}
+			if ((i == pendingSector) && (pendingVersion) && (SectorIs(i, pendingVersion))) {
+				versions[i] = pendingVersion;
+				newAccepted++;
+				continue;
+			}
+			printf("Error, sector %u has invalid content after cut %u\n", (unsigned int)i, (unsigned int)cuts);
+			exit(1);
+		}
+	}
+	g_cutCountdown = 0;
+	printf("Power cut ok, %u cuts, %u times the sector in progress got the new content\n",
+	       (unsigned int)cuts, (unsigned int)newAccepted);
+}
+
+static void TestWear(void) {
+	memset(g_flash, 0xFF, sizeof(g_flash));
+	memset(g_eraseCount, 0, sizeof(g_eraseCount));
+	TASS(FtlInit(OFFSET, FLASHSIZE - OFFSET), true);
+	uint32_t sectors = FtlSectorsGet();
+	uint8_t data[FTL_SECTORSIZE];
+	//fill the disk with data which never change
+	for (uint32_t i = 0; i < sectors; i++) {
+		SectorContent(i, 1, data);
+		TASS(FtlWrite(i, data), true);
+	}
+	//then keep rewriting one sector
+	for (uint32_t i = 0; i < 100000; i++) {
+		SectorContent(0, i + 2, data);
+		TASS(FtlWrite(0, data), true);
+		FtlBackground(1);
+	}
+	uint32_t eraseMin = UINT32_MAX;
+	uint32_t eraseMax = 0;
+	for (uint32_t page = OFFSET / PAGESIZE; page < PAGES; page++) {
+		if (g_eraseCount[page] < eraseMin) {
+			eraseMin = g_eraseCount[page];
+		}
+		if (g_eraseCount[page] > eraseMax) {
+			eraseMax = g_eraseCount[page];
+		}
+	}
+	ftlStats_t stats;
+	FtlStatsGet(&stats);
+	printf("Wear: erase cycles per page %u...%u, %u moves\n", (unsigned int)eraseMin,
+	       (unsigned int)eraseMax, (unsigned int)stats.moves);
+	//without the moves, the pages of sector 0 would get 100000 cycles and others none
+	TASS(eraseMax < (eraseMin * 4), true);
+	TASS(SectorIs(0, 100001), true);
+	TASS(SectorIs(sectors - 1, 1), true);
+}
+
+int main(void) {
+	TestBasic();
+	TestPowerCut();
+	TestWear();
+	return 0;
+}
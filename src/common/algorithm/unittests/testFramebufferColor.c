@@ -0,0 +1,225 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Counts the LcdWriteRect calls and the transferred bytes of framebufferColor.c
+for some typical menu redraws and verifies the content of the simulated LCD.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "framebufferColor.h"
+
+#include "boxlib/lcd.h"
+
+//column address, page address and memory write command with their parameters
+#define LCD_WINDOW_OVERHEAD_BYTES 11
+
+uint16_t g_lcd[FB_SIZE_Y][FB_SIZE_X];
+
+uint32_t g_lcdRectCalls;
+uint32_t g_lcdRectBytes;
+
+void LcdWriteRect(uint16_t x, uint16_t y, uint16_t width, uint16_t height, const uint8_t * data, size_t len) {
+	if ((len != (size_t)width * height * 2) || ((x + width) > FB_SIZE_X) || ((y + height) > FB_SIZE_Y)) {
+		printf("Error, invalid rectangle %u,%u %ux%u len %u\n", x, y, width, height, (unsigned int)len);
+		exit(1);
+	}
+	for (uint32_t yi = y; yi < (uint32_t)(y + height); yi++) {
+		for (uint32_t xi = x; xi < (uint32_t)(x + width); xi++) {
+			g_lcd[yi][xi] = (data[0] << 8) | data[1];
+			data += 2;
+		}
+	}
+	g_lcdRectCalls++;
+	g_lcdRectBytes += len;
+}
+
+void LcdWaitBackgroundDone(void) {
+}
+
+void LcdWaitBackgroundDoneRelease(void) {
+}
+
+#define TASS(is, should) if ((is) != (should)) {printf("Error in line %u, should %u, is %u\n", (unsigned int)__LINE__, (unsigned int)should, (unsigned int)is); exit(1);}
+
+static uint16_t ColorToLcd(uint8_t color) {
+	uint16_t out = 0;
+	if (color & 4) {
+		out |= 0xF800;
+	}
+	if (color & 2) {
+		out |= 0x07E0;
+	}
+	if (color & 1) {
+		out |= 0x001F;
+	}
+	return out;
+}
+
+static bool LcdMatchesFramebuffer(void) {
+	for (uint16_t y = 0; y < FB_SIZE_Y; y++) {
+		for (uint16_t x = 0; x < FB_SIZE_X; x++) {
+			if (g_lcd[y][x] != ColorToLcd(menu_screen_get(x, y))) {
+				printf("Error, pixel %u,%u differs\n", x, y);
+				return false;
+			}
+		}
+	}
+	return true;
+}
+
+static void DrawBox(uint16_t x, uint16_t y, uint16_t width, uint16_t height, uint8_t color) {
+	for (uint16_t i = 0; i < width; i++) {
+		menu_screen_set(x + i, y, color);
+		menu_screen_set(x + i, y + height - 1, color);
+	}
+	for (uint16_t i = 0; i < height; i++) {
+		menu_screen_set(x, y + i, color);
+		menu_screen_set(x + width - 1, y + i, color);
+	}
+}
+
+//some pattern with the size of a line of text
+static void DrawText(uint16_t x, uint16_t y, uint16_t width, uint8_t color) {
+	for (uint16_t j = 0; j < 8; j++) {
+		for (uint16_t i = 0; i < width; i++) {
+			if (((i + j) % 3) == 0) {
+				menu_screen_set(x + i, y + j, color);
+			}
+		}
+	}
+}
+
+static void Flush(const char * name, uint32_t callsExpected, uint32_t bytesExpected) {
+	g_lcdRectCalls = 0;
+	g_lcdRectBytes = 0;
+	menu_screen_flush();
+	printf("%-22s %4u calls, %6u bytes, %6u bytes with window setup\n", name,
+	       (unsigned int)g_lcdRectCalls, (unsigned int)g_lcdRectBytes,
+	       (unsigned int)(g_lcdRectBytes + g_lcdRectCalls * LCD_WINDOW_OVERHEAD_BYTES));
+	TASS(LcdMatchesFramebuffer(), true);
+	TASS(g_lcdRectCalls, callsExpected);
+	TASS(g_lcdRectBytes, bytesExpected);
+}
+
+static uint8_t g_reference[FB_SIZE_Y][FB_SIZE_X];
+
+static uint32_t FlushCount(void) {
+	g_lcdRectCalls = 0;
+	menu_screen_flush();
+	TASS(LcdMatchesFramebuffer(), true);
+	return g_lcdRectCalls;
+}
+
+//the bulk functions must give the same result as menu_screen_set for every pixel
+static void TestBulk(uint16_t x, uint16_t y, uint16_t width, uint16_t height) {
+	uint8_t data[64 * 64];
+	for (uint32_t i = 0; i < width * height; i++) {
+		data[i] = (i * 7 + i / 5) % 8;
+	}
+	for (uint8_t function = 0; function < 4; function++) {
+		menu_screen_clear();
+		for (uint16_t j = 0; j < height; j++) {
+			for (uint16_t i = 0; i < width; i++) {
+				uint8_t color = 5;
+				if (function == 1) {
+					color = data[j * width + i];
+				}
+				if ((function < 2) || ((function == 2) && (j == 0)) || ((function == 3) && (i == 0))) {
+					menu_screen_set(x + i, y + j, color);
+				}
+			}
+		}
+		for (uint16_t j = 0; j < FB_SIZE_Y; j++) {
+			for (uint16_t i = 0; i < FB_SIZE_X; i++) {
+				g_reference[j][i] = menu_screen_get(i, j);
+			}
+		}
+		uint32_t callsReference = FlushCount();
+		menu_screen_clear();
+		FlushCount();
+		menu_screen_clear();
+		switch (function) {
+			case 0: menu_screen_fill_rect(x, y, width, height, 5); break;
+			case 1: menu_screen_blit(x, y, width, height, data); break;
+			case 2: menu_screen_hline(x, y, width, 5); break;
+			default: menu_screen_vline(x, y, height, 5);
+		}
+		for (uint16_t j = 0; j < FB_SIZE_Y; j++) {
+			for (uint16_t i = 0; i < FB_SIZE_X; i++) {
+				TASS(menu_screen_get(i, j), g_reference[j][i]);
+			}
+		}
+		//partly outside of the screen, the pixels there must be 0
+		FB_COLOR_IN_TYPE row[FB_SIZE_X + 8];
+		for (uint16_t j = 0; j < FB_SIZE_Y; j++) {
+			menu_screen_get_row(0, j, FB_SIZE_X, row);
+			for (uint16_t i = 0; i < FB_SIZE_X; i++) {
+				TASS(row[i], g_reference[j][i]);
+			}
+			memset(row, 0xFF, sizeof(row));
+			menu_screen_get_row(x, j, width + 8, row);
+			for (uint16_t i = 0; i < width + 8; i++) {
+				TASS(row[i], menu_screen_get(x + i, j));
+			}
+		}
+		TASS(FlushCount(), callsReference);
+		menu_screen_clear();
+		FlushCount();
+	}
+}
+
+#ifdef FB_COALESCE_BLOCKS
+#define CALLS(single, coalesced) (coalesced)
+#else
+#define CALLS(single, coalesced) (single)
+#endif
+
+int main(void) {
+	const uint32_t blockBytes = FB_OUTPUTBLOCK_X * FB_OUTPUTBLOCK_Y * 2;
+#ifdef FB_COALESCE_BLOCKS
+	printf("Coalescing up to %u blocks\n", FB_COALESCE_BLOCKS);
+#else
+	printf("No coalescing\n");
+#endif
+	memset(g_lcd, 0xAA, sizeof(g_lcd));
+	menu_screen_clear();
+	Flush("Initial screen", CALLS(150, 15), 150 * blockBytes);
+
+	menu_screen_clear();
+	DrawText(0, 20, FB_SIZE_X, 7);
+	Flush("Full width text", CALLS(10, 1), 10 * blockBytes);
+
+	menu_screen_clear();
+	DrawText(100, 200, 40, 4);
+	Flush("Label update", CALLS(12, 2), 12 * blockBytes);
+
+	menu_screen_clear();
+	DrawText(100, 200, 40, 2);
+	Flush("Label update again", CALLS(2, 1), 2 * blockBytes);
+
+	menu_screen_clear();
+	DrawBox(20, 20, 280, 200, 7);
+	DrawText(40, 40, 240, 3);
+	Flush("Window with box", CALLS(52, 7), 52 * blockBytes);
+
+	menu_screen_clear();
+	Flush("Clear window", CALLS(50, 5), 50 * blockBytes);
+
+	menu_screen_clear();
+	Flush("Nothing changed", 0, 0);
+
+	TestBulk(0, 0, 64, 64);
+	TestBulk(3, 5, 17, 9);
+	TestBulk(31, 1, 2, 50);
+	TestBulk(100, 100, 1, 1);
+	TestBulk(290, 230, 40, 20);
+	printf("Bulk functions ok\n");
+	return 0;
+}
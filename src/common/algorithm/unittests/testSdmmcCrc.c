@@ -0,0 +1,109 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Checks the CRC16 of the data blocks and the CRC7 of the commands of
+sdmmcAccess.c against a bitwise reference. The Makefile builds it once for
+each SDMMC_CRC variant, all must be bit exact.
+The SDMMC_CRC_HW variant needs the STM32L4 and can not be tested here.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "sdmmcAccess.h"
+
+uint32_t g_randomState = 1;
+
+uint32_t HAL_GetTick(void) {
+	return 0;
+}
+
+void HAL_Delay(uint32_t delay) {
+	(void)delay;
+}
+
+//own generator, so the results are the same on every system
+static uint32_t Random(void) {
+	g_randomState = g_randomState * 1103515245 + 12345;
+	return g_randomState >> 8;
+}
+
+static uint16_t Crc16Reference(const uint8_t * data, size_t len) {
+	uint16_t crc = 0;
+	for (size_t i = 0; i < len; i++) {
+		crc ^= data[i] << 8;
+		for (uint32_t j = 0; j < 8; j++) {
+			crc = (crc & 0x8000) ? ((crc << 1) ^ 0x1021) : (crc << 1);
+		}
+	}
+	return crc;
+}
+
+static uint8_t Crc7Reference(const uint8_t * data, size_t len) {
+	uint8_t crc = 0;
+	for (size_t i = 0; i < len; i++) {
+		for (int32_t j = 7; j >= 0; j--) {
+			bool bit = ((data[i] >> j) ^ (crc >> 6)) & 1;
+			crc = (crc << 1) & 0x7F;
+			if (bit) {
+				crc ^= 0x09;
+			}
+		}
+	}
+	return crc;
+}
+
+#define TASS(is, should) if ((is) != (should)) {printf("Error in line %u, should %u, is %u\n", (unsigned int)__LINE__, (unsigned int)should, (unsigned int)is); exit(1);}
+
+static void TestDataCrc(void) {
+	uint8_t block[SDMMC_BLOCKSIZE];
+	//known values, the one of 0xFF can be seen when reading an erased card
+	memset(block, 0xFF, sizeof(block));
+	TASS(SdmmcDataCrc(block), 0x7FA1);
+	memset(block, 0, sizeof(block));
+	TASS(SdmmcDataCrc(block), 0);
+	for (uint32_t i = 0; i < sizeof(block); i++) {
+		block[i] = i;
+	}
+	TASS(SdmmcDataCrc(block), 0x40DA);
+	for (uint32_t round = 0; round < 2000; round++) {
+		for (uint32_t i = 0; i < sizeof(block); i++) {
+			block[i] = Random();
+		}
+		TASS(SdmmcDataCrc(block), Crc16Reference(block, sizeof(block)));
+	}
+	//single bits, as every table entry gets used
+	for (uint32_t bit = 0; bit < sizeof(block) * 8; bit++) {
+		memset(block, 0, sizeof(block));
+		block[bit / 8] = 1 << (bit % 8);
+		TASS(SdmmcDataCrc(block), Crc16Reference(block, sizeof(block)));
+	}
+	printf("Data CRC ok\n");
+}
+
+static void TestCommandCrc(void) {
+	uint8_t command[8];
+	SdmmcFillCommand(command, NULL, sizeof(command), 0, 0);
+	TASS(command[5], 0x95);
+	SdmmcFillCommand(command, NULL, sizeof(command), 8, 0x1AA);
+	TASS(command[5], 0x87);
+	TASS(command[6], 0xFF);
+	for (uint32_t round = 0; round < 100000; round++) {
+		uint8_t cmd = Random() & 0x3F;
+		uint32_t param = Random() ^ (Random() << 16);
+		SdmmcFillCommand(command, NULL, sizeof(command), cmd, param);
+		TASS(command[5], (Crc7Reference(command, 5) << 1) | 1);
+	}
+	printf("Command CRC ok\n");
+}
+
+int main(void) {
+	TestDataCrc();
+	TestCommandCrc();
+	return 0;
+}
@@ -0,0 +1,148 @@
+/*
+(c) 2026 by Malte Marwedel
+
+SPDX-License-Identifier:  BSD-3-Clause
+
+Builds a tar like the app Makefiles do and parses it with TarStreamFeed,
+split into pieces of different sizes. Every file must be reported with the
+same content as TarFileStartGet finds in the complete tar.
+*/
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "tarextract.h"
+
+#define FILES 4
+#define TARSIZE (64 * 1024)
+
+const char * g_names[FILES] = {"readme.md", "empty.txt", "application.bin", "metadata.json"};
+const size_t g_lengths[FILES] = {700, 0, 20000, 512};
+
+uint8_t g_tar[TARSIZE];
+size_t g_tarLen;
+
+uint8_t g_received[FILES][TARSIZE];
+size_t g_receivedLen[FILES];
+uint32_t g_fileIndex;
+uint32_t g_calls;
+
+uint32_t g_randomState = 1;
+
+//own generator, so the results are the same on every system
+static uint32_t Random(void) {
+	g_randomState = g_randomState * 1103515245 + 12345;
+	return g_randomState >> 8;
+}
+
+#define TASS(is, should) if ((is) != (should)) {printf("Error in line %u, should %u, is %u\n", (unsigned int)__LINE__, (unsigned int)should, (unsigned int)is); exit(1);}
+
+//some tar writers pad the checksum with leading spaces instead of zeros
+bool g_checksumSpaces;
+
+static void TarAppend(const char * name, size_t len) {
+	uint8_t * header = g_tar + g_tarLen;
+	memset(header, 0, TAR_BLOCKSIZE);
+	strcpy((char *)header, name);
+	strcpy((char *)header + 100, "0000644");
+	snprintf((char *)header + 124, 12, "%011o", (unsigned int)len);
+	snprintf((char *)header + 136, 12, "%011o", 1700000000u);
+	header[156] = '0';
+	memset(header + 148, ' ', 8);
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < TAR_BLOCKSIZE; i++) {
+		sum += header[i];
+	}
+	snprintf((char *)header + 148, 8, g_checksumSpaces ? "%6o" : "%06o", (unsigned int)sum);
+	header[155] = ' ';
+	g_tarLen += TAR_BLOCKSIZE;
+	for (size_t i = 0; i < len; i++) {
+		g_tar[g_tarLen + i] = Random();
+	}
+	g_tarLen += (len + TAR_BLOCKSIZE - 1) & ~(TAR_BLOCKSIZE - 1);
+}
+
+static void TarBuild(void) {
+	memset(g_tar, 0, sizeof(g_tar));
+	g_tarLen = 0;
+	for (uint32_t i = 0; i < FILES; i++) {
+		TarAppend(g_names[i], g_lengths[i]);
+	}
+	g_tarLen += 2 * TAR_BLOCKSIZE; //end of archive
+}
+
+static bool Receive(void * param, const char * name, size_t fileLen, uint32_t timestamp,
+                    size_t offset, const uint8_t * data, size_t dataLen) {
+	(void)param;
+	g_calls++;
+	if (offset == 0) {
+		g_fileIndex++;
+	}
+	uint32_t index = g_fileIndex - 1;
+	TASS(strcmp(name, g_names[index]), 0);
+	TASS(fileLen, g_lengths[index]);
+	TASS(timestamp, 1700000000u);
+	TASS(offset, g_receivedLen[index]);
+	memcpy(g_received[index] + offset, data, dataLen);
+	g_receivedLen[index] += dataLen;
+	return true;
+}
+
+//maxPiece 0 uses random sizes
+static void TestSplit(size_t maxPiece) {
+	memset(g_receivedLen, 0, sizeof(g_receivedLen));
+	g_fileIndex = 0;
+	g_calls = 0;
+	tarStream_t stream;
+	TarStreamInit(&stream, &Receive, NULL);
+	size_t done = 0;
+	while (done < g_tarLen) {
+		size_t piece = maxPiece ? maxPiece : (1 + Random() % 3000);
+		if (piece > (g_tarLen - done)) {
+			piece = g_tarLen - done;
+		}
+		TASS(TarStreamFeed(&stream, g_tar + done, piece), true);
+		done += piece;
+	}
+	TASS(stream.ended, true);
+	TASS(g_fileIndex, FILES);
+	for (uint32_t i = 0; i < FILES; i++) {
+		uint8_t * start;
+		size_t len;
+		TASS(TarFileStartGet(g_names[i], g_tar, g_tarLen, &start, &len, NULL), true);
+		TASS(g_receivedLen[i], len);
+		TASS(memcmp(g_received[i], start, len), 0);
+	}
+}
+
+static void TestCorrupted(void) {
+	tarStream_t stream;
+	TarStreamInit(&stream, &Receive, NULL);
+	g_fileIndex = 0;
+	memset(g_receivedLen, 0, sizeof(g_receivedLen));
+	uint8_t header[TAR_BLOCKSIZE];
+	memcpy(header, g_tar, TAR_BLOCKSIZE);
+	header[0] ^= 1;
+	TASS(TarStreamFeed(&stream, header, TAR_BLOCKSIZE), false);
+}
+
+int main(void) {
+	TarBuild();
+	size_t pieces[] = {1, 7, 511, 512, 513, 2048, TARSIZE};
+	for (uint32_t i = 0; i < sizeof(pieces) / sizeof(size_t); i++) {
+		TestSplit(pieces[i]);
+	}
+	for (uint32_t i = 0; i < 20; i++) {
+		TestSplit(0);
+	}
+	TestCorrupted();
+	g_checksumSpaces = true;
+	TarBuild();
+	TestSplit(512);
+	TestSplit(0);
+	printf("Tar stream ok\n");
+	return 0;
+}
@@ -7,18 +7,461 @@
 /* storage control modules to the FatFs module with a defined API.       */
 /*-----------------------------------------------------------------------*/
 
+#include <stdbool.h>
+#include <string.h>
+
 #include "ff.h"			/* Obtains integer types */
 #include "diskio.h"		/* Declarations of disk functions */
 
 #include "boxlib/flash.h"
 
-/* Definitions of physical drive number for each drive */
-#define DEV_EXTFLASH 0
+#include "main.h"
+
+/*Set to 1 in ffconf.h to access a SD card with sdmmcAccess.c as drive DEV_SDCARD.
+  Not usable on the stm32f411, where the flash functions already use the SD card.
+*/
+#ifndef DISK_SDCARD
+#define DISK_SDCARD 0
+#endif
+
+#if DISK_SDCARD
+#include "sdmmcAccess.h"
+
+_Static_assert(FF_VOLUMES > DEV_SDCARD, "DISK_SDCARD needs FF_VOLUMES >= 2");
+_Static_assert(SDMMC_BLOCKSIZE == DISK_BLOCKSIZE, "FatFs sectors must be SD card blocks");
+
+/*The erase block size is not read from the card, but the allocation unit of
+  most SDHC cards is 4MiB. f_mkfs aligns the data area to it.
+*/
+#define DISK_SDCARD_ERASEBLOCK (4 * 1024 * 1024 / DISK_BLOCKSIZE)
+#endif
 
 #define PAGESIZE FLASHPAGESIZE
 
+/*Number of sectors in the write-back cache, set by ffconf.h. 0 disables it.
+  Each needs DISK_BLOCKSIZE bytes of RAM. Dirty sectors are written to the
+  flash on CTRL_SYNC, when evicted or after DISK_CACHE_TIMEOUT. The timeout is
+  checked with each disk access and by disk_background(), so the apps call
+  FilesystemBackground() from their main loop.
+*/
+#ifndef DISK_CACHE_SECTORS
+#define DISK_CACHE_SECTORS 0
+#endif
+
+//Milliseconds until a dirty sector gets written to the flash
+#ifndef DISK_CACHE_TIMEOUT
+#define DISK_CACHE_TIMEOUT 1000
+#endif
+
 
+#if DISK_SDCARD
+uint8_t g_diskState[FF_VOLUMES] = {STA_NOINIT, STA_NOINIT};
+#else
 uint8_t g_diskState[FF_VOLUMES] = {STA_NOINIT};
+#endif
+
+uint32_t g_diskCacheHits;
+uint32_t g_diskCacheMisses;
+
+static bool DiskFlashRead(LBA_t sector, BYTE * buff, UINT count) {
+	return FlashRead(DISK_RESERVEDOFFSET + sector * DISK_BLOCKSIZE, buff, count * DISK_BLOCKSIZE);
+}
+
+//compare = false if the old content is known to differ
+static bool DiskFlashWrite(LBA_t sector, const BYTE * buff, UINT count, bool compare) {
+	uint64_t address = DISK_RESERVEDOFFSET + sector * DISK_BLOCKSIZE;
+	if (!compare) {
+		return FlashWrite(address, buff, count * DISK_BLOCKSIZE);
+	}
+	//FatFs often rewrites unchanged FAT and directory sectors
+	return FlashWriteCompare(address, buff, count * DISK_BLOCKSIZE, NULL);
+}
+
+static uint32_t DiskSectorsGet(void) {
+	return (FlashSizeGet() - DISK_RESERVEDOFFSET) / DISK_BLOCKSIZE;
+}
+
+#ifdef DISK_TRIMOFFSET
+
+/*Trimmed sectors are kept in a bitmap. They read as zero without accessing
+  the flash. The bitmap is stored within the reserved area at DISK_TRIMOFFSET,
+  one page per chunk. Changed chunks are only stored by CTRL_SYNC, so writing
+  sectors does not erase a bitmap page every time.
+  A stored bit is only trusted for a free cluster, DiskTrimValidate drops all
+  others when loading. This covers a power loss before the next CTRL_SYNC, and
+  sectors written by builds not knowing the bitmap, as they allocate the
+  cluster first. Chunks with an invalid checksum are loaded as not trimmed.
+*/
+
+//Sectors covered by the bitmap, the default fits 8MiB
+#ifndef DISK_TRIM_SECTORS
+#define DISK_TRIM_SECTORS (8 * 1024 * 1024 / DISK_BLOCKSIZE)
+#endif
+
+#define DISK_TRIM_MAGIC 0x314D5254 //"TRM1"
+
+#define DISK_TRIM_HEADER 8
+
+//Bitmap bytes per flash page, the header and bitmap fit into 256 byte pages
+#define DISK_TRIM_CHUNK (256 - DISK_TRIM_HEADER)
+
+#define DISK_TRIM_CHUNKS ((DISK_TRIM_SECTORS + DISK_TRIM_CHUNK * 8 - 1) / (DISK_TRIM_CHUNK * 8))
+
+uint8_t g_diskTrimmed[DISK_TRIM_CHUNKS * DISK_TRIM_CHUNK];
+bool g_diskTrimPending[DISK_TRIM_CHUNKS]; //bits changed, but not stored so far
+uint32_t g_diskTrimSectors; //0 if the bitmap does not fit into the reserved area
+
+static uint32_t DiskTrimChecksum(uint32_t chunk, const uint8_t * bitmap) {
+	uint32_t sum = (chunk << 16) ^ g_diskTrimSectors;
+	for (uint32_t i = 0; i < DISK_TRIM_CHUNK; i++) {
+		sum = ((sum << 5) | (sum >> 27)) + bitmap[i];
+	}
+	return sum;
+}
+
+static uint64_t DiskTrimAddress(uint32_t chunk) {
+	return DISK_TRIMOFFSET + (uint64_t)chunk * FlashBlocksizeGet();
+}
+
+//Returns true if the chunk in the flash is valid, the bitmap is then copied to bitmap
+static bool DiskTrimChunkLoad(uint32_t chunk, uint8_t * bitmap) {
+	uint32_t header[DISK_TRIM_HEADER / sizeof(uint32_t)];
+	uint64_t address = DiskTrimAddress(chunk);
+	if ((!FlashRead(address, (uint8_t *)header, DISK_TRIM_HEADER)) ||
+	    (!FlashRead(address + DISK_TRIM_HEADER, bitmap, DISK_TRIM_CHUNK))) {
+		return false;
+	}
+	return (header[0] == DISK_TRIM_MAGIC) && (header[1] == DiskTrimChecksum(chunk, bitmap));
+}
+
+static bool DiskTrimChunkStore(uint32_t chunk, const uint8_t * bitmap) {
+	uint8_t page[DISK_BLOCKSIZE];
+	uint32_t header[DISK_TRIM_HEADER / sizeof(uint32_t)];
+	header[0] = DISK_TRIM_MAGIC;
+	header[1] = DiskTrimChecksum(chunk, bitmap);
+	memset(page, 0xFF, sizeof(page));
+	memcpy(page, header, DISK_TRIM_HEADER);
+	memcpy(page + DISK_TRIM_HEADER, bitmap, DISK_TRIM_CHUNK);
+	return FlashWrite(DiskTrimAddress(chunk), page, FlashBlocksizeGet());
+}
+
+static bool DiskTrimmed(LBA_t sector) {
+	if (sector >= g_diskTrimSectors) {
+		return false;
+	}
+	return (g_diskTrimmed[sector / 8] >> (sector % 8)) & 1;
+}
+
+typedef struct {
+	LBA_t fatStart;
+	LBA_t dataStart;
+	uint32_t clusterSectors;
+	uint32_t clusters; //the first data cluster is number 2
+	uint32_t fatBits;
+	LBA_t loaded; //FAT sector within buffer
+	uint8_t buffer[DISK_BLOCKSIZE];
+} diskTrimFat_t;
+
+static uint32_t DiskLoad16(const uint8_t * data) {
+	return data[0] | (data[1] << 8);
+}
+
+static uint32_t DiskLoad32(const uint8_t * data) {
+	return DiskLoad16(data) | (DiskLoad16(data + 2) << 16);
+}
+
+static bool DiskTrimBootSector(const uint8_t * data) {
+	return ((data[0] == 0xEB) || (data[0] == 0xE9) || (data[0] == 0xE8)) &&
+	       (DiskLoad16(data + 510) == 0xAA55) && (DiskLoad16(data + 11) == DISK_BLOCKSIZE) &&
+	       (data[13] != 0) && (DiskLoad16(data + 14) != 0) && (data[16] != 0);
+}
+
+//Reads the boot sector of a FAT12/16/32 volume, returns false if there is none
+static bool DiskTrimFatInit(diskTrimFat_t * pFat) {
+	uint8_t * data = pFat->buffer;
+	LBA_t volume = 0;
+	if (!DiskFlashRead(0, data, 1)) {
+		return false;
+	}
+	if (!DiskTrimBootSector(data)) {
+		//f_mkfs may create a partition table, the volume is then the first partition
+		volume = DiskLoad32(data + 446 + 8);
+		if ((DiskLoad16(data + 510) != 0xAA55) || (data[446 + 4] == 0) ||
+		    (volume == 0) || (volume >= DiskSectorsGet()) ||
+		    (!DiskFlashRead(volume, data, 1)) || (!DiskTrimBootSector(data))) {
+			return false;
+		}
+	}
+	uint32_t sectors = DiskLoad16(data + 19);
+	if (sectors == 0) {
+		sectors = DiskLoad32(data + 32);
+	}
+	uint32_t fatSize = DiskLoad16(data + 22);
+	if (fatSize == 0) {
+		fatSize = DiskLoad32(data + 36);
+	}
+	uint32_t rootSectors = (DiskLoad16(data + 17) * 32 + DISK_BLOCKSIZE - 1) / DISK_BLOCKSIZE;
+	uint32_t systemSectors = DiskLoad16(data + 14) + data[16] * fatSize + rootSectors;
+	if (systemSectors >= sectors) {
+		return false;
+	}
+	pFat->fatStart = volume + DiskLoad16(data + 14);
+	pFat->dataStart = volume + systemSectors;
+	pFat->clusterSectors = data[13];
+	pFat->clusters = (sectors - systemSectors) / pFat->clusterSectors;
+	//same limits as FatFs uses for detecting the FAT type
+	if (pFat->clusters <= 0xFF5) {
+		pFat->fatBits = 12;
+	} else if (pFat->clusters <= 0xFFF5) {
+		pFat->fatBits = 16;
+	} else {
+		pFat->fatBits = 32;
+	}
+	pFat->loaded = (LBA_t)-1;
+	return true;
+}
+
+static bool DiskTrimClusterFree(diskTrimFat_t * pFat, uint32_t cluster) {
+	uint32_t offset = cluster * pFat->fatBits / 8;
+	uint32_t value = 0;
+	for (uint32_t i = 0; i < ((pFat->fatBits == 32) ? 4 : 2); i++) {
+		LBA_t sector = pFat->fatStart + (offset + i) / DISK_BLOCKSIZE;
+		if (pFat->loaded != sector) {
+			if (!DiskFlashRead(sector, pFat->buffer, 1)) {
+				return false;
+			}
+			pFat->loaded = sector;
+		}
+		value |= (uint32_t)pFat->buffer[(offset + i) % DISK_BLOCKSIZE] << (i * 8);
+	}
+	if (pFat->fatBits == 12) {
+		value = (cluster & 1) ? (value >> 4) : (value & 0xFFF);
+	} else if (pFat->fatBits == 32) {
+		value &= 0x0FFFFFFF;
+	}
+	return value == 0;
+}
+
+/*Drops the bits of sectors outside the data area and of allocated clusters.
+  Without a FAT volume, like after the host formatted another file system by
+  USB, all bits are dropped.
+*/
+static void DiskTrimValidate(void) {
+	diskTrimFat_t fat;
+	bool valid = DiskTrimFatInit(&fat);
+	for (LBA_t sector = 0; sector < g_diskTrimSectors; sector++) {
+		if (g_diskTrimmed[sector / 8] == 0) {
+			sector |= 7;
+			continue;
+		}
+		if (!DiskTrimmed(sector)) {
+			continue;
+		}
+		if ((valid) && (sector >= fat.dataStart)) {
+			uint32_t cluster = 2 + (sector - fat.dataStart) / fat.clusterSectors;
+			if ((cluster < fat.clusters + 2) && (DiskTrimClusterFree(&fat, cluster))) {
+				continue;
+			}
+		}
+		g_diskTrimmed[sector / 8] &= ~(1 << (sector % 8));
+		g_diskTrimPending[sector / (DISK_TRIM_CHUNK * 8)] = true;
+	}
+}
+
+static void DiskTrimLoad(void) {
+	memset(g_diskTrimmed, 0, sizeof(g_diskTrimmed));
+	memset(g_diskTrimPending, 0, sizeof(g_diskTrimPending));
+	uint32_t sectors = DiskSectorsGet();
+	if (sectors > DISK_TRIM_SECTORS) {
+		sectors = DISK_TRIM_SECTORS;
+	}
+	g_diskTrimSectors = sectors;
+	uint32_t chunks = (sectors + DISK_TRIM_CHUNK * 8 - 1) / (DISK_TRIM_CHUNK * 8);
+	if ((FlashBlocksizeGet() < 256) || (DiskTrimAddress(chunks) > DISK_RESERVEDOFFSET)) {
+		g_diskTrimSectors = 0;
+		return;
+	}
+	for (uint32_t chunk = 0; chunk < chunks; chunk++) {
+		uint8_t * bitmap = g_diskTrimmed + chunk * DISK_TRIM_CHUNK;
+		if (!DiskTrimChunkLoad(chunk, bitmap)) {
+			memset(bitmap, 0, DISK_TRIM_CHUNK);
+		}
+	}
+	DiskTrimValidate();
+}
+
+static void DiskTrimSet(LBA_t first, LBA_t last) {
+	for (LBA_t sector = first; (sector <= last) && (sector < g_diskTrimSectors); sector++) {
+		g_diskTrimmed[sector / 8] |= 1 << (sector % 8);
+		g_diskTrimPending[sector / (DISK_TRIM_CHUNK * 8)] = true;
+	}
+}
+
+static void DiskTrimClear(LBA_t first, UINT count) {
+	for (LBA_t sector = first; sector < first + count; sector++) {
+		g_diskTrimmed[sector / 8] &= ~(1 << (sector % 8));
+		g_diskTrimPending[sector / (DISK_TRIM_CHUNK * 8)] = true;
+	}
+}
+
+static bool DiskTrimSync(void) {
+	for (uint32_t chunk = 0; chunk < DISK_TRIM_CHUNKS; chunk++) {
+		if (g_diskTrimPending[chunk]) {
+			if (!DiskTrimChunkStore(chunk, g_diskTrimmed + chunk * DISK_TRIM_CHUNK)) {
+				return false;
+			}
+			g_diskTrimPending[chunk] = false;
+		}
+	}
+	return true;
+}
+
+//Number of sectors starting at sector with the same trim state, up to count
+static UINT DiskTrimRun(LBA_t sector, UINT count, bool * pTrimmed) {
+	bool trimmed = DiskTrimmed(sector);
+	UINT num = 1;
+	while ((num < count) && (DiskTrimmed(sector + num) == trimmed)) {
+		num++;
+	}
+	*pTrimmed = trimmed;
+	return num;
+}
+
+#endif
+
+static bool DiskSectorsRead(LBA_t sector, BYTE * buff, UINT count) {
+#ifdef DISK_TRIMOFFSET
+	while (count) {
+		bool trimmed;
+		UINT num = DiskTrimRun(sector, count, &trimmed);
+		if (trimmed) {
+			memset(buff, 0, num * DISK_BLOCKSIZE);
+		} else if (!DiskFlashRead(sector, buff, num)) {
+			return false;
+		}
+		buff += num * DISK_BLOCKSIZE;
+		sector += num;
+		count -= num;
+	}
+	return true;
+#else
+	return DiskFlashRead(sector, buff, count);
+#endif
+}
+
+static bool DiskSectorsWrite(LBA_t sector, const BYTE * buff, UINT count) {
+#ifdef DISK_TRIMOFFSET
+	while (count) {
+		bool trimmed;
+		UINT num = DiskTrimRun(sector, count, &trimmed);
+		if (trimmed) {
+			DiskTrimClear(sector, num);
+		}
+		//for trimmed sectors the old content is unused, so comparing would only cost time
+		if (!DiskFlashWrite(sector, buff, num, !trimmed)) {
+			return false;
+		}
+		buff += num * DISK_BLOCKSIZE;
+		sector += num;
+		count -= num;
+	}
+	return true;
+#else
+	return DiskFlashWrite(sector, buff, count, true);
+#endif
+}
+
+#if DISK_CACHE_SECTORS > 0
+
+typedef struct {
+	LBA_t sector;
+	uint32_t lastUse; //value of g_diskCacheUseCounter, the lowest gets evicted first
+	uint32_t dirtySince; //HAL_GetTick() of the first unwritten change
+	bool valid;
+	bool dirty;
+	uint8_t data[DISK_BLOCKSIZE];
+} diskCacheEntry_t;
+
+diskCacheEntry_t g_diskCache[DISK_CACHE_SECTORS];
+uint32_t g_diskCacheUseCounter;
+
+static bool DiskCacheWriteBack(diskCacheEntry_t * pEntry) {
+	if ((pEntry->valid) && (pEntry->dirty)) {
+		if (!DiskSectorsWrite(pEntry->sector, pEntry->data, 1)) {
+			return false;
+		}
+		pEntry->dirty = false;
+	}
+	return true;
+}
+
+static diskCacheEntry_t * DiskCacheFind(LBA_t sector) {
+	for (uint32_t i = 0; i < DISK_CACHE_SECTORS; i++) {
+		if ((g_diskCache[i].valid) && (g_diskCache[i].sector == sector)) {
+			g_diskCache[i].lastUse = ++g_diskCacheUseCounter;
+			return &g_diskCache[i];
+		}
+	}
+	return NULL;
+}
+
+//Returns a free entry for sector, writing back the least recently used one if needed
+static diskCacheEntry_t * DiskCacheAllocate(LBA_t sector) {
+	diskCacheEntry_t * pEntry = &g_diskCache[0];
+	for (uint32_t i = 0; i < DISK_CACHE_SECTORS; i++) {
+		if (!g_diskCache[i].valid) {
+			pEntry = &g_diskCache[i];
+			break;
+		}
+		if (g_diskCache[i].lastUse < pEntry->lastUse) {
+			pEntry = &g_diskCache[i];
+		}
+	}
+	if (!DiskCacheWriteBack(pEntry)) {
+		return NULL;
+	}
+	pEntry->sector = sector;
+	pEntry->lastUse = ++g_diskCacheUseCounter;
+	pEntry->valid = true;
+	pEntry->dirty = false;
+	return pEntry;
+}
+
+static bool DiskCacheSync(bool onlyExpired) {
+	bool success = true;
+	uint32_t now = HAL_GetTick();
+	for (uint32_t i = 0; i < DISK_CACHE_SECTORS; i++) {
+		diskCacheEntry_t * pEntry = &g_diskCache[i];
+		if ((onlyExpired) && ((now - pEntry->dirtySince) < DISK_CACHE_TIMEOUT)) {
+			continue;
+		}
+		if (!DiskCacheWriteBack(pEntry)) {
+			success = false;
+		}
+	}
+	return success;
+}
+
+#endif
+
+void disk_cache_timeout(void) {
+#if DISK_CACHE_SECTORS > 0
+	DiskCacheSync(true);
+#endif
+}
+
+void disk_background(void) {
+	disk_cache_timeout();
+}
+
+void disk_cache_stats(uint32_t * hits, uint32_t * misses) {
+	if (hits) {
+		*hits = g_diskCacheHits;
+	}
+	if (misses) {
+		*misses = g_diskCacheMisses;
+	}
+}
 
 /*-----------------------------------------------------------------------*/
 /* Get Drive Status                                                      */
@@ -31,6 +474,10 @@ DSTATUS disk_status (
 	switch (pdrv) {
 	case DEV_EXTFLASH :
 		return g_diskState[DEV_EXTFLASH];
+#if DISK_SDCARD
+	case DEV_SDCARD :
+		return g_diskState[DEV_SDCARD];
+#endif
 	}
 	return STA_NOINIT;
 }
@@ -41,7 +488,7 @@ DSTATUS disk_status (
 /* Inidialize a Drive                                                    */
 /*-----------------------------------------------------------------------*/
 
-//FlashEnable must be called before
+//FlashEnable must be called before, for DEV_SDCARD SdmmcInit
 DSTATUS disk_initialize (
 	BYTE pdrv				/* Physical drive nmuber to identify the drive */
 )
@@ -52,9 +499,24 @@ DSTATUS disk_initialize (
 			if ((FlashReady()) && (FlashPagesizePowertwoGet()) &&
 			    (FlashBlocksizeGet() <= DISK_BLOCKSIZE)) {
 				g_diskState[DEV_EXTFLASH] = 0;
+#ifdef DISK_TRIMOFFSET
+				if (g_diskState[DEV_EXTFLASH] == 0) {
+					DiskTrimLoad();
+				}
+#endif
 			}
 		}
 		return g_diskState[DEV_EXTFLASH];
+#if DISK_SDCARD
+	case DEV_SDCARD :
+		//checked every time, as the card might have been changed and initialized again
+		if (SdmmcCapacity() > 0) {
+			g_diskState[DEV_SDCARD] = 0;
+		} else {
+			g_diskState[DEV_SDCARD] = STA_NOINIT | STA_NODISK;
+		}
+		return g_diskState[DEV_SDCARD];
+#endif
 	}
 	return STA_NOINIT;
 }
@@ -72,15 +534,96 @@ DRESULT disk_read (
 {
 	switch (pdrv) {
 	case DEV_EXTFLASH:
-		if (FlashRead(DISK_RESERVEDOFFSET + sector * DISK_BLOCKSIZE, buff, count * DISK_BLOCKSIZE)) {
+#if DISK_CACHE_SECTORS > 0
+		DiskCacheSync(true);
+		while (count) {
+			diskCacheEntry_t * pEntry = DiskCacheFind(sector);
+			if (pEntry) {
+				memcpy(buff, pEntry->data, DISK_BLOCKSIZE);
+				g_diskCacheHits++;
+				buff += DISK_BLOCKSIZE;
+				sector++;
+				count--;
+				continue;
+			}
+			/*Read all following uncached sectors at once. Only single sector
+			  reads are cached, as FatFs uses them for the FAT and directories,
+			  while file data are mostly read in multiple sectors and would
+			  evict them.
+			*/
+			UINT num = 1;
+			while ((num < count) && (!DiskCacheFind(sector + num))) {
+				num++;
+			}
+			g_diskCacheMisses += num;
+			if (!DiskSectorsRead(sector, buff, num)) {
+				return RES_ERROR;
+			}
+			if (count == 1) {
+				pEntry = DiskCacheAllocate(sector);
+				if (pEntry) {
+					memcpy(pEntry->data, buff, DISK_BLOCKSIZE);
+				}
+			}
+			buff += num * DISK_BLOCKSIZE;
+			sector += num;
+			count -= num;
+		}
+		return RES_OK;
+#else
+		if (DiskSectorsRead(sector, buff, count)) {
 			return RES_OK;
 		} else {
 			return RES_ERROR;
 		}
+#endif
+#if DISK_SDCARD
+	case DEV_SDCARD:
+		//multiple sectors are read with one CMD18
+		if (SdmmcRead(buff, sector, count)) {
+			return RES_OK;
+		} else {
+			return RES_ERROR;
+		}
+#endif
 	}
 	return RES_PARERR;
 }
 
+/*-----------------------------------------------------------------------*/
+/* Start Reading a Sector in the Background                              */
+/*-----------------------------------------------------------------------*/
+
+DRESULT disk_read_start (
+	BYTE pdrv,		/* Physical drive nmuber to identify the drive */
+	BYTE *buff,		/* Data buffer to store read data */
+	LBA_t sector	/* Sector in LBA */
+)
+{
+#if DISK_CACHE_SECTORS == 0
+	if (pdrv == DEV_EXTFLASH) {
+#ifdef DISK_TRIMOFFSET
+		if (DiskTrimmed(sector)) {
+			memset(buff, 0, DISK_BLOCKSIZE);
+			return RES_OK;
+		}
+#endif
+		if (FlashReadBackground(DISK_RESERVEDOFFSET + sector * DISK_BLOCKSIZE, buff, DISK_BLOCKSIZE)) {
+			return RES_OK;
+		}
+		return RES_ERROR;
+	}
+#endif
+	//the cache and the SD card only support blocking reads
+	return disk_read(pdrv, buff, sector, 1);
+}
+
+void disk_read_wait(void) {
+	FlashReadBackgroundWait();
+}
+
+
+
 /*-----------------------------------------------------------------------*/
 /* Write Sector(s)                                                       */
 /*-----------------------------------------------------------------------*/
@@ -96,11 +639,49 @@ DRESULT disk_write (
 {
 	switch (pdrv) {
 	case DEV_EXTFLASH:
-		if (FlashWrite(DISK_RESERVEDOFFSET + sector * DISK_BLOCKSIZE, buff, count * DISK_BLOCKSIZE)) {
+#if DISK_CACHE_SECTORS > 0
+		DiskCacheSync(true);
+		if (count == 1) {
+			//delay single sector writes, FatFs often changes the same sector again
+			diskCacheEntry_t * pEntry = DiskCacheFind(sector);
+			if (pEntry) {
+				g_diskCacheHits++;
+			} else {
+				g_diskCacheMisses++;
+				pEntry = DiskCacheAllocate(sector);
+				if (!pEntry) {
+					return RES_ERROR;
+				}
+			}
+			memcpy(pEntry->data, buff, DISK_BLOCKSIZE);
+			if (!pEntry->dirty) {
+				pEntry->dirtySince = HAL_GetTick();
+				pEntry->dirty = true;
+			}
+			return RES_OK;
+		}
+		//multiple sectors are written directly, cached copies get the new data
+		for (UINT i = 0; i < count; i++) {
+			diskCacheEntry_t * pEntry = DiskCacheFind(sector + i);
+			if (pEntry) {
+				memcpy(pEntry->data, buff + i * DISK_BLOCKSIZE, DISK_BLOCKSIZE);
+				pEntry->dirty = false;
+			}
+		}
+#endif
+		if (DiskSectorsWrite(sector, buff, count)) {
+			return RES_OK;
+		} else {
+			return RES_ERROR;
+		}
+#if DISK_SDCARD
+	case DEV_SDCARD:
+		if (SdmmcWrite(buff, sector, count)) {
 			return RES_OK;
 		} else {
 			return RES_ERROR;
 		}
+#endif
 	}
 	return RES_PARERR;
 }
@@ -120,12 +701,36 @@ DRESULT disk_ioctl (
 {
 	switch (pdrv) {
 	case DEV_EXTFLASH:
-		if ((cmd == CTRL_SYNC) || (cmd == CTRL_TRIM)) {
+		if (cmd == CTRL_SYNC) {
+#if DISK_CACHE_SECTORS > 0
+			if (!DiskCacheSync(false)) {
+				return RES_ERROR;
+			}
+#endif
+#ifdef DISK_TRIMOFFSET
+			if (!DiskTrimSync()) {
+				return RES_ERROR;
+			}
+#endif
+			return RES_OK;
+		}
+		if (cmd == CTRL_TRIM) {
+#ifdef DISK_TRIMOFFSET
+			LBA_t * range = (LBA_t *)buff;
+#if DISK_CACHE_SECTORS > 0
+			//the cached data are not needed anymore, even if dirty
+			for (uint32_t i = 0; i < DISK_CACHE_SECTORS; i++) {
+				if ((g_diskCache[i].sector >= range[0]) && (g_diskCache[i].sector <= range[1])) {
+					g_diskCache[i].valid = false;
+				}
+			}
+#endif
+			DiskTrimSet(range[0], range[1]);
+#endif
 			return RES_OK;
 		}
 		if (cmd == GET_SECTOR_COUNT) {
-			uint32_t sectors = (FlashSizeGet() - DISK_RESERVEDOFFSET) / DISK_BLOCKSIZE;
-			*((LBA_t*)buff) = sectors;
+			*((LBA_t*)buff) = DiskSectorsGet();
 			return RES_OK;
 		}
 		if (cmd == GET_SECTOR_SIZE) {
@@ -136,6 +741,27 @@ DRESULT disk_ioctl (
 			*(DWORD*)buff = DISK_BLOCKSIZE;
 			return RES_OK;
 		}
+		break;
+#if DISK_SDCARD
+	case DEV_SDCARD:
+		//SdmmcWrite returns after the card finished writing, trimming is not supported
+		if ((cmd == CTRL_SYNC) || (cmd == CTRL_TRIM)) {
+			return RES_OK;
+		}
+		if (cmd == GET_SECTOR_COUNT) {
+			*((LBA_t*)buff) = SdmmcCapacity();
+			return RES_OK;
+		}
+		if (cmd == GET_SECTOR_SIZE) {
+			*((WORD*)buff) = DISK_BLOCKSIZE;
+			return RES_OK;
+		}
+		if (cmd == GET_BLOCK_SIZE) {
+			*(DWORD*)buff = DISK_SDCARD_ERASEBLOCK;
+			return RES_OK;
+		}
+		break;
+#endif
 	}
 	return RES_PARERR;
 }
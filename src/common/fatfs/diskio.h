@@ -14,6 +14,13 @@ extern "C" {
 //must be at least 512 byte, so the value from FlashBlocksizeGet() can not be used
 #define DISK_BLOCKSIZE 512
 
+/* Definitions of physical drive number for each drive */
+#define DEV_EXTFLASH 0
+#define DEV_SDCARD 1
+/* DEV_SDCARD is only available if DISK_SDCARD is set to 1 in ffconf.h, which
+   also needs FF_VOLUMES >= 2. SdmmcInit must be called before
+   disk_initialize(DEV_SDCARD). */
+
 /* Status of Disk Functions */
 typedef BYTE	DSTATUS;
 
@@ -37,6 +44,24 @@ DRESULT disk_read (BYTE pdrv, BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_write (BYTE pdrv, const BYTE* buff, LBA_t sector, UINT count);
 DRESULT disk_ioctl (BYTE pdrv, BYTE cmd, void* buff);
 
+/* Starts reading one sector, for DEV_EXTFLASH the data can arrive in the
+   background by DMA. disk_read_wait must be called before buff is used and
+   before any other disk function. With the diskio cache, the sector is read
+   at once. */
+DRESULT disk_read_start (BYTE pdrv, BYTE* buff, LBA_t sector);
+void disk_read_wait(void);
+
+/* Writes back the sectors of the diskio cache which are dirty for longer than
+   DISK_CACHE_TIMEOUT. Call it periodically if data should reach the flash
+   without closing or syncing the files. */
+void disk_cache_timeout(void);
+
+/* Call periodically when idle, runs disk_cache_timeout(). */
+void disk_background(void);
+
+/* Number of sectors found and not found in the diskio cache */
+void disk_cache_stats(uint32_t * hits, uint32_t * misses);
+
 
 /* Disk Status Bits (DSTATUS) */
 
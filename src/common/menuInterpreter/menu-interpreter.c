@@ -120,8 +120,47 @@ uint16_t menu_focus_prime;
 
 uint8_t menu_focus_key_next, menu_focus_key_prev, menu_key_enter;
 uint8_t menu_focus_restore; //set to 1 if focus should be resored
-//the index of all objects in the list, 0 for objects which disallow a focus
-MENUADDR menu_focus_objects[MENU_OBJECTS_MAX];
+
+/*Index of all objects of the window set up by menu_new_window.
+  Redrawing, the focus handling and the shortcut lookup use this instead of
+  parsing the window data again, which is slow if menu_byte_get reads from an
+  external memory.
+*/
+typedef struct {
+	MENUADDR addr; //start of the object (the token)
+	MENUADDR dataaddr; //text or graphic address, 0 if the object has none
+	SCREENPOS px;
+	SCREENPOS py;
+	SCREENPOS sx; //0 for labels and shortcuts
+	SCREENPOS sy; //for labels the highest text height since the window was indexed
+	uint8_t token;
+	uint8_t options; //the focusable bit is only set for objects which can get the focus
+	uint8_t fonts;
+} menu_object_t;
+
+menu_object_t menu_index[MENU_OBJECTS_MAX];
+
+#ifdef MENU_BYTE_STATS
+
+uint32_t menu_byte_fetches;
+
+static uint8_t menu_byte_get_counted(MENUADDR addr) {
+	menu_byte_fetches++;
+	return menu_byte_get(addr);
+}
+
+//all following reads of the menu data are counted
+#define menu_byte_get menu_byte_get_counted
+
+#endif
+
+//returns the address of the object if it can get the focus, 0 otherwise
+static MENUADDR menu_focus_addr(uint16_t index) {
+	if ((index < menu_objects) && (menu_index[index].options & (1 << MENU_OPTIONS_FOCUSABLE))) {
+		return menu_index[index].addr;
+	}
+	return 0;
+}
 
 MENUADDR menu_pc; //shows on the byte to read next
 static void menu_pc_set(MENUADDR addr) {
@@ -160,6 +199,26 @@ static MENUADDR menu_object_datasize(uint8_t object_id) {
 	}
 }
 
+//end positions are exclusive
+typedef struct {
+	uint16_t x1;
+	uint16_t y1;
+	uint16_t x2;
+	uint16_t y2;
+} menu_area_t;
+
+//while enabled, nothing outside of this area is drawn, used by menu_redraw_dirty
+menu_area_t menu_clip;
+uint8_t menu_clip_enabled;
+
+void menu_screen_set_clipped(SCREENPOS x, SCREENPOS y, SCREENCOLOR color) {
+	if ((menu_clip_enabled) &&
+	    ((x < menu_clip.x1) || (x >= menu_clip.x2) || (y < menu_clip.y1) || (y >= menu_clip.y2))) {
+		return;
+	}
+	menu_screen_set(x, y, color);
+}
+
 #if (defined(MENU_USE_LIST) || defined(MENU_USE_SUBWINDOW) || \
      defined(MENU_USE_BUTTON) || defined(MENU_USE_CHECKBOX) || \
      defined(MENU_USE_RADIOBUTTON) || defined(MENU_USE_BOX) || \
@@ -167,6 +226,12 @@ static MENUADDR menu_object_datasize(uint8_t object_id) {
 
 static void menu_draw_Xline(SCREENPOS px, SCREENPOS py,
                               SCREENPOS length, SCREENCOLOR color, uint8_t dotted) {
+#ifdef MENU_SCREEN_BULK
+	if ((!dotted) && (!menu_clip_enabled)) {
+		menu_screen_hline(px, py, length, color);
+		return;
+	}
+#endif
 	SCREENPOS x;
 	SCREENCOLOR colormod;
 	for (x = px; x < px+length; x++) {
@@ -177,12 +242,18 @@ static void menu_draw_Xline(SCREENPOS px, SCREENPOS py,
 		} else {
 			colormod = color;
 		}
-		menu_screen_set(x, py, colormod);
+		menu_screen_set_clipped(x, py, colormod);
 	}
 }
 
 static void menu_draw_Yline(SCREENPOS px, SCREENPOS py,
                               SCREENPOS length, SCREENCOLOR color, uint8_t dotted) {
+#ifdef MENU_SCREEN_BULK
+	if ((!dotted) && (!menu_clip_enabled)) {
+		menu_screen_vline(px, py, length, color);
+		return;
+	}
+#endif
 	SCREENPOS y;
 	SCREENCOLOR colormod;
 	for (y = py; y < py+length; y++) {
@@ -193,7 +264,7 @@ static void menu_draw_Yline(SCREENPOS px, SCREENPOS py,
 		} else {
 			colormod = color;
 		}
-		menu_screen_set(px, y, colormod);
+		menu_screen_set_clipped(px, y, colormod);
 	}
 }
 
@@ -222,21 +293,32 @@ static void menu_draw_border(SCREENPOS px, SCREENPOS py, SCREENPOS sx,
 
 #endif
 
-#if (defined(MENU_USE_LIST) || defined(MENU_USE_BOX) || defined(MENU_USE_SUBWINDOW))
-
-static void menu_draw_box(SCREENPOS px, SCREENPOS py, SCREENPOS sx,
+void menu_draw_box(SCREENPOS px, SCREENPOS py, SCREENPOS sx,
                    SCREENPOS sy, SCREENCOLOR color) {
-	SCREENPOS x, y;
 	SCREENPOS ex = px+sx;
 	SCREENPOS ey = py+sy;
+#ifdef MENU_SCREEN_BULK
+	if ((ex > px) && (ey > py)) { //same as the loop below, if the end wraps around
+		uint16_t x1 = px, y1 = py, x2 = ex, y2 = ey;
+		if (menu_clip_enabled) {
+			if (x1 < menu_clip.x1) x1 = menu_clip.x1;
+			if (y1 < menu_clip.y1) y1 = menu_clip.y1;
+			if (x2 > menu_clip.x2) x2 = menu_clip.x2;
+			if (y2 > menu_clip.y2) y2 = menu_clip.y2;
+		}
+		if ((x1 < x2) && (y1 < y2)) {
+			menu_screen_fill_rect(x1, y1, x2 - x1, y2 - y1, color);
+		}
+	}
+#else
+	SCREENPOS x, y;
 	for (y = py; y < ey; y++) {
 		for (x = px; x < ex; x++) {
-			menu_screen_set(x, y, color);
+			menu_screen_set_clipped(x, y, color);
 		}
 	}
-}
-
 #endif
+}
 
 #if defined(MENU_USE_MULTILANGUAGE) || defined(MENU_USE_MULTIGFX)
 
@@ -294,7 +376,7 @@ static void menu_text_draw_base(SCREENPOS x, SCREENPOS y, uint8_t font,
 	maxpix += x;
 	uint8_t storage = (options>>MENU_OPTIONS_STORAGE) & 3;
 	uint8_t transparency = (options>>MENU_OPTIONS_TRANSPARENCY) & 1;
-	while (index < 10000) {
+	while ((uint16_t)(index - offset) < 10000) { //limits the characters, not the position within a long list
 		cdraw = menu_text_byte_get(baseaddr, index, storage);
 		index++;
 		if ((cdraw == '\0') || (cdraw == '\n') || (x >= maxpix)) {
@@ -437,12 +519,12 @@ static void menu_checkbox(uint8_t hasfocus) {
 	}
 	MENU_DEBUGMSG("Drawing checkbox %i with state %i\n", ckbnumber, color);
 	//TODO: make the pattern available as gfx instead of hard coded values
-	menu_screen_set(px+1, py+4, color);
-	menu_screen_set(px+2, py+5, color);
-	menu_screen_set(px+3, py+4, color);
-	menu_screen_set(px+4, py+3, color);
-	menu_screen_set(px+5, py+2, color);
-	menu_screen_set(px+6, py+1, color);
+	menu_screen_set_clipped(px+1, py+4, color);
+	menu_screen_set_clipped(px+2, py+5, color);
+	menu_screen_set_clipped(px+3, py+4, color);
+	menu_screen_set_clipped(px+4, py+3, color);
+	menu_screen_set_clipped(px+5, py+2, color);
+	menu_screen_set_clipped(px+6, py+1, color);
 #else
 	UNREFERENCED_PARAMETER(hasfocus);
 	MENU_DEBUGMSG("Error: Checkbox used, but not compiled in\n");
@@ -473,18 +555,18 @@ static void menu_radiobutton(uint8_t hasfocus) {
 	}
 	MENU_DEBUGMSG("Drawing radiobutton of group %i, checked on %i. Tableentry: %i\n", radionumber, radioselect, menu_checkboxstate[radionumber]);
 	//TODO: make the pattern available as gfx instead of hard coded values
-	menu_screen_set(px+3, py+2, color);
-	menu_screen_set(px+4, py+2, color);
-	menu_screen_set(px+2, py+3, color);
-	menu_screen_set(px+3, py+3, color);
-	menu_screen_set(px+4, py+3, color);
-	menu_screen_set(px+5, py+3, color);
-	menu_screen_set(px+3, py+5, color);
-	menu_screen_set(px+4, py+5, color);
-	menu_screen_set(px+2, py+4, color);
-	menu_screen_set(px+3, py+4, color);
-	menu_screen_set(px+4, py+4, color);
-	menu_screen_set(px+5, py+4, color);
+	menu_screen_set_clipped(px+3, py+2, color);
+	menu_screen_set_clipped(px+4, py+2, color);
+	menu_screen_set_clipped(px+2, py+3, color);
+	menu_screen_set_clipped(px+3, py+3, color);
+	menu_screen_set_clipped(px+4, py+3, color);
+	menu_screen_set_clipped(px+5, py+3, color);
+	menu_screen_set_clipped(px+3, py+5, color);
+	menu_screen_set_clipped(px+4, py+5, color);
+	menu_screen_set_clipped(px+2, py+4, color);
+	menu_screen_set_clipped(px+3, py+4, color);
+	menu_screen_set_clipped(px+4, py+4, color);
+	menu_screen_set_clipped(px+5, py+4, color);
 #else
 	UNREFERENCED_PARAMETER(hasfocus);
 	MENU_DEBUGMSG("Error: Radiobutton used, but not compiled in\n");
@@ -538,7 +620,7 @@ static void menu_gfx_4Bit_set(SCREENPOS x, SCREENPOS y, uint8_t color4Bit) {
 	SCREENCOLOR bout = color4Bit >> (8 - MENU_COLOR_OUT_BLUE_BITS);
 	c = (rout << MENU_COLOR_OUT_RED_LSB_POS) | (gout << MENU_COLOR_OUT_GREEN_LSB_POS) | (bout << MENU_COLOR_OUT_BLUE_LSB_POS);
 #endif
-	menu_screen_set(x, y, c);
+	menu_screen_set_clipped(x, y, c);
 }
 #endif
 
@@ -570,7 +652,7 @@ static void menu_gfx_Custom1_set(SCREENPOS x, SCREENPOS y, COLORCUSTOM3 colorin)
 #else
 	MENU_GFX_CUSTOMCOLOR_TO_SCREENCOLOR(1)
 #endif
-	menu_screen_set(x, y, c);
+	menu_screen_set_clipped(x, y, c);
 }
 #endif
 
@@ -583,7 +665,7 @@ static void menu_gfx_Custom2_set(SCREENPOS x, SCREENPOS y, COLORCUSTOM3 colorin)
 #else
 	MENU_GFX_CUSTOMCOLOR_TO_SCREENCOLOR(2)
 #endif
-	menu_screen_set(x, y, c);
+	menu_screen_set_clipped(x, y, c);
 }
 #endif
 
@@ -596,7 +678,7 @@ static void menu_gfx_Custom3_set(SCREENPOS x, SCREENPOS y, COLORCUSTOM3 colorin)
 #else
 	MENU_GFX_CUSTOMCOLOR_TO_SCREENCOLOR(3)
 #endif
-	menu_screen_set(x, y, c);
+	menu_screen_set_clipped(x, y, c);
 }
 #endif
 
@@ -671,6 +753,9 @@ inline static uint32_t menu_gfx_3byte_fetch(MENUADDR gfxaddr, MENUADDR gfxinc, u
 	if (imageformat == FORMAT) { \
 		COLORCUSTOM##ID color = 0;\
 		for (y = py; y < py+sy; y++) {\
+			if ((menu_clip_enabled) && (y >= menu_clip.y2)) {\
+				break;\
+			}\
 			for (x = px; x < px+sx; x++) {\
 				if (havedata == 0) { \
 					havedata = 1;\
@@ -727,6 +812,9 @@ static void menu_gfx(uint8_t hasfocus) {
 		SCREENCOLOR color = 0;
 		uint8_t data = 0;
 		for (y = py; y < py+sy; y++) {
+			if ((menu_clip_enabled) && (y >= menu_clip.y2)) {
+				break; //nothing more to draw
+			}
 			for (x = px; x < px+sx; x++) {
 				//check if we have source data
 				if (havedata == 0) { //fetch a next byte
@@ -751,7 +839,7 @@ static void menu_gfx(uint8_t hasfocus) {
 					data = data << 1;
 				}
 				havedata--;
-				menu_screen_set(x, y, color);
+				menu_screen_set_clipped(x, y, color);
 			}
 		}
   }
@@ -761,6 +849,9 @@ static void menu_gfx(uint8_t hasfocus) {
 		uint8_t color = 0;
 		uint8_t data = 0;
 		for (y = py; y < py+sy; y++) {
+			if ((menu_clip_enabled) && (y >= menu_clip.y2)) {
+				break; //nothing more to draw
+			}
 			for (x = px; x < px+sx; x++) {
 				//check if we have source data
 				if (havedata == 0) { //fetch a next byte
@@ -802,7 +893,7 @@ static void menu_gfx(uint8_t hasfocus) {
 
 #ifdef MENU_USE_LIST
 
-static uint16_t menu_list_lines(MENUADDR addr, uint8_t storage) {
+static uint16_t menu_list_lines_count(MENUADDR addr, uint8_t storage) {
 	uint16_t lines = 0;
 	uint16_t i = 0;
 	char c;
@@ -815,9 +906,140 @@ static uint16_t menu_list_lines(MENUADDR addr, uint8_t storage) {
 	return lines;
 }
 
-static uint16_t menu_list_line_seek(MENUADDR addr, uint8_t storage, uint16_t line) {
+#ifdef MENU_LIST_INDEX
+
+/*Line offset index of a list, the buffer for the offsets is provided by
+  menu_list_index_set. offsets[n] is the text position of line n * step.
+  So a list with less lines than entries can seek every line directly.
+*/
+typedef struct {
+	uint16_t * offsets;
+	uint16_t entries;
+	uint16_t step; //0 if the index needs to be built
+	uint16_t lines;
+	MENUADDR baseaddr; //the text the index was built for
+	uint8_t storage;
+	const char * text; //the menu_strings pointer of a RAM text
+#ifdef MENU_USE_MULTILANGUAGE
+	uint8_t language;
+#endif
+} menu_list_index_t;
+
+menu_list_index_t menu_list_indexes[MENU_LIST_MAX];
+
+void menu_list_index_set(uint8_t listnumber, uint16_t * offsets, uint16_t entries) {
+	if (listnumber < MENU_LIST_MAX) {
+		menu_list_indexes[listnumber].offsets = offsets;
+		menu_list_indexes[listnumber].entries = entries;
+		menu_list_indexes[listnumber].step = 0;
+	} else {
+		MENU_DEBUGMSG("Error: list %i is out of range\n", listnumber);
+	}
+}
+
+//returns the menu_strings index of a RAM text, or MENU_TEXT_MAX for a fixed text
+static MENUADDR menu_list_text_index(MENUADDR addr, uint8_t storage) {
+	if ((storage & 1) == 0) {
+		return MENU_TEXT_MAX;
+	}
+#ifdef MENU_USE_MULTILANGUAGE
+	if (storage & 2) {
+		addr += menu_language;
+	}
+#endif
+	return addr;
+}
+
+//called by menu_text_changed
+static void menu_list_index_invalidate(uint16_t textindex) {
+	uint8_t i;
+	for (i = 0; i < MENU_LIST_MAX; i++) {
+		menu_list_index_t * li = &menu_list_indexes[i];
+		if ((li->step) && (menu_list_text_index(li->baseaddr, li->storage) == textindex)) {
+			li->step = 0;
+		}
+	}
+}
+
+//returns the index of the list, built for the given text, or NULL if the list has none
+static menu_list_index_t * menu_list_index_get(uint8_t listnumber, MENUADDR addr, uint8_t storage) {
+	if (listnumber >= MENU_LIST_MAX) {
+		return NULL;
+	}
+	menu_list_index_t * li = &menu_list_indexes[listnumber];
+	if ((li->offsets == NULL) || (li->entries == 0)) {
+		return NULL;
+	}
+	const char * text = NULL;
+	MENUADDR textindex = menu_list_text_index(addr, storage);
+	if (textindex < MENU_TEXT_MAX) {
+		text = menu_strings[textindex];
+	}
+	if ((li->baseaddr != addr) || (li->storage != storage) || (li->text != text)) {
+		li->step = 0;
+	}
+#ifdef MENU_USE_MULTILANGUAGE
+	if (li->language != menu_language) {
+		li->step = 0;
+	}
+	li->language = menu_language;
+#endif
+	if (li->step) {
+		return li;
+	}
+	//build the index again
+	li->baseaddr = addr;
+	li->storage = storage;
+	li->text = text;
+	li->lines = menu_list_lines_count(addr, storage);
+	li->step = (li->lines + li->entries - 1) / li->entries;
+	uint16_t i = 0;
+	uint16_t line = 0;
+	char c;
+	li->offsets[0] = 0;
+	while ((c = menu_text_byte_get(addr, i++, storage)) != '\0') {
+		if (c == '\n') {
+			line++;
+			if ((line % li->step) == 0) {
+				li->offsets[line / li->step] = i;
+			}
+		}
+	}
+	MENU_DEBUGMSG("List %i index built, lines %i, step %i\n", listnumber, li->lines, li->step);
+	return li;
+}
+
+#endif
+
+static uint16_t menu_list_lines(MENUADDR addr, uint8_t storage, uint8_t listnumber) {
+#ifdef MENU_LIST_INDEX
+	menu_list_index_t * li = menu_list_index_get(listnumber, addr, storage);
+	if (li) {
+		return li->lines;
+	}
+#else
+	UNREFERENCED_PARAMETER(listnumber);
+#endif
+	return menu_list_lines_count(addr, storage);
+}
+
+static uint16_t menu_list_line_seek(MENUADDR addr, uint8_t storage, uint16_t line, uint8_t listnumber) {
 	uint16_t i = 0;
 	char c;
+#ifdef MENU_LIST_INDEX
+	menu_list_index_t * li = menu_list_index_get(listnumber, addr, storage);
+	if (li) { //start at the nearest known line before
+		uint16_t entry = line / li->step;
+		uint16_t entrylast = (li->lines - 1) / li->step;
+		if (entry > entrylast) {
+			entry = entrylast;
+		}
+		i = li->offsets[entry];
+		line -= entry * li->step;
+	}
+#else
+	UNREFERENCED_PARAMETER(listnumber);
+#endif
 	while (line > 0) {
 		c = menu_text_byte_get(addr, i, storage);
 		if (c == '\n')
@@ -861,7 +1083,7 @@ static void menu_list(uint8_t hasfocus) {
 	SCREENPOS x, y;
 	MENU_DEBUGMSG("Drawing list %i;%i with size %i;%i\n", px, py, sx, sy);
 	//draw the text
-	uint16_t textlines = menu_list_lines(baseaddr, storage); //lines of the list to display
+	uint16_t textlines = menu_list_lines(baseaddr, storage, listnumber); //lines of the list to display
 	uint16_t selectedline = menu_listindexstate[listnumber];
 	SCREENPOS fontheight = menu_font_heigth(fonts & 0x0f)+1;
 	SCREENPOS linesonscreen = (sy - 3)/ (fontheight); //maximum lines which could be displayed
@@ -884,7 +1106,7 @@ static void menu_list(uint8_t hasfocus) {
 	}
 	MENU_DEBUGMSG("textlines %i, selectedline %i, fontheigth %i, on screen %i, beginningline %i\n",
 	  textlines, selectedline, fontheight, linesonscreen, beginningline);
-	uint16_t textpos = menu_list_line_seek(baseaddr, storage, beginningline);
+	uint16_t textpos = menu_list_line_seek(baseaddr, storage, beginningline, listnumber);
 	y = py+2;
 	uint16_t t;
 	for (t = beginningline; t < (beginningline+linesonscreen); t++) { //now draw each line
@@ -953,11 +1175,16 @@ static void menu_new_window(MENUADDR addr) {
 		menu_focus_key_next = menu_byte_get_next();
 		menu_key_enter = menu_byte_get_next();
 		uint16_t index = 0;
-		uint8_t options;
 		while (index < MENU_OBJECTS_MAX) {
+			menu_object_t * obj = &menu_index[index];
+			obj->addr = menu_pc;
 			token = menu_byte_get_next();
 			MENUADDR t = menu_pc + menu_object_datasize(token);
-			menu_focus_objects[index] = 0; //for LABEL and shortcut
+			obj->token = token;
+			obj->dataaddr = 0;
+			obj->px = obj->py = obj->sx = obj->sy = 0;
+			obj->options = 0;
+			obj->fonts = 0;
 			switch(token) {
 				case MENU_BOX:
 				case MENU_BUTTON:
@@ -965,16 +1192,37 @@ static void menu_new_window(MENUADDR addr) {
 				case MENU_LIST:
 				case MENU_CHECKBOX:
 				case MENU_RADIOBUTTON:
-						options = menu_byte_get(menu_pc+MENU_CORDSKIP); //offset for the options in all objects
-						if (options & (1<<MENU_OPTIONS_FOCUSABLE)) { //if focusable
-							menu_focus_objects[index] = menu_pc-1; //start addr of object
-						} else
-							menu_focus_objects[index] = 0;
- 						break;
+					{
+						MENU_SCREENPOS_PX_PY
+						MENU_SCREENPOS_SX_SY
+						obj->px = px;
+						obj->py = py;
+						obj->sx = sx;
+						obj->sy = sy;
+					}
+					obj->options = menu_byte_get_next();
+					if (token != MENU_BOX) {
+						menu_pc_skip(MENU_ACTION_BYTES + MENU_ADDR_BYTES); //action + windowaddr
+						obj->dataaddr = menu_assemble_addr();
+						if (token != MENU_GFX) {
+							obj->fonts = menu_byte_get_next();
+						}
+					}
+					break;
+				case MENU_LABEL:
+					{
+						MENU_SCREENPOS_PX_PY
+						obj->px = px;
+						obj->py = py;
+					}
+					obj->options = menu_byte_get_next() & ~(1 << MENU_OPTIONS_FOCUSABLE); //a label never gets the focus
+					obj->dataaddr = menu_assemble_addr();
+					obj->fonts = menu_byte_get_next();
+					break;
 				case MENU_WINDOW:
 				case MENU_SUBWINDOW:
 				case MENU_INVALID: goto windowend; //sorry, no double break possible
-				default: ; //do nothing for the label
+				default: ; //nothing to remember for the shortcut
 			}
 			menu_pc_set(t);
 			index++; //count amounts of objects
@@ -985,14 +1233,14 @@ static void menu_new_window(MENUADDR addr) {
 		menu_objects = index;
 		MENU_DEBUGMSG("Objects in Window: %i\n", menu_objects);
 		//check if old focus should be used
-		if ((menu_focus_restore) && (menu_focus_objects[menu_focus_prime])) {
+		if ((menu_focus_restore) && (menu_focus_addr(menu_focus_prime))) {
 			menu_focus = menu_focus_prime;
 			menu_focus_restore = 0;
 		} else {
 			//set up focus on first focusabel object
 			menu_focus = 0;
 			for (index = 0; index < menu_objects; index++) {
-				if (menu_focus_objects[index] != 0) {
+				if (menu_focus_addr(index) != 0) {
 					menu_focus = index;
 					break;
 				}
@@ -1005,30 +1253,49 @@ static void menu_new_window(MENUADDR addr) {
 	menu_window_init = addr;
 }
 
-//draws two times in the case of a window with a sub window
-static void menu_draw_windowcontent(uint8_t focusallow) {
+//draws the object at menu_pc, returns 0 if the token is not a drawable object
+static uint8_t menu_draw_object(uint8_t token, uint8_t hasfocus) {
+	switch(token) {
+		case MENU_BOX: menu_box(hasfocus); break;
+		case MENU_LABEL: menu_label(); break;
+		case MENU_BUTTON: menu_button(hasfocus); break;
+		case MENU_GFX: menu_gfx(hasfocus); break;
+		case MENU_LIST: menu_list(hasfocus); break;
+		case MENU_CHECKBOX: menu_checkbox(hasfocus); break;
+		case MENU_RADIOBUTTON: menu_radiobutton(hasfocus); break;
+		case MENU_SHORTCUT: menu_shortcut(); break;
+		default: return 0;
+	}
+	return 1;
+}
+
+//draws the window below a sub window, which is not in the object index
+static void menu_draw_windowcontent(void) {
 	uint16_t index = 0;
 	while (index <= MENU_OBJECTS_MAX) {
 		uint8_t token = menu_byte_get_next();
+		if (menu_draw_object(token, 0) == 0) {
+			return;
+		}
+		index++; //count amounts of objects
+	}
+}
+
+//draws all objects of the window set up by menu_new_window
+static void menu_draw_indexed(void) {
+	uint16_t index;
+	for (index = 0; index < menu_objects; index++) {
 		uint8_t hasfocus = 0;
-		if ((index == menu_focus) && (menu_focus_objects[index]) && (focusallow)) {
+		if ((index == menu_focus) && (menu_focus_addr(index))) {
 			hasfocus = 1;
 		}
-		switch(token) {
-			case MENU_BOX: menu_box(hasfocus); break;
-			case MENU_LABEL: menu_label(); break;
-			case MENU_BUTTON: menu_button(hasfocus); break;
-			case MENU_GFX: menu_gfx(hasfocus); break;
-			case MENU_LIST: menu_list(hasfocus); break;
-			case MENU_CHECKBOX: menu_checkbox(hasfocus); break;
-			case MENU_RADIOBUTTON: menu_radiobutton(hasfocus); break;
-			case MENU_SHORTCUT: menu_shortcut(); break;
-			default: return;
-		}
-		index++; //count amounts of objects
+		menu_pc_set(menu_index[index].addr + 1);
+		menu_draw_object(menu_index[index].token, hasfocus);
 	}
 }
 
+static void menu_dirty_reset(void);
+
 void menu_redraw(void) {
 	//skip over possible global shortcuts if menu_window_init = 0
 	if (menu_window_init == 0) { //first start
@@ -1055,18 +1322,17 @@ void menu_redraw(void) {
 		menu_new_window(menu_window_start);
 	}
 #endif
+	menu_dirty_reset(); //everything gets drawn now
 	//draw window
 	menu_pc_set(menu_window_start);
 	uint8_t token = menu_byte_get_next();
 	if (token == MENU_WINDOW) {
-		uint8_t allowfocus = 1;
-#ifdef MENU_USE_SUBWINDOW
-		if (menu_subwindow_start) {
-			allowfocus = 0;
+		if (menu_window_init == menu_window_start) {
+			menu_draw_indexed();
+		} else { //the index holds the sub window, draw without focus
+			menu_pc_skip(MENU_WINDOW_DATA);
+			menu_draw_windowcontent();
 		}
-#endif
-		menu_pc_skip(MENU_WINDOW_DATA);
-		menu_draw_windowcontent(allowfocus);
 	} else {
 		MENU_DEBUGMSG("Error: Not a window\n");
 	}
@@ -1080,8 +1346,7 @@ void menu_redraw(void) {
 			MENU_SCREENPOS_SX_SY
 			menu_draw_box(px, py, sx, sy, MENU_COLOR_SUBWINDOW_BACKGROUND);
 			menu_draw_border(px, py, sx, sy, MENU_COLOR_SUBWINDOW_BORDER, 0);
-			menu_pc_skip(3); //three byte for the keys
-			menu_draw_windowcontent(1);
+			menu_draw_indexed();
 		} else {
 			MENU_DEBUGMSG("Error: Not a subwindow\n");
 		}
@@ -1090,6 +1355,248 @@ void menu_redraw(void) {
 	menu_screen_flush();
 }
 
+/* Redraw of changed objects only.
+Instead of clearing the whole screen, only the area the changed objects might
+have drawn to is cleared. Then all objects touching this area are drawn again
+in their normal order, but nothing outside of the area gets modified. So the
+result is the same as with menu_redraw.
+*/
+
+//bit arrays of the changed menu_strings and menu_gfxdata entries
+uint8_t menu_text_dirty[(MENU_TEXT_MAX + 8) / 8];
+#if MENU_GFX_MAX > 0
+uint8_t menu_gfx_dirty[(MENU_GFX_MAX + 8) / 8];
+#endif
+
+//maximum number of areas to redraw, if exceeded, everything gets redrawn
+#define MENU_DIRTY_AREAS_MAX 8
+
+static void menu_dirty_reset(void) {
+	uint16_t i;
+	for (i = 0; i < sizeof(menu_text_dirty); i++) {
+		menu_text_dirty[i] = 0;
+	}
+#if MENU_GFX_MAX > 0
+	for (i = 0; i < sizeof(menu_gfx_dirty); i++) {
+		menu_gfx_dirty[i] = 0;
+	}
+#endif
+}
+
+void menu_text_changed(uint16_t index) {
+	if (index < MENU_TEXT_MAX) {
+		menu_text_dirty[index / 8] |= 1 << (index % 8);
+	}
+#if defined(MENU_USE_LIST) && defined(MENU_LIST_INDEX)
+	menu_list_index_invalidate(index);
+#endif
+}
+
+void menu_gfx_changed(uint16_t index) {
+#if MENU_GFX_MAX > 0
+	if (index < MENU_GFX_MAX) {
+		menu_gfx_dirty[index / 8] |= 1 << (index % 8);
+	}
+#else
+	(void)index;
+#endif
+}
+
+static void menu_area_add(menu_area_t * area, uint16_t x1, uint16_t y1, uint16_t x2, uint16_t y2) {
+	if (x2 > MENU_SCREEN_X) {
+		x2 = MENU_SCREEN_X;
+	}
+	if (y2 > MENU_SCREEN_Y) {
+		y2 = MENU_SCREEN_Y;
+	}
+	if ((x1 >= x2) || (y1 >= y2)) {
+		return;
+	}
+	if (area->x1 >= area->x2) { //empty area
+		area->x1 = x1;
+		area->y1 = y1;
+		area->x2 = x2;
+		area->y2 = y2;
+		return;
+	}
+	if (x1 < area->x1) area->x1 = x1;
+	if (y1 < area->y1) area->y1 = y1;
+	if (x2 > area->x2) area->x2 = x2;
+	if (y2 > area->y2) area->y2 = y2;
+}
+
+static uint8_t menu_area_overlap(const menu_area_t * a, const menu_area_t * b) {
+	return (a->x1 < b->x2) && (b->x1 < a->x2) && (a->y1 < b->y2) && (b->y1 < a->y2);
+}
+
+static uint8_t menu_dirty_text(MENUADDR textaddr, uint8_t options) {
+	uint8_t storage = (options >> MENU_OPTIONS_STORAGE) & 3;
+	if ((storage & 1) == 0) {
+		return 0; //fixed text
+	}
+#ifdef MENU_USE_MULTILANGUAGE
+	if (storage & 2) {
+		textaddr += menu_language;
+	}
+#endif
+	if (textaddr >= MENU_TEXT_MAX) {
+		return 0;
+	}
+	return (menu_text_dirty[textaddr / 8] >> (textaddr % 8)) & 1;
+}
+
+static uint8_t menu_text_heigth(uint8_t fonts) {
+	uint8_t h1 = menu_font_heigth(fonts & 0x0f);
+	uint8_t h2 = menu_font_heigth(fonts >> 4);
+	return (h1 > h2) ? h1 : h2;
+}
+
+#ifdef MENU_USE_LABEL
+//Height of all lines of the text, with one pixel between the lines
+static uint16_t menu_text_lines_heigth(MENUADDR textaddr, uint8_t options, uint8_t font) {
+	uint8_t storage = (options >> MENU_OPTIONS_STORAGE) & 3;
+	uint16_t lines = 1;
+	uint16_t index;
+	char c;
+	for (index = 0; index < 10000; index++) { //same limit as menu_text_draw_base
+		c = menu_text_byte_get(textaddr, index, storage);
+		if (c == '\0') {
+			break;
+		}
+		if (c == '\n') {
+			lines++;
+		}
+	}
+	return lines * (menu_font_heigth(font) + 1) - 1;
+}
+#endif
+
+/*Gets the area the object may draw to, including the text up to the
+  right side of the screen, as the text width is not known.
+  A label keeps the area of its highest text, so the lines of a longer
+  previous text get cleared too.
+  Returns 1 if the object shows a changed RAM text or graphic.
+*/
+static uint8_t menu_object_area(menu_object_t * obj, menu_area_t * area) {
+	uint8_t dirty = 0;
+	uint8_t token = obj->token;
+	uint16_t px = obj->px;
+	uint16_t py = obj->py;
+	area->x1 = area->x2 = 0;
+	area->y1 = area->y2 = 0;
+	if (token == MENU_LABEL) {
+#ifdef MENU_USE_LABEL
+		uint16_t heigth = menu_text_lines_heigth(obj->dataaddr, obj->options, obj->fonts);
+#else
+		uint16_t heigth = menu_font_heigth(obj->fonts);
+#endif
+		if (heigth > MENU_SCREEN_Y) {
+			heigth = MENU_SCREEN_Y;
+		}
+		if (heigth > obj->sy) {
+			obj->sy = heigth;
+		}
+		menu_area_add(area, px, py, MENU_SCREEN_X, py + obj->sy);
+		dirty = menu_dirty_text(obj->dataaddr, obj->options);
+	} else if ((token == MENU_BOX) || (token == MENU_BUTTON) || (token == MENU_GFX) ||
+	           (token == MENU_LIST) || (token == MENU_CHECKBOX) || (token == MENU_RADIOBUTTON)) {
+		menu_area_add(area, px, py, px + obj->sx, py + obj->sy);
+		if (token == MENU_LIST) { //the last char of a line may exceed the list
+			menu_area_add(area, px, py, px + obj->sx + 8, py + obj->sy);
+		}
+		if (token == MENU_GFX) {
+#if MENU_GFX_MAX > 0
+			MENUADDR gfxaddr = obj->dataaddr;
+			if ((obj->options & (1 << MENU_OPTIONS_STORAGE)) && (gfxaddr < MENU_GFX_MAX)) {
+				dirty = (menu_gfx_dirty[gfxaddr / 8] >> (gfxaddr % 8)) & 1;
+			}
+#endif
+		} else if (token != MENU_BOX) {
+			dirty = menu_dirty_text(obj->dataaddr, obj->options);
+			if (token == MENU_BUTTON) {
+				menu_area_add(area, px + 2, py + 2, MENU_SCREEN_X, py + 2 + menu_text_heigth(obj->fonts));
+			} else if (token != MENU_LIST) { //checkbox and radiobutton
+				menu_area_add(area, px, py, px + 8, py + 8);
+				menu_area_add(area, px + 10, py, MENU_SCREEN_X, py + menu_text_heigth(obj->fonts));
+			}
+		}
+	}
+	return dirty;
+}
+
+/*Returns 0 if the objects could be redrawn, 1 if everything needs a redraw
+  because there are too many changed areas.
+*/
+static uint8_t menu_redraw_objects(void) {
+	menu_area_t areas[MENU_DIRTY_AREAS_MAX];
+	uint8_t areasnum = 0;
+	menu_area_t area;
+	uint16_t index;
+	for (index = 0; index < menu_objects; index++) {
+		if (menu_object_area(&menu_index[index], &area)) {
+			if (areasnum == MENU_DIRTY_AREAS_MAX) {
+				return 1;
+			}
+			areas[areasnum] = area;
+			areasnum++;
+		}
+	}
+	//merge overlapping areas, otherwise their common part would be drawn twice
+	uint8_t i, j;
+	for (i = 0; i < areasnum; i++) {
+		for (j = i + 1; j < areasnum; j++) {
+			if (menu_area_overlap(&areas[i], &areas[j])) {
+				menu_area_add(&areas[i], areas[j].x1, areas[j].y1, areas[j].x2, areas[j].y2);
+				areasnum--;
+				areas[j] = areas[areasnum];
+				j = i; //the grown area may overlap the already checked ones now
+			}
+		}
+	}
+	//clear each area and draw everything touching it, limited to the area
+	for (i = 0; i < areasnum; i++) {
+		MENU_DEBUGMSG("Redrawing area %i;%i - %i;%i\n", areas[i].x1, areas[i].y1, areas[i].x2, areas[i].y2);
+		menu_clip = areas[i];
+		menu_clip_enabled = 1;
+		menu_draw_box(areas[i].x1, areas[i].y1, areas[i].x2 - areas[i].x1, areas[i].y2 - areas[i].y1, MENU_COLOR_BACKGROUND);
+		for (index = 0; index < menu_objects; index++) {
+			menu_object_area(&menu_index[index], &area);
+			if (menu_area_overlap(&area, &areas[i])) {
+				uint8_t hasfocus = 0;
+				if ((index == menu_focus) && (menu_focus_addr(index))) {
+					hasfocus = 1;
+				}
+				menu_pc_set(menu_index[index].addr + 1);
+				menu_draw_object(menu_index[index].token, hasfocus);
+				MENU_SCHEDULE
+			}
+		}
+		menu_clip_enabled = 0;
+	}
+	return 0;
+}
+
+void menu_redraw_dirty(void) {
+	uint8_t full = 0;
+	if (menu_window_init != menu_window_start) {
+		full = 1; //first drawing or a window switch
+	}
+#ifdef MENU_USE_SUBWINDOW
+	if (menu_subwindow_start) {
+		full = 1; //subwindow objects may be drawn outside of the subwindow
+	}
+#endif
+	if (!full) {
+		full = menu_redraw_objects();
+	}
+	if (full) {
+		menu_redraw();
+	} else {
+		menu_dirty_reset();
+		menu_screen_flush();
+	}
+}
+
 static void menu_run_action(MENUADDR addr) {
 	menu_pc_set(addr);
 	MENU_DEBUGMSG("Reading action from adress %i\n", addr);
@@ -1182,7 +1689,7 @@ static void menu_handle_listbox(MENUADDR addr, uint8_t key) {
 			nvalue -= linesonscreen;
 		}
 		if (ovalue != nvalue) { //a quick pre-checking
-			uint16_t textlines = menu_list_lines(baseaddr, storage);
+			uint16_t textlines = menu_list_lines(baseaddr, storage, listindex);
 			if (nvalue > 32000) //indicates an underflow
 				nvalue = 0;
 			if (nvalue >= textlines) //indicates an overflow
@@ -1204,10 +1711,10 @@ void menu_keypress(uint8_t key) {
 	if (key == 0)
 		return;
 	//look if key is the enter key
-	MENUADDR focusaddr = menu_focus_objects[menu_focus];
+	MENUADDR focusaddr = menu_focus_addr(menu_focus);
 	if (focusaddr) { //if there is at least one object with a focus
 #if defined(MENU_USE_LIST) || defined(MENU_USE_CHECKBOX) || defined(MENU_USE_RADIOBUTTON)
-		uint8_t obj = menu_byte_get(focusaddr);
+		uint8_t obj = menu_index[menu_focus].token;
 #endif
 		//look if this is a listbox
 #ifdef MENU_USE_LIST
@@ -1235,7 +1742,7 @@ void menu_keypress(uint8_t key) {
 			menu_focus--;
 			if (menu_focus >= menu_objects)
 				menu_focus = menu_objects-1;
-			if (menu_focus_objects[menu_focus] != 0) //found one
+			if (menu_focus_addr(menu_focus) != 0) //found one
 				break;
 		}
 		MENU_DEBUGMSG("New focus: %i\n", menu_focus);
@@ -1248,7 +1755,7 @@ void menu_keypress(uint8_t key) {
 			menu_focus++;
 			if (menu_focus >= menu_objects)
 				menu_focus = 0;
-			if (menu_focus_objects[menu_focus] != 0) //found one
+			if (menu_focus_addr(menu_focus) != 0) //found one
 				break;
 		}
 		MENU_DEBUGMSG("New focus: %i\n", menu_focus);
@@ -1256,24 +1763,20 @@ void menu_keypress(uint8_t key) {
 		return;
 	}
 	//look if key is part of a shortcut
-	uint8_t windowtoken = menu_byte_get(menu_window_init);
-	MENUADDR p = menu_window_init+menu_object_datasize(windowtoken)+1;
-	uint8_t token;
-	while (1) {
-		token = menu_byte_get(p);
-		if (token == MENU_SHORTCUT) {
+	uint16_t index;
+	MENUADDR p;
+	for (index = 0; index < menu_objects; index++) {
+		if (menu_index[index].token == MENU_SHORTCUT) {
+			p = menu_index[index].addr;
 			if (key == menu_byte_get(p+1)) {
 				MENU_DEBUGMSG("Found proper shortcut at %i, key: %i\n", p, key);
 				menu_run_action(p+2);
 				return;
-			} //else
-				//printf("Found other shortcut at %i with key %i\n", p, menu_byte_get(p+1));
-		} else if ((token == MENU_WINDOW) || (token == MENU_SUBWINDOW) || (token == MENU_INVALID)) {
-			break;
+			}
 		}
-		p += menu_object_datasize(token)+1;
 	}
   //look if key is part of a global shortcut
+	uint8_t token;
 	p = 1;
 	while (1) {
 		token = menu_byte_get(p);
@@ -1295,47 +1798,16 @@ void menu_keypress(uint8_t key) {
 
 void menu_mouse(SCREENPOS x, SCREENPOS y, uint8_t key) {
 	MENUADDR elemmatch = 0;
-	MENUADDR seekpos = 0;
-	//check if sub window active or not
-	seekpos = menu_window_start;
-#ifdef MENU_USE_SUBWINDOW
-	if (menu_subwindow_start) {
-		seekpos = menu_subwindow_start;
-	}
-#endif
-	//jump over first window definitions
-	seekpos += menu_object_datasize(menu_byte_get(seekpos))+1;
-	//check objects, remember last found object
-	while(1) {
-		uint8_t obj = menu_byte_get(seekpos);
-		if ((obj == MENU_BOX) || (obj == MENU_BUTTON) || (obj == MENU_GFX) ||
-		    (obj == MENU_LIST) || (obj == MENU_CHECKBOX) || (obj == MENU_RADIOBUTTON)) {
-			MENUADDR spos2 = seekpos+1;
-			SCREENPOS px = menu_byte_get(spos2++);
-			SCREENPOS py = menu_byte_get(spos2++);
-#ifdef LARGESCREEN
-			uint8_t lpxy = menu_byte_get(spos2++);
-			px += (SCREENPOS)(lpxy & 0xF0) << 4;
-			py += (SCREENPOS)(lpxy & 0x0F) << 8;
-#endif
-			SCREENPOS sx = menu_byte_get(spos2++);
-			SCREENPOS sy = menu_byte_get(spos2++);
-#ifdef LARGESCREEN
-			uint8_t lsxy = menu_byte_get(spos2++);
-			sx += (SCREENPOS)(lsxy & 0xF0) << 4;
-			sy += (SCREENPOS)(lsxy & 0x0F) << 8;
-#endif
-			uint8_t focusable = menu_byte_get(spos2) & 1;
-			if (focusable) {
-				//compare if position fits
-				if ((x >= px) && (x < (px+sx)) && (y >= py) && (y < (py+sy))) {
-					elemmatch = seekpos;
-				}
+	uint16_t index;
+	//check objects of the active window or subwindow, remember last found object
+	for (index = 0; index < menu_objects; index++) {
+		const menu_object_t * obj = &menu_index[index];
+		if (menu_focus_addr(index)) {
+			//compare if position fits
+			if ((x >= obj->px) && (x < (obj->px + obj->sx)) && (y >= obj->py) && (y < (obj->py + obj->sy))) {
+				elemmatch = obj->addr;
 			}
-		} else if ((obj != MENU_LABEL) && (obj != MENU_SHORTCUT)) {
-				break;
 		}
-		seekpos += menu_object_datasize(obj)+1;
 	}
 	//run action
 	if (elemmatch) {
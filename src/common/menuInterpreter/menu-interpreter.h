@@ -259,6 +259,21 @@ extern void menu_screen_flush(void);
 extern void menu_screen_clear(void);
 extern uint8_t menu_action(MENUACTION action);
 
+#ifdef MENU_SCREEN_BULK
+/*Optional, define MENU_SCREEN_BULK if these are implemented too. They must
+  give the same result as calling menu_screen_set for every pixel, but may
+  be implemented much faster.
+*/
+extern void menu_screen_fill_rect(SCREENPOS x, SCREENPOS y, SCREENPOS sx, SCREENPOS sy, SCREENCOLOR color);
+extern void menu_screen_hline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color);
+extern void menu_screen_vline(SCREENPOS x, SCREENPOS y, SCREENPOS length, SCREENCOLOR color);
+#endif
+
+#ifdef MENU_BYTE_STATS
+//Number of menu_byte_get calls done by the interpreter, for measuring only
+extern uint32_t menu_byte_fetches;
+#endif
+
 //arrys for dynamic data
 extern char * menu_strings[];
 extern uint8_t menu_checkboxstate[];
@@ -354,6 +369,30 @@ extern uint16_t menu_gfxindexstate[];
 void menu_redraw(void);
 void menu_keypress(uint8_t key);
 
+/*Instead of a menu_redraw after changing some dynamic data, the changed
+menu_strings and menu_gfxdata entries can be marked and then menu_redraw_dirty
+only redraws the objects showing them and everything overlapping them.
+If a subwindow is shown or the window has been switched, it does a full redraw.
+Changes of focus, check boxes, radio buttons or list indexes still need menu_redraw.
+menu_screen_clear must use MENU_COLOR_BACKGROUND and menu_screen_flush must
+support being called without a menu_screen_clear before.
+*/
+void menu_text_changed(uint16_t index);
+void menu_gfx_changed(uint16_t index);
+void menu_redraw_dirty(void);
+
+#if defined(MENU_USE_LIST) && defined(MENU_LIST_INDEX)
+/*Optional, define MENU_LIST_INDEX to use it. Without an index, every redraw
+and key press of a list counts all lines of its text and searches the first
+visible line. With an index, offsets gets the text position of every line, so
+only the visible lines are read. With more lines than entries, every n-th line
+is stored and up to n-1 lines are searched. The index is built on the next
+use of the list and again after menu_text_changed() for the text of the list
+or a changed menu_strings pointer. Set offsets to NULL to remove the index.
+*/
+void menu_list_index_set(uint8_t listnumber, uint16_t * offsets, uint16_t entries);
+#endif
+
 #ifdef MENU_MOUSE_SUPPORT
 void menu_mouse(SCREENPOS x, SCREENPOS y, uint8_t key);
 #endif
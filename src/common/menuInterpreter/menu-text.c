@@ -36,6 +36,7 @@ Date of last changes:
 */
 
 #include "menu-interpreter.h"
+#include "menu-text.h"
 
 //the following file might define MENU_USE_UTF8
 #include "menu-interpreter-config.h"
@@ -675,16 +676,55 @@ unsigned char menu_font_heigth(unsigned char font) {
 
 #if !defined(MENU_SCREEN_7SEGMENT) && !defined(MENU_SCREEN_HD44780)
 
-uint8_t menu_char_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font, char c, uint8_t transparency) {
-	uint8_t ix, iy, charwidth, patternbyte, patternbit;
+#if defined(MENU_TEXT_ENABLE_8X15)
+#define MENU_GLYPH_ROWS 15
+#else
+#define MENU_GLYPH_ROWS 8
+#endif
+
+#ifndef MENU_TEXT_SPAN_MIN
+//shorter parts of a row are drawn pixel by pixel, as menu_screen_set is faster then
+#define MENU_TEXT_SPAN_MIN 3
+#endif
+
+/*A character prepared for drawing, independent of the position.
+Bit n of a row is the pixel n columns right of the character start. All
+pixels of the columns 0...columns-1 are drawn, either with the text or the
+background color. Drawing it row by row gives horizontal spans, which
+menu_screen_fill_rect draws faster than setting every single pixel.
+*/
+typedef struct {
+	uint16_t rows[MENU_GLYPH_ROWS];
+	uint8_t columns;
+	uint8_t charwidth;
+} menu_glyph_t;
+
+//returns the rows to draw, underlineoffset is only valid for underlined fonts
+static uint8_t menu_glyph_rows(uint8_t font, uint8_t * underlineoffset) {
+	uint8_t fontheight = menu_font_heigth(font);
+	*underlineoffset = 0;
+	if (MENU_CHECK_FONT_UNDERLINED) { //only valid for font 2, 3, 6, 7
+		if ((font == 6) || (font == 7))
+		{
+			*underlineoffset = fontheight - 2;
+		} else { //font 2 and 3
+			fontheight--; //no underline here
+			*underlineoffset = fontheight;
+		}
+	}
+	return fontheight;
+}
+
+//returns 0 if there is no bitmap for the character
+static uint8_t menu_glyph_build(uint8_t cdraw, uint32_t cdrawx, uint8_t font, menu_glyph_t * glyph) {
+	uint8_t ix, iy, charwidth;
+	uint16_t pattern;
 #if defined(MENU_TEXT_ENABLE_8X15)
 	uint8_t copyedbytes[MENU_TEXT_8X15_BYTES];
 #else
 	uint8_t copyedbytes[MENU_TEXT_5X7_BYTES];
 #endif
-	SCREENPOS tempx, tempy;
 	uint8_t byte_eq_count, nun;
-	uint8_t cdraw = (uint8_t)c;
 	/* level of char shrinking:
 	0: Fixed with
 	1: Width defined by character within array, only empty colums are removed.
@@ -693,60 +733,7 @@ uint8_t menu_char_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font, char c, uin
 	*/
 	uint8_t shrink = 0;
 	uint8_t fontheight;
-	uint8_t underlineoffset = 0;
-//------------------- UTF-8 decoding ----------------------
-#if defined(MENU_USE_UTF8)
-	uint32_t cdrawx;
-	//catch utf8 chars
-#ifndef MENU_ENABLE_SPECIAL_CHARS
-	if (cdraw >= (MENU_CHARACTERS + MENU_CHARACTER_TABLE_OFFSET)) { //its something for utf-8
-		if (!g_menu_utf8_state)  {
-			//a new char begins
-			g_menu_utf8_char = cdraw;
-			if ((cdraw & 0xE0) == 0xC0) {
-				g_menu_utf8_state = 1;
-			}
-			if ((cdraw & 0xF0) == 0xE0) {
-				g_menu_utf8_state = 2;
-			}
-			if ((cdraw & 0xF8) == 0xF0) {
-				g_menu_utf8_state = 3;
-			}
-			return -1; //symbol not complete, 255 = -1 do not go one pixel to the right
-		} else {
-			g_menu_utf8_char <<= 8;
-			g_menu_utf8_char |= cdraw;
-			g_menu_utf8_state--;
-			if (g_menu_utf8_state) {
-				return 0; //symbol not complete
-			}
-			cdrawx = g_menu_utf8_char; //symbol complete
-		}
-	} else {
-		g_menu_utf8_state = 0; //reset state
-		cdrawx = cdraw;
-	}
-#else
-	//for backward compatibility only
-	cdrawx = cdraw;
-	if (cdraw == 196) cdrawx = 0xC384; //Ä
-	if (cdraw == 214) cdrawx = 0xC396; //Ö
-	if (cdraw == 220) cdrawx = 0xC39C; //Ü
-	if (cdraw == 228) cdrawx = 0xC3A4; //ä
-	if (cdraw == 246) cdrawx = 0xC3B6; //ö
-	if (cdraw == 252) cdrawx = 0xC3BC; //ü
-	if (cdraw == 223) cdrawx = 0xC39F; //ß
-	if (cdraw == 0xB0) cdrawx = 0xC2B0; //°
-#endif
-#else
-	uint8_t cdrawx = cdraw;
-#endif
-//--------------- special handling... ------------------------------------------
-	if (MENU_CHECK_FONT_5X5) {
-		if (cdraw == 9) { //its a tab, make same width as digits -> easy blinking (safe to use cdraw instead of cdrawx here)
-			return 3;
-		}
-	}
+	uint8_t underlineoffset;
 //--------------- determine data source ----------------------------------------
 	const uint8_t * bmpsource = NULL;
 	uint8_t bmpsize = 0;
@@ -842,42 +829,25 @@ uint8_t menu_char_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font, char c, uin
 			}
 		} //end of loop
 	} //end if shrink != 0
-	fontheight = menu_font_heigth(font);
-	if (MENU_CHECK_FONT_UNDERLINED) { //only valid for font 2, 3, 6, 7
-		if ((font == 6) || (font == 7))
-		{
-			underlineoffset = fontheight - 2;
-		} else { //font 2 and 3
-			fontheight--; //no underline here
-			underlineoffset = fontheight;
-		}
+	fontheight = menu_glyph_rows(font, &underlineoffset);
+//------------------- place the columns ----------------------------------------
+	glyph->columns = 0;
+	for (iy = 0; iy < fontheight; iy++) {
+		glyph->rows[iy] = 0;
 	}
-//------------------- actually draw --------------------------------------------
 	for (ix = 0; ix < bmpwidth; ix++) {
-		tempx = posx+charwidth;
-		if (tempx < posx+charwidth) {
-			break; //prevent overflow to the left side of the screen
+		pattern = copyedbytes[ix];
+		if (MENU_CHECK_FONT_8X15) {
+			pattern |= (uint16_t)copyedbytes[ix + bmpwidth] << 8;
 		}
-		patternbyte = copyedbytes[ix];
-		patternbit = 1;
-		for (iy = 0; iy < fontheight; iy++) {
-			if (MENU_CHECK_FONT_8X15) {
-				if (!patternbit) {
-					patternbit = 1;
-					patternbyte = copyedbytes[ix + bmpwidth];
-				}
-			}
-			tempy = posy+iy;
-			if ((patternbyte & patternbit) != 0) {
-				menu_screen_set(tempx, tempy, MENU_COLOR_TEXT);
-			} else if (transparency == 0) {
-				menu_screen_set(tempx, tempy, MENU_COLOR_BACKGROUND);
+		for (iy = 0; (iy < fontheight) && (pattern); iy++) {
+			if (pattern & 1) {
+				glyph->rows[iy] |= (uint16_t)1 << charwidth;
 			}
-			patternbit <<= 1;
-		}       //end: inner loop
-		if (MENU_CHECK_FONT_UNDERLINED) { //only valid for font 2, 3, 6, 7
-			menu_screen_set(tempx, posy + underlineoffset, MENU_COLOR_TEXT);//underline fonts
+			pattern >>= 1;
 		}
+		//an empty column not increasing charwidth is only visible as background
+		glyph->columns = charwidth + 1;
 		if ((copyedbytes[ix] != 0) || (shrink == 0) ||
 				((MENU_CHECK_FONT_8X15) && (copyedbytes[ix + MENU_TEXT_8X15_WIDTH] != 0)) ||
 				((MENU_CHECK_FONT_8X15) && (cdrawx == ' ') && (charwidth < 2))) {
@@ -889,10 +859,156 @@ uint8_t menu_char_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font, char c, uin
 		charwidth = 3;
 	}
 #endif
+	glyph->charwidth = charwidth;
+	return 1;
+}
+
+//returns the width of the character
+static uint8_t menu_glyph_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font,
+                               const menu_glyph_t * glyph, uint8_t transparency) {
+	uint8_t ix, iy, start, set;
+	uint16_t bits;
+	uint8_t underlineoffset;
+	uint8_t fontheight = menu_glyph_rows(font, &underlineoffset);
+	uint8_t columns = glyph->columns;
+	uint8_t charwidth = glyph->charwidth;
+	while ((columns) && ((SCREENPOS)(posx + columns - 1) < posx)) {
+		columns--; //prevent overflow to the left side of the screen
+		charwidth = columns;
+	}
+#ifdef MENU_SCREEN_BULK
+	if (transparency == 0) {
+		//one rectangle for the background, the text is drawn on top
+		menu_draw_box(posx, posy, columns, fontheight, MENU_COLOR_BACKGROUND);
+		transparency = 1;
+	}
+#endif
+	for (iy = 0; iy < fontheight; iy++) {
+		if ((MENU_CHECK_FONT_UNDERLINED) && (iy == underlineoffset)) {
+			continue; //the underline covers the row
+		}
+		bits = glyph->rows[iy];
+		ix = 0;
+		while ((ix < columns) && ((bits) || (transparency == 0))) {
+			set = bits & 1;
+			start = ix;
+			do {
+				bits >>= 1;
+				ix++;
+			} while ((ix < columns) && ((bits & 1) == set));
+			if (set) {
+				if ((ix - start) >= MENU_TEXT_SPAN_MIN) {
+					menu_draw_box(posx + start, posy + iy, ix - start, 1, MENU_COLOR_TEXT);
+					start = ix;
+				}
+				for (; start < ix; start++) {
+					menu_screen_set_clipped(posx + start, posy + iy, MENU_COLOR_TEXT);
+				}
+			} else if (transparency == 0) {
+				for (; start < ix; start++) {
+					menu_screen_set_clipped(posx + start, posy + iy, MENU_COLOR_BACKGROUND);
+				}
+			}
+		}
+	}
 	if (MENU_CHECK_FONT_UNDERLINED) { //only valid for font 2, 3, 6, 7
-		menu_screen_set(posx + charwidth, posy + underlineoffset, MENU_COLOR_TEXT); //underline empty part between chars (this is not perfect on word ending)
+		//includes the empty part between chars (this is not perfect on word ending)
+		menu_draw_box(posx, posy + underlineoffset, charwidth + 1, 1, MENU_COLOR_TEXT);
 	}
-	return charwidth++;
+	return charwidth;
+}
+
+#ifdef MENU_TEXT_GLYPH_CACHE
+
+/*Optional cache of prepared characters. Define MENU_TEXT_GLYPH_CACHE as the
+number of entries, each needs about 40 byte RAM. Saves copying the bitmap and
+shrinking the character every time it is drawn.
+*/
+typedef struct {
+	uint32_t code;
+	uint8_t font;
+	uint8_t valid;
+	menu_glyph_t glyph;
+} menu_glyph_cache_t;
+
+static menu_glyph_cache_t g_menu_glyph_cache[MENU_TEXT_GLYPH_CACHE];
+
+#endif
+
+uint8_t menu_char_draw(SCREENPOS posx, SCREENPOS posy, uint8_t font, char c, uint8_t transparency) {
+	uint8_t cdraw = (uint8_t)c;
+//------------------- UTF-8 decoding ----------------------
+#if defined(MENU_USE_UTF8)
+	uint32_t cdrawx;
+	//catch utf8 chars
+#ifndef MENU_ENABLE_SPECIAL_CHARS
+	if (cdraw >= (MENU_CHARACTERS + MENU_CHARACTER_TABLE_OFFSET)) { //its something for utf-8
+		if (!g_menu_utf8_state)  {
+			//a new char begins
+			g_menu_utf8_char = cdraw;
+			if ((cdraw & 0xE0) == 0xC0) {
+				g_menu_utf8_state = 1;
+			}
+			if ((cdraw & 0xF0) == 0xE0) {
+				g_menu_utf8_state = 2;
+			}
+			if ((cdraw & 0xF8) == 0xF0) {
+				g_menu_utf8_state = 3;
+			}
+			return -1; //symbol not complete, 255 = -1 do not go one pixel to the right
+		} else {
+			g_menu_utf8_char <<= 8;
+			g_menu_utf8_char |= cdraw;
+			g_menu_utf8_state--;
+			if (g_menu_utf8_state) {
+				return 0; //symbol not complete
+			}
+			cdrawx = g_menu_utf8_char; //symbol complete
+		}
+	} else {
+		g_menu_utf8_state = 0; //reset state
+		cdrawx = cdraw;
+	}
+#else
+	//for backward compatibility only
+	cdrawx = cdraw;
+	if (cdraw == 196) cdrawx = 0xC384; //Ä
+	if (cdraw == 214) cdrawx = 0xC396; //Ö
+	if (cdraw == 220) cdrawx = 0xC39C; //Ü
+	if (cdraw == 228) cdrawx = 0xC3A4; //ä
+	if (cdraw == 246) cdrawx = 0xC3B6; //ö
+	if (cdraw == 252) cdrawx = 0xC3BC; //ü
+	if (cdraw == 223) cdrawx = 0xC39F; //ß
+	if (cdraw == 0xB0) cdrawx = 0xC2B0; //°
+#endif
+#else
+	uint8_t cdrawx = cdraw;
+#endif
+//--------------- special handling... ------------------------------------------
+	if (MENU_CHECK_FONT_5X5) {
+		if (cdraw == 9) { //its a tab, make same width as digits -> easy blinking (safe to use cdraw instead of cdrawx here)
+			return 3;
+		}
+	}
+	menu_glyph_t glyph;
+#ifdef MENU_TEXT_GLYPH_CACHE
+	menu_glyph_cache_t * entry = &g_menu_glyph_cache[(cdrawx + font * 97) % MENU_TEXT_GLYPH_CACHE];
+	if ((entry->valid == 0) || (entry->code != cdrawx) || (entry->font != font)) {
+		if (!menu_glyph_build(cdraw, cdrawx, font, &glyph)) {
+			return 0;
+		}
+		entry->glyph = glyph;
+		entry->code = cdrawx;
+		entry->font = font;
+		entry->valid = 1;
+	}
+	return menu_glyph_draw(posx, posy, font, &(entry->glyph), transparency);
+#else
+	if (!menu_glyph_build(cdraw, cdrawx, font, &glyph)) {
+		return 0;
+	}
+	return menu_glyph_draw(posx, posy, font, &glyph, transparency);
+#endif
 }          //end: function
 
 #endif
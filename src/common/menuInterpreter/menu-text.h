@@ -29,4 +29,15 @@ Returns the height of the selected font in pixel
 */
 uint8_t menu_font_heigth(uint8_t font);
 
+/*
+menu_screen_set, but does nothing outside of the area redrawn by menu_redraw_dirty
+*/
+void menu_screen_set_clipped(SCREENPOS x, SCREENPOS y, SCREENCOLOR color);
+
+/*
+Filled rectangle, uses menu_screen_fill_rect if available and clips like
+menu_screen_set_clipped
+*/
+void menu_draw_box(SCREENPOS px, SCREENPOS py, SCREENPOS sx, SCREENPOS sy, SCREENCOLOR color);
+
 #endif